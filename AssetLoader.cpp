@@ -0,0 +1,778 @@
+#include "AssetLoader.h"
+#include "Graphics.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+
+// WIC is used directly (rather than through WICTextureLoader) so
+// decoding never touches the device or context
+#pragma comment(lib, "windowscodecs.lib")
+#include <wincodec.h>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Decoded image, always tightly packed 8 bit RGBA
+	struct Image
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<unsigned char> pixels;
+	};
+
+	// Converts any image WIC can read to 8 bit RGBA
+	bool DecodeImage(IWICImagingFactory* factory, const std::wstring& path, Image& image)
+	{
+		if (!factory)
+			return false;
+
+		Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+		if (FAILED(factory->CreateDecoderFromFilename(path.c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf())))
+			return false;
+
+		Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+		if (FAILED(decoder->GetFrame(0, frame.GetAddressOf())) ||
+			FAILED(frame->GetSize(&image.width, &image.height)))
+			return false;
+
+		Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+		if (FAILED(factory->CreateFormatConverter(converter.GetAddressOf())) ||
+			FAILED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0.0, WICBitmapPaletteTypeCustom)))
+			return false;
+
+		image.pixels.resize((size_t)image.width * image.height * 4);
+		return SUCCEEDED(converter->CopyPixels(0, image.width * 4, (UINT)image.pixels.size(), image.pixels.data()));
+	}
+
+	// --------------------------------------------------------
+	// Creates a texture with a full mip chain, generated on the GPU
+	// - The shaders do their own gamma correction, so this is always
+	//   UNORM (never _SRGB) regardless of any sRGB chunk in the file
+	// --------------------------------------------------------
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateTexture(const Image& image)
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = image.width;
+		desc.Height = image.height;
+		desc.MipLevels = 0; // Full chain
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET; // GenerateMips() renders into the mips
+		desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		if (FAILED(Graphics::Device->CreateTexture2D(&desc, 0, texture.GetAddressOf())))
+			return nullptr;
+
+		Graphics::Context->UpdateSubresource(texture.Get(), 0, 0, image.pixels.data(), image.width * 4, 0);
+
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		Graphics::Device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+		Graphics::Context->GenerateMips(srv.Get());
+		return srv;
+	}
+
+	// --------------------------------------------------------
+	// Same cube map Sky::CreateCubemap() makes, but created in one
+	// call with the already decoded faces as its initial data
+	// --------------------------------------------------------
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(const std::array<Image, 6>& faces)
+	{
+		// Every face must be the same size
+		for (const Image& face : faces)
+		{
+			if (face.width != faces[0].width || face.height != faces[0].height)
+				return nullptr;
+		}
+
+		D3D11_TEXTURE2D_DESC cubeDesc = {};
+		cubeDesc.ArraySize = 6;
+		cubeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		cubeDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		cubeDesc.Width = faces[0].width;
+		cubeDesc.Height = faces[0].height;
+		cubeDesc.MipLevels = 1;
+		cubeDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+		cubeDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		cubeDesc.SampleDesc.Count = 1;
+
+		D3D11_SUBRESOURCE_DATA initialData[6] = {};
+		for (int face = 0; face < 6; face++)
+		{
+			initialData[face].pSysMem = faces[face].pixels.data();
+			initialData[face].SysMemPitch = faces[face].width * 4;
+		}
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> cubeMapTexture;
+		if (FAILED(Graphics::Device->CreateTexture2D(&cubeDesc, initialData, cubeMapTexture.GetAddressOf())))
+			return nullptr;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = cubeDesc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MipLevels = 1;
+		srvDesc.TextureCube.MostDetailedMip = 0;
+
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeSRV;
+		Graphics::Device->CreateShaderResourceView(cubeMapTexture.Get(), &srvDesc, cubeSRV.GetAddressOf());
+		return cubeSRV;
+	}
+
+	std::string FileName(const std::wstring& path)
+	{
+		return std::filesystem::path(path).filename().string();
+	}
+
+	// Rough cost of a job, so the biggest ones start first
+	uintmax_t FileSize(const std::wstring& path)
+	{
+		std::error_code error;
+		uintmax_t size = std::filesystem::file_size(path, error);
+		return error ? 0 : size;
+	}
+
+	// Cache keys for single textures and meshes.  Until it loads
+	// (or if it fails) a handle shows its placeholder - null when
+	// queued, a stand-in when streamed - so requests that would
+	// show different things each get their own handle.
+	std::wstring TextureKey(const std::wstring& path, const wchar_t* placeholder)
+	{
+		return std::wstring(L"texture|") + placeholder + L"|" + path;
+	}
+
+	std::wstring TextureKey(const std::wstring& path, TexturePlaceholder placeholder)
+	{
+		const wchar_t* names[] = { L"white", L"black", L"flat normal" };
+		return TextureKey(path, names[(int)placeholder]);
+	}
+
+	std::wstring MeshKey(const std::wstring& objFile, const std::wstring& cookedFile, const wchar_t* placeholder)
+	{
+		return std::wstring(L"mesh|") + placeholder + L"|" + objFile + L"|" + cookedFile;
+	}
+
+	// WIC needs COM on every thread that uses it.  The calling thread
+	// may already have it in another mode, which is fine.
+	struct ComScope
+	{
+		HRESULT result;
+		Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+
+		ComScope()
+		{
+			result = CoInitializeEx(0, COINIT_MULTITHREADED);
+			CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()));
+		}
+
+		~ComScope()
+		{
+			factory.Reset();
+			if (SUCCEEDED(result))
+				CoUninitialize();
+		}
+	};
+}
+
+AssetLoader::AssetLoader()
+{
+	startTime = std::chrono::high_resolution_clock::now();
+}
+
+AssetLoader::~AssetLoader()
+{
+	// Workers finish the job they're on, the rest are dropped
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		stopping = true;
+	}
+	streamWake.notify_all();
+
+	for (std::thread& thread : streamThreads)
+		thread.join();
+}
+
+double AssetLoader::Elapsed()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+// --------------------------------------------------------
+// Wraps a job so it drives the handle through its states
+// --------------------------------------------------------
+template<typename T>
+void AssetLoader::Track(Job& job, std::shared_ptr<AsyncAsset<T>> handle)
+{
+	std::function<bool(IWICImagingFactory*)> work = job.work;
+	job.work = [work, handle](IWICImagingFactory* factory)
+		{
+			handle->BeginLoading();
+			bool loaded = work(factory);
+			if (loaded) handle->FinishLoading();
+			return loaded;
+		};
+
+	std::function<void(bool)> create = job.create;
+	job.create = [create, handle](bool loaded)
+		{
+			if (!loaded) handle->Fail();
+			create(loaded);
+		};
+}
+
+AssetLoader::Job AssetLoader::MakeTextureJob(const std::wstring& path, std::shared_ptr<AsyncTexture> handle)
+{
+	std::shared_ptr<Image> image = std::make_shared<Image>();
+
+	Job job;
+	job.label = FileName(path);
+	job.cost = FileSize(path);
+	job.work = [path, image](IWICImagingFactory* factory)
+		{
+			return DecodeImage(factory, path, *image);
+		};
+	job.create = [image, handle](bool decoded)
+		{
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv = decoded ? CreateTexture(*image) : nullptr;
+			if (srv) handle->Publish(srv);
+			else handle->Fail();
+			*image = Image(); // Pixels aren't needed anymore
+		};
+	Track(job, handle);
+	return job;
+}
+
+AssetLoader::Job AssetLoader::MakeMeshJob(const char* name, const std::wstring& objFile, const std::wstring& cookedFile, std::shared_ptr<AsyncMesh> handle)
+{
+	struct Geometry
+	{
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		MeshBounds bounds;
+	};
+	std::shared_ptr<Geometry> geometry = std::make_shared<Geometry>();
+
+	Job job;
+	job.label = name;
+	job.cost = FileSize(objFile);
+	job.work = [name, objFile, cookedFile, geometry](IWICImagingFactory*)
+		{
+			Mesh::LoadGeometry(name, objFile, cookedFile, geometry->verts, geometry->indices, geometry->bounds);
+			return !geometry->indices.empty();
+		};
+	job.create = [name, geometry, handle](bool loaded)
+		{
+			if (loaded) handle->Publish(std::make_shared<Mesh>(name, geometry->verts, geometry->indices, geometry->bounds));
+			*geometry = Geometry();
+		};
+	Track(job, handle);
+	return job;
+}
+
+// --------------------------------------------------------
+// Cache lookups.  Keys are the kind of asset, its placeholder and
+// every file it's loaded from, so a repeat request gets the exact
+// same handle - whether it's loaded, still loading or failed.
+// --------------------------------------------------------
+template<typename T>
+std::shared_ptr<AsyncAsset<T>> AssetLoader::FindCached(std::unordered_map<std::wstring, std::shared_ptr<AsyncAsset<T>>>& cache, const std::wstring& key)
+{
+	auto found = cache.find(key);
+	if (found == cache.end())
+	{
+		cacheMisses++;
+		return nullptr;
+	}
+
+	cacheHits++;
+	return found->second;
+}
+
+std::shared_ptr<AsyncTexture> AssetLoader::QueueTexture(const std::wstring& path)
+{
+	std::wstring key = TextureKey(path, L"none");
+	std::shared_ptr<AsyncTexture> handle = FindCached(textureCache, key);
+	if (handle)
+		return handle;
+
+	handle = std::make_shared<AsyncTexture>(nullptr);
+	textureCache[key] = handle;
+	jobs.push_back(MakeTextureJob(path, handle));
+	return handle;
+}
+
+std::shared_ptr<AsyncTexture> AssetLoader::QueueCubemap(
+	const std::wstring& right,
+	const std::wstring& left,
+	const std::wstring& up,
+	const std::wstring& down,
+	const std::wstring& front,
+	const std::wstring& back)
+{
+	std::wstring key = L"cubemap|" + right + L"|" + left + L"|" + up + L"|" + down + L"|" + front + L"|" + back;
+	std::shared_ptr<AsyncTexture> handle = FindCached(textureCache, key);
+	if (handle)
+		return handle;
+
+	handle = std::make_shared<AsyncTexture>(nullptr);
+	textureCache[key] = handle;
+
+	// Each face decodes as its own job, and the last one to be
+	// created makes the cube map
+	std::shared_ptr<std::array<Image, 6>> faces = std::make_shared<std::array<Image, 6>>();
+	std::shared_ptr<int> remaining = std::make_shared<int>(6);
+	std::shared_ptr<bool> allDecoded = std::make_shared<bool>(true);
+
+	const std::wstring* paths[6] = { &right, &left, &up, &down, &front, &back };
+	for (int face = 0; face < 6; face++)
+	{
+		std::wstring path = *paths[face];
+
+		Job job;
+		job.label = FileName(path);
+		job.cost = FileSize(path);
+		job.work = [path, faces, face, handle](IWICImagingFactory* factory)
+			{
+				handle->BeginLoading(); // Only the first face actually changes it
+				return DecodeImage(factory, path, (*faces)[face]);
+			};
+		job.create = [faces, remaining, allDecoded, handle](bool decoded)
+			{
+				if (!decoded) *allDecoded = false;
+				if (--*remaining > 0)
+					return;
+
+				Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv = *allDecoded ? CreateCubemap(*faces) : nullptr;
+				if (srv && handle->FinishLoading()) handle->Publish(srv);
+				else handle->Fail();
+				*faces = std::array<Image, 6>();
+			};
+		jobs.push_back(job);
+	}
+	return handle;
+}
+
+std::shared_ptr<AsyncMesh> AssetLoader::QueueMesh(const char* name, const std::wstring& objFile, const std::wstring& cookedFile)
+{
+	std::wstring key = MeshKey(objFile, cookedFile, L"none");
+	std::shared_ptr<AsyncMesh> handle = FindCached(meshCache, key);
+	if (handle)
+		return handle;
+
+	handle = std::make_shared<AsyncMesh>(nullptr);
+	meshCache[key] = handle;
+	jobs.push_back(MakeMeshJob(name, objFile, cookedFile, handle));
+	return handle;
+}
+
+// Runs the worker half of a job, timing it
+void AssetLoader::RunJob(Job& job, const std::string& thread, IWICImagingFactory* factory)
+{
+	job.thread = thread;
+	job.start = Elapsed();
+	try
+	{
+		job.succeeded = job.work(factory);
+	}
+	catch (...)
+	{
+		job.succeeded = false;
+		job.error = std::current_exception();
+	}
+	job.end = Elapsed();
+}
+
+// Runs the owning thread half of a job, and records both halves
+void AssetLoader::RunCreate(Job& job)
+{
+	if (!job.succeeded)
+		printf("Failed to load %s\n", job.label.c_str());
+
+	double createStart = Elapsed();
+	job.create(job.succeeded);
+
+	timeline.push_back({ job.label, "load", job.thread, job.start, job.end });
+	timeline.push_back({ job.label, "create", "main", createStart, Elapsed() });
+}
+
+// --------------------------------------------------------
+// Runs every queued job on a pool of threads (the calling
+// thread included), then creates the D3D resources for their
+// results here on the calling thread.
+//
+// Anything a job throws (such as a missing .obj) is rethrown
+// here once the other jobs have finished.
+// --------------------------------------------------------
+void AssetLoader::Load()
+{
+	// Largest files first, so the slowest job isn't the last to start
+	std::stable_sort(jobs.begin(), jobs.end(),
+		[](const Job& a, const Job& b) { return a.cost > b.cost; });
+
+	std::atomic<size_t> nextJob = 0;
+	auto worker = [&](int index)
+		{
+			ComScope com;
+			std::string thread = index == 0 ? "main" : "load " + std::to_string(index);
+			for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+				RunJob(jobs[j], thread, com.factory.Get());
+		};
+
+	int threadCount = (int)std::min<size_t>(std::max<size_t>(jobs.size(), 1), std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::thread> threads;
+	for (int t = 1; t < threadCount; t++)
+		threads.emplace_back(worker, t);
+	worker(0);
+	for (std::thread& thread : threads)
+		thread.join();
+
+	std::vector<Job> finished;
+	finished.swap(jobs);
+	for (Job& job : finished)
+	{
+		if (job.error)
+			std::rethrow_exception(job.error);
+	}
+
+	// Device resources, on this thread only
+	for (Job& job : finished)
+		RunCreate(job);
+}
+
+// --------------------------------------------------------
+// Hands a job to the streaming threads, starting them if needed.
+// Streaming threads leave a core free for the main thread.
+// --------------------------------------------------------
+void AssetLoader::Stream(Job job)
+{
+	if (streamThreads.empty())
+	{
+		int threadCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		for (int t = 0; t < threadCount; t++)
+			streamThreads.emplace_back(&AssetLoader::StreamWorker, this, t + 1);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		streamQueue.push_back(std::move(job));
+	}
+	streamsPending++;
+	streamWake.notify_one();
+}
+
+void AssetLoader::StreamWorker(int index)
+{
+	ComScope com;
+	std::string thread = "stream " + std::to_string(index);
+
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(streamMutex);
+			streamWake.wait(lock, [&]() { return stopping || !streamQueue.empty(); });
+			if (stopping)
+				return;
+
+			job = std::move(streamQueue.front());
+			streamQueue.pop_front();
+		}
+
+		RunJob(job, thread, com.factory.Get());
+		if (job.error)
+		{
+			try { std::rethrow_exception(job.error); }
+			catch (const std::exception& e) { printf("Error streaming %s: %s\n", job.label.c_str(), e.what()); }
+			catch (...) {}
+		}
+
+		std::lock_guard<std::mutex> lock(streamMutex);
+		createQueue.push_back(std::move(job));
+	}
+}
+
+std::shared_ptr<AsyncTexture> AssetLoader::StreamTexture(const std::wstring& path, TexturePlaceholder placeholder)
+{
+	std::wstring key = TextureKey(path, placeholder);
+	std::shared_ptr<AsyncTexture> handle = FindCached(textureCache, key);
+	if (handle)
+		return handle;
+
+	handle = std::make_shared<AsyncTexture>(GetPlaceholder(placeholder));
+	textureCache[key] = handle;
+	Stream(MakeTextureJob(path, handle));
+	return handle;
+}
+
+std::shared_ptr<AsyncMesh> AssetLoader::StreamMesh(const char* name, const std::wstring& objFile, const std::wstring& cookedFile)
+{
+	std::wstring key = MeshKey(objFile, cookedFile, L"unit cube");
+	std::shared_ptr<AsyncMesh> handle = FindCached(meshCache, key);
+	if (handle)
+		return handle;
+
+	handle = std::make_shared<AsyncMesh>(GetPlaceholderMesh());
+	meshCache[key] = handle;
+	Stream(MakeMeshJob(name, objFile, cookedFile, handle));
+	return handle;
+}
+
+void AssetLoader::Update(int maxCreates)
+{
+	std::vector<Job> ready;
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		while (!createQueue.empty() && (int)ready.size() < maxCreates)
+		{
+			ready.push_back(std::move(createQueue.front()));
+			createQueue.pop_front();
+		}
+	}
+
+	for (Job& job : ready)
+	{
+		RunCreate(job);
+		streamsPending--;
+	}
+
+	if (!ready.empty() && streamsPending == 0)
+	{
+		AssetCacheStats stats = GetCacheStats();
+		printf("Finished streaming assets (%d cached, %d hits, %d misses)\n", stats.Entries, stats.Hits, stats.Misses);
+		PrintTimeline();
+	}
+}
+
+bool AssetLoader::IsStreaming()
+{
+	return streamsPending > 0;
+}
+
+// --------------------------------------------------------
+// A handle only the cache refers to is unused - jobs that are
+// still loading hold their own references, so in-flight
+// handles are never evicted
+// --------------------------------------------------------
+template<typename T>
+int AssetLoader::Evict(std::unordered_map<std::wstring, std::shared_ptr<AsyncAsset<T>>>& cache)
+{
+	int evicted = 0;
+	for (auto entry = cache.begin(); entry != cache.end();)
+	{
+		if (entry->second.use_count() == 1)
+		{
+			entry = cache.erase(entry);
+			evicted++;
+		}
+		else
+		{
+			++entry;
+		}
+	}
+	return evicted;
+}
+
+int AssetLoader::EvictUnused()
+{
+	int evicted = Evict(textureCache) + Evict(meshCache);
+	cacheEvictions += evicted;
+	return evicted;
+}
+
+AssetCacheStats AssetLoader::GetCacheStats()
+{
+	AssetCacheStats stats = {};
+	stats.Hits = cacheHits;
+	stats.Misses = cacheMisses;
+	stats.Evictions = cacheEvictions;
+	stats.Entries = (int)(textureCache.size() + meshCache.size());
+	return stats;
+}
+
+// --------------------------------------------------------
+// 1x1 stand-ins for textures that haven't loaded yet
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> AssetLoader::GetPlaceholder(TexturePlaceholder placeholder)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv = placeholderTextures[(int)placeholder];
+	if (srv)
+		return srv;
+
+	unsigned char color[4] = { 255, 255, 255, 255 };
+	if (placeholder == TexturePlaceholder::Black) { color[0] = color[1] = color[2] = 0; }
+	if (placeholder == TexturePlaceholder::FlatNormal) { color[0] = color[1] = 128; } // (0, 0, 1) once unpacked
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = 1;
+	desc.Height = 1;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = color;
+	initialData.SysMemPitch = sizeof(color);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	Graphics::Device->CreateTexture2D(&desc, &initialData, texture.GetAddressOf());
+	Graphics::Device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+	return srv;
+}
+
+// --------------------------------------------------------
+// Unit cube stand-in for meshes that haven't loaded yet, built
+// in code so it never waits on a file itself
+// --------------------------------------------------------
+std::shared_ptr<Mesh> AssetLoader::GetPlaceholderMesh()
+{
+	if (placeholderMesh)
+		return placeholderMesh;
+
+	// Each face: its normal and the direction that's "up" on it
+	const XMFLOAT3 faces[6][2] = {
+		{ XMFLOAT3(+1, 0, 0), XMFLOAT3(0, 1, 0) },
+		{ XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 1, 0) },
+		{ XMFLOAT3(0, +1, 0), XMFLOAT3(0, 0, 1) },
+		{ XMFLOAT3(0, -1, 0), XMFLOAT3(0, 0, 1) },
+		{ XMFLOAT3(0, 0, +1), XMFLOAT3(0, 1, 0) },
+		{ XMFLOAT3(0, 0, -1), XMFLOAT3(0, 1, 0) } };
+
+	Vertex verts[24] = {};
+	unsigned int indices[36] = {};
+	for (int f = 0; f < 6; f++)
+	{
+		XMVECTOR normal = XMLoadFloat3(&faces[f][0]);
+		XMVECTOR up = XMLoadFloat3(&faces[f][1]);
+		XMVECTOR right = XMVector3Cross(normal, up); // Right, as seen from outside
+
+		// Top left, top right, bottom right, bottom left (clockwise)
+		const float corners[4][2] = { { -1, 1 }, { 1, 1 }, { 1, -1 }, { -1, -1 } };
+		for (int c = 0; c < 4; c++)
+		{
+			Vertex& v = verts[f * 4 + c];
+			XMVECTOR position = XMVectorScale(
+				XMVectorAdd(normal, XMVectorAdd(XMVectorScale(right, corners[c][0]), XMVectorScale(up, corners[c][1]))),
+				0.5f);
+			XMStoreFloat3(&v.Position, position);
+			XMStoreFloat3(&v.Normal, normal);
+			v.UV = XMFLOAT2((corners[c][0] + 1) * 0.5f, (1 - corners[c][1]) * 0.5f);
+		}
+
+		const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; i++)
+			indices[f * 6 + i] = f * 4 + quad[i];
+	}
+
+	placeholderMesh = std::make_shared<Mesh>("Unit Cube", verts, 24, indices, 36);
+	return placeholderMesh;
+}
+
+void AssetLoader::PrintTimeline()
+{
+	std::vector<TimelineEntry> sorted = timeline;
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[](const TimelineEntry& a, const TimelineEntry& b) { return a.start < b.start; });
+
+	double loadTotal = 0;
+	double end = 0;
+	const TimelineEntry* slowest = 0;
+	for (const TimelineEntry& entry : sorted)
+	{
+		end = std::max(end, entry.end);
+		if (strcmp(entry.stage, "load") != 0)
+			continue;
+
+		loadTotal += entry.end - entry.start;
+		if (!slowest || entry.end - entry.start > slowest->end - slowest->start)
+			slowest = &entry;
+	}
+
+	printf("Asset timeline (%d assets, done at %.2f ms):\n", (int)sorted.size() / 2, end);
+	printf("  %-9s  %8s  %8s  %-6s  %s\n", "thread", "start ms", "end ms", "stage", "asset");
+	for (const TimelineEntry& entry : sorted)
+		printf("  %-9s  %8.2f  %8.2f  %-6s  %s\n", entry.thread.c_str(), entry.start, entry.end, entry.stage, entry.label.c_str());
+
+	if (slowest)
+	{
+		printf("Loading: %.2f ms summed, slowest %s at %.2f ms\n",
+			loadTotal, slowest->label.c_str(), slowest->end - slowest->start);
+	}
+	printf("\n");
+}
+
+// --------------------------------------------------------
+// Runs a loader of its own on files that don't exist, which
+// fail quickly but are cached all the same.  Needs the device,
+// for the placeholders.
+// --------------------------------------------------------
+bool AssetLoader::CacheTest()
+{
+	const std::wstring path = L"cache_test_missing.png";
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+	auto stats = [](AssetLoader& loader, int hits, int misses, int evictions, int entries) {
+		AssetCacheStats s = loader.GetCacheStats();
+		return s.Hits == hits && s.Misses == misses && s.Evictions == evictions && s.Entries == entries;
+	};
+
+	AssetLoader loader;
+	{
+		// Same file and placeholder is a hit, anything else a miss
+		std::shared_ptr<AsyncTexture> white = loader.StreamTexture(path, TexturePlaceholder::White);
+		check(stats(loader, 0, 1, 0, 1), "first request is a miss");
+		check(loader.StreamTexture(path, TexturePlaceholder::White) == white, "repeat request gets the same handle");
+		check(stats(loader, 1, 1, 0, 1), "repeat request is a hit");
+
+		std::shared_ptr<AsyncTexture> black = loader.StreamTexture(path, TexturePlaceholder::Black);
+		std::shared_ptr<AsyncTexture> queued = loader.QueueTexture(path);
+		check(black != white && queued != white && queued != black, "other placeholders get their own handles");
+		check(white->GetPlaceholder() == loader.GetPlaceholder(TexturePlaceholder::White) &&
+			black->GetPlaceholder() == loader.GetPlaceholder(TexturePlaceholder::Black) &&
+			queued->GetPlaceholder() == nullptr, "each handle shows the placeholder it was asked for");
+		check(loader.QueueTexture(path) == queued, "repeat queued request gets the same handle");
+		check(stats(loader, 2, 3, 0, 3), "hits and misses are counted per placeholder");
+
+		// Still loading - nothing is evicted even with no one else
+		// holding the handles
+		white = black = queued = nullptr;
+		check(loader.EvictUnused() == 0, "loading handles aren't evicted");
+	}
+
+	// Let everything fail, then only handles held elsewhere stay
+	std::shared_ptr<AsyncTexture> held = loader.StreamTexture(path, TexturePlaceholder::FlatNormal);
+	loader.Load();
+	for (int wait = 0; wait < 5000 && loader.IsStreaming(); wait++)
+	{
+		loader.Update();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	check(held->GetState() == AssetState::Failed && held->Get() == loader.GetPlaceholder(TexturePlaceholder::FlatNormal), "failed handles keep their placeholder");
+	check(loader.StreamTexture(path, TexturePlaceholder::FlatNormal) == held, "failed handles are cached too");
+	check(stats(loader, 3, 4, 0, 4), "counts before eviction");
+	check(loader.EvictUnused() == 3, "unused handles are evicted");
+	check(stats(loader, 3, 4, 3, 1), "evictions are counted");
+	check(loader.StreamTexture(path, TexturePlaceholder::FlatNormal) == held, "held handles survive eviction");
+
+	// An evicted handle is loaded afresh
+	loader.StreamTexture(path, TexturePlaceholder::White);
+	check(stats(loader, 4, 5, 3, 2), "requests after eviction are misses");
+
+	bool passed = failures == 0;
+	printf("Asset cache test: %s\n\n", passed ? "passed" : "FAILED");
+	return passed;
+}
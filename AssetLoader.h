@@ -0,0 +1,181 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "AsyncAsset.h"
+#include "Material.h"
+#include "Mesh.h"
+
+struct IWICImagingFactory;
+
+// A mesh that may still be streaming in
+typedef AsyncAsset<std::shared_ptr<Mesh>> AsyncMesh;
+
+// What a streamed texture shows until it's loaded
+enum class TexturePlaceholder
+{
+	White,		// Albedo, roughness
+	Black,		// Metalness
+	FlatNormal	// Normal maps
+};
+
+// Cache counters, see AssetLoader::GetCacheStats()
+struct AssetCacheStats
+{
+	int Hits;		// Requests that got an existing handle
+	int Misses;		// Requests that started a new load
+	int Evictions;	// Entries dropped by EvictUnused()
+	int Entries;	// Handles currently cached
+};
+
+// --------------------------------------------------------
+// Loads textures, cube maps and meshes on worker threads.
+//
+// Every asset is split into two steps:
+//  1. Reading/decoding (images) or parsing/cooking (meshes) on
+//     a worker thread - plain CPU work, no D3D calls
+//  2. Creating the GPU resource on the thread that owns the
+//     immediate context
+//
+// There are two ways to use it:
+//  - Queue*() then Load() - blocks until everything queued is
+//    loaded, running step 1 for all of them in parallel.  Startup
+//    is bounded by the slowest asset rather than the sum of them.
+//  - Stream*() - returns an AsyncAsset handle straight away that
+//    resolves to a placeholder.  Background threads do step 1 and
+//    Update(), called once a frame, does step 2 and swaps the
+//    real asset in.
+//
+// Every handle is cached by what it was loaded from, so asking for
+// the same file twice costs nothing.  The cache holds a reference
+// to each handle; EvictUnused() drops the ones nothing else uses,
+// which releases their GPU resources.
+// --------------------------------------------------------
+class AssetLoader
+{
+private:
+	// One asset's worth of work, and when/where it ran
+	struct Job
+	{
+		std::string label;
+		uintmax_t cost = 0; // Bytes to read, roughly
+
+		// Worker thread: returns false if the asset couldn't be loaded
+		std::function<bool(IWICImagingFactory*)> work;
+
+		// Owning thread: receives the result of work()
+		std::function<void(bool)> create;
+
+		bool succeeded = false;
+		std::exception_ptr error;
+		std::string thread;
+		double start = 0;
+		double end = 0;
+	};
+
+	struct TimelineEntry
+	{
+		std::string label;
+		const char* stage;
+		std::string thread;
+		double start;
+		double end;
+	};
+
+	std::chrono::high_resolution_clock::time_point startTime;
+	std::vector<Job> jobs; // Queued for Load()
+	std::vector<TimelineEntry> timeline;
+
+	// Streaming
+	std::vector<std::thread> streamThreads;
+	std::mutex streamMutex;
+	std::condition_variable streamWake;
+	std::deque<Job> streamQueue;	// Waiting for a worker
+	std::deque<Job> createQueue;	// Waiting for Update()
+	int streamsPending = 0;			// Streamed but not yet created
+	bool stopping = false;
+
+	// Cached handles, keyed by kind of asset + source file(s)
+	std::unordered_map<std::wstring, std::shared_ptr<AsyncTexture>> textureCache;
+	std::unordered_map<std::wstring, std::shared_ptr<AsyncMesh>> meshCache;
+	int cacheHits = 0;
+	int cacheMisses = 0;
+	int cacheEvictions = 0;
+
+	// Placeholders, made the first time they're needed
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholderTextures[3];
+	std::shared_ptr<Mesh> placeholderMesh;
+
+	double Elapsed();
+	void RunJob(Job& job, const std::string& thread, IWICImagingFactory* factory);
+	void RunCreate(Job& job);
+	void StreamWorker(int index);
+	void Stream(Job job);
+
+	template<typename T> void Track(Job& job, std::shared_ptr<AsyncAsset<T>> handle);
+	Job MakeTextureJob(const std::wstring& path, std::shared_ptr<AsyncTexture> handle);
+	Job MakeMeshJob(const char* name, const std::wstring& objFile, const std::wstring& cookedFile, std::shared_ptr<AsyncMesh> handle);
+
+	template<typename T> std::shared_ptr<AsyncAsset<T>> FindCached(std::unordered_map<std::wstring, std::shared_ptr<AsyncAsset<T>>>& cache, const std::wstring& key);
+	template<typename T> int Evict(std::unordered_map<std::wstring, std::shared_ptr<AsyncAsset<T>>>& cache);
+
+public:
+	AssetLoader();
+	~AssetLoader();
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// Loaded by the next Load() - until then (or if they fail)
+	// these handles resolve to null
+	std::shared_ptr<AsyncTexture> QueueTexture(const std::wstring& path);
+	std::shared_ptr<AsyncTexture> QueueCubemap(
+		const std::wstring& right,
+		const std::wstring& left,
+		const std::wstring& up,
+		const std::wstring& down,
+		const std::wstring& front,
+		const std::wstring& back);
+	std::shared_ptr<AsyncMesh> QueueMesh(const char* name, const std::wstring& objFile, const std::wstring& cookedFile);
+
+	// Loads everything queued so far, blocking until it's done.
+	// Must be called from the thread that owns Graphics::Context.
+	void Load();
+
+	// Starts loading in the background.  A handle that fails to
+	// load keeps its placeholder (a unit cube, for meshes).
+	std::shared_ptr<AsyncTexture> StreamTexture(const std::wstring& path, TexturePlaceholder placeholder = TexturePlaceholder::White);
+	std::shared_ptr<AsyncMesh> StreamMesh(const char* name, const std::wstring& objFile, const std::wstring& cookedFile);
+
+	// Creates the GPU resources for up to maxCreates streamed assets
+	// that have finished decoding.  Call once a frame, from the
+	// thread that owns Graphics::Context.
+	void Update(int maxCreates = 4);
+	bool IsStreaming();
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetPlaceholder(TexturePlaceholder placeholder);
+	std::shared_ptr<Mesh> GetPlaceholderMesh();
+
+	// Drops cached handles that nothing outside the cache holds
+	// (and that aren't mid-load), returning how many were dropped
+	int EvictUnused();
+	AssetCacheStats GetCacheStats();
+
+	// Per-asset start/end times of everything loaded so far
+	void PrintTimeline();
+
+	// Checks cache hits, misses and evictions, and that textures
+	// with different placeholders get different handles.  Prints the
+	// results and returns whether they passed.
+	static bool CacheTest();
+};
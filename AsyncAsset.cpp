@@ -0,0 +1,116 @@
+#include "AsyncAsset.h"
+#include <cstdio>
+#include <thread>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	typedef AsyncAsset<std::shared_ptr<int>> TestAsset;
+
+	// A handle walked forward to the given state
+	std::shared_ptr<TestAsset> MakeAsset(AssetState state, std::shared_ptr<int> placeholder, std::shared_ptr<int> loaded)
+	{
+		std::shared_ptr<TestAsset> asset = std::make_shared<TestAsset>(placeholder);
+		if (state == AssetState::Failed)
+		{
+			asset->Fail();
+			return asset;
+		}
+		if (state != AssetState::Queued) asset->BeginLoading();
+		if (state != AssetState::Queued && state != AssetState::Loading) asset->FinishLoading();
+		if (state == AssetState::Ready) asset->Publish(loaded);
+		return asset;
+	}
+}
+
+bool AsyncAssetTest()
+{
+	const AssetState states[] = { AssetState::Queued, AssetState::Loading, AssetState::Creating, AssetState::Ready, AssetState::Failed };
+	const char* names[] = { "Queued", "Loading", "Creating", "Ready", "Failed" };
+	std::shared_ptr<int> placeholder = std::make_shared<int>(0);
+	std::shared_ptr<int> loaded = std::make_shared<int>(1);
+	int failures = 0;
+	auto check = [&](bool condition, const char* what, int state) {
+		if (!condition)
+		{
+			printf("  FAILED: %s (from %s)\n", what, names[state]);
+			failures++;
+		}
+	};
+
+	for (int i = 0; i < 5; i++)
+	{
+		AssetState from = states[i];
+		check(MakeAsset(from, placeholder, loaded)->GetState() == from, "handle reaches the state", i);
+
+		// Each step only works from the state right before it
+		std::shared_ptr<TestAsset> asset = MakeAsset(from, placeholder, loaded);
+		check(asset->BeginLoading() == (from == AssetState::Queued), "BeginLoading only from Queued", i);
+		asset = MakeAsset(from, placeholder, loaded);
+		check(asset->FinishLoading() == (from == AssetState::Loading), "FinishLoading only from Loading", i);
+		asset = MakeAsset(from, placeholder, loaded);
+		check(asset->Publish(loaded) == (from == AssetState::Creating), "Publish only from Creating", i);
+
+		// A refused step leaves the handle as it was
+		asset = MakeAsset(from, placeholder, loaded);
+		if (from != AssetState::Queued) asset->BeginLoading();
+		if (from != AssetState::Loading) asset->FinishLoading();
+		if (from != AssetState::Creating) asset->Publish(std::make_shared<int>(2));
+		check(asset->GetState() == from, "refused steps change nothing", i);
+		check(asset->Get() == (from == AssetState::Ready ? loaded : placeholder), "refused steps don't change Get()", i);
+
+		// Anything not finished can fail, and then only shows the
+		// placeholder - and nothing moves it on from there
+		asset = MakeAsset(from, placeholder, loaded);
+		bool canFail = from != AssetState::Ready && from != AssetState::Failed;
+		check(asset->Fail() == canFail, "Fail from anything unfinished", i);
+		check(asset->GetState() == (canFail ? AssetState::Failed : from), "Fail leaves the handle Failed", i);
+		if (canFail)
+		{
+			check(asset->Get() == placeholder, "failed handles show the placeholder", i);
+			check(!asset->BeginLoading() && !asset->FinishLoading() && !asset->Publish(loaded) && !asset->Fail(), "failed handles stay failed", i);
+			check(asset->Get() == placeholder, "failed handles can't be published", i);
+		}
+	}
+
+	// Get() is the placeholder right up until Publish
+	{
+		std::shared_ptr<TestAsset> asset = std::make_shared<TestAsset>(placeholder);
+		bool placeholderUntilPublished = asset->Get() == placeholder && !asset->IsReady();
+		asset->BeginLoading();
+		placeholderUntilPublished = placeholderUntilPublished && asset->Get() == placeholder;
+		asset->FinishLoading();
+		placeholderUntilPublished = placeholderUntilPublished && asset->Get() == placeholder;
+		asset->Publish(loaded);
+		check(placeholderUntilPublished, "Get returns the placeholder until Publish", 0);
+		check(asset->IsReady() && asset->Get() == loaded && asset->GetPlaceholder() == placeholder, "Get returns the asset once published", 3);
+		check(TestAsset::Loaded(loaded)->Get() == loaded, "Loaded handles start Ready", 3);
+	}
+
+	// Publish and Fail racing from Creating - exactly one wins, and
+	// the handle agrees with the winner
+	const int races = 2000;
+	int published = 0;
+	int lost = 0;
+	for (int race = 0; race < races; race++)
+	{
+		std::shared_ptr<TestAsset> asset = MakeAsset(AssetState::Creating, placeholder, loaded);
+		bool publishWon = false;
+		bool failWon = false;
+		std::thread failer([&]() { failWon = asset->Fail(); });
+		publishWon = asset->Publish(loaded);
+		failer.join();
+
+		if (publishWon == failWon ||
+			asset->GetState() != (publishWon ? AssetState::Ready : AssetState::Failed) ||
+			asset->Get() != (publishWon ? loaded : placeholder))
+			lost++;
+		published += publishWon;
+	}
+	check(lost == 0, "exactly one of a racing Publish and Fail wins", 2);
+
+	bool passed = failures == 0;
+	printf("Async asset test: %s\n  Publish won %d of %d races with Fail\n\n", passed ? "passed" : "FAILED", published, races);
+	return passed;
+}
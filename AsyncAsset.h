@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+// Where an asynchronously loaded asset is in its life
+enum class AssetState
+{
+	Queued,		// Waiting for a worker thread
+	Loading,	// Being read/decoded on a worker thread
+	Creating,	// Decoded, waiting for its GPU resource to be made
+	Ready,		// Loaded - Get() returns the real asset
+	Failed		// Gave up - Get() keeps returning the placeholder
+};
+
+// --------------------------------------------------------
+// Handle to an asset that's loading in the background.
+//
+// Until the asset is Ready, Get() returns the placeholder it was
+// created with, so anything holding the handle (a Material, the
+// game's mesh list) can draw straight away.  The loaded value is
+// written before the state becomes Ready, and the state is
+// read before the value, so the swap is atomic from any thread.
+//
+// Nothing here depends on D3D - T is whatever the asset is.
+//
+// Expected transitions (anything else is rejected):
+//   Queued -> Loading -> Creating -> Ready
+//   Queued/Loading/Creating -> Failed
+// Publish() is only ever called from one thread (the one that
+// owns the device context), once the handle is Creating, but
+// Fail() may race it from any thread.
+// --------------------------------------------------------
+template<typename T>
+class AsyncAsset
+{
+private:
+	T placeholder;
+	T value;
+	std::atomic<AssetState> state;
+
+	bool Advance(AssetState from, AssetState to)
+	{
+		return state.compare_exchange_strong(from, to, std::memory_order_acq_rel);
+	}
+
+public:
+	explicit AsyncAsset(T placeholder) : placeholder(placeholder), value(), state(AssetState::Queued) {}
+
+	// A handle for something that's already loaded
+	static std::shared_ptr<AsyncAsset<T>> Loaded(T value)
+	{
+		std::shared_ptr<AsyncAsset<T>> asset = std::make_shared<AsyncAsset<T>>(value);
+		asset->value = value;
+		asset->state.store(AssetState::Ready, std::memory_order_release);
+		return asset;
+	}
+
+	AssetState GetState() const { return state.load(std::memory_order_acquire); }
+	bool IsReady() const { return GetState() == AssetState::Ready; }
+
+	// The loaded asset if it's ready, otherwise the placeholder
+	T Get() const { return IsReady() ? value : placeholder; }
+	T GetPlaceholder() const { return placeholder; }
+
+	bool BeginLoading() { return Advance(AssetState::Queued, AssetState::Loading); }
+	bool FinishLoading() { return Advance(AssetState::Loading, AssetState::Creating); }
+
+	// The value goes in first, but only a Creating -> Ready swap
+	// makes it visible - if a Fail() got there first it stays Failed
+	bool Publish(T loaded)
+	{
+		if (GetState() != AssetState::Creating)
+			return false;
+
+		value = loaded;
+		if (Advance(AssetState::Creating, AssetState::Ready))
+			return true;
+
+		value = T();
+		return false;
+	}
+
+	bool Fail()
+	{
+		AssetState current = GetState();
+		while (current != AssetState::Ready && current != AssetState::Failed)
+		{
+			if (state.compare_exchange_weak(current, AssetState::Failed, std::memory_order_acq_rel))
+				return true;
+		}
+		return false;
+	}
+};
+
+// Walks handles through every legal and illegal transition, fails
+// them from each state, checks Get() only gives up the placeholder
+// once published, and races Publish() against Fail().  Prints the
+// results and returns whether they passed.
+bool AsyncAssetTest();
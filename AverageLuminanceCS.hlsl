@@ -0,0 +1,33 @@
+#include "Exposure.hlsli"
+
+RWStructuredBuffer<uint> Histogram : register(u0);
+RWStructuredBuffer<float> AdaptedLuminance : register(u1); // One value, kept from frame to frame
+
+groupshared uint weighted[HISTOGRAM_BINS];
+
+// --------------------------------------------------------
+// Averages the histogram with one thread per bin - each weights
+// its bin's count by the bin, then the list is halved and summed
+// until one total is left - and eases the adapted luminance
+// towards it.  Clears the histogram for next frame on the way.
+// --------------------------------------------------------
+[numthreads(HISTOGRAM_BINS, 1, 1)]
+void main(uint groupIndex : SV_GroupIndex)
+{
+    uint count = Histogram[groupIndex];
+    weighted[groupIndex] = count * groupIndex;
+    Histogram[groupIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+    
+    [unroll]
+    for (uint cutoff = HISTOGRAM_BINS / 2; cutoff > 0; cutoff >>= 1)
+    {
+        if (groupIndex < cutoff)
+            weighted[groupIndex] += weighted[groupIndex + cutoff];
+        GroupMemoryBarrierWithGroupSync();
+    }
+    
+    // Thread 0's count is the black pixels
+    if (groupIndex == 0)
+        AdaptedLuminance[0] = Adapt(AdaptedLuminance[0], AverageLuminance(weighted[0], count));
+}
@@ -0,0 +1,312 @@
+#include "Blur.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	XMFLOAT4& PixelAt(Blur::Image& image, int x, int y)
+	{
+		return image.Pixels[(size_t)y * image.Width + x];
+	}
+
+	const XMFLOAT4& PixelAt(const Blur::Image& image, int x, int y)
+	{
+		return image.Pixels[(size_t)y * image.Width + x];
+	}
+
+	void Allocate(Blur::Image& image, int width, int height)
+	{
+		image.Width = width;
+		image.Height = height;
+		image.Pixels.assign((size_t)width * height, XMFLOAT4(0, 0, 0, 0));
+	}
+
+	// One sample per texel, no merging - what MergeTaps() should
+	// be equivalent to
+	void PassPerTexel(const Blur::Image& source, const float* weights, int radius, bool horizontal, Blur::Image& result)
+	{
+		Allocate(result, source.Width, source.Height);
+		float stepU = horizontal ? 1.0f / source.Width : 0.0f;
+		float stepV = horizontal ? 0.0f : 1.0f / source.Height;
+		for (int y = 0; y < source.Height; y++)
+		{
+			for (int x = 0; x < source.Width; x++)
+			{
+				float u = (x + 0.5f) / source.Width;
+				float v = (y + 0.5f) / source.Height;
+				XMVECTOR total = XMVectorScale(XMLoadFloat4(&PixelAt(source, x, y)), weights[0]);
+				for (int i = 1; i <= radius; i++)
+				{
+					XMFLOAT4 after = Blur::SampleLinear(source, u + i * stepU, v + i * stepV);
+					XMFLOAT4 before = Blur::SampleLinear(source, u - i * stepU, v - i * stepV);
+					total = XMVectorAdd(total, XMVectorScale(XMVectorAdd(XMLoadFloat4(&after), XMLoadFloat4(&before)), weights[i]));
+				}
+				XMStoreFloat4(&PixelAt(result, x, y), total);
+			}
+		}
+	}
+
+	float LargestDifference(const Blur::Image& a, const Blur::Image& b)
+	{
+		float largest = 0.0f;
+		for (size_t i = 0; i < a.Pixels.size(); i++)
+		{
+			largest = std::max(largest, fabsf(a.Pixels[i].x - b.Pixels[i].x));
+			largest = std::max(largest, fabsf(a.Pixels[i].y - b.Pixels[i].y));
+			largest = std::max(largest, fabsf(a.Pixels[i].z - b.Pixels[i].z));
+			largest = std::max(largest, fabsf(a.Pixels[i].w - b.Pixels[i].w));
+		}
+		return largest;
+	}
+}
+
+void Blur::GetWeights(KernelType type, int radius, float* weights)
+{
+	if (type == KernelBox)
+	{
+		for (int i = 0; i <= radius; i++)
+			weights[i] = 1.0f / (2 * radius + 1);
+		return;
+	}
+
+	// Three standard deviations out to just past the radius
+	float sigma = (radius + 1) / 3.0f;
+	float total = 0.0f;
+	for (int i = 0; i <= radius; i++)
+	{
+		weights[i] = expf(-(float)(i * i) / (2.0f * sigma * sigma));
+		total += i == 0 ? weights[i] : 2.0f * weights[i];
+	}
+	for (int i = 0; i <= radius; i++)
+		weights[i] /= total;
+}
+
+// --------------------------------------------------------
+// Texels i and i + 1, weighted a and b, are the same as one
+// bilinear sample b / (a + b) of the way from i to i + 1,
+// weighted a + b.  An odd radius leaves the last texel alone.
+// --------------------------------------------------------
+BlurKernel Blur::MergeTaps(const float* weights, int radius)
+{
+	radius = std::clamp(radius, 0, MaxRadius);
+
+	BlurKernel kernel = {};
+	kernel.CenterWeight = weights[0];
+	for (int i = 1; i <= radius; i += 2)
+	{
+		float a = weights[i];
+		float b = i + 1 <= radius ? weights[i + 1] : 0.0f;
+		BlurTap& tap = kernel.Taps[kernel.TapCount++];
+		tap.Weight = a + b;
+		tap.Offset = tap.Weight > 0.0f ? i + b / tap.Weight : (float)i;
+	}
+	return kernel;
+}
+
+BlurKernel Blur::MakeKernel(KernelType type, int radius)
+{
+	radius = std::clamp(radius, 0, MaxRadius);
+	float weights[MaxRadius + 1];
+	GetWeights(type, radius, weights);
+	return MergeTaps(weights, radius);
+}
+
+int Blur::SeparableSamples(const BlurKernel& kernel)
+{
+	return 2 * (1 + 2 * kernel.TapCount);
+}
+
+int Blur::BoxSamples(int radius)
+{
+	return (2 * radius + 1) * (2 * radius + 1);
+}
+
+// Texel centers are at (i + 0.5) / size, and anything off the
+// edge takes the edge texel
+XMFLOAT4 Blur::SampleLinear(const Image& image, float u, float v)
+{
+	float x = u * image.Width - 0.5f;
+	float y = v * image.Height - 0.5f;
+	float x0 = floorf(x);
+	float y0 = floorf(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	int left = std::clamp((int)x0, 0, image.Width - 1);
+	int right = std::clamp((int)x0 + 1, 0, image.Width - 1);
+	int top = std::clamp((int)y0, 0, image.Height - 1);
+	int bottom = std::clamp((int)y0 + 1, 0, image.Height - 1);
+
+	XMVECTOR upper = XMVectorAdd(
+		XMVectorScale(XMLoadFloat4(&PixelAt(image, left, top)), 1.0f - fx),
+		XMVectorScale(XMLoadFloat4(&PixelAt(image, right, top)), fx));
+	XMVECTOR lower = XMVectorAdd(
+		XMVectorScale(XMLoadFloat4(&PixelAt(image, left, bottom)), 1.0f - fx),
+		XMVectorScale(XMLoadFloat4(&PixelAt(image, right, bottom)), fx));
+
+	XMFLOAT4 result;
+	XMStoreFloat4(&result, XMVectorAdd(XMVectorScale(upper, 1.0f - fy), XMVectorScale(lower, fy)));
+	return result;
+}
+
+void Blur::Box2D(const Image& source, int radius, Image& result)
+{
+	Allocate(result, source.Width, source.Height);
+	float count = (float)BoxSamples(radius);
+	for (int y = 0; y < source.Height; y++)
+	{
+		for (int x = 0; x < source.Width; x++)
+		{
+			float u = (x + 0.5f) / source.Width;
+			float v = (y + 0.5f) / source.Height;
+			XMVECTOR total = XMVectorZero();
+			for (int i = -radius; i <= radius; i++)
+			{
+				for (int j = -radius; j <= radius; j++)
+				{
+					XMFLOAT4 sample = SampleLinear(source, u + (float)i / source.Width, v + (float)j / source.Height);
+					total = XMVectorAdd(total, XMLoadFloat4(&sample));
+				}
+			}
+			XMStoreFloat4(&PixelAt(result, x, y), XMVectorScale(total, 1.0f / count));
+		}
+	}
+}
+
+void Blur::Pass(const Image& source, const BlurKernel& kernel, bool horizontal, Image& result)
+{
+	Allocate(result, source.Width, source.Height);
+	float stepU = horizontal ? 1.0f / source.Width : 0.0f;
+	float stepV = horizontal ? 0.0f : 1.0f / source.Height;
+	for (int y = 0; y < source.Height; y++)
+	{
+		for (int x = 0; x < source.Width; x++)
+		{
+			float u = (x + 0.5f) / source.Width;
+			float v = (y + 0.5f) / source.Height;
+			XMFLOAT4 center = SampleLinear(source, u, v);
+			XMVECTOR total = XMVectorScale(XMLoadFloat4(&center), kernel.CenterWeight);
+			for (int t = 0; t < kernel.TapCount; t++)
+			{
+				const BlurTap& tap = kernel.Taps[t];
+				XMFLOAT4 after = SampleLinear(source, u + tap.Offset * stepU, v + tap.Offset * stepV);
+				XMFLOAT4 before = SampleLinear(source, u - tap.Offset * stepU, v - tap.Offset * stepV);
+				total = XMVectorAdd(total, XMVectorScale(XMVectorAdd(XMLoadFloat4(&after), XMLoadFloat4(&before)), tap.Weight));
+			}
+			XMStoreFloat4(&PixelAt(result, x, y), total);
+		}
+	}
+}
+
+void Blur::Resample(const Image& source, int width, int height, Image& result)
+{
+	Allocate(result, width, height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+			PixelAt(result, x, y) = SampleLinear(source, (x + 0.5f) / width, (y + 0.5f) / height);
+	}
+}
+
+// --------------------------------------------------------
+// Random images with odd sizes, so the clamped edges get used
+// on every side
+// --------------------------------------------------------
+bool Blur::Test()
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	Image image;
+	Allocate(image, 37, 23);
+	for (XMFLOAT4& pixel : image.Pixels)
+		pixel = XMFLOAT4(unit(random), unit(random), unit(random), 1.0f);
+
+	// Separable box blur vs. the old 2D box, at a range of radii
+	float boxDifference = 0.0f;
+	float weightError = 0.0f;
+	const int radii[] = { 0, 1, 2, 3, 7, 16, 50, MaxRadius };
+	for (int radius : radii)
+	{
+		Image expected, horizontal, separable;
+		Box2D(image, radius, expected);
+		BlurKernel kernel = MakeKernel(KernelBox, radius);
+		Pass(image, kernel, true, horizontal);
+		Pass(horizontal, kernel, false, separable);
+		boxDifference = std::max(boxDifference, LargestDifference(expected, separable));
+
+		for (KernelType type : { KernelBox, KernelGaussian })
+		{
+			BlurKernel typed = MakeKernel(type, radius);
+			float total = typed.CenterWeight;
+			for (int t = 0; t < typed.TapCount; t++)
+				total += 2.0f * typed.Taps[t].Weight;
+			weightError = std::max(weightError, fabsf(total - 1.0f));
+		}
+	}
+
+	// Merged Gaussian taps vs. sampling every texel
+	float gaussianDifference = 0.0f;
+	for (int radius : radii)
+	{
+		float weights[MaxRadius + 1];
+		GetWeights(KernelGaussian, radius, weights);
+		Image expected, merged;
+		for (bool horizontal : { true, false })
+		{
+			PassPerTexel(image, weights, radius, horizontal, expected);
+			Pass(image, MergeTaps(weights, radius), horizontal, merged);
+			gaussianDifference = std::max(gaussianDifference, LargestDifference(expected, merged));
+		}
+	}
+
+	// Halving an even sized image averages each 2x2 block
+	Image even, half;
+	Allocate(even, 32, 20);
+	for (XMFLOAT4& pixel : even.Pixels)
+		pixel = XMFLOAT4(unit(random), unit(random), unit(random), 1.0f);
+	Resample(even, 16, 10, half);
+	float halfDifference = 0.0f;
+	for (int y = 0; y < half.Height; y++)
+	{
+		for (int x = 0; x < half.Width; x++)
+		{
+			XMVECTOR average = XMVectorScale(XMVectorAdd(
+				XMVectorAdd(XMLoadFloat4(&PixelAt(even, 2 * x, 2 * y)), XMLoadFloat4(&PixelAt(even, 2 * x + 1, 2 * y))),
+				XMVectorAdd(XMLoadFloat4(&PixelAt(even, 2 * x, 2 * y + 1)), XMLoadFloat4(&PixelAt(even, 2 * x + 1, 2 * y + 1)))), 0.25f);
+			XMFLOAT4 expected;
+			XMStoreFloat4(&expected, average);
+			const XMFLOAT4& actual = PixelAt(half, x, y);
+			halfDifference = std::max(halfDifference, std::max(
+				std::max(fabsf(expected.x - actual.x), fabsf(expected.y - actual.y)),
+				std::max(fabsf(expected.z - actual.z), fabsf(expected.w - actual.w))));
+		}
+	}
+
+	const float tolerance = 1e-4f;
+	bool passed = boxDifference < tolerance && gaussianDifference < tolerance && halfDifference < tolerance && weightError < tolerance;
+	printf("Blur test: %dx%d image - %s\n", image.Width, image.Height, passed ? "passed" : "FAILED");
+	printf("  Separable vs 2D box, largest difference: %g\n", boxDifference);
+	printf("  Merged vs per texel Gaussian, largest difference: %g\n", gaussianDifference);
+	printf("  Halving vs 2x2 average, largest difference: %g\n", halfDifference);
+	printf("  Kernel weights off 1 by at most: %g\n", weightError);
+
+	const int radius = 50;
+	printf("  Samples per screen pixel, radius %d:\n", radius);
+	printf("    2D box: %d\n", BoxSamples(radius));
+	for (int level = 0; level < 3; level++)
+	{
+		int scale = 1 << level;
+		BlurKernel kernel = MakeKernel(KernelBox, (radius + scale - 1) / scale);
+		int samples = SeparableSamples(kernel);
+		printf("    Separable, 1/%d resolution: %d per pass pixel, %.2f per screen pixel\n", scale, samples, (float)samples / (scale * scale));
+	}
+	printf("\n");
+	return passed;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+namespace Blur
+{
+	constexpr int MaxRadius = 64;
+	constexpr int MaxTaps = (MaxRadius + 1) / 2; // Either side of the center
+
+	enum KernelType
+	{
+		KernelBox,		// Every texel in reach counts the same
+		KernelGaussian	// Falls off to almost nothing at the radius
+	};
+}
+
+// One bilinear sample either side of a blur's center texel, at
+// Offset texels, each weighted Weight
+struct BlurTap
+{
+	float Offset;
+	float Weight;
+};
+
+// --------------------------------------------------------
+// One axis of a separable blur, as BlurPS.hlsl samples it.
+// Neighbouring texels are merged into a single bilinear sample
+// placed between them by weight, so a radius r kernel is the
+// center plus about r / 2 samples each side.
+// --------------------------------------------------------
+struct BlurKernel
+{
+	float CenterWeight;
+	int TapCount;
+	BlurTap Taps[Blur::MaxTaps];
+};
+
+// --------------------------------------------------------
+// Kernels for the post process blur, and CPU versions of the
+// passes that use them - sampling the way the GPU's clamped,
+// bilinear sampler does - so they can be checked anywhere.
+// --------------------------------------------------------
+namespace Blur
+{
+	// RGBA, row by row
+	struct Image
+	{
+		int Width = 0;
+		int Height = 0;
+		std::vector<DirectX::XMFLOAT4> Pixels;
+	};
+
+	// Weights of texels 0 to radius along one side, adding up to 1
+	// over the whole (2 * radius + 1) texels
+	void GetWeights(KernelType type, int radius, float* weights);
+
+	// Pairs up texels 1 and 2, 3 and 4... either side of the center
+	BlurKernel MergeTaps(const float* weights, int radius);
+	BlurKernel MakeKernel(KernelType type, int radius);
+
+	// Texture samples a pixel takes for a horizontal and a vertical
+	// pass of a kernel - and for the old single pass box blur
+	int SeparableSamples(const BlurKernel& kernel);
+	int BoxSamples(int radius);
+
+	// CPU reference versions of the GPU passes
+	DirectX::XMFLOAT4 SampleLinear(const Image& image, float u, float v); // Clamped, like ppSampler
+	void Box2D(const Image& source, int radius, Image& result);	// The old BlurPS.hlsl
+	void Pass(const Image& source, const BlurKernel& kernel, bool horizontal, Image& result); // BlurPS.hlsl
+	void Resample(const Image& source, int width, int height, Image& result); // CopyPS.hlsl into a differently sized target
+
+	// Checks the separable box blur gives the same image as the old
+	// box blur, that merged taps match sampling every texel, that
+	// halving averages 2x2 texels, and prints how many samples each
+	// path takes.  Returns whether everything passed.
+	bool Test();
+}
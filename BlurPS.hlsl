@@ -1,8 +1,10 @@
+// Must match BlurPSData in BufferStructs.h
 cbuffer ExternalData : register(b0)
 {
-    int blurRadius;
-    float pixelWidth;
-    float pixelHeight;
+    float2 texelStep; // One texel along the pass's axis, in UVs
+    int tapCount;
+    float centerWeight;
+    float4 taps[32]; // x = offset in texels, y = weight (see Blur.h)
 }
 
 struct VertexToPixel
@@ -14,26 +16,21 @@ struct VertexToPixel
 Texture2D Pixels : register(t0);
 SamplerState ClampSampler : register(s0);
 
+// --------------------------------------------------------
+// One axis of a separable blur - run across, then down.  Each
+// tap lands between two texels, so the bilinear filter blends
+// both of them in a single sample.
+// --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    // Track the total color and number of samples
-    float4 total = 0;
-    int sampleCount = 0;
+    float4 total = Pixels.Sample(ClampSampler, input.uv) * centerWeight;
     
-    // Loop through the "box"
-    for (int x = -blurRadius; x <= blurRadius; x++)
+    // Either side of the center
+    for (int i = 0; i < tapCount; i++)
     {
-        for (int y = -blurRadius; y <= blurRadius; y++)
-        {
-            // Calculate the uv for this sample
-            float2 uv = input.uv;
-            uv += float2(x * pixelWidth, y * pixelHeight);
-            
-            // Add this color to the running total
-            total += Pixels.Sample(ClampSampler, uv);
-            sampleCount++;
-        }
+        float2 offset = taps[i].x * texelStep;
+        total += (Pixels.Sample(ClampSampler, input.uv + offset) +
+            Pixels.Sample(ClampSampler, input.uv - offset)) * taps[i].y;
     }
-    // Return the average
-    return total / sampleCount;
-}
\ No newline at end of file
+    return total;
+}
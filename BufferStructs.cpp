@@ -0,0 +1,154 @@
+#include "BufferStructs.h"
+#include "ConstantRing.h"
+#include <cstdio>
+#include <vector>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Where one member sits in its struct
+	struct Field
+	{
+		const char* Name;
+		size_t Offset;
+		size_t Size;
+	};
+
+	struct Layout
+	{
+		const char* Name;
+		size_t Size;
+		std::vector<Field> Fields; // In declaration order
+		bool PerEntity;
+	};
+
+#define FIELD(type, member) { #member, offsetof(type, member), sizeof(type::member) }
+
+	// Every cbuffer struct, member by member
+	std::vector<Layout> GetLayouts()
+	{
+		return {
+			{ "PerFrameVSData", sizeof(PerFrameVSData), {
+				FIELD(PerFrameVSData, view),
+				FIELD(PerFrameVSData, projection) }, false },
+			{ "PerFramePSData", sizeof(PerFramePSData), {
+				FIELD(PerFramePSData, directionalLightCount),
+				FIELD(PerFramePSData, ambientLight),
+				FIELD(PerFramePSData, cameraPos),
+				FIELD(PerFramePSData, farClipDistance),
+				FIELD(PerFramePSData, fogType),
+				FIELD(PerFramePSData, fogColor),
+				FIELD(PerFramePSData, fogStartDist),
+				FIELD(PerFramePSData, fogEndDist),
+				FIELD(PerFramePSData, fogDensity),
+				FIELD(PerFramePSData, heightBasedFog),
+				FIELD(PerFramePSData, fogVerticalDensity),
+				FIELD(PerFramePSData, fogHeight),
+				FIELD(PerFramePSData, padding),
+				FIELD(PerFramePSData, shadowViewProjections),
+				FIELD(PerFramePSData, cascadeSplits),
+				FIELD(PerFramePSData, cameraForward),
+				FIELD(PerFramePSData, cascadeCount),
+				FIELD(PerFramePSData, clusterTilesX),
+				FIELD(PerFramePSData, clusterTilesY),
+				FIELD(PerFramePSData, clusterSlices),
+				FIELD(PerFramePSData, clusterSliceScale),
+				FIELD(PerFramePSData, clusterTileScale),
+				FIELD(PerFramePSData, clusterSliceBias),
+				FIELD(PerFramePSData, shadowedLight) }, false },
+			{ "PerMaterialPSData", sizeof(PerMaterialPSData), {
+				FIELD(PerMaterialPSData, colorTint),
+				FIELD(PerMaterialPSData, uvScale),
+				FIELD(PerMaterialPSData, uvOffset),
+				FIELD(PerMaterialPSData, roughness),
+				FIELD(PerMaterialPSData, padding) }, true },
+			{ "PerObjectVSData", sizeof(PerObjectVSData), {
+				FIELD(PerObjectVSData, world),
+				FIELD(PerObjectVSData, worldInvTranspose) }, true },
+			{ "BlurPSData", sizeof(BlurPSData), {
+				FIELD(BlurPSData, texelStep),
+				FIELD(BlurPSData, tapCount),
+				FIELD(BlurPSData, centerWeight),
+				FIELD(BlurPSData, taps) }, false },
+			{ "ExposureData", sizeof(ExposureData), {
+				FIELD(ExposureData, inputWidth),
+				FIELD(ExposureData, inputHeight),
+				FIELD(ExposureData, minLogLuminance),
+				FIELD(ExposureData, logLuminanceRange),
+				FIELD(ExposureData, timeDelta),
+				FIELD(ExposureData, adaptationRate),
+				FIELD(ExposureData, keyValue),
+				FIELD(ExposureData, exposureCompensation),
+				FIELD(ExposureData, pixelCount),
+				FIELD(ExposureData, autoExposure),
+				FIELD(ExposureData, tonemapper),
+				FIELD(ExposureData, padding) }, false } };
+	}
+
+#undef FIELD
+}
+
+// --------------------------------------------------------
+// Checks each layout against HLSL's cbuffer packing, member by
+// member: anything of 16 bytes or more (matrices, arrays, float4s)
+// starts a register, smaller members never straddle one, and every
+// byte is a named member - so the C++ struct has no padding the
+// compiler added on its own, and each struct fills whole registers.
+// Also checks the ring sizes, since every upload is rounded up to
+// ConstantRing::Alignment.
+// --------------------------------------------------------
+bool BufferStructsTest()
+{
+	const size_t RegisterSize = 16;
+	int failures = 0;
+	auto check = [&](bool condition, const char* layout, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s %s\n", layout, what);
+			failures++;
+		}
+	};
+
+	size_t perEntityBytes = 0;
+	for (const Layout& layout : GetLayouts())
+	{
+		size_t end = 0;
+		bool contiguous = true;
+		bool packed = true;
+		for (const Field& field : layout.Fields)
+		{
+			contiguous = contiguous && field.Offset == end;
+			end = field.Offset + field.Size;
+
+			if (field.Size >= RegisterSize)
+				packed = packed && field.Offset % RegisterSize == 0;
+			else
+				packed = packed && field.Offset / RegisterSize == (end - 1) / RegisterSize;
+			if (!packed)
+			{
+				printf("  %s::%s straddles a register\n", layout.Name, field.Name);
+				break;
+			}
+		}
+
+		check(contiguous && end == layout.Size, layout.Name, "has no padding of its own");
+		check(packed, layout.Name, "packs like HLSL");
+		check(layout.Size % RegisterSize == 0, layout.Name, "fills whole registers");
+		size_t ringBytes = ConstantRing::AlignedSize((unsigned int)layout.Size);
+		check(ringBytes % ConstantRing::Alignment == 0 && ringBytes >= layout.Size && ringBytes - layout.Size < ConstantRing::Alignment, layout.Name, "rounds up to whole ring slots");
+		printf("  %-18s %4d bytes, %2d registers, %4d bytes in the ring\n",
+			layout.Name, (int)layout.Size, (int)(layout.Size / RegisterSize), (int)ringBytes);
+
+		if (layout.PerEntity)
+			perEntityBytes += ringBytes;
+	}
+
+	// The split is what keeps per entity uploads small - the per
+	// frame data must never end up in them
+	check(perEntityBytes == 2 * ConstantRing::Alignment, "Per entity data", "is one ring slot for each of b1 and b2");
+
+	bool passed = failures == 0;
+	printf("Constant buffer layout test: %s\n  %d bytes uploaded per entity at most\n\n", passed ? "passed" : "FAILED", (int)perEntityBytes);
+	return passed;
+}
@@ -1,30 +1,38 @@
 #pragma once
 #include <DirectXMath.h>
+#include <cstddef>
+#include "Blur.h"
 #include "Lights.h"
-struct VertexShaderData
+#include "ShadowCascades.h"
+
+// --------------------------------------------------------
+// Constant buffer layouts, split by how often they change:
+//  - b0: per frame (camera, lights, fog, shadow cascades, light
+//    clusters) - the lights themselves are in a structured buffer
+//  - b1: per material, only re-uploaded when the material changes
+//  - b2: per object
+//
+// Each must match its cbuffer in VertexShader.hlsl/PixelShader.hlsl
+// byte for byte.  HLSL packs members into 16 byte registers and never
+// lets one straddle two, so the offsets are checked below - a field
+// added in the wrong place fails to compile instead of reading junk.
+// --------------------------------------------------------
+
+// b0, vertex shader
+struct PerFrameVSData
 {
-	DirectX::XMFLOAT4X4 world;
-	DirectX::XMFLOAT4X4 worldInvTranspose;
-	DirectX::XMFLOAT4X4 projection;
 	DirectX::XMFLOAT4X4 view;
-	DirectX::XMFLOAT4X4 lightView;
-	DirectX::XMFLOAT4X4 lightProj;
+	DirectX::XMFLOAT4X4 projection;
 };
 
-struct PixelShaderData
+// b0, pixel shader
+struct PerFramePSData
 {
-	Light lights[5];
-
-	int lightCount;
+	int directionalLightCount; // First in the light buffer, shaded everywhere
 	DirectX::XMFLOAT3 ambientLight;
 
-	DirectX::XMFLOAT4 colorTint;
-
-	float roughness;
 	DirectX::XMFLOAT3 cameraPos;
-
-	DirectX::XMFLOAT2 uvScale;
-	DirectX::XMFLOAT2 uvOffset;
+	float farClipDistance;
 
 	int fogType;
 	DirectX::XMFLOAT3 fogColor;
@@ -34,7 +42,118 @@ struct PixelShaderData
 	int heightBasedFog;
 	float fogVerticalDensity;
 	float fogHeight;
+	DirectX::XMFLOAT2 padding;
 
-	float farClipDistance;
+	// Shadow cascades - the pixel's view depth (along cameraForward)
+	// picks the first one whose split reaches past it
+	DirectX::XMFLOAT4X4 shadowViewProjections[ShadowCascades::MaxCascades];
+	DirectX::XMFLOAT4 cascadeSplits; // Far depth of each
+	DirectX::XMFLOAT3 cameraForward;
+	int cascadeCount;
+
+	// Light clusters (see LightClusters.h) - a pixel's tile is its
+	// position times clusterTileScale, its slice
+	// log(depth) * clusterSliceScale + clusterSliceBias
+	int clusterTilesX;
+	int clusterTilesY;
+	int clusterSlices;
+	float clusterSliceScale;
+	DirectX::XMFLOAT2 clusterTileScale;
+	float clusterSliceBias;
+	int shadowedLight; // Index of the light the shadow maps belong to, -1 if none
 };
 
+// b1, pixel shader
+struct PerMaterialPSData
+{
+	DirectX::XMFLOAT4 colorTint;
+
+	DirectX::XMFLOAT2 uvScale;
+	DirectX::XMFLOAT2 uvOffset;
+
+	float roughness;
+	DirectX::XMFLOAT3 padding;
+};
+
+// b2, vertex shader
+struct PerObjectVSData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+};
+
+// b0, BlurPS.hlsl - one axis of a BlurKernel
+struct BlurPSData
+{
+	DirectX::XMFLOAT2 texelStep;
+	int tapCount;
+	float centerWeight;
+	DirectX::XMFLOAT4 taps[Blur::MaxTaps]; // x = offset, y = weight
+};
+
+// b0, Exposure.hlsli - the histogram and average luminance compute
+// shaders and TonemapPS
+struct ExposureData
+{
+	int inputWidth;
+	int inputHeight;
+	float minLogLuminance;
+	float logLuminanceRange;
+
+	float timeDelta;
+	float adaptationRate;
+	float keyValue;
+	float exposureCompensation; // Stops
+
+	int pixelCount;
+	int autoExposure;
+	int tonemapper;
+	float padding;
+};
+
+static_assert(sizeof(Light) == 64, "Light must match the HLSL struct");
+
+static_assert(sizeof(PerFrameVSData) == 128, "PerFrameVSData size");
+static_assert(offsetof(PerFrameVSData, projection) == 64, "PerFrameVSData layout");
+
+static_assert(ShadowCascades::MaxCascades == 4, "cascadeSplits holds one split per cascade");
+static_assert(sizeof(PerFramePSData) == 400, "PerFramePSData size");
+static_assert(offsetof(PerFramePSData, ambientLight) == 4, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, cameraPos) == 16, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, farClipDistance) == 28, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, fogType) == 32, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, fogColor) == 36, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, fogStartDist) == 48, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, heightBasedFog) == 60, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, fogVerticalDensity) == 64, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, fogHeight) == 68, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, shadowViewProjections) == 80, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, cascadeSplits) == 336, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, cameraForward) == 352, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, cascadeCount) == 364, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, clusterTilesX) == 368, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, clusterSliceScale) == 380, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, clusterTileScale) == 384, "PerFramePSData layout");
+static_assert(offsetof(PerFramePSData, clusterSliceBias) == 392, "PerFramePSData layout");
+
+static_assert(Blur::MaxTaps == 32, "BlurPS.hlsl holds 32 taps");
+static_assert(sizeof(BlurPSData) == 528, "BlurPSData size");
+static_assert(offsetof(BlurPSData, taps) == 16, "BlurPSData layout");
+
+static_assert(sizeof(ExposureData) == 48, "ExposureData size");
+static_assert(offsetof(ExposureData, timeDelta) == 16, "ExposureData layout");
+static_assert(offsetof(ExposureData, pixelCount) == 32, "ExposureData layout");
+static_assert(offsetof(PerFramePSData, shadowedLight) == 396, "PerFramePSData layout");
+
+static_assert(sizeof(PerMaterialPSData) == 48, "PerMaterialPSData size");
+static_assert(offsetof(PerMaterialPSData, uvScale) == 16, "PerMaterialPSData layout");
+static_assert(offsetof(PerMaterialPSData, uvOffset) == 24, "PerMaterialPSData layout");
+static_assert(offsetof(PerMaterialPSData, roughness) == 32, "PerMaterialPSData layout");
+
+static_assert(sizeof(PerObjectVSData) == 128, "PerObjectVSData size");
+static_assert(offsetof(PerObjectVSData, worldInvTranspose) == 64, "PerObjectVSData layout");
+
+// Checks every layout above against HLSL's packing rules at run
+// time, member by member, and prints each one's size in registers
+// and in the constant ring.  Returns whether they passed.
+bool BufferStructsTest();
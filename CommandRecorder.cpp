@@ -0,0 +1,270 @@
+#include "CommandRecorder.h"
+#include <cstdio>
+#include <random>
+#include <thread>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// State an item in the test was added with
+	struct TestItem
+	{
+		uint32_t Shader;
+		uint32_t Material;
+		uint32_t Mesh;
+	};
+
+	// One draw as it reached the "GPU" - firstInstance is -1 when
+	// not instanced
+	struct TestDraw
+	{
+		int Item;
+		int FirstInstance;
+		int InstanceCount;
+
+		bool operator==(const TestDraw& other) const
+		{
+			return Item == other.Item && FirstInstance == other.FirstInstance && InstanceCount == other.InstanceCount;
+		}
+	};
+
+	// Stands in for a deferred context - starts blank every Begin(),
+	// keeps its draws until Execute() appends them to the output,
+	// and counts draws that would use the wrong state.  Material
+	// binds read per material data the way the game does.
+	class MockRecorder : public CommandRecorder
+	{
+	public:
+		const std::vector<TestItem>& items;
+		const std::vector<int>& materialData;
+		std::vector<TestDraw>* output;
+		std::thread::id submitter;
+
+		int shader = -1;
+		int material = -1;
+		int mesh = -1;
+		int boundMaterialData = 0;
+		std::vector<TestDraw> recorded;
+		int wrongDraws = 0;
+		int wrongThreads = 0;
+
+		MockRecorder(const std::vector<TestItem>& items, const std::vector<int>& materialData, std::vector<TestDraw>* output)
+			: items(items), materialData(materialData), output(output), submitter(std::this_thread::get_id())
+		{
+		}
+
+		void Begin() override
+		{
+			shader = material = mesh = -1;
+			boundMaterialData = 0;
+			recorded.clear();
+		}
+
+		void Finish() override {}
+
+		void Execute() override
+		{
+			if (std::this_thread::get_id() != submitter)
+				wrongThreads++;
+			output->insert(output->end(), recorded.begin(), recorded.end());
+			recorded.clear();
+		}
+
+		void BindShaders(int item) override { shader = (int)items[item].Shader; }
+
+		void BindMaterial(int item) override
+		{
+			material = (int)items[item].Material;
+			boundMaterialData = materialData[items[item].Material];
+		}
+
+		void BindMesh(int item) override { mesh = (int)items[item].Mesh; }
+
+		void Draw(int item) override
+		{
+			Check(item);
+			recorded.push_back({ item, -1, 1 });
+		}
+
+		void DrawInstanced(int item, int firstInstance, int instanceCount) override
+		{
+			Check(item);
+			recorded.push_back({ item, firstInstance, instanceCount });
+		}
+
+		void Check(int item)
+		{
+			const TestItem& expected = items[item];
+			if (shader != (int)expected.Shader || material != (int)expected.Material || mesh != (int)expected.Mesh ||
+				boundMaterialData == 0 || boundMaterialData != materialData[expected.Material])
+				wrongDraws++;
+		}
+	};
+}
+
+std::vector<int> CommandRecording::Split(RenderQueue& queue, int chunkCount, int minPerChunk)
+{
+	int count = queue.GetCount();
+	if (minPerChunk < 1)
+		minPerChunk = 1;
+	if (chunkCount > count / minPerChunk)
+		chunkCount = count / minPerChunk;
+	if (chunkCount < 1)
+		chunkCount = 1;
+
+	std::vector<int> bounds;
+	bounds.push_back(0);
+	for (int c = 1; c < chunkCount; c++)
+	{
+		int split = (int)((long long)count * c / chunkCount);
+		if (split <= bounds.back())
+			continue;
+
+		while (split < count && RenderKey::State(queue.GetKey(split)) == RenderKey::State(queue.GetKey(split - 1)))
+			split++;
+		if (split < count)
+			bounds.push_back(split);
+	}
+	bounds.push_back(count);
+	return bounds;
+}
+
+// --------------------------------------------------------
+// The chunks only read the queue, and each has its own recorder,
+// so they're free to record at the same time
+// --------------------------------------------------------
+RenderQueueStats CommandRecording::RecordParallel(
+	RenderQueue& queue,
+	bool instanced,
+	CommandRecorder* const* recorders,
+	int recorderCount,
+	int minPerChunk,
+	JobSystem& jobs)
+{
+	std::vector<int> bounds = Split(queue, recorderCount, minPerChunk);
+	int chunkCount = (int)bounds.size() - 1;
+
+	std::vector<RenderQueueStats> chunkStats(chunkCount);
+	JobCounter recorded;
+	for (int c = 0; c < chunkCount; c++)
+	{
+		jobs.Run([&, c] {
+			recorders[c]->Begin();
+			chunkStats[c] = queue.SubmitRange(*recorders[c], instanced, bounds[c], bounds[c + 1]);
+			recorders[c]->Finish();
+		}, &recorded);
+	}
+	jobs.Wait(recorded);
+
+	RenderQueueStats total = {};
+	for (int c = 0; c < chunkCount; c++)
+	{
+		recorders[c]->Execute();
+		total.Draws += chunkStats[c].Draws;
+		total.Instances += chunkStats[c].Instances;
+		total.ShaderChanges += chunkStats[c].ShaderChanges;
+		total.MaterialChanges += chunkStats[c].MaterialChanges;
+		total.MeshChanges += chunkStats[c].MeshChanges;
+	}
+	return total;
+}
+
+bool CommandRecording::Test()
+{
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	JobSystem jobs(3);
+	std::mt19937 random(1234);
+	int queuesChecked = 0;
+	int chunksRecorded = 0;
+	int chunksMidMaterial = 0;
+	for (int round = 0; round < 300; round++)
+	{
+		// Some queues like the main pass, some like a shadow pass
+		// (one material, nothing but meshes), and some tiny
+		int count = round < 10 ? round : (int)(random() % 3000);
+		int materials = round % 4 == 0 ? 1 : 1 + random() % 8;
+		int meshes = 1 + random() % 12;
+		const int minPerChunkChoices[] = { 1, 16, 128 };
+		int minPerChunk = minPerChunkChoices[random() % 3];
+		int recorderCount = 1 + random() % 8;
+		bool instanced = random() % 2 == 0;
+
+		RenderQueue queue;
+		std::vector<TestItem> items(count);
+		for (int i = 0; i < count; i++)
+		{
+			uint32_t material = random() % materials;
+			items[i] = { material % 2, material, (uint32_t)(random() % meshes) };
+			queue.Add(RenderQueue::Opaque, items[i].Shader, items[i].Material, items[i].Mesh, (random() % 16) / 15.0f, i);
+		}
+		queue.Sort();
+
+		// Material data written once per material in view, as the
+		// game does - anything else is left as garbage (0)
+		std::vector<int> materialData(materials, 0);
+		for (const TestItem& item : items)
+			materialData[item.Material] = 100 + item.Material;
+
+		// Where chunks start - at most one per recorder, never inside
+		// a run of the same state, and big enough to be worth it
+		std::vector<int> bounds = Split(queue, recorderCount, minPerChunk);
+		bool boundsValid = bounds.size() >= 2 && bounds.front() == 0 && bounds.back() == count && (int)bounds.size() - 1 <= recorderCount;
+		for (size_t b = 1; boundsValid && b + 1 < bounds.size(); b++)
+		{
+			boundsValid = bounds[b] > bounds[b - 1] &&
+				RenderKey::State(queue.GetKey(bounds[b])) != RenderKey::State(queue.GetKey(bounds[b] - 1));
+			chunksMidMaterial += RenderKey::Material(queue.GetKey(bounds[b])) == RenderKey::Material(queue.GetKey(bounds[b] - 1));
+		}
+		check(boundsValid, "chunks cover the queue without splitting a run of one state");
+
+		// The same queue on one recorder, then in parallel
+		std::vector<TestDraw> serialDraws;
+		MockRecorder serial(items, materialData, &serialDraws);
+		serial.Begin();
+		RenderQueueStats serialStats = queue.Submit(serial, instanced);
+		serial.Execute();
+
+		std::vector<TestDraw> parallelDraws;
+		std::vector<MockRecorder> recorders;
+		std::vector<CommandRecorder*> recorderPointers;
+		recorders.reserve(recorderCount);
+		for (int r = 0; r < recorderCount; r++)
+		{
+			recorders.emplace_back(items, materialData, &parallelDraws);
+			recorderPointers.push_back(&recorders.back());
+		}
+		RenderQueueStats parallelStats = RecordParallel(queue, instanced, recorderPointers.data(), recorderCount, minPerChunk, jobs);
+
+		int wrongDraws = serial.wrongDraws;
+		int wrongThreads = 0;
+		for (const MockRecorder& recorder : recorders)
+		{
+			wrongDraws += recorder.wrongDraws;
+			wrongThreads += recorder.wrongThreads;
+		}
+		check(wrongDraws == 0, "every chunk draws with its own items' state and material data");
+		check(wrongThreads == 0, "chunks are executed on the submitting thread");
+		check(parallelDraws == serialDraws, "merged chunks draw the same as one recorder, in order");
+		check(parallelStats.Draws == serialStats.Draws && parallelStats.Instances == serialStats.Instances && parallelStats.Instances == count,
+			"chunk stats add up to the whole queue");
+		check(parallelStats.MaterialChanges - serialStats.MaterialChanges <= (int)bounds.size() - 2, "chunks cost at most one extra bind each");
+
+		queuesChecked++;
+		chunksRecorded += (int)bounds.size() - 1;
+	}
+	check(chunksMidMaterial > 0, "some chunks start inside a material's run");
+
+	bool passed = failures == 0;
+	printf("Command recording test: %s\n", passed ? "passed" : "FAILED");
+	printf("  %d queues, %d chunks recorded (%d starting inside a material's run)\n\n", queuesChecked, chunksRecorded, chunksMidMaterial);
+	return passed;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include "JobSystem.h"
+#include "RenderQueue.h"
+
+// --------------------------------------------------------
+// A RenderCommandSink that records its commands to be played back
+// later, so that separate parts of a frame can be recorded at the
+// same time on different threads and then run in order.
+//
+// A recording starts from nothing - Begin() must set up whatever
+// the pass needs before the first draw (targets, viewport, per
+// frame constants, ...).  The queue always binds the full state for
+// the first draw of each chunk, and a chunk can start anywhere in a
+// run of one material - so whatever a bind looks up (material
+// constants, say) has to be there for every item, not just the
+// first of each run.
+//
+// The game records on D3D11 deferred contexts; a mock that just
+// stores its commands can check the merged stream without D3D.
+// --------------------------------------------------------
+class CommandRecorder : public RenderCommandSink
+{
+public:
+	virtual void Begin() = 0;	// Worker thread, before the chunk's commands
+	virtual void Finish() = 0;	// Worker thread, after them
+	virtual void Execute() = 0;	// Submitting thread, in chunk order
+};
+
+namespace CommandRecording
+{
+	// Where to split a sorted queue into at most chunkCount chunks of
+	// at least minPerChunk draws each - chunk i is [result[i], result[i + 1]).
+	// Boundaries are moved past any run of same-state entries, so
+	// splitting never breaks up an instanced draw.
+	std::vector<int> Split(RenderQueue& queue, int chunkCount, int minPerChunk);
+
+	// Records each chunk on its own recorder, as jobs, then executes
+	// them in order on this thread.  Uses as many recorders as there
+	// are chunks (see Split()); the stats are the sum over chunks.
+	RenderQueueStats RecordParallel(
+		RenderQueue& queue,
+		bool instanced,
+		CommandRecorder* const* recorders,
+		int recorderCount,
+		int minPerChunk,
+		JobSystem& jobs);
+
+	// Records random queues in parallel on mock recorders that start
+	// blank and track what's bound, checking each chunk draws with
+	// its own items' state and material data, that the merged stream
+	// matches submitting on one thread and that chunks never split
+	// an instanced draw.  Prints the results and returns whether they
+	// passed.
+	bool Test();
+}
@@ -0,0 +1,306 @@
+#include "ConstantRing.h"
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+ConstantRing::ConstantRing(unsigned int sizeInBytes) :
+	size(sizeInBytes / Alignment * Alignment),
+	head(0),
+	batchEnd(0),
+	batchStart(0),
+	batchOpen(false),
+	discardNext(true),
+	frame(0),
+	discards(0),
+	grows(0),
+	recordingBytes(0),
+	frameBytes(0)
+{
+}
+
+unsigned int ConstantRing::AlignedSize(unsigned int bytes)
+{
+	return (bytes + Alignment - 1) / Alignment * Alignment;
+}
+
+bool ConstantRing::OverlapsInFlight(unsigned int start, unsigned int end)
+{
+	for (const Region& region : inFlight)
+	{
+		if (region.start < end && start < region.end)
+			return true;
+	}
+	return false;
+}
+
+unsigned int ConstantRing::GrowSizeFor(unsigned int reserveBytes)
+{
+	unsigned int reserve = AlignedSize(reserveBytes);
+	if (reserve <= size)
+		return 0;
+
+	unsigned int grown = size > 0 ? size : Alignment;
+	while (grown < reserve)
+		grown *= 2;
+	return grown;
+}
+
+void ConstantRing::Grow(unsigned int sizeInBytes)
+{
+	if (batchOpen)
+		throw std::logic_error("ConstantRing can't grow with a batch open");
+
+	size = sizeInBytes / Alignment * Alignment;
+	head = 0;
+	inFlight.clear();
+	discardNext = true;
+	grows++;
+}
+
+// --------------------------------------------------------
+// Picks where the batch goes - right after the last one, or back
+// at the start when it won't fit before the end.  If that space
+// is still in flight, the buffer has to be discarded: D3D hands
+// back fresh memory and the GPU keeps reading the old copy, so
+// nothing in flight is stomped on.
+// --------------------------------------------------------
+ConstantRing::MapMode ConstantRing::BeginBatch(unsigned int reserveBytes)
+{
+	if (batchOpen)
+		throw std::logic_error("ConstantRing batch is already open");
+
+	unsigned int reserve = AlignedSize(reserveBytes);
+	if (reserve > size)
+		throw std::invalid_argument("Constant data batch is larger than the whole ring");
+
+	MapMode mode = MapMode::NoOverwrite;
+	unsigned int start = head + reserve > size ? 0 : head;
+	if (discardNext || OverlapsInFlight(start, start + reserve))
+	{
+		// Everything in flight now belongs to the discarded copy
+		mode = MapMode::Discard;
+		inFlight.clear();
+		start = 0;
+		discardNext = false;
+		discards++;
+	}
+
+	head = start;
+	batchStart = start;
+	batchEnd = start + reserve;
+	batchOpen = true;
+	return mode;
+}
+
+unsigned int ConstantRing::Allocate(unsigned int bytes)
+{
+	unsigned int aligned = AlignedSize(bytes);
+	if (!batchOpen || head + aligned > batchEnd)
+		throw std::logic_error("Constant data allocated outside of its batch's reservation");
+
+	unsigned int offset = head;
+	head += aligned;
+	return offset;
+}
+
+// Whatever was actually allocated is now in flight - the
+// unused end of the reservation is free again
+void ConstantRing::EndBatch()
+{
+	if (!batchOpen)
+		throw std::logic_error("ConstantRing batch ended without being begun");
+	batchOpen = false;
+
+	if (head == batchStart)
+		return;
+
+	recordingBytes += head - batchStart;
+	if (!inFlight.empty() && inFlight.back().frame == frame && inFlight.back().end == batchStart)
+		inFlight.back().end = head;
+	else
+		inFlight.push_back({ frame, batchStart, head });
+}
+
+// Returns the number of the frame that just ended
+uint64_t ConstantRing::EndFrame()
+{
+	frameBytes = recordingBytes;
+	recordingBytes = 0;
+	return frame++;
+}
+
+void ConstantRing::FrameCompleted(uint64_t completedFrame)
+{
+	// Regions are always added in frame order
+	while (!inFlight.empty() && inFlight.front().frame <= completedFrame)
+		inFlight.pop_front();
+}
+
+unsigned int ConstantRing::GetSize()
+{
+	return size;
+}
+
+unsigned int ConstantRing::GetBytesInFlight()
+{
+	unsigned int bytes = 0;
+	for (const Region& region : inFlight)
+		bytes += region.end - region.start;
+	return bytes;
+}
+
+unsigned int ConstantRing::GetFrameBytes()
+{
+	return frameBytes;
+}
+
+int ConstantRing::GetDiscards()
+{
+	return discards;
+}
+
+int ConstantRing::GetGrows()
+{
+	return grows;
+}
+
+// --------------------------------------------------------
+// Random batches of random allocations, with now and then a batch
+// bigger than the ring starts out.  Every allocation is tagged, and the
+// pretend GPU checks each tag is still there when the frame's fence
+// reports done - the last moment it could still be reading it.
+// A Discard hands the CPU a fresh copy of the buffer while the GPU
+// keeps the one it had, which is what D3D does.
+// --------------------------------------------------------
+bool ConstantRing::Test()
+{
+	const int frames = 3000;
+	const unsigned int startSlots = 64;
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	// Batches that can never fit are refused until the ring grows
+	{
+		ConstantRing ring(startSlots * Alignment);
+		bool refused = false;
+		try { ring.BeginBatch((startSlots + 1) * Alignment); }
+		catch (const std::invalid_argument&) { refused = true; }
+		check(refused, "oversized batches are refused");
+		check(ring.GrowSizeFor(startSlots * Alignment) == 0, "batches that fit don't grow the ring");
+		check(ring.GrowSizeFor((startSlots + 1) * Alignment) == startSlots * Alignment * 2, "growing doubles the ring");
+		check(ring.GrowSizeFor((startSlots * 5) * Alignment) == startSlots * Alignment * 8, "growing doubles until the batch fits");
+	}
+
+	// One copy of the buffer per Discard, as slots of tags
+	struct Read
+	{
+		uint64_t Frame;
+		size_t Copy;
+		unsigned int Slot;
+		uint32_t Tag;
+	};
+	ConstantRing ring(startSlots * Alignment);
+	std::vector<std::vector<uint32_t>> copies;
+	std::deque<Read> pending;
+	uint32_t nextTag = 1;
+	int stomped = 0;
+	int misplaced = 0;
+	int reads = 0;
+
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<int> batchCount(1, 5);
+	std::uniform_int_distribution<int> allocationCount(1, 10);
+	std::uniform_int_distribution<unsigned int> allocationSize(1, 700);
+	std::uniform_int_distribution<int> fenceLag(0, 3);
+	std::uniform_int_distribution<int> oversized(0, 299);
+	for (int f = 0; f < frames; f++)
+	{
+		for (int b = batchCount(random); b > 0; b--)
+		{
+			std::vector<unsigned int> sizes(oversized(random) == 0 ? startSlots + 3 : allocationCount(random));
+			unsigned int reserve = 0;
+			for (unsigned int& size : sizes)
+			{
+				size = allocationSize(random);
+				reserve += AlignedSize(size);
+			}
+
+			// What Graphics does before every batch
+			unsigned int grown = ring.GrowSizeFor(reserve);
+			if (grown)
+				ring.Grow(grown);
+
+			if (ring.BeginBatch(reserve) == MapMode::Discard)
+				copies.emplace_back(ring.GetSize() / Alignment, 0);
+			for (unsigned int size : sizes)
+			{
+				unsigned int offset = ring.Allocate(size);
+				if (offset % Alignment != 0 || offset + AlignedSize(size) > ring.GetSize())
+				{
+					misplaced++;
+					continue;
+				}
+				for (unsigned int slot = offset / Alignment; slot < (offset + AlignedSize(size)) / Alignment; slot++)
+				{
+					copies.back()[slot] = nextTag;
+					pending.push_back({ (uint64_t)f, copies.size() - 1, slot, nextTag });
+				}
+				nextTag++;
+			}
+			ring.EndBatch();
+		}
+
+		// The GPU finishes a few frames behind, and its fences
+		// don't always report in order
+		uint64_t frame = ring.EndFrame();
+		uint64_t lag = (uint64_t)fenceLag(random);
+		if (frame < lag)
+			continue;
+
+		uint64_t completed = frame - lag;
+		while (!pending.empty() && pending.front().Frame <= completed)
+		{
+			const Read& read = pending.front();
+			if (copies[read.Copy][read.Slot] != read.Tag)
+				stomped++;
+			reads++;
+			pending.pop_front();
+		}
+		ring.FrameCompleted(completed);
+	}
+
+	check(misplaced == 0, "allocations are aligned and inside the ring");
+	check(stomped == 0, "nothing is overwritten before the GPU is done with it");
+	check(ring.GetGrows() > 0 && ring.GetSize() % (startSlots * Alignment) == 0, "oversized batches grow the ring");
+	int randomDiscards = ring.GetDiscards();
+	int randomGrows = ring.GetGrows();
+	unsigned int randomSize = ring.GetSize();
+
+	// A steady load that fits a few frames over only discards once,
+	// on the very first map
+	ConstantRing steady(startSlots * Alignment);
+	for (int f = 0; f < 500; f++)
+	{
+		steady.BeginBatch(8 * Alignment);
+		for (int i = 0; i < 8; i++)
+			steady.Allocate(Alignment);
+		steady.EndBatch();
+		uint64_t frame = steady.EndFrame();
+		if (frame >= 2)
+			steady.FrameCompleted(frame - 2);
+	}
+	check(steady.GetDiscards() == 1, "a steady load wraps without discarding");
+
+	bool passed = failures == 0;
+	printf("Constant ring test: %s\n  %d frames, %d slot reads checked, %d discards, grew %d times to %u KB\n\n",
+		passed ? "passed" : "FAILED", frames, reads, randomDiscards, randomGrows, randomSize / 1024);
+	return passed;
+}
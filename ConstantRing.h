@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+
+// --------------------------------------------------------
+// Bookkeeping for a ring buffer of constant data that the CPU
+// writes and the GPU reads a frame or two later.
+//
+// Nothing here touches D3D - it only hands out offsets and says
+// how the backing buffer has to be mapped, so it can be driven
+// (and checked) against plain CPU memory.
+//
+// Usage, per batch of uploads:
+//   BeginBatch(bytes)  - how to map: NoOverwrite, or Discard when
+//                        the space needed may still be in use
+//   Allocate(size)     - offsets within the reserved space
+//   EndBatch()         - unmap
+// and once a frame:
+//   EndFrame()         - returns the frame's number to fence on
+//   FrameCompleted(n)  - the GPU is done with frame n, so the
+//                        regions it used can be overwritten
+//
+// A batch never wraps part way through, so everything written
+// under one map lands in one contiguous block.  A batch bigger
+// than the whole ring needs a bigger buffer first - see
+// GrowSizeFor() and Grow().
+// --------------------------------------------------------
+class ConstantRing
+{
+private:
+	// Bytes written by one frame, which the GPU may still be reading
+	struct Region
+	{
+		uint64_t frame;
+		unsigned int start;
+		unsigned int end;
+	};
+
+	unsigned int size;
+	unsigned int head;			// Next free byte
+	unsigned int batchEnd;		// End of the open batch's reservation
+	unsigned int batchStart;
+	bool batchOpen;
+	bool discardNext;			// Nothing has been mapped yet
+	uint64_t frame;				// Frame currently being recorded
+	std::deque<Region> inFlight;
+
+	// Stats
+	int discards;
+	int grows;
+	unsigned int recordingBytes;	// Written so far this frame
+	unsigned int frameBytes;		// Written by the last whole frame
+
+	bool OverlapsInFlight(unsigned int start, unsigned int end);
+
+public:
+	// D3D needs constant buffer offsets in multiples of 256 bytes
+	static const unsigned int Alignment = 256;
+
+	enum class MapMode
+	{
+		NoOverwrite,	// Only untouched space is written
+		Discard			// Everything else may be in flight - start fresh
+	};
+
+	explicit ConstantRing(unsigned int sizeInBytes = 0);
+
+	static unsigned int AlignedSize(unsigned int bytes);
+
+	// Size to grow to (doubling) so a batch of reserveBytes fits,
+	// or 0 if it already does
+	unsigned int GrowSizeFor(unsigned int reserveBytes);
+
+	// Moves to a new, bigger buffer.  Nothing in the old one is in
+	// flight as far as the new one is concerned, but frame numbers
+	// carry on so fences already issued still line up.
+	void Grow(unsigned int sizeInBytes);
+
+	// Reserves room for a batch of allocations totalling at most
+	// reserveBytes (after alignment).  Throws if it can never fit.
+	MapMode BeginBatch(unsigned int reserveBytes);
+	unsigned int Allocate(unsigned int bytes);
+	void EndBatch();
+
+	uint64_t EndFrame();
+	void FrameCompleted(uint64_t completedFrame);
+
+	unsigned int GetSize();
+	unsigned int GetBytesInFlight();
+	unsigned int GetFrameBytes(); // Used by the previous frame
+	int GetDiscards();
+	int GetGrows();
+
+	// Drives a ring against a simulated GPU that reads each frame's
+	// data a few frames late, checking nothing is overwritten before
+	// it's read, and that oversized batches grow the ring.  Prints
+	// the results and returns whether they passed.
+	static bool Test();
+};
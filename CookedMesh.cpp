@@ -0,0 +1,104 @@
+#include "CookedMesh.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Size and timestamp used to decide if a cook is stale
+	bool GetSourceStamp(const std::wstring& sourceFile, uint64_t& size, int64_t& writeTime)
+	{
+		std::error_code error;
+		size = (uint64_t)std::filesystem::file_size(sourceFile, error);
+		if (error) return false;
+
+		auto time = std::filesystem::last_write_time(sourceFile, error);
+		if (error) return false;
+
+		writeTime = (int64_t)time.time_since_epoch().count();
+		return true;
+	}
+}
+
+// --------------------------------------------------------
+// Writes the mesh to a temporary file and renames it into
+// place, so a crash mid-write never leaves a truncated cook
+// that looks valid
+// --------------------------------------------------------
+bool CookedMesh::Write(
+	const std::wstring& cookedFile,
+	const std::wstring& sourceFile,
+	const Vertex* vertices, uint32_t vertexCount,
+	const unsigned int* indices, uint32_t indexCount)
+{
+	CookedMeshHeader header = {};
+	memcpy(header.Magic, "MESH", 4);
+	header.Version = Version;
+	header.VertexStride = sizeof(Vertex);
+	header.VertexCount = vertexCount;
+	header.IndexCount = indexCount;
+	if (!GetSourceStamp(sourceFile, header.SourceSize, header.SourceWriteTime))
+		return false;
+
+	// Local space bounds, so they never need recalculating at load
+	header.Bounds = Culling::ComputeBounds(vertices, (int)vertexCount);
+
+	std::filesystem::path tempFile = std::filesystem::path(cookedFile).concat(L".tmp");
+	{
+		std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			return false;
+
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)vertices, sizeof(Vertex) * vertexCount);
+		out.write((const char*)indices, sizeof(unsigned int) * indexCount);
+		if (!out.good())
+			return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempFile, cookedFile, error);
+	return !error;
+}
+
+const CookedMeshHeader* CookedMesh::Validate(MappedFile& cooked, const std::wstring& sourceFile)
+{
+	if (!cooked.IsOpen() || cooked.Size() < sizeof(CookedMeshHeader))
+		return nullptr;
+
+	const CookedMeshHeader* header = (const CookedMeshHeader*)cooked.Data();
+	if (memcmp(header->Magic, "MESH", 4) != 0 ||
+		header->Version != Version ||
+		header->VertexStride != sizeof(Vertex))
+		return nullptr;
+
+	// The streams must fit exactly
+	uint64_t expectedSize = sizeof(CookedMeshHeader) +
+		(uint64_t)header->VertexCount * sizeof(Vertex) +
+		(uint64_t)header->IndexCount * sizeof(unsigned int);
+	if (cooked.Size() != expectedSize)
+		return nullptr;
+
+	// Source missing means we can't be stale - use what we have
+	uint64_t sourceSize = 0;
+	int64_t sourceWriteTime = 0;
+	if (GetSourceStamp(sourceFile, sourceSize, sourceWriteTime) &&
+		(sourceSize != header->SourceSize || sourceWriteTime != header->SourceWriteTime))
+		return nullptr;
+
+	return header;
+}
+
+const Vertex* CookedMesh::GetVertices(const CookedMeshHeader* header)
+{
+	return (const Vertex*)(header + 1);
+}
+
+const unsigned int* CookedMesh::GetIndices(const CookedMeshHeader* header)
+{
+	return (const unsigned int*)(GetVertices(header) + header->VertexCount);
+}
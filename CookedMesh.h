@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "Culling.h"
+#include "MappedFile.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Binary "cooked" mesh container
+//
+// Layout (all little endian, everything 4 byte aligned):
+//   CookedMeshHeader               - including the culling bounds
+//   Vertex  vertices[vertexCount]  - tangents already calculated
+//   uint32  indices[indexCount]    - already welded and optimized
+//
+// The header records the size and timestamp of the .obj it was
+// cooked from, so a stale file is detected and re-cooked instead
+// of silently loading old geometry.
+// --------------------------------------------------------
+struct CookedMeshHeader
+{
+	char Magic[4];				// "MESH"
+	uint32_t Version;			// Bumped whenever the layout changes
+	uint32_t VertexStride;		// sizeof(Vertex) when cooked
+	uint32_t VertexCount;
+	uint32_t IndexCount;
+	uint32_t Padding;
+	uint64_t SourceSize;		// Size of the source .obj in bytes
+	int64_t SourceWriteTime;	// Last write time of the source .obj
+	MeshBounds Bounds;			// Local space, used as is at load
+};
+
+namespace CookedMesh
+{
+	const uint32_t Version = 3;
+
+	// Writes a cooked file for the given (final) mesh data
+	bool Write(
+		const std::wstring& cookedFile,
+		const std::wstring& sourceFile,
+		const Vertex* vertices, uint32_t vertexCount,
+		const unsigned int* indices, uint32_t indexCount);
+
+	// Returns the header if the mapped file is a valid, up to date
+	// cook of sourceFile, or null if it should be re-cooked
+	const CookedMeshHeader* Validate(MappedFile& cooked, const std::wstring& sourceFile);
+
+	// Streams that directly follow a validated header
+	const Vertex* GetVertices(const CookedMeshHeader* header);
+	const unsigned int* GetIndices(const CookedMeshHeader* header);
+}
@@ -0,0 +1,18 @@
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+Texture2D Pixels : register(t0);
+SamplerState ClampSampler : register(s0);
+
+// --------------------------------------------------------
+// Copies a texture into a target of any size.  Into one half the
+// size, each pixel center sits between four texels, so the one
+// bilinear sample averages them.
+// --------------------------------------------------------
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    return Pixels.Sample(ClampSampler, input.uv);
+}
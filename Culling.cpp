@@ -0,0 +1,223 @@
+#include "Culling.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Normalizes a plane so distances come out in world units
+	XMFLOAT4 MakePlane(float x, float y, float z, float w)
+	{
+		float length = sqrtf(x * x + y * y + z * z);
+		return XMFLOAT4(x / length, y / length, z / length, w / length);
+	}
+}
+
+MeshBounds Culling::ComputeBounds(const Vertex* vertices, int vertexCount)
+{
+	MeshBounds bounds = {};
+	if (vertexCount <= 0)
+		return bounds;
+
+	XMVECTOR min = XMLoadFloat3(&vertices[0].Position);
+	XMVECTOR max = min;
+	for (int i = 1; i < vertexCount; i++)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[i].Position);
+		min = XMVectorMin(min, p);
+		max = XMVectorMax(max, p);
+	}
+
+	XMVECTOR center = XMVectorScale(XMVectorAdd(min, max), 0.5f);
+	XMStoreFloat3(&bounds.Center, center);
+	XMStoreFloat3(&bounds.Extents, XMVectorScale(XMVectorSubtract(max, min), 0.5f));
+
+	// Sphere around the box's center - not the smallest possible,
+	// but it never needs a second pass and is usually close
+	XMVECTOR radiusSq = XMVectorZero();
+	for (int i = 0; i < vertexCount; i++)
+		radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(XMVectorSubtract(XMLoadFloat3(&vertices[i].Position), center)));
+	bounds.Radius = sqrtf(XMVectorGetX(radiusSq));
+	return bounds;
+}
+
+// --------------------------------------------------------
+// Gribb/Hartmann plane extraction.  Points are transformed as
+// row vectors (p * M), so each plane is a combination of the
+// matrix's columns.  D3D clip space: -w <= x,y <= w, 0 <= z <= w.
+// --------------------------------------------------------
+Frustum Culling::ExtractFrustum(const XMFLOAT4X4& viewProjection, bool includeNear)
+{
+	const float(*m)[4] = viewProjection.m;
+	Frustum frustum = {};
+	frustum.Planes[0] = MakePlane(m[0][3] + m[0][0], m[1][3] + m[1][0], m[2][3] + m[2][0], m[3][3] + m[3][0]); // Left
+	frustum.Planes[1] = MakePlane(m[0][3] - m[0][0], m[1][3] - m[1][0], m[2][3] - m[2][0], m[3][3] - m[3][0]); // Right
+	frustum.Planes[2] = MakePlane(m[0][3] + m[0][1], m[1][3] + m[1][1], m[2][3] + m[2][1], m[3][3] + m[3][1]); // Bottom
+	frustum.Planes[3] = MakePlane(m[0][3] - m[0][1], m[1][3] - m[1][1], m[2][3] - m[2][1], m[3][3] - m[3][1]); // Top
+	frustum.Planes[4] = MakePlane(m[0][3] - m[0][2], m[1][3] - m[1][2], m[2][3] - m[2][2], m[3][3] - m[3][2]); // Far
+	frustum.Planes[5] = MakePlane(m[0][2], m[1][2], m[2][2], m[3][2]); // Near
+	frustum.PlaneCount = includeNear ? 6 : 5;
+	return frustum;
+}
+
+void Culling::Resize(CullingBounds& bounds, int count)
+{
+	size_t padded = (size_t)(count + 3) & ~(size_t)3;
+	bounds.Count = count;
+	for (std::vector<float>* component : { &bounds.CenterX, &bounds.CenterY, &bounds.CenterZ, &bounds.ExtentX, &bounds.ExtentY, &bounds.ExtentZ, &bounds.Radius })
+		component->resize(padded, 0.0f);
+}
+
+// --------------------------------------------------------
+// The world box is the box around the transformed local box
+// (Arvo's method), so it's conservative under rotation.  The
+// sphere scales with the largest axis of the transform.
+// --------------------------------------------------------
+void Culling::SetBounds(CullingBounds& bounds, int index, const MeshBounds& local, const XMFLOAT4X4& world)
+{
+	XMFLOAT3 center;
+	XMStoreFloat3(&center, XMVector3Transform(XMLoadFloat3(&local.Center), XMLoadFloat4x4(&world)));
+	bounds.CenterX[index] = center.x;
+	bounds.CenterY[index] = center.y;
+	bounds.CenterZ[index] = center.z;
+
+	const float(*m)[4] = world.m;
+	const XMFLOAT3& e = local.Extents;
+	bounds.ExtentX[index] = fabsf(m[0][0]) * e.x + fabsf(m[1][0]) * e.y + fabsf(m[2][0]) * e.z;
+	bounds.ExtentY[index] = fabsf(m[0][1]) * e.x + fabsf(m[1][1]) * e.y + fabsf(m[2][1]) * e.z;
+	bounds.ExtentZ[index] = fabsf(m[0][2]) * e.x + fabsf(m[1][2]) * e.y + fabsf(m[2][2]) * e.z;
+
+	float scaleSq = 0.0f;
+	for (int row = 0; row < 3; row++)
+		scaleSq = std::max(scaleSq, m[row][0] * m[row][0] + m[row][1] * m[row][1] + m[row][2] * m[row][2]);
+	bounds.Radius[index] = local.Radius * sqrtf(scaleSq);
+}
+
+// --------------------------------------------------------
+// Tests four objects per iteration against every plane.  An
+// object is outside if its center is further behind any one plane
+// than it reaches - using whichever of its box or sphere reaches
+// less, since both are conservative.
+//
+// All math is done with XMVECTORs, which DirectXMath maps to SSE
+// (or plain floats when built with _XM_NO_INTRINSICS_).
+// --------------------------------------------------------
+int Culling::Cull(const Frustum& frustum, const CullingBounds& bounds, std::vector<uint8_t>& visible)
+{
+	visible.resize(bounds.Count);
+
+	// Splat each plane once, up front
+	XMVECTOR planes[6][4];
+	XMVECTOR reaches[6][3];
+	for (int p = 0; p < frustum.PlaneCount; p++)
+	{
+		const XMFLOAT4& plane = frustum.Planes[p];
+		planes[p][0] = XMVectorReplicate(plane.x);
+		planes[p][1] = XMVectorReplicate(plane.y);
+		planes[p][2] = XMVectorReplicate(plane.z);
+		planes[p][3] = XMVectorReplicate(plane.w);
+		reaches[p][0] = XMVectorReplicate(fabsf(plane.x));
+		reaches[p][1] = XMVectorReplicate(fabsf(plane.y));
+		reaches[p][2] = XMVectorReplicate(fabsf(plane.z));
+	}
+
+	int visibleCount = 0;
+	XMVECTOR zero = XMVectorZero();
+	for (int i = 0; i < bounds.Count; i += 4)
+	{
+		XMVECTOR cx = XMLoadFloat4((const XMFLOAT4*)&bounds.CenterX[i]);
+		XMVECTOR cy = XMLoadFloat4((const XMFLOAT4*)&bounds.CenterY[i]);
+		XMVECTOR cz = XMLoadFloat4((const XMFLOAT4*)&bounds.CenterZ[i]);
+		XMVECTOR ex = XMLoadFloat4((const XMFLOAT4*)&bounds.ExtentX[i]);
+		XMVECTOR ey = XMLoadFloat4((const XMFLOAT4*)&bounds.ExtentY[i]);
+		XMVECTOR ez = XMLoadFloat4((const XMFLOAT4*)&bounds.ExtentZ[i]);
+		XMVECTOR radius = XMLoadFloat4((const XMFLOAT4*)&bounds.Radius[i]);
+
+		XMVECTOR outside = XMVectorFalseInt();
+		for (int p = 0; p < frustum.PlaneCount; p++)
+		{
+			XMVECTOR distance = XMVectorMultiplyAdd(cz, planes[p][2], XMVectorMultiplyAdd(cy, planes[p][1], XMVectorMultiplyAdd(cx, planes[p][0], planes[p][3])));
+			XMVECTOR reach = XMVectorMultiplyAdd(ez, reaches[p][2], XMVectorMultiplyAdd(ey, reaches[p][1], XMVectorMultiply(ex, reaches[p][0])));
+			reach = XMVectorMin(reach, radius);
+			outside = XMVectorOrInt(outside, XMVectorLess(XMVectorAdd(distance, reach), zero));
+		}
+
+		uint32_t masks[4];
+		XMStoreInt4(masks, outside);
+		for (int j = 0; j < 4 && i + j < bounds.Count; j++)
+		{
+			visible[i + j] = masks[j] ? 0 : 1;
+			visibleCount += visible[i + j];
+		}
+	}
+	return visibleCount;
+}
+
+// --------------------------------------------------------
+// Scatters unit cubes (randomly scaled and rotated) over a field
+// around a camera at the origin, then times updating their world
+// bounds and culling them.  Best of several runs, so one hiccup
+// doesn't skew the result.
+// --------------------------------------------------------
+void Culling::Benchmark(int objectCount)
+{
+	const int runs = 10;
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> angle(0.0f, XM_2PI);
+	std::uniform_real_distribution<float> scale(0.5f, 4.0f);
+
+	MeshBounds cube = {};
+	cube.Center = XMFLOAT3(0, 0, 0);
+	cube.Extents = XMFLOAT3(0.5f, 0.5f, 0.5f);
+	cube.Radius = sqrtf(0.75f);
+
+	std::vector<XMFLOAT4X4> worlds(objectCount);
+	for (XMFLOAT4X4& world : worlds)
+	{
+		XMMATRIX matrix =
+			XMMatrixScaling(scale(random), scale(random), scale(random)) *
+			XMMatrixRotationRollPitchYaw(angle(random), angle(random), angle(random)) *
+			XMMatrixTranslation(position(random), position(random) * 0.1f, position(random));
+		XMStoreFloat4x4(&world, matrix);
+	}
+
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection,
+		XMMatrixLookToLH(XMVectorSet(0, 0, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)) *
+		XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 1000.0f));
+	Frustum frustum = ExtractFrustum(viewProjection);
+
+	CullingBounds bounds;
+	Resize(bounds, objectCount);
+	std::vector<uint8_t> visible;
+
+	double bestBounds = 1e9;
+	double bestCull = 1e9;
+	int visibleCount = 0;
+	for (int run = 0; run < runs; run++)
+	{
+		auto boundsStart = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < objectCount; i++)
+			SetBounds(bounds, i, cube, worlds[i]);
+
+		auto cullStart = std::chrono::high_resolution_clock::now();
+		visibleCount = Cull(frustum, bounds, visible);
+		auto cullEnd = std::chrono::high_resolution_clock::now();
+
+		bestBounds = std::min(bestBounds, std::chrono::duration<double, std::milli>(cullStart - boundsStart).count());
+		bestCull = std::min(bestCull, std::chrono::duration<double, std::milli>(cullEnd - cullStart).count());
+	}
+
+	printf("Culling benchmark: %d objects, best of %d runs\nWorld bounds: %.3f ms\nFrustum test: %.3f ms (%.2f ns per object)\nVisible: %d, culled: %d\n\n",
+		objectCount, runs,
+		bestBounds,
+		bestCull, bestCull * 1000000.0 / objectCount,
+		visibleCount, objectCount - visibleCount);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Vertex.h"
+
+// Local space bounds of a mesh
+struct MeshBounds
+{
+	DirectX::XMFLOAT3 Center;	// Of the box, and of the sphere
+	DirectX::XMFLOAT3 Extents;	// Half the box's size on each axis
+	float Radius;				// Sphere around Center holding every vertex
+};
+
+// Inward facing planes (xyz = unit normal, w = distance), so a
+// point p is inside when dot(xyz, p) + w >= 0 for every plane
+struct Frustum
+{
+	DirectX::XMFLOAT4 Planes[6]; // Left, right, bottom, top, far, near
+	int PlaneCount;
+};
+
+// --------------------------------------------------------
+// World space bounds for a whole set of objects, one array per
+// component (structure of arrays), so four objects at a time load
+// straight into SIMD registers.  Arrays are padded to a multiple
+// of 4 - the padding is never visible.
+// --------------------------------------------------------
+struct CullingBounds
+{
+	int Count = 0;
+	std::vector<float> CenterX, CenterY, CenterZ;
+	std::vector<float> ExtentX, ExtentY, ExtentZ;
+	std::vector<float> Radius;
+};
+
+namespace Culling
+{
+	// Box and sphere around a set of vertices
+	MeshBounds ComputeBounds(const Vertex* vertices, int vertexCount);
+
+	// Planes of a view * projection (perspective or orthographic).
+	// Leaving out the near plane suits depth clamped (pancaked)
+	// shadow maps, where casters in front of the light still count.
+	Frustum ExtractFrustum(const DirectX::XMFLOAT4X4& viewProjection, bool includeNear = true);
+
+	void Resize(CullingBounds& bounds, int count);
+
+	// Stores the world space bounds of one object
+	void SetBounds(CullingBounds& bounds, int index, const MeshBounds& local, const DirectX::XMFLOAT4X4& world);
+
+	// visible[i] = 1 if object i may be inside the frustum, 0 if it's
+	// definitely outside.  Returns the number visible.
+	int Cull(const Frustum& frustum, const CullingBounds& bounds, std::vector<uint8_t>& visible);
+
+	// Times SetBounds() + Cull() for a field of random objects around
+	// a camera and prints the results
+	void Benchmark(int objectCount = 100000);
+}
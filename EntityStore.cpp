@@ -0,0 +1,860 @@
+#include "EntityStore.h"
+#include "JobSystem.h"
+#include "Transform.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Stand-ins for a mesh and a material - something to point at
+	struct BenchmarkResource
+	{
+		float Value;
+	};
+
+	// How GameEntity laid things out, for comparison: a transform
+	// and two shared_ptrs, each entity in its own allocation
+	struct LegacyEntity
+	{
+		Transform transform;
+		std::shared_ptr<BenchmarkResource> mesh;
+		std::shared_ptr<BenchmarkResource> material;
+
+		std::shared_ptr<BenchmarkResource> GetMesh() { return mesh; }
+		std::shared_ptr<BenchmarkResource> GetMaterial() { return material; }
+		Transform& GetTransform() { return transform; }
+	};
+
+	// Gathers values into order - sorted[i] = values[order[i]]
+	template<typename T>
+	void Reorder(std::vector<T>& values, const std::vector<uint32_t>& order)
+	{
+		std::vector<T> sorted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+			sorted[i] = values[order[i]];
+		values.swap(sorted);
+	}
+
+	// A node in a classic scene graph, for comparison - its own
+	// allocation, holding its children
+	struct SceneNode
+	{
+		XMFLOAT3 Position = XMFLOAT3(0, 0, 0);
+		XMFLOAT3 Rotation = XMFLOAT3(0, 0, 0);
+		XMFLOAT3 Scale = XMFLOAT3(1, 1, 1);
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 WorldInverseTranspose;
+		std::vector<std::unique_ptr<SceneNode>> Children;
+	};
+
+	// Same matrices as UpdateSubtrees(), by recursion
+	void UpdateRecursive(SceneNode& node, FXMMATRIX parentWorld, CXMMATRIX parentInverseTranspose)
+	{
+		XMMATRIX rotate = XMMatrixRotationRollPitchYaw(node.Rotation.x, node.Rotation.y, node.Rotation.z);
+		XMMATRIX world =
+			XMMatrixScaling(node.Scale.x, node.Scale.y, node.Scale.z) * rotate *
+			XMMatrixTranslation(node.Position.x, node.Position.y, node.Position.z) *
+			parentWorld;
+		XMMATRIX inverseTranspose =
+			XMMatrixScaling(1.0f / node.Scale.x, 1.0f / node.Scale.y, 1.0f / node.Scale.z) * rotate *
+			parentInverseTranspose;
+		XMStoreFloat4x4(&node.World, world);
+		XMStoreFloat4x4(&node.WorldInverseTranspose, inverseTranspose);
+		for (std::unique_ptr<SceneNode>& child : node.Children)
+			UpdateRecursive(*child, world, inverseTranspose);
+	}
+
+	// What a draw needs per entity
+	struct BenchmarkObjectData
+	{
+		XMFLOAT4X4 World;
+		XMFLOAT4X4 WorldInverseTranspose;
+	};
+}
+
+EntityId EntityStore::Create(uint32_t mesh, uint32_t material)
+{
+	uint32_t slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (uint32_t)indices.size();
+		indices.push_back(0);
+		generations.push_back(0);
+	}
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	uint32_t index = (uint32_t)positions.size();
+	indices[slot] = index;
+	positions.push_back(XMFLOAT3(0, 0, 0));
+	rotations.push_back(XMFLOAT3(0, 0, 0));
+	scales.push_back(XMFLOAT3(1, 1, 1));
+	worlds.push_back(identity);
+	worldInverseTransposes.push_back(identity);
+	dirty.push_back(0);
+	meshes.push_back(mesh);
+	materials.push_back(material);
+	slots.push_back(slot);
+	parents.push_back(NoParent);
+	childCounts.push_back(0);
+	dynamicFlags.push_back(0);
+	treeDynamic.push_back(0);
+	staticVersion++;
+
+	// A new root on the end is a new subtree on the end - the
+	// order's still good
+	if (!orderDirty)
+	{
+		parentIndices.push_back(NoParent);
+		subtreeOf.push_back((uint32_t)subtreeDirty.size());
+		subtreeStarts.push_back(index + 1);
+		subtreeDirty.push_back(0);
+		rebuilt.push_back(0);
+	}
+
+	return { slot, generations[slot] };
+}
+
+// --------------------------------------------------------
+// Children go first (they can't outlive their parent), then the
+// last entity moves into the hole, so everything stays packed,
+// and the slot's generation is bumped so the old ID dies
+// --------------------------------------------------------
+bool EntityStore::Destroy(EntityId id)
+{
+	int index = GetIndex(id);
+	if (index < 0)
+		return false;
+
+	if (childCounts[index] > 0)
+	{
+		std::vector<EntityId> children;
+		for (int i = 0; i < GetCount(); i++)
+		{
+			if (parents[i] == id.Slot)
+				children.push_back(GetId(i));
+		}
+		for (EntityId child : children)
+			Destroy(child);
+		index = GetIndex(id);
+	}
+
+	if (parents[index] != NoParent)
+		childCounts[indices[parents[index]]]--;
+
+	int last = GetCount() - 1;
+	if (index != last)
+	{
+		positions[index] = positions[last];
+		rotations[index] = rotations[last];
+		scales[index] = scales[last];
+		worlds[index] = worlds[last];
+		worldInverseTransposes[index] = worldInverseTransposes[last];
+		dirty[index] = dirty[last];
+		meshes[index] = meshes[last];
+		materials[index] = materials[last];
+		slots[index] = slots[last];
+		parents[index] = parents[last];
+		childCounts[index] = childCounts[last];
+		dynamicFlags[index] = dynamicFlags[last];
+		treeDynamic[index] = treeDynamic[last];
+		indices[slots[index]] = (uint32_t)index;
+	}
+
+	positions.pop_back();
+	rotations.pop_back();
+	scales.pop_back();
+	worlds.pop_back();
+	worldInverseTransposes.pop_back();
+	dirty.pop_back();
+	meshes.pop_back();
+	materials.pop_back();
+	slots.pop_back();
+	parents.pop_back();
+	childCounts.pop_back();
+	dynamicFlags.pop_back();
+	treeDynamic.pop_back();
+
+	generations[id.Slot]++;
+	staticVersion++;
+	freeSlots.push_back(id.Slot);
+	orderDirty = true;
+	return true;
+}
+
+bool EntityStore::IsAlive(EntityId id)
+{
+	return GetIndex(id) >= 0;
+}
+
+int EntityStore::GetIndex(EntityId id)
+{
+	if (id.Slot >= generations.size() || generations[id.Slot] != id.Generation)
+		return -1;
+	return (int)indices[id.Slot];
+}
+
+EntityId EntityStore::GetId(int index)
+{
+	uint32_t slot = slots[index];
+	return { slot, generations[slot] };
+}
+
+int EntityStore::GetCount()
+{
+	return (int)positions.size();
+}
+
+XMFLOAT3 EntityStore::GetPosition(int index) { return positions[index]; }
+XMFLOAT3 EntityStore::GetPitchYawRoll(int index) { return rotations[index]; }
+XMFLOAT3 EntityStore::GetScale(int index) { return scales[index]; }
+uint32_t EntityStore::GetMesh(int index) { return meshes[index]; }
+uint32_t EntityStore::GetMaterial(int index) { return materials[index]; }
+
+// Flags the entity, and its subtree if the order's current (if not,
+// SortHierarchy() works the subtree flags out from scratch)
+void EntityStore::MarkDirty(int index)
+{
+	dirty[index] = 1;
+	if (!orderDirty)
+		subtreeDirty[subtreeOf[index]] = 1;
+	StaticChanged(index);
+}
+
+// Only dynamic entities can change without the static version
+// moving.  With the order out of date, treeDynamic may be too, so
+// assume the worst.
+void EntityStore::StaticChanged(int index)
+{
+	if (orderDirty || !treeDynamic[index])
+		staticVersion++;
+}
+
+// Parents come first, so one pass in order carries flags down
+void EntityStore::UpdateTreeDynamic()
+{
+	for (int i = 0; i < GetCount(); i++)
+	{
+		uint32_t parent = parentIndices[i];
+		treeDynamic[i] = dynamicFlags[i] || (parent != NoParent && treeDynamic[parent]);
+	}
+}
+
+void EntityStore::SetPosition(int index, XMFLOAT3 position)
+{
+	positions[index] = position;
+	MarkDirty(index);
+}
+
+void EntityStore::SetRotation(int index, XMFLOAT3 pitchYawRoll)
+{
+	rotations[index] = pitchYawRoll;
+	MarkDirty(index);
+}
+
+void EntityStore::SetScale(int index, XMFLOAT3 scale)
+{
+	scales[index] = scale;
+	MarkDirty(index);
+}
+
+void EntityStore::SetMesh(int index, uint32_t mesh)
+{
+	meshes[index] = mesh;
+	StaticChanged(index);
+}
+
+void EntityStore::SetMaterial(int index, uint32_t material)
+{
+	materials[index] = material;
+}
+
+void EntityStore::MoveAbsolute(int index, XMFLOAT3 offset)
+{
+	positions[index].x += offset.x;
+	positions[index].y += offset.y;
+	positions[index].z += offset.z;
+	MarkDirty(index);
+}
+
+// Either way, whatever was cached from the static entities may
+// have included (or left out) this one and everything below it
+void EntityStore::SetDynamic(int index, bool dynamic)
+{
+	dynamicFlags[index] = dynamic ? 1 : 0;
+	staticVersion++;
+	if (!orderDirty)
+		UpdateTreeDynamic();
+}
+
+bool EntityStore::IsDynamic(int index)
+{
+	return treeDynamic[index] != 0;
+}
+
+uint32_t EntityStore::GetStaticVersion()
+{
+	return staticVersion;
+}
+
+bool EntityStore::SetParent(EntityId child, EntityId parent)
+{
+	int childIndex = GetIndex(child);
+	int parentIndex = GetIndex(parent);
+	if (childIndex < 0 || parentIndex < 0)
+		return false;
+
+	// Walk up from the new parent - meeting the child means it'd
+	// become its own ancestor
+	for (uint32_t slot = parent.Slot; slot != NoParent; slot = parents[indices[slot]])
+	{
+		if (slot == child.Slot)
+			return false;
+	}
+
+	ClearParent(child);
+	parents[childIndex] = parent.Slot;
+	childCounts[parentIndex]++;
+	dirty[childIndex] = 1;
+	orderDirty = true;
+	staticVersion++;
+	return true;
+}
+
+void EntityStore::ClearParent(EntityId child)
+{
+	int index = GetIndex(child);
+	if (index < 0 || parents[index] == NoParent)
+		return;
+
+	childCounts[indices[parents[index]]]--;
+	parents[index] = NoParent;
+	dirty[index] = 1;
+	orderDirty = true;
+	staticVersion++;
+}
+
+EntityId EntityStore::GetParent(int index)
+{
+	uint32_t slot = parents[index];
+	if (slot == NoParent)
+		return { NoParent, 0 };
+	return { slot, generations[slot] };
+}
+
+// --------------------------------------------------------
+// Lists each entity's children (a counting sort by parent), then
+// walks breadth first down from each root, in the order the roots
+// are packed now.  Each root's walk is one subtree.  Every array
+// is then gathered into that order.
+// --------------------------------------------------------
+void EntityStore::SortHierarchy()
+{
+	if (!orderDirty)
+		return;
+
+	int count = GetCount();
+	std::vector<uint32_t> childStarts(count + 1, 0);
+	for (int i = 0; i < count; i++)
+	{
+		if (parents[i] != NoParent)
+			childStarts[indices[parents[i]] + 1]++;
+	}
+	for (int i = 0; i < count; i++)
+		childStarts[i + 1] += childStarts[i];
+
+	std::vector<uint32_t> children(count);
+	std::vector<uint32_t> next(childStarts.begin(), childStarts.end() - 1);
+	for (int i = 0; i < count; i++)
+	{
+		if (parents[i] != NoParent)
+			children[next[indices[parents[i]]]++] = i;
+	}
+
+	std::vector<uint32_t> order;
+	order.reserve(count);
+	subtreeStarts.clear();
+	for (int root = 0; root < count; root++)
+	{
+		if (parents[root] != NoParent)
+			continue;
+
+		subtreeStarts.push_back((uint32_t)order.size());
+		size_t head = order.size();
+		order.push_back(root);
+		while (head < order.size())
+		{
+			uint32_t node = order[head++];
+			for (uint32_t c = childStarts[node]; c < childStarts[node + 1]; c++)
+				order.push_back(children[c]);
+		}
+	}
+	subtreeStarts.push_back(count);
+
+	// Parents by (new) index, worked out before anything moves
+	std::vector<uint32_t> newIndices(count);
+	for (int i = 0; i < count; i++)
+		newIndices[order[i]] = i;
+	parentIndices.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t parent = parents[order[i]];
+		parentIndices[i] = parent == NoParent ? NoParent : newIndices[indices[parent]];
+	}
+
+	Reorder(positions, order);
+	Reorder(rotations, order);
+	Reorder(scales, order);
+	Reorder(worlds, order);
+	Reorder(worldInverseTransposes, order);
+	Reorder(dirty, order);
+	Reorder(meshes, order);
+	Reorder(materials, order);
+	Reorder(slots, order);
+	Reorder(parents, order);
+	Reorder(childCounts, order);
+	Reorder(dynamicFlags, order);
+	for (int i = 0; i < count; i++)
+		indices[slots[i]] = i;
+	treeDynamic.resize(count);
+	UpdateTreeDynamic();
+
+	int subtreeCount = (int)subtreeStarts.size() - 1;
+	subtreeOf.resize(count);
+	subtreeDirty.assign(subtreeCount, 0);
+	for (int s = 0; s < subtreeCount; s++)
+	{
+		for (uint32_t i = subtreeStarts[s]; i < subtreeStarts[s + 1]; i++)
+		{
+			subtreeOf[i] = s;
+			subtreeDirty[s] |= dirty[i];
+		}
+	}
+	rebuilt.resize(count);
+	orderDirty = false;
+}
+
+int EntityStore::GetSubtreeCount()
+{
+	return (int)subtreeStarts.size() - 1;
+}
+
+int EntityStore::GetSubtreeStart(int subtree)
+{
+	return (int)subtreeStarts[subtree];
+}
+
+// --------------------------------------------------------
+// One pass, in order, over each changed subtree.  Parents come
+// before their children, so a parent's matrices are always
+// final by the time its children need them, and an entity is
+// rebuilt if it changed or its parent was just rebuilt.
+//
+// Locally world = S * R * T, and the inverse transpose's upper
+// 3x3 is S^-1 * R (as in Transform).  Under a parent both just
+// multiply by the parent's - (AB)^-T = A^-T B^-T.
+// --------------------------------------------------------
+void EntityStore::UpdateSubtrees(int first, int last)
+{
+	for (int s = first; s < last; s++)
+	{
+		if (!subtreeDirty[s])
+			continue;
+
+		for (uint32_t i = subtreeStarts[s]; i < subtreeStarts[s + 1]; i++)
+		{
+			uint32_t parent = parentIndices[i];
+			rebuilt[i] = dirty[i] || (parent != NoParent && rebuilt[parent]);
+			if (!rebuilt[i])
+				continue;
+
+			XMFLOAT3 p = positions[i];
+			XMFLOAT3 r = rotations[i];
+			XMFLOAT3 sc = scales[i];
+			XMMATRIX rotate = XMMatrixRotationRollPitchYaw(r.x, r.y, r.z);
+			XMMATRIX world = XMMatrixScaling(sc.x, sc.y, sc.z) * rotate * XMMatrixTranslation(p.x, p.y, p.z);
+			XMMATRIX worldInverseTranspose = XMMatrixScaling(1.0f / sc.x, 1.0f / sc.y, 1.0f / sc.z) * rotate;
+			if (parent != NoParent)
+			{
+				world = world * XMLoadFloat4x4(&worlds[parent]);
+				worldInverseTranspose = worldInverseTranspose * XMLoadFloat4x4(&worldInverseTransposes[parent]);
+			}
+
+			XMStoreFloat4x4(&worlds[i], world);
+			XMStoreFloat4x4(&worldInverseTransposes[i], worldInverseTranspose);
+			dirty[i] = 0;
+		}
+		subtreeDirty[s] = 0;
+	}
+}
+
+void EntityStore::UpdateMatrices()
+{
+	SortHierarchy();
+	UpdateSubtrees(0, GetSubtreeCount());
+}
+
+const XMFLOAT4X4* EntityStore::GetWorldMatrices() { return worlds.data(); }
+const XMFLOAT4X4* EntityStore::GetWorldInverseTransposeMatrices() { return worldInverseTransposes.data(); }
+const uint32_t* EntityStore::GetMeshes() { return meshes.data(); }
+const uint32_t* EntityStore::GetMaterials() { return materials.data(); }
+
+// --------------------------------------------------------
+// Each frame moves movingFraction of the entities, then does
+// what PrepareFrame() and Draw() ask of every entity: a bounds
+// position from its world matrix and mesh, then its matrices and
+// material gathered for drawing.  The old layout copies the
+// shared_ptrs by value, as the draw loop used to.
+// --------------------------------------------------------
+void EntityStore::Benchmark(float movingFraction)
+{
+	const int counts[] = { 10000, 100000, 1000000 };
+	const int frames = 10;
+	const int meshCount = 16;
+	const int materialCount = 8;
+
+	std::vector<std::shared_ptr<BenchmarkResource>> resources;
+	for (int i = 0; i < meshCount + materialCount; i++)
+		resources.push_back(std::make_shared<BenchmarkResource>(BenchmarkResource{ 1.0f + i }));
+
+	printf("Entity storage benchmark: %.0f%% moving, average of %d frames\n", movingFraction * 100.0f, frames);
+	for (int count : counts)
+	{
+		int movingCount = (int)(count * movingFraction);
+		std::vector<BenchmarkObjectData> objects(count);
+		float checksum = 0.0f;
+
+		// Old layout
+		std::vector<std::shared_ptr<LegacyEntity>> legacy;
+		legacy.reserve(count);
+		for (int i = 0; i < count; i++)
+		{
+			std::shared_ptr<LegacyEntity> entity = std::make_shared<LegacyEntity>();
+			entity->mesh = resources[i % meshCount];
+			entity->material = resources[meshCount + i % materialCount];
+			entity->GetTransform().SetPosition((float)(i % 1000), 0, (float)(i / 1000));
+			entity->GetTransform().SetRotation(0, i * 0.01f, 0);
+			legacy.push_back(entity);
+		}
+
+		auto legacyStart = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < movingCount; i++)
+				legacy[i]->GetTransform().MoveAbsolute(0, 0.01f, 0);
+
+			for (int i = 0; i < count; i++)
+			{
+				XMFLOAT4X4 world = legacy[i]->GetTransform().GetWorldMatrix();
+				checksum += world._41 * legacy[i]->GetMesh()->Value;
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				std::shared_ptr<LegacyEntity> entity = legacy[i];
+				std::shared_ptr<BenchmarkResource> material = entity->GetMaterial();
+				objects[i].World = entity->GetTransform().GetWorldMatrix();
+				objects[i].WorldInverseTranspose = entity->GetTransform().GetWorldInverseTransposeMatrix();
+				checksum += material->Value;
+			}
+		}
+		auto legacyEnd = std::chrono::high_resolution_clock::now();
+		legacy.clear();
+
+		// Entity store
+		EntityStore store;
+		for (int i = 0; i < count; i++)
+		{
+			int index = store.GetIndex(store.Create(i % meshCount, meshCount + i % materialCount));
+			store.SetPosition(index, XMFLOAT3((float)(i % 1000), 0, (float)(i / 1000)));
+			store.SetRotation(index, XMFLOAT3(0, i * 0.01f, 0));
+		}
+
+		auto storeStart = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (int i = 0; i < movingCount; i++)
+				store.MoveAbsolute(i, XMFLOAT3(0, 0.01f, 0));
+			store.UpdateMatrices();
+
+			const XMFLOAT4X4* world = store.GetWorldMatrices();
+			const XMFLOAT4X4* worldInverseTranspose = store.GetWorldInverseTransposeMatrices();
+			const uint32_t* meshHandles = store.GetMeshes();
+			const uint32_t* materialHandles = store.GetMaterials();
+			for (int i = 0; i < count; i++)
+				checksum += world[i]._41 * resources[meshHandles[i]]->Value;
+
+			for (int i = 0; i < count; i++)
+			{
+				objects[i].World = world[i];
+				objects[i].WorldInverseTranspose = worldInverseTranspose[i];
+				checksum += resources[materialHandles[i]]->Value;
+			}
+		}
+		auto storeEnd = std::chrono::high_resolution_clock::now();
+
+		double legacyMs = std::chrono::duration<double, std::milli>(legacyEnd - legacyStart).count() / frames;
+		double storeMs = std::chrono::duration<double, std::milli>(storeEnd - storeStart).count() / frames;
+		printf("  %7d entities: shared_ptr<GameEntity> %.3f ms, EntityStore %.3f ms (%.1fx) (checksum %.1f)\n",
+			count, legacyMs, storeMs, legacyMs / (storeMs > 0.000001 ? storeMs : 0.000001), checksum);
+	}
+	printf("\n");
+}
+
+// --------------------------------------------------------
+// Every round builds a random forest, then repeatedly changes it
+// - moves, new parents, cleared parents, destroys (which take
+// whole subtrees), new entities - and updates, sometimes all at
+// once and sometimes in subtree batches on the job system.  After
+// every update each world matrix must match the recursive one,
+// and each inverse transpose must match the actual inverse
+// transpose.  Anything alive must have a live parent.
+// --------------------------------------------------------
+bool EntityStore::HierarchyTest()
+{
+	const int rounds = 20;
+	const int startCount = 2000;
+	const int steps = 50;
+	const float tolerance = 0.001f;
+
+	std::mt19937 random(5678);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f);
+	std::uniform_real_distribution<float> scale(0.8f, 1.25f);
+
+	JobSystem jobs;
+	int failures = 0;
+	int checked = 0;
+	printf("Entity hierarchy test: %d rounds of %d updates\n", rounds, steps);
+
+	for (int round = 0; round < rounds; round++)
+	{
+		EntityStore store;
+		std::vector<EntityId> ids;
+		auto randomize = [&](int index) {
+			store.SetPosition(index, XMFLOAT3(position(random), position(random), position(random)));
+			store.SetRotation(index, XMFLOAT3(angle(random), angle(random), angle(random)));
+			store.SetScale(index, XMFLOAT3(scale(random), scale(random), scale(random)));
+		};
+		auto create = [&]() {
+			EntityId id = store.Create(0, 0);
+			randomize(store.GetIndex(id));
+			if (!ids.empty() && random() % 4 != 0)
+				store.SetParent(id, ids[random() % ids.size()]);
+			ids.push_back(id);
+		};
+
+		for (int i = 0; i < startCount; i++)
+			create();
+
+		for (int step = 0; step < steps; step++)
+		{
+			for (int change = 0; change < 20; change++)
+			{
+				EntityId id = ids[random() % ids.size()];
+				EntityId other = ids[random() % ids.size()];
+				int index = store.GetIndex(id);
+				if (index < 0)
+					continue;
+
+				switch (random() % 6)
+				{
+				case 0: randomize(index); break;
+				case 1: store.MoveAbsolute(index, XMFLOAT3(0, 1, 0)); break;
+				case 2: store.SetParent(id, other); break;
+				case 3: store.ClearParent(id); break;
+				case 4: store.Destroy(id); break;
+				case 5: create(); break;
+				}
+			}
+
+			store.SortHierarchy();
+			if (step % 2 == 0)
+			{
+				store.UpdateSubtrees(0, store.GetSubtreeCount());
+			}
+			else
+			{
+				JobCounter counter;
+				jobs.ParallelFor(store.GetSubtreeCount(), 16, [&](int begin, int end) { store.UpdateSubtrees(begin, end); }, counter);
+				jobs.Wait(counter);
+			}
+
+			for (int i = 0; i < store.GetCount(); i++)
+			{
+				EntityId parent = store.GetParent(i);
+				if (parent.Slot != NoParent && !store.IsAlive(parent))
+				{
+					failures++;
+					continue;
+				}
+
+				// Recursive reference - local up the chain to the root
+				XMMATRIX expected = XMMatrixIdentity();
+				for (int at = i; at >= 0; )
+				{
+					XMFLOAT3 p = store.GetPosition(at);
+					XMFLOAT3 r = store.GetPitchYawRoll(at);
+					XMFLOAT3 s = store.GetScale(at);
+					expected = expected * XMMatrixScaling(s.x, s.y, s.z) * XMMatrixRotationRollPitchYaw(r.x, r.y, r.z) * XMMatrixTranslation(p.x, p.y, p.z);
+					EntityId up = store.GetParent(at);
+					at = up.Slot == NoParent ? -1 : store.GetIndex(up);
+				}
+
+				XMFLOAT4X4 want, wantInverseTranspose;
+				XMStoreFloat4x4(&want, expected);
+				XMStoreFloat4x4(&wantInverseTranspose, XMMatrixTranspose(XMMatrixInverse(0, expected)));
+				const XMFLOAT4X4& got = store.GetWorldMatrices()[i];
+				const XMFLOAT4X4& gotInverseTranspose = store.GetWorldInverseTransposeMatrices()[i];
+
+				bool match = true;
+				for (int row = 0; row < 4; row++)
+				{
+					for (int column = 0; column < 4; column++)
+					{
+						float w = want.m[row][column];
+						match = match && fabsf(got.m[row][column] - w) <= tolerance * (1.0f + fabsf(w));
+						if (row < 3 && column < 3)
+						{
+							float wi = wantInverseTranspose.m[row][column];
+							match = match && fabsf(gotInverseTranspose.m[row][column] - wi) <= tolerance * (1.0f + fabsf(wi));
+						}
+					}
+				}
+				failures += !match;
+				checked++;
+			}
+		}
+	}
+
+	printf("%s - %d matrices checked, %d wrong\n\n", failures ? "FAILED" : "Passed", checked, failures);
+	return failures == 0;
+}
+
+// --------------------------------------------------------
+// Deep: many long chains.  Wide: a few roots with lots of
+// children each.  Both get a full update (every root moved, so
+// everything below is rebuilt) and a partial one (1% of roots
+// moved).  The recursive version is a classic scene graph - nodes
+// in their own allocations, each holding its children - which
+// rebuilds everything every time.
+// --------------------------------------------------------
+void EntityStore::HierarchyBenchmark()
+{
+	struct Shape
+	{
+		const char* Name;
+		int Roots;
+		int Depth;		// Levels below the root
+		int Children;	// Per parent, per level
+	};
+	const Shape shapes[] = {
+		{ "Deep (1000 chains of 100)", 1000, 99, 1 },
+		{ "Wide (100 roots x 999 children)", 100, 1, 999 },
+	};
+	const int frames = 10;
+
+	JobSystem jobs;
+	printf("Entity hierarchy benchmark: average of %d frames, %d threads for batched (jobs)\n", frames, jobs.GetThreadCount());
+
+	for (const Shape& shape : shapes)
+	{
+		EntityStore store;
+		std::vector<std::unique_ptr<SceneNode>> graph;
+		std::vector<EntityId> roots;
+		for (int r = 0; r < shape.Roots; r++)
+		{
+			EntityId root = store.Create(0, 0);
+			roots.push_back(root);
+			graph.push_back(std::make_unique<SceneNode>());
+
+			std::vector<EntityId> level = { root };
+			std::vector<SceneNode*> levelNodes = { graph.back().get() };
+			for (int d = 0; d < shape.Depth; d++)
+			{
+				std::vector<EntityId> nextLevel;
+				std::vector<SceneNode*> nextNodes;
+				for (size_t p = 0; p < level.size(); p++)
+				{
+					for (int c = 0; c < shape.Children; c++)
+					{
+						XMFLOAT3 offset(1.0f, 0.1f * c, 0);
+						EntityId child = store.Create(0, 0);
+						store.SetParent(child, level[p]);
+						store.SetPosition(store.GetIndex(child), offset);
+						store.SetRotation(store.GetIndex(child), XMFLOAT3(0, 0.01f, 0));
+						nextLevel.push_back(child);
+
+						levelNodes[p]->Children.push_back(std::make_unique<SceneNode>());
+						SceneNode* node = levelNodes[p]->Children.back().get();
+						node->Position = offset;
+						node->Rotation = XMFLOAT3(0, 0.01f, 0);
+						nextNodes.push_back(node);
+					}
+				}
+				level.swap(nextLevel);
+				levelNodes.swap(nextNodes);
+			}
+		}
+		store.UpdateMatrices();
+
+		float checksum = 0.0f;
+		for (int partial = 0; partial < 2; partial++)
+		{
+			int moving = partial ? (shape.Roots + 99) / 100 : shape.Roots;
+
+			auto recursiveStart = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				for (int r = 0; r < moving; r++)
+					graph[r]->Position.y += 0.01f;
+				for (std::unique_ptr<SceneNode>& root : graph)
+					UpdateRecursive(*root, XMMatrixIdentity(), XMMatrixIdentity());
+				checksum += graph[0]->World._42;
+			}
+
+			auto batchedStart = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				for (int r = 0; r < moving; r++)
+					store.MoveAbsolute(store.GetIndex(roots[r]), XMFLOAT3(0, 0.01f, 0));
+				store.UpdateMatrices();
+				checksum += store.GetWorldMatrices()[0]._42;
+			}
+
+			auto jobsStart = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				for (int r = 0; r < moving; r++)
+					store.MoveAbsolute(store.GetIndex(roots[r]), XMFLOAT3(0, 0.01f, 0));
+				store.SortHierarchy();
+				JobCounter counter;
+				jobs.ParallelFor(store.GetSubtreeCount(), 1, [&](int begin, int end) { store.UpdateSubtrees(begin, end); }, counter);
+				jobs.Wait(counter);
+				checksum += store.GetWorldMatrices()[0]._42;
+			}
+			auto jobsEnd = std::chrono::high_resolution_clock::now();
+
+			double recursiveMs = std::chrono::duration<double, std::milli>(batchedStart - recursiveStart).count() / frames;
+			double batchedMs = std::chrono::duration<double, std::milli>(jobsStart - batchedStart).count() / frames;
+			double jobsMs = std::chrono::duration<double, std::milli>(jobsEnd - jobsStart).count() / frames;
+			printf("  %s, %s: recursive %.3f ms, batched %.3f ms, batched (jobs) %.3f ms\n",
+				shape.Name, partial ? "1% of roots moving" : "all moving", recursiveMs, batchedMs, jobsMs);
+		}
+		printf("  (checksum %.1f)\n", checksum);
+	}
+	printf("\n");
+}
@@ -0,0 +1,253 @@
+#include "Exposure.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Top bin of the histogram - bin 0 is for black
+	constexpr float TopBin = (float)(Exposure::HistogramBins - 2);
+
+	float ACES(float x)
+	{
+		// Krzysztof Narkowicz's fit of the ACES curve
+		x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+		return std::clamp(x, 0.0f, 1.0f);
+	}
+
+	float Reinhard(float x)
+	{
+		return x / (1.0f + x);
+	}
+
+	// An image of one color, with every other pixel black if
+	// blackHalf - luminance comes out exactly as asked
+	std::vector<XMFLOAT4> FlatImage(int width, int height, float luminance, bool blackHalf)
+	{
+		std::vector<XMFLOAT4> pixels((size_t)width * height, XMFLOAT4(luminance, luminance, luminance, 1.0f));
+		if (blackHalf)
+		{
+			for (size_t i = 0; i < pixels.size(); i += 2)
+				pixels[i] = XMFLOAT4(0, 0, 0, 1);
+		}
+		return pixels;
+	}
+}
+
+float Exposure::Luminance(XMFLOAT3 color)
+{
+	return color.x * 0.2126f + color.y * 0.7152f + color.z * 0.0722f;
+}
+
+uint32_t Exposure::HistogramBin(float luminance, const Settings& settings)
+{
+	if (luminance < BlackLuminance)
+		return 0;
+
+	float logLuminance = (log2f(luminance) - settings.MinLogLuminance) / settings.LogLuminanceRange;
+	return (uint32_t)(std::clamp(logLuminance, 0.0f, 1.0f) * TopBin + 1.0f);
+}
+
+void Exposure::BuildHistogram(const XMFLOAT4* pixels, int width, int height, const Settings& settings, uint32_t* histogram)
+{
+	// One thread group's worth at a time, counted into its own
+	// histogram first and then added in
+	uint32_t group[HistogramBins];
+	for (int groupY = 0; groupY < height; groupY += GroupSize)
+	{
+		for (int groupX = 0; groupX < width; groupX += GroupSize)
+		{
+			std::fill(group, group + HistogramBins, 0);
+			for (int y = groupY; y < std::min(groupY + GroupSize, height); y++)
+			{
+				for (int x = groupX; x < std::min(groupX + GroupSize, width); x++)
+				{
+					const XMFLOAT4& pixel = pixels[(size_t)y * width + x];
+					group[HistogramBin(Luminance(XMFLOAT3(pixel.x, pixel.y, pixel.z)), settings)]++;
+				}
+			}
+
+			for (int i = 0; i < HistogramBins; i++)
+				histogram[i] += group[i];
+		}
+	}
+}
+
+uint32_t Exposure::ReduceSum(const uint32_t* values)
+{
+	uint32_t shared[HistogramBins];
+	std::copy(values, values + HistogramBins, shared);
+	for (int cutoff = HistogramBins / 2; cutoff > 0; cutoff /= 2)
+	{
+		for (int i = 0; i < cutoff; i++)
+			shared[i] += shared[i + cutoff];
+	}
+	return shared[0];
+}
+
+float Exposure::AverageLuminance(const uint32_t* histogram, int pixelCount, const Settings& settings)
+{
+	uint32_t litPixels = (uint32_t)pixelCount - histogram[0];
+	if (litPixels == 0)
+		return 0.0f;
+
+	// Average bin, then back to a luminance from the middle of it
+	// - bin b covers (b - 1) / TopBin to b / TopBin of the range
+	uint32_t weighted[HistogramBins];
+	for (int i = 0; i < HistogramBins; i++)
+		weighted[i] = histogram[i] * i;
+	float averageBin = (float)ReduceSum(weighted) / litPixels;
+	return exp2f((averageBin - 0.5f) / TopBin * settings.LogLuminanceRange + settings.MinLogLuminance);
+}
+
+float Exposure::Adapt(float adapted, float target, float deltaTime, const Settings& settings)
+{
+	if (target <= 0.0f)
+		return adapted;
+	if (adapted <= 0.0f)
+		return target;
+	return adapted + (target - adapted) * (1.0f - expf(-deltaTime * settings.AdaptationRate));
+}
+
+float Exposure::ExposureScale(float adaptedLuminance, bool autoExposure, const Settings& settings)
+{
+	float scale = exp2f(settings.Compensation);
+	if (autoExposure)
+		scale *= settings.KeyValue / std::max(adaptedLuminance, exp2f(settings.MinLogLuminance));
+	return scale;
+}
+
+XMFLOAT3 Exposure::Tonemap(XMFLOAT3 color, Tonemapper tonemapper)
+{
+	if (tonemapper == TonemapACES)
+		return XMFLOAT3(ACES(color.x), ACES(color.y), ACES(color.z));
+	return XMFLOAT3(Reinhard(color.x), Reinhard(color.y), Reinhard(color.z));
+}
+
+bool Exposure::Test()
+{
+	Settings settings;
+	const float binWidth = settings.LogLuminanceRange / TopBin; // In stops
+	const int width = 37; // Not a multiple of GroupSize
+	const int height = 23;
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	// Flat images average back to their own luminance, to within
+	// half a bin, with or without black pixels mixed in
+	float worstStops = 0.0f;
+	for (float stops = -7.5f; stops <= 3.5f; stops += 0.37f)
+	{
+		for (bool blackHalf : { false, true })
+		{
+			std::vector<XMFLOAT4> image = FlatImage(width, height, exp2f(stops), blackHalf);
+			uint32_t histogram[HistogramBins] = {};
+			BuildHistogram(image.data(), width, height, settings, histogram);
+			float average = AverageLuminance(histogram, width * height, settings);
+			worstStops = std::max(worstStops, fabsf(log2f(average) - stops));
+		}
+	}
+	check(worstStops <= binWidth * 0.5f + 1e-4f, "flat images average to their luminance");
+
+	// Half one luminance, half another - the log average is the
+	// geometric mean
+	{
+		std::vector<XMFLOAT4> image = FlatImage(width, height, 0.05f, false);
+		for (size_t i = 0; i < image.size(); i += 2)
+			image[i] = XMFLOAT4(2.0f, 2.0f, 2.0f, 1.0f);
+		uint32_t histogram[HistogramBins] = {};
+		BuildHistogram(image.data(), width, height, settings, histogram);
+		float brightShare = ((width * height + 1) / 2) / (float)(width * height); // The pixel count is odd
+		float expected = brightShare * log2f(2.0f) + (1.0f - brightShare) * log2f(0.05f);
+		check(fabsf(log2f(AverageLuminance(histogram, width * height, settings)) - expected) <= binWidth, "mixed images average to the geometric mean");
+	}
+
+	// All black has nothing to average, and adaptation ignores it
+	{
+		std::vector<XMFLOAT4> image = FlatImage(width, height, 0.0f, false);
+		uint32_t histogram[HistogramBins] = {};
+		BuildHistogram(image.data(), width, height, settings, histogram);
+		check(histogram[0] == (uint32_t)(width * height) && AverageLuminance(histogram, width * height, settings) == 0.0f, "black images have no average");
+		check(Adapt(0.3f, 0.0f, 0.016f, settings) == 0.3f, "adapting to nothing keeps the last luminance");
+	}
+
+	// Out of range luminances land in the end bins
+	check(HistogramBin(1e6f, settings) == HistogramBins - 1, "bright pixels go in the top bin");
+	check(HistogramBin(exp2f(settings.MinLogLuminance - 0.5f) + BlackLuminance, settings) >= 1, "dim pixels aren't black");
+
+	// Tiled binning and the reduction vs. simple loops
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> stopsDistribution(-10.0f, 6.0f);
+	std::vector<XMFLOAT4> noise((size_t)width * height);
+	for (XMFLOAT4& pixel : noise)
+		pixel = XMFLOAT4(exp2f(stopsDistribution(random)), exp2f(stopsDistribution(random)), exp2f(stopsDistribution(random)), 1.0f);
+	uint32_t tiled[HistogramBins] = {};
+	uint32_t simple[HistogramBins] = {};
+	BuildHistogram(noise.data(), width, height, settings, tiled);
+	for (const XMFLOAT4& pixel : noise)
+		simple[HistogramBin(Luminance(XMFLOAT3(pixel.x, pixel.y, pixel.z)), settings)]++;
+	check(std::equal(tiled, tiled + HistogramBins, simple), "tiled histogram matches binning every pixel");
+
+	uint32_t values[HistogramBins];
+	uint32_t serial = 0;
+	for (uint32_t& value : values)
+	{
+		value = random() % 100000;
+		serial += value;
+	}
+	check(ReduceSum(values) == serial, "reduction matches a serial sum");
+
+	// Adaptation - the first frame jumps, later ones close in
+	// without overshooting, and the frame rate doesn't matter
+	check(Adapt(0.0f, 0.4f, 0.016f, settings) == 0.4f, "first frame jumps to the target");
+	float fast = 0.1f;
+	for (int frame = 0; frame < 120; frame++)
+		fast = Adapt(fast, 1.0f, 1.0f / 120.0f, settings);
+	float slow = 0.1f;
+	for (int frame = 0; frame < 20; frame++)
+		slow = Adapt(slow, 1.0f, 1.0f / 20.0f, settings);
+	float once = Adapt(0.1f, 1.0f, 1.0f, settings);
+	check(fabsf(fast - once) < 1e-4f && fabsf(slow - once) < 1e-4f, "adaptation is frame rate independent");
+	check(once > 0.1f && once < 1.0f, "adaptation closes in without overshooting");
+
+	// Exposure puts the adapted luminance on the key value
+	check(fabsf(ExposureScale(0.5f, true, settings) * 0.5f - settings.KeyValue) < 1e-6f, "exposure maps the average to the key");
+	Settings brighter = settings;
+	brighter.Compensation = 1.0f;
+	check(fabsf(ExposureScale(0.5f, true, brighter) - 2.0f * ExposureScale(0.5f, true, settings)) < 1e-5f, "a stop of compensation doubles exposure");
+	check(ExposureScale(0.5f, false, brighter) == 2.0f, "manual exposure is just compensation");
+
+	// Tonemappers start at 0, never go down and stay under 1
+	for (Tonemapper tonemapper : { TonemapACES, TonemapReinhard })
+	{
+		bool monotonic = Tonemap(XMFLOAT3(0, 0, 0), tonemapper).x == 0.0f;
+		float last = 0.0f;
+		for (float x = 0.001f; x < 1000.0f; x *= 1.1f)
+		{
+			float mapped = Tonemap(XMFLOAT3(x, x, x), tonemapper).x;
+			monotonic = monotonic && mapped >= last && mapped <= 1.0f;
+			last = mapped;
+		}
+		check(monotonic, "tonemapping stays in 0-1 and never goes down");
+		check(last > 0.99f, "tonemapping reaches white");
+	}
+	check(Tonemap(XMFLOAT3(1, 1, 1), TonemapReinhard).x == 0.5f, "Reinhard maps 1 to 0.5");
+
+	bool passed = failures == 0;
+	printf("Exposure test: %s\n", passed ? "passed" : "FAILED");
+	printf("  Flat images averaged within %.4f stops (half a bin is %.4f)\n", worstStops, binWidth * 0.5f);
+	printf("  One second of adaptation: %.5f at 120 fps, %.5f at 20 fps, %.5f in one step\n\n", fast, slow, once);
+	return passed;
+}
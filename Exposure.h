@@ -0,0 +1,73 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+
+// --------------------------------------------------------
+// Auto-exposure and tonemapping, done the same way as
+// LuminanceHistogramCS.hlsl, AverageLuminanceCS.hlsl and
+// TonemapPS.hlsl (all through Exposure.hlsli), so the math can
+// be checked without a GPU.
+//
+// Each frame the HDR scene's pixels are binned by the log of
+// their luminance (black pixels go in bin 0 and are left out),
+// the bins are averaged with a parallel reduction, and the
+// adapted luminance eases towards that average.  Tonemapping
+// then scales the scene so the adapted luminance lands on
+// KeyValue and squeezes the result into 0-1.
+// --------------------------------------------------------
+namespace Exposure
+{
+	constexpr int HistogramBins = 256;
+	constexpr int GroupSize = 16; // Pixels per side of a histogram thread group
+	constexpr float BlackLuminance = 0.005f; // Pixels darker than this don't count
+
+	enum Tonemapper
+	{
+		TonemapACES,	// Filmic, with a toe and a soft shoulder
+		TonemapReinhard	// c / (1 + c)
+	};
+
+	// Matches ExposureData in BufferStructs.h, besides the frame
+	// specific parts
+	struct Settings
+	{
+		float MinLogLuminance = -8.0f;	// log2 of the darkest luminance binned
+		float LogLuminanceRange = 12.0f;	// ...up to 2^4 at the top
+		float AdaptationRate = 1.5f;		// Higher adapts faster
+		float KeyValue = 0.18f;			// Where the average ends up
+		float Compensation = 0.0f;		// In stops - the only exposure when auto-exposure is off
+	};
+
+	float Luminance(DirectX::XMFLOAT3 color);
+	uint32_t HistogramBin(float luminance, const Settings& settings);
+
+	// Adds every pixel to histogram, a GroupSize x GroupSize tile at
+	// a time, like the compute shader
+	void BuildHistogram(const DirectX::XMFLOAT4* pixels, int width, int height, const Settings& settings, uint32_t* histogram);
+
+	// Adds up HistogramBins values in the order the compute shader's
+	// reduction does - halving the list each step
+	uint32_t ReduceSum(const uint32_t* values);
+
+	// Average luminance of the pixels that aren't black, or 0 if
+	// every pixel is
+	float AverageLuminance(const uint32_t* histogram, int pixelCount, const Settings& settings);
+
+	// Moves the adapted luminance towards target, independent of
+	// frame rate.  With no history yet (adapted 0) it jumps
+	// straight there; with nothing to adapt to (target 0) it stays.
+	float Adapt(float adapted, float target, float deltaTime, const Settings& settings);
+
+	// What the scene is multiplied by before tonemapping
+	float ExposureScale(float adaptedLuminance, bool autoExposure, const Settings& settings);
+
+	// Exposed linear color to 0-1 linear color (gamma comes after)
+	DirectX::XMFLOAT3 Tonemap(DirectX::XMFLOAT3 color, Tonemapper tonemapper);
+
+	// Checks histograms of known images average back to their
+	// luminance, that tiled binning and the reduction match simple
+	// loops, that adaptation doesn't depend on frame rate and that
+	// the tonemappers stay in 0-1 and never reverse.  Prints the
+	// results and returns whether everything passed.
+	bool Test();
+}
@@ -0,0 +1,83 @@
+#ifndef _GGP_EXPOSURE_INCLUDES_
+#define _GGP_EXPOSURE_INCLUDES_
+
+// The GPU half of Exposure.h - keep the two in step
+
+#define HISTOGRAM_BINS      256
+#define HISTOGRAM_TOP_BIN   254.0f
+#define BLACK_LUMINANCE     0.005f
+#define TONEMAP_ACES        0
+#define TONEMAP_REINHARD    1
+
+// Must match ExposureData in BufferStructs.h
+cbuffer ExposureData : register(b0)
+{
+    int inputWidth;
+    int inputHeight;
+    float minLogLuminance;
+    float logLuminanceRange;
+    
+    float timeDelta;
+    float adaptationRate;
+    float keyValue;
+    float exposureCompensation; // Stops
+    
+    int pixelCount;
+    int autoExposure;
+    int tonemapper;
+}
+
+float Luminance(float3 color)
+{
+    return dot(color, float3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Exposure::HistogramBin()
+uint HistogramBin(float luminance)
+{
+    if (luminance < BLACK_LUMINANCE)
+        return 0;
+    
+    float logLuminance = saturate((log2(luminance) - minLogLuminance) / logLuminanceRange);
+    return (uint)(logLuminance * HISTOGRAM_TOP_BIN + 1.0f);
+}
+
+// Exposure::AverageLuminance(), from the reduced sum of bin * count
+float AverageLuminance(uint weightedSum, uint blackPixels)
+{
+    uint litPixels = (uint)pixelCount - blackPixels;
+    if (litPixels == 0)
+        return 0;
+    
+    float averageBin = (float)weightedSum / litPixels;
+    return exp2((averageBin - 0.5f) / HISTOGRAM_TOP_BIN * logLuminanceRange + minLogLuminance);
+}
+
+// Exposure::Adapt()
+float Adapt(float adapted, float target)
+{
+    if (target <= 0)
+        return adapted;
+    if (adapted <= 0)
+        return target;
+    return adapted + (target - adapted) * (1 - exp(-timeDelta * adaptationRate));
+}
+
+// Exposure::ExposureScale()
+float ExposureScale(float adaptedLuminance)
+{
+    float scale = exp2(exposureCompensation);
+    if (autoExposure)
+        scale *= keyValue / max(adaptedLuminance, exp2(minLogLuminance));
+    return scale;
+}
+
+// Exposure::Tonemap()
+float3 Tonemap(float3 color)
+{
+    if (tonemapper == TONEMAP_ACES)
+        return saturate((color * (2.51f * color + 0.03f)) / (color * (2.43f * color + 0.59f) + 0.14f));
+    return color / (1 + color);
+}
+
+#endif
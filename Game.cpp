@@ -2,11 +2,19 @@
 #include "Graphics.h"
 #include "Input.h"
 #include "Mesh.h"
+#include "ObjLoader.h"
 #include "PathHelpers.h"
 #include "Window.h"
 #include "Sky.h"
+#include "Instancing.h"
+#include "CommandRecorder.h"
+#include "ConstantRing.h"
 
 #include <DirectXMath.h>
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <string>
 
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
@@ -16,11 +24,144 @@
 #include "ImGui/imgui_impl_dx11.h"
 #include "ImGui/imgui_impl_win32.h"
 
-#include "WICTextureLoader.h"
-
 // For the DirectX Math library
 using namespace DirectX;
 
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Position of item in list - entities' mesh and material
+	// handles are indices into the game's lists
+	template<typename T>
+	uint32_t HandleOf(const std::vector<std::shared_ptr<T>>& list, const std::shared_ptr<T>& item)
+	{
+		return (uint32_t)(std::find(list.begin(), list.end(), item) - list.begin());
+	}
+
+	// Every .obj in Assets/Meshes, for the loading benchmarks
+	std::vector<std::wstring> MeshAssetFiles()
+	{
+		std::vector<std::wstring> objFiles;
+		std::error_code error;
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(FixPath(L"../../Assets/Meshes/"), error))
+		{
+			if (entry.path().extension() == L".obj")
+				objFiles.push_back(entry.path().wstring());
+		}
+		std::sort(objFiles.begin(), objFiles.end());
+		return objFiles;
+	}
+
+	// Below this many draws per chunk, recording on deferred contexts
+	// costs more than it saves
+	const int MinDeferredDrawsPerChunk = 128;
+
+	// --------------------------------------------------------
+	// Draws entities for a RenderQueue - items are entity indices,
+	// and their constants have already been written.  Material
+	// constants are indexed by material rather than entity, since
+	// any item can end up first in a chunk and need them.  Without
+	// any (the shadow pass) only meshes and object data get bound.
+	//
+	// Instanced draws read object data from the instance buffer
+	// instead, and swap the material's vertex shader for the
+	// instanced one.
+	//
+	// Without a deferred context it draws straight away on the
+	// immediate one.  With one, each chunk starts by applying
+	// passState (a deferred context starts out blank) and ends up
+	// as a command list, executed in order on the immediate context.
+	// --------------------------------------------------------
+	class EntityRecorder : public CommandRecorder
+	{
+	private:
+		EntityStore& entities;
+		const std::vector<std::shared_ptr<Mesh>>& meshes;
+		const std::vector<std::shared_ptr<Material>>& materials;
+		const std::vector<Graphics::ConstantAllocation>* materialConstants;
+		const std::vector<Graphics::ConstantAllocation>* objectConstants;
+		ID3D11VertexShader* instancedVS;
+		ID3D11DeviceContext1* context;
+		bool deferred;
+		const std::function<void(ID3D11DeviceContext1*)>* passState;
+		Microsoft::WRL::ComPtr<ID3D11CommandList> commandList;
+
+	public:
+		EntityRecorder(
+			EntityStore& entities,
+			const std::vector<std::shared_ptr<Mesh>>& meshes,
+			const std::vector<std::shared_ptr<Material>>& materials,
+			const std::vector<Graphics::ConstantAllocation>* materialConstants,
+			const std::vector<Graphics::ConstantAllocation>* objectConstants,
+			ID3D11VertexShader* instancedVS,
+			ID3D11DeviceContext1* deferredContext = 0,
+			const std::function<void(ID3D11DeviceContext1*)>* passState = 0)
+			: entities(entities), meshes(meshes), materials(materials), materialConstants(materialConstants), objectConstants(objectConstants), instancedVS(instancedVS),
+			context(deferredContext ? deferredContext : Graphics::ImmediateContext1()), deferred(deferredContext != 0), passState(passState)
+		{
+		}
+
+		void Begin() override
+		{
+			if (deferred)
+				(*passState)(context);
+		}
+
+		void Finish() override
+		{
+			if (deferred)
+				context->FinishCommandList(FALSE, commandList.ReleaseAndGetAddressOf());
+		}
+
+		void Execute() override
+		{
+			if (!commandList)
+				return;
+
+			// Put the immediate context's state back afterwards, so the
+			// rest of the frame carries on as if it drew everything itself
+			Graphics::Context->ExecuteCommandList(commandList.Get(), TRUE);
+			commandList.Reset();
+		}
+
+		void BindShaders(int item) override
+		{
+			if (!materialConstants)
+				return;
+
+			Material* material = materials[entities.GetMaterial(item)].get();
+			context->VSSetShader(instancedVS ? instancedVS : material->GetVertexShader().Get(), 0, 0);
+			context->PSSetShader(material->GetPixelShader().Get(), 0, 0);
+		}
+
+		void BindMaterial(int item) override
+		{
+			if (!materialConstants)
+				return;
+
+			materials[entities.GetMaterial(item)]->BindTexturesAndSamplers(context);
+			Graphics::BindConstants((*materialConstants)[entities.GetMaterial(item)], D3D11_PIXEL_SHADER, 1, context);
+		}
+
+		void BindMesh(int item) override
+		{
+			meshes[entities.GetMesh(item)]->SetBuffers(context);
+		}
+
+		void Draw(int item) override
+		{
+			Graphics::BindConstants((*objectConstants)[item], D3D11_VERTEX_SHADER, 2, context);
+			context->DrawIndexed(meshes[entities.GetMesh(item)]->GetIndexCount(), 0, 0);
+		}
+
+		void DrawInstanced(int item, int firstInstance, int instanceCount) override
+		{
+			context->DrawIndexedInstanced(meshes[entities.GetMesh(item)]->GetIndexCount(), instanceCount, 0, 0, firstInstance);
+		}
+	};
+}
+
 // --------------------------------------------------------
 // The constructor is called after the window and graphics API
 // are initialized but before the game loop begins
@@ -85,8 +226,8 @@ Game::Game()
 			inputElements[2].SemanticName = "NORMAL";							// Match our vertex shader input!
 			inputElements[2].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;	// After the previous element
 
-			//Set up the fourth element - Tangent vector which is 3 more float values
-			inputElements[3].Format = DXGI_FORMAT_R32G32B32_FLOAT;			// 3x 32-bit floats
+			//Set up the fourth element - Tangent vector plus handedness, which is 4 more float values
+			inputElements[3].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;		// 4x 32-bit floats
 			inputElements[3].SemanticName = "TANGENT";						// Match the VS input
 			inputElements[3].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT; // after the previous element
 
@@ -101,6 +242,41 @@ Game::Game()
 				inputLayout.GetAddressOf());			// Address of the resulting ID3D11InputLayout pointer
 		}
 
+		// The instanced layout - the same vertex in slot 0, plus each
+		// instance's matrices (a PerObjectVSData) in slot 1, one row
+		// per element, stepping once per instance
+		{
+			D3D11_INPUT_ELEMENT_DESC inputElements[12] = {};
+			const char* vertexSemantics[4] = { "POSITION", "TEXCOORD", "NORMAL", "TANGENT" };
+			DXGI_FORMAT vertexFormats[4] = { DXGI_FORMAT_R32G32B32_FLOAT, DXGI_FORMAT_R32G32_FLOAT, DXGI_FORMAT_R32G32B32_FLOAT, DXGI_FORMAT_R32G32B32A32_FLOAT };
+			for (int i = 0; i < 4; i++) {
+				inputElements[i].Format = vertexFormats[i];
+				inputElements[i].SemanticName = vertexSemantics[i];
+				inputElements[i].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+			}
+
+			for (int row = 0; row < 8; row++) {
+				D3D11_INPUT_ELEMENT_DESC& element = inputElements[4 + row];
+				element.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+				element.SemanticName = row < 4 ? "WORLD" : "WORLD_INV_TRANSPOSE";
+				element.SemanticIndex = row % 4;
+				element.InputSlot = 1;
+				element.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+				element.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+				element.InstanceDataStepRate = 1;
+			}
+
+			ID3DBlob* vertexShaderBlob;
+			D3DReadFileToBlob(FixPath(L"VertexShaderInstanced.cso").c_str(), &vertexShaderBlob);
+			Graphics::Device->CreateInputLayout(
+				inputElements,
+				12,
+				vertexShaderBlob->GetBufferPointer(),
+				vertexShaderBlob->GetBufferSize(),
+				instancedInputLayout.GetAddressOf());
+			vertexShaderBlob->Release();
+		}
+
 		// Ensure the pipeline knows how to interpret all the numbers stored in
 		// the vertex buffer. For this course, all of your vertices will probably
 		// have the same layout, so we can just set this once at startup.
@@ -109,6 +285,17 @@ Game::Game()
 		// Shadow map
 		CreateShadowMapResources();
 
+		// One deferred context per job system thread, for recording
+		// big passes in parallel
+		for (int i = 0; i < jobs.GetThreadCount(); i++) {
+			Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deferred = Graphics::CreateDeferredContext();
+			if (!deferred) {
+				deferredContexts.clear();
+				break;
+			}
+			deferredContexts.push_back(deferred);
+		}
+
 		fogOptions = {
 			.FogType = 1,
 			.FogColor = XMFLOAT3(0.5f, 0.5f, 0.5f),
@@ -203,88 +390,52 @@ void Game::CreateGeometry()
 	lights.push_back(spotLight1);
 
 	// Load Textures
+	// - These stream in, showing placeholders until they're loaded
 	//Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockResource;
 	//Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockNormalsResource;
 	//Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rockNormalsResource;
 	//Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cushionResource;
 	//Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cushionNormalsResource;
 
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodNormalsResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodMetalResource;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodRoughnessResource;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> flatNormalsResource;
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/bronze_albedo.png").c_str(), 0, bronzeResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/bronze_normals.png").c_str(), 0, bronzeNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/bronze_metals.png").c_str(), 0, bronzeMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/bronze_roughness.png").c_str(), 0, bronzeRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/cobblestone_albedo.png").c_str(), 0, cobblestoneResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/cobblestone_normals.png").c_str(), 0, cobblestoneNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/cobblestone_metal.png").c_str(), 0, cobblestoneMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/cobblestone_roughness.png").c_str(), 0, cobblestoneRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/floor_albedo.png").c_str(), 0, floorResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/floor_normals.png").c_str(), 0, floorNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/floor_metal.png").c_str(), 0, floorMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/floor_roughness.png").c_str(), 0, floorRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/paint_albedo.png").c_str(), 0, paintResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/paint_normals.png").c_str(), 0, paintNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/paint_metal.png").c_str(), 0, paintMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/paint_roughness.png").c_str(), 0, paintRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/rough_albedo.png").c_str(), 0, roughResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/rough_normals.png").c_str(), 0, roughNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/rough_metal.png").c_str(), 0, roughMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/rough_roughness.png").c_str(), 0, roughRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/scratched_albedo.png").c_str(), 0, scratchedResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/scratched_normals.png").c_str(), 0, scratchedNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/scratched_metal.png").c_str(), 0, scratchedMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/scratched_roughness.png").c_str(), 0, scratchedRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/wood_albedo.png").c_str(), 0, woodResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/wood_normals.png").c_str(), 0, woodNormalsResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/wood_metal.png").c_str(), 0, woodMetalResource.GetAddressOf());
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/wood_roughness.png").c_str(), 0, woodRoughnessResource.GetAddressOf());
-
-	CreateWICTextureFromFile(Graphics::Device.Get(), Graphics::Context.Get(), FixPath(L"../../Assets/PBR/flat_normals.png").c_str(), 0, flatNormalsResource.GetAddressOf());
+	std::shared_ptr<AsyncTexture> bronzeResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/bronze_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> bronzeNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/bronze_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> bronzeMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/bronze_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> bronzeRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/bronze_roughness.png"), TexturePlaceholder::White);
+
+	std::shared_ptr<AsyncTexture> cobblestoneResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/cobblestone_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> cobblestoneNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/cobblestone_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> cobblestoneMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/cobblestone_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> cobblestoneRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/cobblestone_roughness.png"), TexturePlaceholder::White);
+
+	std::shared_ptr<AsyncTexture> floorResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/floor_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> floorNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/floor_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> floorMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/floor_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> floorRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/floor_roughness.png"), TexturePlaceholder::White);
+
+	std::shared_ptr<AsyncTexture> paintResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/paint_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> paintNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/paint_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> paintMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/paint_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> paintRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/paint_roughness.png"), TexturePlaceholder::White);
+
+	std::shared_ptr<AsyncTexture> roughResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/rough_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> roughNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/rough_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> roughMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/rough_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> roughRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/rough_roughness.png"), TexturePlaceholder::White);
+
+	std::shared_ptr<AsyncTexture> scratchedResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/scratched_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> scratchedNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/scratched_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> scratchedMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/scratched_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> scratchedRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/scratched_roughness.png"), TexturePlaceholder::White);
+
+	std::shared_ptr<AsyncTexture> woodResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/wood_albedo.png"), TexturePlaceholder::White);
+	std::shared_ptr<AsyncTexture> woodNormalsResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/wood_normals.png"), TexturePlaceholder::FlatNormal);
+	std::shared_ptr<AsyncTexture> woodMetalResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/wood_metal.png"), TexturePlaceholder::Black);
+	std::shared_ptr<AsyncTexture> woodRoughnessResource = assets.StreamTexture(FixPath(L"../../Assets/PBR/wood_roughness.png"), TexturePlaceholder::White);
 
 	// Load Shaders
 	shadowVS = Graphics::LoadVertexShader(FixPath(L"ShadowMapVS.cso").c_str());
+	instancedShadowVS = Graphics::LoadVertexShader(FixPath(L"ShadowMapVSInstanced.cso").c_str());
+	instancedVS = Graphics::LoadVertexShader(FixPath(L"VertexShaderInstanced.cso").c_str());
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> firstVertexShader = Graphics::LoadVertexShader(FixPath(L"VertexShader.cso").c_str());
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> firstPixelShader = Graphics::LoadPixelShader(FixPath(L"PixelShader.cso").c_str());
 	//Microsoft::WRL::ComPtr<ID3D11PixelShader> comboPixelShader = Graphics::LoadPixelShader(FixPath(L"ComboPS.cso").c_str());
@@ -294,30 +445,35 @@ void Game::CreateGeometry()
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> normalsPixelShader = LoadPixelShader(L"DebugNormalsPS.cso");
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> customPixelShader = LoadPixelShader(L"CustomPS.cso");*/
 
+	// Load the sky, and the cube it's drawn with, right away - they
+	// have no sensible placeholder
+	std::shared_ptr<AsyncMesh> cube = assets.QueueMesh("Cube", FixPath(L"../../Assets/Meshes/cube.obj"), FixPath(L"../../Assets/Meshes/cube.mesh"));
+	std::shared_ptr<AsyncTexture> skyCubeMap = assets.QueueCubemap(
+		FixPath(L"../../Assets/Skies/Planet/right.png"),
+		FixPath(L"../../Assets/Skies/Planet/left.png"),
+		FixPath(L"../../Assets/Skies/Planet/up.png"),
+		FixPath(L"../../Assets/Skies/Planet/down.png"),
+		FixPath(L"../../Assets/Skies/Planet/front.png"),
+		FixPath(L"../../Assets/Skies/Planet/back.png"));
+
+	// Decode and parse those in parallel, then create the
+	// GPU resources here on the main thread
+	assets.Load();
+	assets.PrintTimeline();
+
 	// Load Meshes
-	std::shared_ptr<Mesh> cube = std::make_shared<Mesh>("Cube", FixPath(L"../../Assets/Meshes/cube.obj").c_str());
-	std::shared_ptr<Mesh> cylinder = std::make_shared<Mesh>("Cylinder", FixPath(L"../../Assets/Meshes/cylinder.obj").c_str());
-	std::shared_ptr<Mesh> helix = std::make_shared<Mesh>("Helix", FixPath(L"../../Assets/Meshes/helix.obj").c_str());
-	std::shared_ptr<Mesh> quad = std::make_shared<Mesh>("Quad", FixPath(L"../../Assets/Meshes/quad.obj").c_str());
-	std::shared_ptr<Mesh> quad_double_sided = std::make_shared<Mesh>("Quad Double Sided", FixPath(L"../../Assets/Meshes/quad_double_sided.obj").c_str());
-	std::shared_ptr<Mesh> sphere = std::make_shared<Mesh>("Sphere", FixPath(L"../../Assets/Meshes/sphere.obj").c_str());
-	std::shared_ptr<Mesh> torus = std::make_shared<Mesh>("Torus", FixPath(L"../../Assets/Meshes/torus.obj").c_str());
+	// - The rest stream in, drawn as a unit cube until they're loaded
+	std::shared_ptr<AsyncMesh> cylinder = assets.StreamMesh("Cylinder", FixPath(L"../../Assets/Meshes/cylinder.obj"), FixPath(L"../../Assets/Meshes/cylinder.mesh"));
+	std::shared_ptr<AsyncMesh> helix = assets.StreamMesh("Helix", FixPath(L"../../Assets/Meshes/helix.obj"), FixPath(L"../../Assets/Meshes/helix.mesh"));
+	std::shared_ptr<AsyncMesh> quad = assets.StreamMesh("Quad", FixPath(L"../../Assets/Meshes/quad.obj"), FixPath(L"../../Assets/Meshes/quad.mesh"));
+	std::shared_ptr<AsyncMesh> quad_double_sided = assets.StreamMesh("Quad Double Sided", FixPath(L"../../Assets/Meshes/quad_double_sided.obj"), FixPath(L"../../Assets/Meshes/quad_double_sided.mesh"));
+	std::shared_ptr<AsyncMesh> sphere = assets.StreamMesh("Sphere", FixPath(L"../../Assets/Meshes/sphere.obj"), FixPath(L"../../Assets/Meshes/sphere.mesh"));
+	std::shared_ptr<AsyncMesh> torus = assets.StreamMesh("Torus", FixPath(L"../../Assets/Meshes/torus.obj"), FixPath(L"../../Assets/Meshes/torus.mesh"));
 
 	// Got this from the demo code, good shortcut to remember
 	meshes.insert(meshes.end(), { cube, cylinder, helix, quad, quad_double_sided, sphere, torus });
 
-	// Load Sky resources
-	sky = std::make_shared<Sky>(
-		FixPath(L"../../Assets/Skies/Planet/right.png").c_str(),
-		FixPath(L"../../Assets/Skies/Planet/left.png").c_str(),
-		FixPath(L"../../Assets/Skies/Planet/up.png").c_str(),
-		FixPath(L"../../Assets/Skies/Planet/down.png").c_str(),
-		FixPath(L"../../Assets/Skies/Planet/front.png").c_str(),
-		FixPath(L"../../Assets/Skies/Planet/back.png").c_str(),
-		cube,
-		skyVertexShader,
-		skyPixelShader,
-		samplerState);
+	sky = std::make_shared<Sky>(skyCubeMap->Get(), cube->Get(), skyVertexShader, skyPixelShader, samplerState);
 
 	// Create Materials
 	//std::shared_ptr<Material> matRed = std::make_shared<Material>("Red", red, firstVertexShader, firstPixelShader);
@@ -335,7 +491,7 @@ void Game::CreateGeometry()
 	matBronzeEnvMap->AddTextureSRV(1, bronzeNormalsResource);
 	matBronzeEnvMap->AddTextureSRV(2, bronzeRoughnessResource);
 	matBronzeEnvMap->AddTextureSRV(3, bronzeMetalResource);
-	matBronzeEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matBronzeEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	std::shared_ptr<Material> matCobblestoneEnvMap = std::make_shared<Material>("Cobblestone with Env Map", XMFLOAT4(1, 1, 1, 1), 0.9f, firstVertexShader, firstPixelShader, XMFLOAT2(2, 2), XMFLOAT2(0, 0));
 	matCobblestoneEnvMap->AddSampler(0, samplerState);
@@ -343,7 +499,7 @@ void Game::CreateGeometry()
 	matCobblestoneEnvMap->AddTextureSRV(1, cobblestoneNormalsResource);
 	matCobblestoneEnvMap->AddTextureSRV(2, cobblestoneRoughnessResource);
 	matCobblestoneEnvMap->AddTextureSRV(3, cobblestoneMetalResource);
-	matCobblestoneEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matCobblestoneEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	std::shared_ptr<Material> matFloorEnvMap = std::make_shared<Material>("Floor with Env Map", XMFLOAT4(1, 1, 1, 1), 0.8f, firstVertexShader, firstPixelShader, XMFLOAT2(2, 2), XMFLOAT2(0, 0));
 	matFloorEnvMap->AddSampler(0, samplerState);
@@ -351,7 +507,7 @@ void Game::CreateGeometry()
 	matFloorEnvMap->AddTextureSRV(1, floorNormalsResource);
 	matFloorEnvMap->AddTextureSRV(2, floorRoughnessResource);
 	matFloorEnvMap->AddTextureSRV(3, floorMetalResource);
-	matFloorEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matFloorEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	std::shared_ptr<Material> matPaintEnvMap = std::make_shared<Material>("Paint with Env Map", XMFLOAT4(1, 1, 1, 1), 0.7f, firstVertexShader, firstPixelShader, XMFLOAT2(2, 2), XMFLOAT2(0, 0));
 	matPaintEnvMap->AddSampler(0, samplerState);
@@ -359,7 +515,7 @@ void Game::CreateGeometry()
 	matPaintEnvMap->AddTextureSRV(1, paintNormalsResource);
 	matPaintEnvMap->AddTextureSRV(2, paintRoughnessResource);
 	matPaintEnvMap->AddTextureSRV(3, paintMetalResource);
-	matPaintEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matPaintEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	std::shared_ptr<Material> matRoughEnvMap = std::make_shared<Material>("Rough Metal with Env Map", XMFLOAT4(1, 1, 1, 1), 0.7f, firstVertexShader, firstPixelShader, XMFLOAT2(2, 2), XMFLOAT2(0, 0));
 	matRoughEnvMap->AddSampler(0, samplerState);
@@ -367,7 +523,7 @@ void Game::CreateGeometry()
 	matRoughEnvMap->AddTextureSRV(1, roughNormalsResource);
 	matRoughEnvMap->AddTextureSRV(2, roughRoughnessResource);
 	matRoughEnvMap->AddTextureSRV(3, roughMetalResource);
-	matRoughEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matRoughEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	std::shared_ptr<Material> matScratchedEnvMap = std::make_shared<Material>("Scratched Metal with Env Map", XMFLOAT4(1, 1, 1, 1), 0.8f, firstVertexShader, firstPixelShader, XMFLOAT2(2, 2), XMFLOAT2(0, 0));
 	matScratchedEnvMap->AddSampler(0, samplerState);
@@ -375,7 +531,7 @@ void Game::CreateGeometry()
 	matScratchedEnvMap->AddTextureSRV(1, scratchedNormalsResource);
 	matScratchedEnvMap->AddTextureSRV(2, scratchedRoughnessResource);
 	matScratchedEnvMap->AddTextureSRV(3, scratchedMetalResource);
-	matScratchedEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matScratchedEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	std::shared_ptr<Material> matWoodEnvMap = std::make_shared<Material>("Wood Metal with Env Map", XMFLOAT4(1, 1, 1, 1), 0.8f, firstVertexShader, firstPixelShader, XMFLOAT2(0.5f, 0.5f), XMFLOAT2(0, 0));
 	matWoodEnvMap->AddSampler(0, samplerState);
@@ -383,108 +539,38 @@ void Game::CreateGeometry()
 	matWoodEnvMap->AddTextureSRV(1, woodNormalsResource);
 	matWoodEnvMap->AddTextureSRV(2, woodRoughnessResource);
 	matWoodEnvMap->AddTextureSRV(3, woodMetalResource);
-	matWoodEnvMap->AddTextureSRV(4, sky->GetTexture());
+	matWoodEnvMap->AddTextureSRV(4, skyCubeMap);
 
 	materials.insert(materials.end(), { matBronzeEnvMap, matCobblestoneEnvMap, matFloorEnvMap, matPaintEnvMap, matRoughEnvMap, matScratchedEnvMap, matWoodEnvMap });
 
 
-	//std::shared_ptr<GameEntity> cube1 = std::make_shared<GameEntity>(cube, matNormals);
-	//std::shared_ptr<GameEntity> cube2 = std::make_shared<GameEntity>(cube, matUV);
-	//std::shared_ptr<GameEntity> cube3 = std::make_shared<GameEntity>(cube, matCobblestoneEnvMap);
-	//std::shared_ptr<GameEntity> cylinder1 = std::make_shared<GameEntity>(cylinder, matNormals);
-	//std::shared_ptr<GameEntity> cylinder2 = std::make_shared<GameEntity>(cylinder, matUV);
-	//std::shared_ptr<GameEntity> cylinder3 = std::make_shared<GameEntity>(cylinder, matRockEnvMap);
-	//std::shared_ptr<GameEntity> helix1 = std::make_shared<GameEntity>(helix, matNormals);
-	//std::shared_ptr<GameEntity> helix2 = std::make_shared<GameEntity>(helix, matUV);
-	//std::shared_ptr<GameEntity> helix3 = std::make_shared<GameEntity>(helix, matCobblestoneEnvMap);
-	//std::shared_ptr<GameEntity> sphere1 = std::make_shared<GameEntity>(sphere, matNormals);
-	//std::shared_ptr<GameEntity> sphere2 = std::make_shared<GameEntity>(sphere, matUV);
-	//std::shared_ptr<GameEntity> sphere3 = std::make_shared<GameEntity>(sphere, matCushionEnvMap);
-	//std::shared_ptr<GameEntity> torus1 = std::make_shared<GameEntity>(torus, matNormals);
-	//std::shared_ptr<GameEntity> torus2 = std::make_shared<GameEntity>(torus, matUV);
-	//std::shared_ptr<GameEntity> torus3 = std::make_shared<GameEntity>(torus, matRockEnvMap);
-	//std::shared_ptr<GameEntity> quad1 = std::make_shared<GameEntity>(quad, matNormals);
-	//std::shared_ptr<GameEntity> quad2 = std::make_shared<GameEntity>(quad, matUV);
-	//std::shared_ptr<GameEntity> quad3 = std::make_shared<GameEntity>(quad, matCobblestoneEnvMap);
-	//std::shared_ptr<GameEntity> quad_double_sided1 = std::make_shared<GameEntity>(quad_double_sided, matNormals);
-	//std::shared_ptr<GameEntity> quad_double_sided2 = std::make_shared<GameEntity>(quad_double_sided, matUV);
-	//std::shared_ptr<GameEntity> quad_double_sided3 = std::make_shared<GameEntity>(quad_double_sided, matCushionEnvMap);
-
-	std::shared_ptr<GameEntity> bronzeSphere = std::make_shared<GameEntity>(sphere, matBronzeEnvMap);
-	std::shared_ptr<GameEntity> cobblestoneSphere = std::make_shared<GameEntity>(sphere, matCobblestoneEnvMap);
-	std::shared_ptr<GameEntity> floorSphere = std::make_shared<GameEntity>(sphere, matFloorEnvMap);
-	std::shared_ptr<GameEntity> paintSphere = std::make_shared<GameEntity>(sphere, matPaintEnvMap);
-	std::shared_ptr<GameEntity> roughSphere = std::make_shared<GameEntity>(sphere, matRoughEnvMap);
-	std::shared_ptr<GameEntity> scratchedSphere = std::make_shared<GameEntity>(sphere, matScratchedEnvMap);
-	std::shared_ptr<GameEntity> woodSphere = std::make_shared<GameEntity>(sphere, matWoodEnvMap);
-	std::shared_ptr<GameEntity> woodFloor = std::make_shared<GameEntity>(quad_double_sided, matWoodEnvMap);
-	std::shared_ptr<GameEntity> paintHelix = std::make_shared<GameEntity>(helix, matPaintEnvMap);
-
-
-	//cube1->GetTransform().MoveAbsolute(15.0f, 5.0f, -10.0f);
-	//cube2->GetTransform().MoveAbsolute(15.0f, 0.0f, -10.0f);
-	//cube3->GetTransform().MoveAbsolute(-15.0f, -5.0f, 10.0f);
-	bronzeSphere->GetTransform().MoveAbsolute(-15.0f, -5.0f, 10.0f);
-	//cylinder1->GetTransform().MoveAbsolute(10.0f, 5.0f, -10.0f);
-	//cylinder2->GetTransform().MoveAbsolute(10.0f, 0.0f, -10.0f);
-	//cylinder3->GetTransform().MoveAbsolute(-10.0f, -5.0f, 10.0f);
-	cobblestoneSphere->GetTransform().MoveAbsolute(-10.0f, -5.0f, 10.0f);
-	//helix1->GetTransform().MoveAbsolute(5.0f, 5.0f, -10.0f);
-	//helix2->GetTransform().MoveAbsolute(5.0f, 0.0f, -10.0f);
-	//helix3->GetTransform().MoveAbsolute(-5.0f, -5.0f, 10.0f);
-	floorSphere->GetTransform().MoveAbsolute(-5.0f, -5.0f, 10.0f);
-	//sphere1->GetTransform().MoveAbsolute(0.0f, 5.0f, -10.0f);
-	//sphere2->GetTransform().MoveAbsolute(0.0f, 0.0f, -10.0f);
-	//sphere3->GetTransform().MoveAbsolute(0.0f, -5.0f, 10.0f);
-	paintHelix->GetTransform().MoveAbsolute(0.0f, -5.0f, 10.0f);
-	//torus1->GetTransform().MoveAbsolute(-5.0f, 5.0f, -10.0f);
-	//torus2->GetTransform().MoveAbsolute(-5.0f, 0.0f, -10.0f);
-	//torus3->GetTransform().MoveAbsolute(5.0f, -5.0f, 10.0f);
-	roughSphere->GetTransform().MoveAbsolute(5.0f, -5.0f, 10.0f);
-	//quad1->GetTransform().MoveAbsolute(-10.0f, 5.0f, -10.0f);
-	//quad2->GetTransform().MoveAbsolute(-10.0f, 0.0f, -10.0f);
-	//quad3->GetTransform().MoveAbsolute(10.0f, -5.0f, 10.0f);
-	scratchedSphere->GetTransform().MoveAbsolute(10.0f, -5.0f, 10.0f);
-	//quad_double_sided1->GetTransform().MoveAbsolute(-15.0f, 5.0f, -10.0f);
-	//quad_double_sided2->GetTransform().MoveAbsolute(-15.0f, 0.0f, -10.0f);
-	//quad_double_sided3->GetTransform().MoveAbsolute(15.0f, -5.0f, 10.0f);
-	woodSphere->GetTransform().MoveAbsolute(15.0f, -5.0f, 10.0f);
-	woodFloor->GetTransform().MoveAbsolute(0.0f, -8.0f, 10.0f);
-	woodFloor->GetTransform().SetScale(20.0f, 20.0f, 20.0f);
-
-	//entities.push_back(cube1);
-	//entities.push_back(cube2);
-	entities.push_back(bronzeSphere);
-	//entities.push_back(cylinder1);
-	//entities.push_back(cylinder2);
-	entities.push_back(cobblestoneSphere);
-	//entities.push_back(helix1);
-	//entities.push_back(helix2);
-	entities.push_back(floorSphere);
-	//entities.push_back(quad1);
-	//entities.push_back(quad2);
-	entities.push_back(paintHelix);
-	//entities.push_back(quad_double_sided1);
-	//entities.push_back(quad_double_sided2);
-	entities.push_back(roughSphere);
-	//entities.push_back(sphere1);
-	//entities.push_back(sphere2);
-	entities.push_back(scratchedSphere);
-	//entities.push_back(torus1);
-	//entities.push_back(torus2);
-	//entities.push_back(sphere3);
-	entities.push_back(woodSphere);
-	entities.push_back(woodFloor);
+	// Entities, handles into meshes and materials
+	auto createEntity = [&](std::shared_ptr<AsyncMesh> mesh, std::shared_ptr<Material> material, XMFLOAT3 position) {
+		EntityId id = entities.Create(HandleOf(meshes, mesh), HandleOf(materials, material));
+		entities.SetPosition(entities.GetIndex(id), position);
+		return id;
+	};
+
+	createEntity(sphere, matBronzeEnvMap, XMFLOAT3(-15.0f, -5.0f, 10.0f));
+	createEntity(sphere, matCobblestoneEnvMap, XMFLOAT3(-10.0f, -5.0f, 10.0f));
+	createEntity(sphere, matFloorEnvMap, XMFLOAT3(-5.0f, -5.0f, 10.0f));
+	bobbingHelix = createEntity(helix, matPaintEnvMap, XMFLOAT3(0.0f, -5.0f, 10.0f));
+	entities.SetDynamic(entities.GetIndex(bobbingHelix), true); // Moves every frame - keep it out of the shadow cache
+	createEntity(sphere, matRoughEnvMap, XMFLOAT3(5.0f, -5.0f, 10.0f));
+	createEntity(sphere, matScratchedEnvMap, XMFLOAT3(10.0f, -5.0f, 10.0f));
+	createEntity(sphere, matWoodEnvMap, XMFLOAT3(15.0f, -5.0f, 10.0f));
+	EntityId woodFloor = createEntity(quad_double_sided, matWoodEnvMap, XMFLOAT3(0.0f, -8.0f, 10.0f));
+	entities.SetScale(entities.GetIndex(woodFloor), XMFLOAT3(20.0f, 20.0f, 20.0f));
 
 	CreatePostProcessResource();
 }
 
 void Game::CreateShadowMapResources() {
-	// Create shadow texture
+	// Create shadow texture - one slice per cascade
 	D3D11_TEXTURE2D_DESC shadowDesc = {};
-	shadowDesc.Width = 1024; // shadowMapResolution
-	shadowDesc.Height = 1024; // shadowMapResolution
-	shadowDesc.ArraySize = 1;
+	shadowDesc.Width = ShadowMapResolution;
+	shadowDesc.Height = ShadowMapResolution;
+	shadowDesc.ArraySize = ShadowCascades::MaxCascades;
 	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	shadowDesc.CPUAccessFlags = 0;
 	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
@@ -493,23 +579,33 @@ void Game::CreateShadowMapResources() {
 	shadowDesc.SampleDesc.Count = 1;
 	shadowDesc.SampleDesc.Quality = 0;
 	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
-	Graphics::Device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
-
-	// Create depth/stencil view
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	Graphics::Device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDSV.GetAddressOf());
+	Graphics::Device->CreateTexture2D(&shadowDesc, 0, shadowMap.GetAddressOf());
+
+	// The static casters' cache - only ever drawn to and copied from
+	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	Graphics::Device->CreateTexture2D(&shadowDesc, 0, staticShadowMap.GetAddressOf());
+
+	// Create a depth/stencil view per slice, to render each cascade
+	for (int i = 0; i < ShadowCascades::MaxCascades; i++) {
+		D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
+		shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		shadowDSDesc.Texture2DArray.MipSlice = 0;
+		shadowDSDesc.Texture2DArray.FirstArraySlice = i;
+		shadowDSDesc.Texture2DArray.ArraySize = 1;
+		Graphics::Device->CreateDepthStencilView(shadowMap.Get(), &shadowDSDesc, shadowDSVs[i].GetAddressOf());
+		Graphics::Device->CreateDepthStencilView(staticShadowMap.Get(), &shadowDSDesc, staticShadowDSVs[i].GetAddressOf());
+	}
 
-	// Create the SRV for the shadow map
+	// Create the SRV for the shadow map - every slice at once
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	Graphics::Device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowSRV.GetAddressOf());
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = ShadowCascades::MaxCascades;
+	Graphics::Device->CreateShaderResourceView(shadowMap.Get(), &srvDesc, shadowSRV.GetAddressOf());
 
 	// Declare rasterizer state object
 	D3D11_RASTERIZER_DESC shadowRastDesc = {};
@@ -529,21 +625,16 @@ void Game::CreateShadowMapResources() {
 	shadowSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
 	shadowSampDesc.BorderColor[0] = 1.0f; // Only need the first component
 	Graphics::Device->CreateSamplerState(&shadowSampDesc, &shadowSampler);
-
-	XMMATRIX lightView = XMMatrixLookAtLH(XMLoadFloat3(&lights[0].Direction) * -20, XMLoadFloat3(&lights[0].Direction), XMVectorSet(0, 1, 0, 0));
-	XMStoreFloat4x4(&lightViewMatrix, lightView);
-
-	// Light Projection
-	float lightProjectionSize = 15.0f;
-	
-	XMMATRIX lightProj = XMMatrixOrthographicLH(lightProjectionSize, lightProjectionSize, 1.0f, 100.0f);
-	XMStoreFloat4x4(&lightProjectionMatrix, lightProj);
 }
 
 void Game::CreatePostProcessResource()
 {
 	// Load shader
 	ppPS = Graphics::LoadPixelShader(FixPath(L"BlurPS.cso").c_str());
+	copyPS = Graphics::LoadPixelShader(FixPath(L"CopyPS.cso").c_str());
+	tonemapPS = Graphics::LoadPixelShader(FixPath(L"TonemapPS.cso").c_str());
+	histogramCS = Graphics::LoadComputeShader(FixPath(L"LuminanceHistogramCS.cso").c_str());
+	averageLuminanceCS = Graphics::LoadComputeShader(FixPath(L"AverageLuminanceCS.cso").c_str());
 	fullscreenVS = Graphics::LoadVertexShader(FixPath(L"FullscreenVS.cso").c_str());
 
 
@@ -557,41 +648,173 @@ void Game::CreatePostProcessResource()
 	ppSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	ppSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
 	Graphics::Device->CreateSamplerState(&ppSampDesc, ppSampler.GetAddressOf());
+
+	// Auto-exposure's histogram, and the adapted luminance - both
+	// start at 0, which the compute shaders treat as no history
+	unsigned int zeros[Exposure::HistogramBins] = {};
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = zeros;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = sizeof(zeros);
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(unsigned int);
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> histogramBuffer;
+	Graphics::Device->CreateBuffer(&bufferDesc, &initialData, histogramBuffer.GetAddressOf());
+	Graphics::Device->CreateUnorderedAccessView(histogramBuffer.Get(), 0, histogramUAV.GetAddressOf());
+
+	bufferDesc.ByteWidth = sizeof(float);
+	bufferDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.StructureByteStride = sizeof(float);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> luminanceBuffer;
+	Graphics::Device->CreateBuffer(&bufferDesc, &initialData, luminanceBuffer.GetAddressOf());
+	Graphics::Device->CreateUnorderedAccessView(luminanceBuffer.Get(), 0, adaptedLuminanceUAV.GetAddressOf());
+	Graphics::Device->CreateShaderResourceView(luminanceBuffer.Get(), 0, adaptedLuminanceSRV.GetAddressOf());
 }
 
 void Game::ResizedPostProcessResources() {
-	// Reset existing SRV and RTV ComPtrs
-	ppSRV.Reset();
-	ppRTV.Reset();
-
-	// Describe texture
-	D3D11_TEXTURE2D_DESC textureDesc = {};
-	textureDesc.Width = Window::Width();
-	textureDesc.Height = Window::Height();
-	textureDesc.ArraySize = 1;
-	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	textureDesc.CPUAccessFlags = 0;
-	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	textureDesc.MipLevels = 1;
-	textureDesc.MiscFlags = 0;
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Usage = D3D11_USAGE_DEFAULT;
-
-	// Create the resource (no need to track it after the views are created below)
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ppTexture;
-	Graphics::Device->CreateTexture2D(&textureDesc, 0, ppTexture.GetAddressOf());
-
-	// Create the Render Target View
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
-	rtvDesc.Format = textureDesc.Format;
-	rtvDesc.Texture2D.MipSlice = 0;
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	Graphics::Device->CreateRenderTargetView(ppTexture.Get(), &rtvDesc, ppRTV.ReleaseAndGetAddressOf());
-
-	// Create the Shader Resource View
-	// By passing it a null description for the SRV, we get a "default" SRV that has access to the entire resource
-	Graphics::Device->CreateShaderResourceView(ppTexture.Get(), 0, ppSRV.ReleaseAndGetAddressOf());
+	BuildPostProcessGraph();
+}
+
+// --------------------------------------------------------
+// Describes the post process passes for the current settings and
+// gets textures for them.  Everything up to tonemapping is linear
+// HDR.  Auto-exposure measures the scene as drawn; below full
+// resolution the scene is then halved (a 2x2 average each time)
+// down to the blur's level, the blur itself is two passes -
+// across, then down - and tonemapping stretches the result back
+// over the screen.  Targets are only declared here; the graph
+// works out which can share a texture.
+// --------------------------------------------------------
+void Game::BuildPostProcessGraph() {
+	static constexpr DXGI_FORMAT hdrFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	static constexpr int hdrBytes = 8;
+	postGraphLevel = blurDistance > 0 ? blurLevel : -1;
+	int level = postGraphLevel > 0 ? postGraphLevel : 0;
+
+	postGraph.Clear();
+	sceneTarget = postGraph.AddTarget("Scene", { hdrFormat, hdrBytes, 0 });
+	postGraph.AddPass("Scene", {}, sceneTarget); // The main pass
+	postGraph.AddPass("Auto-Exposure", { sceneTarget }, PostProcessGraph::NoOutput, [this]() { MeasureLuminance(sceneTarget); });
+
+	int current = sceneTarget;
+	for (int l = 1; l <= level; l++) {
+		int half = postGraph.AddTarget("Downsample 1/" + std::to_string(1 << l), { hdrFormat, hdrBytes, l });
+		postGraph.AddPass("Downsample", { current }, half, [this, current, half]() { DrawFullscreenPass(copyPS.Get(), current, half); });
+		current = half;
+	}
+
+	if (postGraphLevel >= 0) {
+		int across = postGraph.AddTarget("Blurred Across", { hdrFormat, hdrBytes, level });
+		postGraph.AddPass("Blur Across", { current }, across, [this, current, across]() { DrawBlurPass(current, across, true); });
+		int down = postGraph.AddTarget("Blurred", { hdrFormat, hdrBytes, level });
+		postGraph.AddPass("Blur Down", { across }, down, [this, across, down]() { DrawBlurPass(across, down, false); });
+		current = down;
+	}
+
+	postGraph.AddPass("Tonemap", { current }, PostProcessGraph::BackBuffer, [this, current]() { DrawTonemapPass(current); });
+
+	if (!postGraph.Compile(Window::Width(), Window::Height()))
+		printf("Post process graph: %s\n", postGraph.GetError().c_str());
+	postTargets.Realize(postGraph);
+}
+
+// --------------------------------------------------------
+// Draws a fullscreen triangle into a graph target (or the back
+// buffer) with pixelShader, sampling another at t0
+// --------------------------------------------------------
+void Game::DrawFullscreenPass(ID3D11PixelShader* pixelShader, int source, int target) {
+	ID3D11RenderTargetView* rtv = Graphics::BackBufferRTV.Get();
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)Window::Width();
+	viewport.Height = (float)Window::Height();
+	viewport.MaxDepth = 1.0f;
+	if (target != PostProcessGraph::BackBuffer) {
+		RenderTarget& texture = postTargets.Get(postGraph, target);
+		rtv = texture.RTV.Get();
+		viewport.Width = (float)texture.Width;
+		viewport.Height = (float)texture.Height;
+	}
+
+	// Unbind the last pass's source first, in case it shares a texture with this target
+	ID3D11ShaderResourceView* srv = 0;
+	Graphics::Context->PSSetShaderResources(0, 1, &srv);
+	Graphics::Context->OMSetRenderTargets(1, &rtv, 0);
+	Graphics::Context->RSSetViewports(1, &viewport);
+
+	srv = postTargets.Get(postGraph, source).SRV.Get();
+	Graphics::Context->PSSetShader(pixelShader, 0, 0);
+	Graphics::Context->PSSetShaderResources(0, 1, &srv);
+	Graphics::Context->Draw(3, 0);
+}
+
+// --------------------------------------------------------
+// One axis of the blur, with its radius scaled down to the
+// source's resolution so it covers the same part of the screen
+// --------------------------------------------------------
+void Game::DrawBlurPass(int source, int target, bool horizontal) {
+	int scale = 1 << postGraph.GetTargets()[source].Desc.ScaleShift;
+	BlurKernel kernel = Blur::MakeKernel((Blur::KernelType)blurKernel, (blurDistance + scale - 1) / scale);
+
+	RenderTarget& texture = postTargets.Get(postGraph, source);
+	BlurPSData blurData = {};
+	blurData.texelStep = horizontal ?
+		XMFLOAT2(1.0f / texture.Width, 0.0f) :
+		XMFLOAT2(0.0f, 1.0f / texture.Height);
+	blurData.tapCount = kernel.TapCount;
+	blurData.centerWeight = kernel.CenterWeight;
+	for (int t = 0; t < kernel.TapCount; t++)
+		blurData.taps[t] = XMFLOAT4(kernel.Taps[t].Offset, kernel.Taps[t].Weight, 0, 0);
+	Graphics::FillAndBindNextConstantBuffer(&blurData, sizeof(BlurPSData), D3D11_PIXEL_SHADER, 0);
+
+	DrawFullscreenPass(ppPS.Get(), source, target);
+}
+
+// --------------------------------------------------------
+// Bins the scene's luminance into the histogram, then averages
+// it and adapts towards the average, all on the GPU - nothing is
+// read back
+// --------------------------------------------------------
+void Game::MeasureLuminance(int source) {
+	if (!autoExposure)
+		return;
+
+	RenderTarget& scene = postTargets.Get(postGraph, source);
+	frameExposure.inputWidth = scene.Width;
+	frameExposure.inputHeight = scene.Height;
+	frameExposure.pixelCount = scene.Width * scene.Height;
+	Graphics::FillAndBindNextConstantBuffer(&frameExposure, sizeof(ExposureData), D3D11_COMPUTE_SHADER, 0);
+
+	// The main pass leaves the scene bound for drawing
+	Graphics::Context->OMSetRenderTargets(0, 0, 0);
+	ID3D11UnorderedAccessView* uavs[2] = { histogramUAV.Get(), adaptedLuminanceUAV.Get() };
+	Graphics::Context->CSSetUnorderedAccessViews(0, 2, uavs, 0);
+	Graphics::Context->CSSetShaderResources(0, 1, scene.SRV.GetAddressOf());
+
+	Graphics::Context->CSSetShader(histogramCS.Get(), 0, 0);
+	Graphics::Context->Dispatch(
+		(scene.Width + Exposure::GroupSize - 1) / Exposure::GroupSize,
+		(scene.Height + Exposure::GroupSize - 1) / Exposure::GroupSize,
+		1);
+	Graphics::Context->CSSetShader(averageLuminanceCS.Get(), 0, 0);
+	Graphics::Context->Dispatch(1, 1, 1);
+
+	// Unbind everything, so the pixel shaders can read it
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	ID3D11ShaderResourceView* nullSRV = 0;
+	Graphics::Context->CSSetUnorderedAccessViews(0, 2, nullUAVs, 0);
+	Graphics::Context->CSSetShaderResources(0, 1, &nullSRV);
+}
+
+// --------------------------------------------------------
+// Exposes, tonemaps and gamma corrects onto the back buffer
+// --------------------------------------------------------
+void Game::DrawTonemapPass(int source) {
+	Graphics::FillAndBindNextConstantBuffer(&frameExposure, sizeof(ExposureData), D3D11_PIXEL_SHADER, 0);
+	Graphics::Context->PSSetShaderResources(1, 1, adaptedLuminanceSRV.GetAddressOf());
+	DrawFullscreenPass(tonemapPS.Get(), source, PostProcessGraph::BackBuffer);
 }
 
 // --------------------------------------------------------
@@ -615,6 +838,9 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	// Swap in any textures and meshes that finished streaming
+	assets.Update();
+
 	activeCamera->Update(deltaTime);
 	UpdateImGui(deltaTime);
 
@@ -625,14 +851,10 @@ void Game::Update(float deltaTime, float totalTime)
 	if (Input::KeyDown(VK_ESCAPE))
 		Window::Quit();
 
-	entities[3]->GetTransform().SetPosition(0.0f, (float)sin(totalTime)*2.0f-5.5f, 10);
-	//entities[2]->GetTransform().Rotate(0, deltaTime * 1.0f, 0);
-	//entities[3]->GetTransform().SetScale((float)sin(totalTime)*0.5f+1.0f, (float)sin(totalTime)*0.5f+1.0f, 0.0f);
-	//for (std::shared_ptr<GameEntity> entity : entities) {
-	//	Transform transform = entity->GetTransform();
-	//	XMFLOAT3 currentPYR = transform.GetPitchYawRoll();
-	//	entity->GetTransform().Rotate(currentPYR.x, deltaTime * 1.0f, currentPYR.z);
-	//}
+	entities.SetPosition(entities.GetIndex(bobbingHelix), XMFLOAT3(0.0f, (float)sin(totalTime)*2.0f-5.5f, 10));
+
+	// Everything's moved - work out what to draw
+	PrepareFrame();
 }
 
 
@@ -653,91 +875,155 @@ void Game::Draw(float deltaTime, float totalTime)
 	}
 
 	RenderShadowMap();
-	Graphics::Context->PSSetShaderResources(5, 1, shadowSRV.GetAddressOf());
-	Graphics::Context->PSSetSamplers(1, 1, shadowSampler.GetAddressOf());
-
 
 	// Post - process Pre Draw
-	Graphics::Context->ClearRenderTargetView(ppRTV.Get(), clearColor);
-	Graphics::Context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
+	if ((blurDistance > 0 ? blurLevel : -1) != postGraphLevel)
+		BuildPostProcessGraph();
+	ID3D11RenderTargetView* sceneRTV = postTargets.Get(postGraph, sceneTarget).RTV.Get();
+	Graphics::Context->ClearRenderTargetView(sceneRTV, clearColor);
 
 	{
 
-		// loop through entities and draw them
-		for (std::shared_ptr<GameEntity> entity : entities) {
-			// Bind textures and samplers
-			entity->GetMaterial()->BindTexturesAndSamplers();
-
-			// Bind material shaders
-			Graphics::Context->VSSetShader(entity->GetMaterial()->GetVertexShader().Get(), 0, 0);
-			Graphics::Context->PSSetShader(entity->GetMaterial()->GetPixelShader().Get(), 0, 0);
-
-			// VS DATA
-			VertexShaderData vsData;
-			//cbData.colorTint = entity->GetMaterial()->GetColorTint();
-			vsData.world = entity->GetTransform().GetWorldMatrix();
-			vsData.worldInvTranspose = entity->GetTransform().GetWorldInverseTransposeMatrix();
-			vsData.projection = activeCamera->GetProjectionMatrix();
-			vsData.view = activeCamera->GetViewMatrix();
-			vsData.lightView = lightViewMatrix;
-			vsData.lightProj = lightProjectionMatrix;
-			Graphics::FillAndBindNextConstantBuffer(&vsData, sizeof(VertexShaderData), D3D11_VERTEX_SHADER, 0);
-
-			// PS DATA
-			PixelShaderData psData;
-			memcpy(&psData.lights, &lights[0], sizeof(Light) * (int)lights.size());
-			psData.lightCount = (int)lights.size();
-			psData.ambientLight = ambientLight;
-			psData.colorTint = entity->GetMaterial()->GetColorTint();
-			psData.roughness = entity->GetMaterial()->GetRoughness();
-			psData.cameraPos = activeCamera->transform.GetPosition();
-			psData.uvScale = entity->GetMaterial()->GetUVScale();
-			psData.uvOffset = entity->GetMaterial()->GetUVOffset();
-			psData.fogType = fogOptions.FogType;
-			psData.fogColor = fogOptions.FogColor;
-			psData.fogStartDist = fogOptions.FogStartDistance;
-			psData.fogEndDist = fogOptions.FogEndDistance;
-			psData.fogDensity = fogOptions.FogDensity;
-			psData.heightBasedFog = fogOptions.HeightBasedFog;
-			psData.fogVerticalDensity = fogOptions.FogVerticalDensity;
-			psData.fogHeight = fogOptions.FogHeight;
-			psData.farClipDistance = activeCamera->farClip;
-			
-			Graphics::FillAndBindNextConstantBuffer(&psData, sizeof(PixelShaderData), D3D11_PIXEL_SHADER, 0);
-
-			entity->Draw();
+		// Instanced, object data goes in the instance buffer rather
+		// than the constant ring
+		if (hardwareInstancing)
+			UploadInstances(mainQueue);
+		unsigned int objectConstantSize = hardwareInstancing ? 0 : Graphics::ConstantSize(sizeof(PerObjectVSData));
+
+		// Write all of the main pass's constants under one map
+		// - Worst case every material is in view
+		int maxMaterials = (int)materials.size() < mainQueue.GetCount() ? (int)materials.size() : mainQueue.GetCount();
+		Graphics::BeginConstantUploads(
+			Graphics::ConstantSize(sizeof(PerFrameVSData)) +
+			Graphics::ConstantSize(sizeof(PerFramePSData)) +
+			maxMaterials * Graphics::ConstantSize(sizeof(PerMaterialPSData)) +
+			mainQueue.GetCount() * objectConstantSize);
+
+		// Per-frame data, shared by every entity
+		Graphics::ConstantAllocation frameVSConstants = Graphics::AllocateConstants(sizeof(PerFrameVSData));
+		PerFrameVSData* frameVSData = (PerFrameVSData*)frameVSConstants.Data;
+		frameVSData->view = activeCamera->GetViewMatrix();
+		frameVSData->projection = activeCamera->GetProjectionMatrix();
+
+		Graphics::ConstantAllocation framePSConstants = Graphics::AllocateConstants(sizeof(PerFramePSData));
+		PerFramePSData* framePSData = (PerFramePSData*)framePSConstants.Data;
+		framePSData->directionalLightCount = frameDirectionalLights;
+		framePSData->ambientLight = ambientLight;
+		framePSData->cameraPos = activeCamera->transform.GetPosition();
+		framePSData->farClipDistance = activeCamera->farClip;
+		framePSData->fogType = fogOptions.FogType;
+		framePSData->fogColor = fogOptions.FogColor;
+		framePSData->fogStartDist = fogOptions.FogStartDistance;
+		framePSData->fogEndDist = fogOptions.FogEndDistance;
+		framePSData->fogDensity = fogOptions.FogDensity;
+		framePSData->heightBasedFog = fogOptions.HeightBasedFog;
+		framePSData->fogVerticalDensity = fogOptions.FogVerticalDensity;
+		framePSData->fogHeight = fogOptions.FogHeight;
+		float splits[ShadowCascades::MaxCascades] = {};
+		for (int c = 0; c < cascadeCount; c++) {
+			framePSData->shadowViewProjections[c] = cascades[c].ViewProjection;
+			splits[c] = cascades[c].SplitFar;
 		}
+		framePSData->cascadeSplits = XMFLOAT4(splits[0], splits[1], splits[2], splits[3]);
+		framePSData->cameraForward = activeCamera->transform.GetForward();
+		framePSData->cascadeCount = cascadeCount;
+		framePSData->clusterTilesX = LightClusters::TilesX;
+		framePSData->clusterTilesY = LightClusters::TilesY;
+		framePSData->clusterSlices = LightClusters::Slices;
+		framePSData->clusterSliceScale = lightClusters.GetSliceScale();
+		framePSData->clusterTileScale = XMFLOAT2((float)LightClusters::TilesX / Window::Width(), (float)LightClusters::TilesY / Window::Height());
+		framePSData->clusterSliceBias = lightClusters.GetSliceBias();
+		framePSData->shadowedLight = frameShadowedLight;
+
+		// Material data once for each material in view, indexed by
+		// material - a chunk recorded on its own can start anywhere in
+		// a material's run, so it can't be tied to the run's first
+		// entity.  Object data for everything, indexed by entity.
+		std::vector<Graphics::ConstantAllocation> materialConstants(materials.size());
+		std::vector<bool> materialWritten(materials.size());
+		std::vector<Graphics::ConstantAllocation> objectConstants(entities.GetCount());
+		const XMFLOAT4X4* world = entities.GetWorldMatrices();
+		const XMFLOAT4X4* worldInverseTranspose = entities.GetWorldInverseTransposeMatrices();
+		for (int d = 0; d < mainQueue.GetCount(); d++) {
+			int e = mainQueue.GetItem(d);
+			uint32_t m = entities.GetMaterial(e);
+
+			if (!materialWritten[m]) {
+				Material* material = materials[m].get();
+				materialConstants[m] = Graphics::AllocateConstants(sizeof(PerMaterialPSData));
+				PerMaterialPSData* materialData = (PerMaterialPSData*)materialConstants[m].Data;
+				materialData->colorTint = material->GetColorTint();
+				materialData->uvScale = material->GetUVScale();
+				materialData->uvOffset = material->GetUVOffset();
+				materialData->roughness = material->GetRoughness();
+				materialWritten[m] = true;
+			}
+
+			if (hardwareInstancing)
+				continue;
+
+			objectConstants[e] = Graphics::AllocateConstants(sizeof(PerObjectVSData));
+			PerObjectVSData* objectData = (PerObjectVSData*)objectConstants[e].Data;
+			objectData->world = world[e];
+			objectData->worldInvTranspose = worldInverseTranspose[e];
+		}
+		Graphics::EndConstantUploads();
+
+		// Lights, and which ones each cluster shades
+		UploadStructured(lightBuffer, frameLights.data(), (int)frameLights.size(), sizeof(Light));
+		UploadStructured(clusterRangeBuffer, lightClusters.GetRanges(), LightClusters::ClusterCount, sizeof(ClusterRange));
+		UploadStructured(clusterIndexBuffer, lightClusters.GetLightIndices(), lightClusters.GetLightIndexCount(), sizeof(uint32_t));
+
+		// Everything the main pass needs besides what the queue binds
+		std::function<void(ID3D11DeviceContext1*)> mainPassState = [&](ID3D11DeviceContext1* context) {
+			context->OMSetRenderTargets(1, &sceneRTV, Graphics::DepthBufferDSV.Get());
+			D3D11_VIEWPORT viewport = {};
+			viewport.Width = (float)Window::Width();
+			viewport.Height = (float)Window::Height();
+			viewport.MaxDepth = 1.0f;
+			context->RSSetViewports(1, &viewport);
+			context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			context->IASetInputLayout(hardwareInstancing ? instancedInputLayout.Get() : inputLayout.Get());
+			if (hardwareInstancing)
+				BindInstances(context);
+
+			context->PSSetShaderResources(5, 1, shadowSRV.GetAddressOf());
+			context->PSSetSamplers(1, 1, shadowSampler.GetAddressOf());
+			ID3D11ShaderResourceView* lightSRVs[3] = { lightBuffer.SRV.Get(), clusterRangeBuffer.SRV.Get(), clusterIndexBuffer.SRV.Get() };
+			context->PSSetShaderResources(6, 3, lightSRVs);
+			Graphics::BindConstants(frameVSConstants, D3D11_VERTEX_SHADER, 0, context);
+			Graphics::BindConstants(framePSConstants, D3D11_PIXEL_SHADER, 0, context);
+		};
+		mainPassState(Graphics::ImmediateContext1());
+
+		// Draw the entities the camera can see in sorted order
+		// - Shaders, materials and meshes are only re-bound when they change
+		// - Instanced, each run of the same mesh and material is one draw
+		mainPassStats = SubmitPass(mainQueue, &materialConstants, &objectConstants, instancedVS.Get(), mainPassState);
+		Graphics::Context->IASetInputLayout(inputLayout.Get());
 
 		// draw sky after normal entities
 		sky->Draw(activeCamera);
 
 		// Post-processing - Post Draw
 		{
-			Graphics::Context->OMSetRenderTargets(1, Graphics::BackBufferRTV.GetAddressOf(), 0);
+			frameExposure = {};
+			frameExposure.minLogLuminance = exposureSettings.MinLogLuminance;
+			frameExposure.logLuminanceRange = exposureSettings.LogLuminanceRange;
+			frameExposure.timeDelta = deltaTime;
+			frameExposure.adaptationRate = exposureSettings.AdaptationRate;
+			frameExposure.keyValue = exposureSettings.KeyValue;
+			frameExposure.exposureCompensation = exposureSettings.Compensation;
+			frameExposure.autoExposure = autoExposure;
+			frameExposure.tonemapper = tonemapper;
 
-			// Activate shaders and bind resources
 			Graphics::Context->VSSetShader(fullscreenVS.Get(), 0, 0);
-			Graphics::Context->PSSetShader(ppPS.Get(), 0, 0);
-
-			Graphics::Context->PSSetShaderResources(0, 1, ppSRV.GetAddressOf());
 			Graphics::Context->PSSetSamplers(0, 1, ppSampler.GetAddressOf());
+			postGraph.Execute();
 
-			// set required cbuffer data here
-			struct BlurData {
-				int blurDistance;
-				float pixelWidth;
-				float pixelHeight;
-			};
-			BlurData blurData = {};
-			blurData.pixelWidth = 1.0f / Window::Width();
-			blurData.pixelHeight = 1.0f / Window::Height();
-			blurData.blurDistance = blurDistance;
-			Graphics::FillAndBindNextConstantBuffer(&blurData, sizeof(BlurData), D3D11_PIXEL_SHADER, 0);
-
-			Graphics::Context->Draw(3, 0);
-
-			//ID3D11ShaderResourceView* nullSRVs[16] = {};
-			//Graphics::Context->PSSetShaderResources(0, 16, nullSRVs);
+			// Leave nothing bound that the next frame draws into
+			ID3D11ShaderResourceView* nullSRVs[2] = {};
+			Graphics::Context->PSSetShaderResources(0, 2, nullSRVs);
 		}
 
 		ImGui::Render(); // Turns this frames UI into renderable triangles
@@ -754,6 +1040,9 @@ void Game::Draw(float deltaTime, float totalTime)
 			vsync ? 1 : 0,
 			vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING);
 
+		// Lets the constant buffer ring reuse what the GPU is done with
+		Graphics::EndFrame();
+
 		// Re-bind back buffer and depth buffer after presenting
 		Graphics::Context->OMSetRenderTargets(
 			1,
@@ -766,46 +1055,452 @@ void Game::Draw(float deltaTime, float totalTime)
 	}
 }
 
-void Game::RenderShadowMap() {
-	Graphics::Context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+// --------------------------------------------------------
+// Works out which entities the camera and each shadow cascade
+// can see, then sorts those into each pass's render queue.  Runs
+// at the end of Update() on the job system:
+//  - World matrices and bounds in batches of subtrees
+//  - Then camera cull -> main queue and, per cascade, light cull
+//    -> shadow queue, as jobs side by side once the bounds are done
+//  - Light clusters alongside all of that - they only need the
+//    camera
+// The main thread helps out while it waits.
+// --------------------------------------------------------
+void Game::PrepareFrame() {
+	UpdateCascades();
+
+	int count = entities.GetCount();
+	Culling::Resize(entityBounds, count);
+
+	// Entities only hold mesh handles - look each mesh up once, so
+	// one that finishes streaming mid-frame doesn't change halfway
+	bool meshesChanged = false;
+	frameMeshes.resize(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		std::shared_ptr<Mesh> mesh = meshes[i]->Get();
+		meshesChanged = meshesChanged || mesh != frameMeshes[i];
+		frameMeshes[i] = mesh;
+	}
 
-	//set shadow map as current depth buffer and unbind back buffer
-	ID3D11RenderTargetView* nullRTV{};
-	Graphics::Context->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
-	Graphics::Context->PSSetShader(0, 0, 0);
-	Graphics::Context->RSSetState(shadowRasterizer.Get());
+	// Parents before children, each root's subtree packed together -
+	// subtrees can then be updated in any order, on any thread
+	entities.SortHierarchy();
+	int subtreeCount = entities.GetSubtreeCount();
+
+	// Which cascades need their static casters drawn again - a mesh
+	// streaming in changes them without touching any version
+	staticShadowRedraws = 0;
+	for (int c = 0; c < cascadeCount; c++) {
+		if (meshesChanged || !shadowCaching)
+			shadowCaches[c].Invalidate();
+		staticShadowStale[c] = !shadowCaches[c].IsCurrent(entities.GetStaticVersion(), shadowLightVersion, cascades[c].ViewProjection);
+		if (staticShadowStale[c])
+			staticShadowRedraws++;
+	}
+	staticShadowRedrawTotal += staticShadowRedraws;
+
+	if (!multithreadedUpdate) {
+		BuildLightClusters();
+		UpdateBounds(0, subtreeCount);
+		CullCamera();
+		BuildMainQueue();
+		for (int c = 0; c < cascadeCount; c++) {
+			CullShadow(c);
+			BuildShadowQueue(c);
+		}
+		return;
+	}
 
-	D3D11_VIEWPORT viewport = {};
-	viewport.Width = 1024.0f;
-	viewport.Height = 1024.0f;
-	viewport.MaxDepth = 1.0f;
-	Graphics::Context->RSSetViewports(1, &viewport);
+	JobCounter queues;
+	jobs.Run([this] { BuildLightClusters(); }, &queues);
+
+	JobCounter bounds;
+	jobs.ParallelFor(subtreeCount, 256, [this](int begin, int end) { UpdateBounds(begin, end); }, bounds);
+
+	jobs.Run([this] { CullCamera(); BuildMainQueue(); }, &queues, &bounds);
+	for (int c = 0; c < cascadeCount; c++)
+		jobs.Run([this, c] { CullShadow(c); BuildShadowQueue(c); }, &queues, &bounds);
+	jobs.Wait(queues);
+}
+
+// Splits the active camera's view into cascades and fits the
+// first light's shadow maps around them
+void Game::UpdateCascades() {
+	ShadowCascades::Build(
+		activeCamera->GetViewMatrix(), activeCamera->GetProjectionMatrix(),
+		activeCamera->nearClip, shadowDistance < activeCamera->farClip ? shadowDistance : activeCamera->farClip,
+		lights[0].Direction, cascadeCount, cascadeSplitLambda,
+		ShadowMapResolution, stableCascades, cascades);
+}
+
+// --------------------------------------------------------
+// Lines the lights up the way the pixel shader wants them -
+// directional lights first, then the rest, scattered lights last -
+// and sorts all but the directional ones into the active camera's
+// clusters
+// --------------------------------------------------------
+void Game::BuildLightClusters() {
+	frameLights.clear();
+	frameShadowedLight = -1;
+	for (int i = 0; i < lights.size(); i++) {
+		if (lights[i].Type != LIGHT_TYPE_DIRECTIONAL)
+			continue;
+		if (i == 0)
+			frameShadowedLight = (int)frameLights.size(); // The first light casts the shadows
+		frameLights.push_back(lights[i]);
+	}
+	frameDirectionalLights = (int)frameLights.size();
+	for (const Light& light : lights) {
+		if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+			frameLights.push_back(light);
+	}
+	frameLights.insert(frameLights.end(), scatteredLights.begin(), scatteredLights.end());
+
+	lightClusters.Build(
+		activeCamera->GetViewMatrix(), activeCamera->GetProjectionMatrix(),
+		activeCamera->nearClip, activeCamera->farClip,
+		frameLights.data(), (int)frameLights.size(),
+		multithreadedUpdate ? &jobs : nullptr);
+}
+
+// Point lights over the floor, the same ones every time for the
+// same count
+void Game::ScatterLights() {
+	std::mt19937 random(2024);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	scatteredLights.resize(scatteredLightCount);
+	for (Light& light : scatteredLights) {
+		light = {};
+		light.Type = LIGHT_TYPE_POINT;
+		light.Position = XMFLOAT3(-20.0f + unit(random) * 40.0f, -7.5f + unit(random) * 4.5f, -10.0f + unit(random) * 40.0f);
+		light.Range = 1.5f + unit(random) * 2.5f;
+		light.Color = XMFLOAT3(unit(random), unit(random), unit(random));
+		light.Intensity = 1.0f;
+	}
+}
+
+// World matrices, then bounds, for every entity in a range of
+// subtrees
+void Game::UpdateBounds(int firstSubtree, int lastSubtree) {
+	entities.UpdateSubtrees(firstSubtree, lastSubtree);
+
+	const XMFLOAT4X4* world = entities.GetWorldMatrices();
+	const uint32_t* meshHandles = entities.GetMeshes();
+	int last = entities.GetSubtreeStart(lastSubtree);
+	for (int i = entities.GetSubtreeStart(firstSubtree); i < last; i++)
+		Culling::SetBounds(entityBounds, i, frameMeshes[meshHandles[i]]->GetBounds(), world[i]);
+}
+
+void Game::CullCamera() {
+	if (!frustumCulling) {
+		cameraVisible.assign(entities.GetCount(), 1);
+		cameraVisibleCount = entities.GetCount();
+		return;
+	}
+
+	XMFLOAT4X4 view = activeCamera->GetViewMatrix();
+	XMFLOAT4X4 proj = activeCamera->GetProjectionMatrix();
+	XMFLOAT4X4 cameraViewProj;
+	XMStoreFloat4x4(&cameraViewProj, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+	cameraVisibleCount = Culling::Cull(Culling::ExtractFrustum(cameraViewProj), entityBounds, cameraVisible);
+}
+
+// The shadow test skips the light's near plane - the shadow
+// rasterizer doesn't depth clip, so casters in front of the
+// light still land in the map
+void Game::CullShadow(int cascade) {
+	if (!frustumCulling) {
+		shadowVisible[cascade].assign(entities.GetCount(), 1);
+		shadowVisibleCount[cascade] = entities.GetCount();
+		return;
+	}
+
+	Frustum frustum = Culling::ExtractFrustum(cascades[cascade].ViewProjection, false);
+	shadowVisibleCount[cascade] = Culling::Cull(frustum, entityBounds, shadowVisible[cascade]);
+}
+
+// Sort what the camera can see by shader, material, mesh and
+// then distance, so shared state is only bound once
+void Game::BuildMainQueue() {
+	XMFLOAT3 cameraPos = activeCamera->transform.GetPosition();
+	mainQueue.Clear();
+	const uint32_t* meshHandles = entities.GetMeshes();
+	const uint32_t* materialHandles = entities.GetMaterials();
+	for (int i = 0; i < entities.GetCount(); i++) {
+		if (!cameraVisible[i])
+			continue;
+
+		Material* material = materials[materialHandles[i]].get();
+		float dx = entityBounds.CenterX[i] - cameraPos.x;
+		float dy = entityBounds.CenterY[i] - cameraPos.y;
+		float dz = entityBounds.CenterZ[i] - cameraPos.z;
+		mainQueue.Add(
+			RenderQueue::Opaque,
+			mainQueue.ShaderId(material->GetVertexShader().Get(), material->GetPixelShader().Get()),
+			mainQueue.MaterialId(material),
+			mainQueue.MeshId(frameMeshes[meshHandles[i]].get()),
+			sqrtf(dx * dx + dy * dy + dz * dz) / activeCamera->farClip,
+			i);
+	}
+	mainQueue.Sort();
+}
 
-	Graphics::Context->VSSetShader(shadowVS.Get(), 0, 0);
+// Only meshes change between shadow draws, so sort by mesh.
+// Static casters are only queued when the cascade's cache is
+// stale.
+void Game::BuildShadowQueue(int cascade) {
+	RenderQueue& staticQueue = staticShadowQueues[cascade];
+	RenderQueue& dynamicQueue = dynamicShadowQueues[cascade];
+	staticQueue.Clear();
+	dynamicQueue.Clear();
+	bool stale = staticShadowStale[cascade];
+	const uint32_t* meshHandles = entities.GetMeshes();
+	for (int i = 0; i < entities.GetCount(); i++) {
+		if (!shadowVisible[cascade][i])
+			continue;
+
+		if (entities.IsDynamic(i))
+			dynamicQueue.Add(RenderQueue::Shadow, 0, 0, dynamicQueue.MeshId(frameMeshes[meshHandles[i]].get()), 0.0f, i);
+		else if (stale)
+			staticQueue.Add(RenderQueue::Shadow, 0, 0, staticQueue.MeshId(frameMeshes[meshHandles[i]].get()), 0.0f, i);
+	}
+	staticQueue.Sort();
+	dynamicQueue.Sort();
+}
+
+void Game::RenderShadowMap() {
 	struct ShadowVSData
 	{
-		XMFLOAT4X4 world;
 		XMFLOAT4X4 view;
 		XMFLOAT4X4 proj;
 	};
 
-	ShadowVSData vsData = {};
-	vsData.view = lightViewMatrix;
-	vsData.proj = lightProjectionMatrix;
+	// Each cascade's matrices, then the world of each caster drawn
+	// this frame, once however many cascades it's in (unless
+	// instanced), all written under one map
+	int casterCount = 0;
+	for (int c = 0; c < cascadeCount; c++)
+		casterCount += staticShadowQueues[c].GetCount() + dynamicShadowQueues[c].GetCount();
+	if (casterCount > entities.GetCount())
+		casterCount = entities.GetCount();
+	Graphics::BeginConstantUploads(
+		cascadeCount * Graphics::ConstantSize(sizeof(ShadowVSData)) +
+		(hardwareInstancing ? 0 : casterCount * Graphics::ConstantSize(sizeof(PerObjectVSData))));
+
+	Graphics::ConstantAllocation cascadeConstants[ShadowCascades::MaxCascades];
+	for (int c = 0; c < cascadeCount; c++)
+	{
+		cascadeConstants[c] = Graphics::AllocateConstants(sizeof(ShadowVSData));
+		ShadowVSData* vsData = (ShadowVSData*)cascadeConstants[c].Data;
+		vsData->view = cascades[c].View;
+		vsData->proj = cascades[c].Projection;
+	}
 
-	// loop and draw
-	for (std::shared_ptr<GameEntity> e : entities) 
+	std::vector<Graphics::ConstantAllocation> objectConstants(entities.GetCount());
+	const XMFLOAT4X4* world = entities.GetWorldMatrices();
+	const XMFLOAT4X4* worldInverseTranspose = entities.GetWorldInverseTransposeMatrices();
+	for (int i = 0; i < entities.GetCount() && !hardwareInstancing; i++)
 	{
-		vsData.world = e->GetTransform().GetWorldMatrix();
-		Graphics::FillAndBindNextConstantBuffer(&vsData, sizeof(ShadowVSData), D3D11_VERTEX_SHADER, 0);
-		e->Draw();
+		bool caster = false;
+		for (int c = 0; c < cascadeCount; c++)
+			caster = caster || (shadowVisible[c][i] && (staticShadowStale[c] || entities.IsDynamic(i)));
+		if (!caster)
+			continue;
+
+		objectConstants[i] = Graphics::AllocateConstants(sizeof(PerObjectVSData));
+		PerObjectVSData* objectData = (PerObjectVSData*)objectConstants[i].Data;
+		objectData->world = world[i];
+		objectData->worldInvTranspose = worldInverseTranspose[i];
 	}
-	
+	Graphics::EndConstantUploads();
+
+	// Per cascade: static casters (into the cache, if caching, and
+	// only when stale), then a copy of the cache, then the dynamic
+	// casters on top
+	shadowPassStats = {};
+	for (int c = 0; c < cascadeCount; c++)
+	{
+		ID3D11DepthStencilView* staticTarget = shadowCaching ? staticShadowDSVs[c].Get() : shadowDSVs[c].Get();
+		if (staticShadowStale[c])
+		{
+			Graphics::Context->ClearDepthStencilView(staticTarget, D3D11_CLEAR_DEPTH, 1.0f, 0);
+			RenderQueueStats stats = DrawShadowQueue(staticShadowQueues[c], staticTarget, cascadeConstants[c], objectConstants);
+			shadowPassStats.Draws += stats.Draws;
+			shadowPassStats.Instances += stats.Instances;
+			shadowPassStats.MeshChanges += stats.MeshChanges;
+			if (shadowCaching)
+				shadowCaches[c].Store(entities.GetStaticVersion(), shadowLightVersion, cascades[c].ViewProjection);
+		}
+
+		// Depth copies have to be of whole slices, with neither bound
+		if (shadowCaching) {
+			Graphics::Context->OMSetRenderTargets(0, 0, 0);
+			Graphics::Context->CopySubresourceRegion(shadowMap.Get(), c, 0, 0, 0, staticShadowMap.Get(), c, 0);
+		}
+
+		RenderQueueStats stats = DrawShadowQueue(dynamicShadowQueues[c], shadowDSVs[c].Get(), cascadeConstants[c], objectConstants);
+		shadowPassStats.Draws += stats.Draws;
+		shadowPassStats.Instances += stats.Instances;
+		shadowPassStats.MeshChanges += stats.MeshChanges;
+	}
+
+	D3D11_VIEWPORT viewport = {};
 	viewport.Width = (float)Window::Width();
 	viewport.Height = (float)Window::Height();
+	viewport.MaxDepth = 1.0f;
 	Graphics::Context->RSSetViewports(1, &viewport);
 	Graphics::Context->OMSetRenderTargets(1, Graphics::BackBufferRTV.GetAddressOf(), Graphics::DepthBufferDSV.Get());
 	Graphics::Context->RSSetState(0);
+	Graphics::Context->IASetInputLayout(inputLayout.Get());
+}
+
+// Draws one of a cascade's shadow queues into target
+RenderQueueStats Game::DrawShadowQueue(
+	RenderQueue& queue,
+	ID3D11DepthStencilView* target,
+	const Graphics::ConstantAllocation& cascadeConstants,
+	const std::vector<Graphics::ConstantAllocation>& objectConstants) {
+	if (queue.GetCount() == 0)
+		return {};
+
+	if (hardwareInstancing)
+		UploadInstances(queue);
+
+	// Everything the shadow pass needs besides what the queue binds
+	std::function<void(ID3D11DeviceContext1*)> shadowPassState = [&](ID3D11DeviceContext1* context) {
+		//set the target slice as current depth buffer and unbind back buffer
+		ID3D11RenderTargetView* nullRTV{};
+		context->OMSetRenderTargets(1, &nullRTV, target);
+		context->PSSetShader(0, 0, 0);
+		context->RSSetState(shadowRasterizer.Get());
+
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (float)ShadowMapResolution;
+		viewport.Height = (float)ShadowMapResolution;
+		viewport.MaxDepth = 1.0f;
+		context->RSSetViewports(1, &viewport);
+
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context->IASetInputLayout(hardwareInstancing ? instancedInputLayout.Get() : inputLayout.Get());
+		if (hardwareInstancing)
+			BindInstances(context);
+
+		context->VSSetShader(hardwareInstancing ? instancedShadowVS.Get() : shadowVS.Get(), 0, 0);
+		Graphics::BindConstants(cascadeConstants, D3D11_VERTEX_SHADER, 0, context);
+	};
+	shadowPassState(Graphics::ImmediateContext1());
+
+	// draw anything in the queue inside the cascade's volume
+	return SubmitPass(queue, nullptr, &objectConstants, nullptr, shadowPassState);
+}
+
+// --------------------------------------------------------
+// Draws a sorted queue with the pass's state already set on the
+// immediate context.  Big enough queues are split into chunks,
+// each recorded on its own deferred context by the job system -
+// passState sets each one up from scratch - and then executed
+// in order.  Smaller ones just draw on the immediate context.
+// --------------------------------------------------------
+RenderQueueStats Game::SubmitPass(
+	RenderQueue& queue,
+	const std::vector<Graphics::ConstantAllocation>* materialConstants,
+	const std::vector<Graphics::ConstantAllocation>* objectConstants,
+	ID3D11VertexShader* instancedVertexShader,
+	const std::function<void(ID3D11DeviceContext1*)>& passState) {
+	ID3D11VertexShader* vs = hardwareInstancing ? instancedVertexShader : 0;
+
+	if (!deferredRecording || deferredContexts.empty() || queue.GetCount() < MinDeferredDrawsPerChunk * 2) {
+		EntityRecorder recorder(entities, frameMeshes, materials, materialConstants, objectConstants, vs);
+		return queue.Submit(recorder, hardwareInstancing);
+	}
+
+	std::vector<EntityRecorder> recorders;
+	std::vector<CommandRecorder*> recorderPointers;
+	recorders.reserve(deferredContexts.size());
+	for (Microsoft::WRL::ComPtr<ID3D11DeviceContext1>& deferred : deferredContexts) {
+		recorders.emplace_back(entities, frameMeshes, materials, materialConstants, objectConstants, vs, deferred.Get(), &passState);
+		recorderPointers.push_back(&recorders.back());
+	}
+
+	return CommandRecording::RecordParallel(
+		queue, hardwareInstancing,
+		recorderPointers.data(), (int)recorderPointers.size(),
+		MinDeferredDrawsPerChunk, jobs);
+}
+
+// --------------------------------------------------------
+// Fills a dynamic structured buffer, growing it (and its view)
+// when count won't fit, like UploadInstances() does the instance
+// buffer.  It always holds at least one element, as a view can't
+// be empty.
+// --------------------------------------------------------
+void Game::UploadStructured(DynamicStructuredBuffer& target, const void* data, int count, int stride) {
+	if (count > target.Capacity || !target.Buffer) {
+		target.Capacity = target.Capacity * 2 > count ? target.Capacity * 2 : count;
+		if (target.Capacity < 1)
+			target.Capacity = 1;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = target.Capacity * stride;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = stride;
+		target.Buffer.Reset();
+		Graphics::Device->CreateBuffer(&desc, 0, target.Buffer.GetAddressOf());
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = target.Capacity;
+		Graphics::Device->CreateShaderResourceView(target.Buffer.Get(), &srvDesc, target.SRV.ReleaseAndGetAddressOf());
+	}
+
+	if (count == 0)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	Graphics::Context->Map(target.Buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	memcpy(mapped.pData, data, (size_t)count * stride);
+	Graphics::Context->Unmap(target.Buffer.Get(), 0);
+}
+
+// --------------------------------------------------------
+// Writes one instance per queued draw, in sorted order, into the
+// instance buffer (BindInstances() puts it in slot 1).  The buffer grows as
+// needed and is mapped with DISCARD, so the shadow and main passes
+// can each fill it in the same frame.
+// --------------------------------------------------------
+void Game::UploadInstances(RenderQueue& queue) {
+	int count = queue.GetCount();
+	if (count == 0)
+		return;
+
+	if (count > instanceCapacity) {
+		instanceCapacity = instanceCapacity * 2 > count ? instanceCapacity * 2 : count;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = instanceCapacity * sizeof(PerObjectVSData);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		instanceBuffer.Reset();
+		Graphics::Device->CreateBuffer(&desc, 0, instanceBuffer.GetAddressOf());
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	Graphics::Context->Map(instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	Instancing::WriteInstances(queue, entities.GetWorldMatrices(), entities.GetWorldInverseTransposeMatrices(), (PerObjectVSData*)mapped.pData);
+	Graphics::Context->Unmap(instanceBuffer.Get(), 0);
+}
+
+void Game::BindInstances(ID3D11DeviceContext* context) {
+	UINT stride = sizeof(PerObjectVSData);
+	UINT offset = 0;
+	context->IASetVertexBuffers(1, 1, instanceBuffer.GetAddressOf(), &stride, &offset);
 }
 
 void Game::UpdateImGui(float deltaTime) {
@@ -855,16 +1550,43 @@ void Game::BuildUI() {
 	if (ImGui::TreeNode("Meshes"))
 	{
 		for (int i = 0; i < meshes.size(); i++) {
-			if (ImGui::TreeNode(meshes[i]->GetName())) {
-				ImGui::Text("\tTriangles: %d", meshes[i]->GetIndexCount() / 3);
-				ImGui::Text("\tVertices: %d", meshes[i]->GetVertexCount());
-				ImGui::Text("\tIndices: %d", meshes[i]->GetIndexCount());
+			// Still streaming in meshes show up as the placeholder
+			std::shared_ptr<Mesh> mesh = meshes[i]->Get();
+			ImGui::PushID(meshes[i].get());
+			if (ImGui::TreeNode("Mesh Node", "%s%s", mesh->GetName(), meshes[i]->IsReady() ? "" : " (loading)")) {
+				ImGui::Text("\tTriangles: %d", mesh->GetIndexCount() / 3);
+				ImGui::Text("\tVertices: %d", mesh->GetVertexCount());
+				ImGui::Text("\tIndices: %d", mesh->GetIndexCount());
 				ImGui::TreePop();
 			}
+			ImGui::PopID();
 		}
+		if (ImGui::Button("Run Load Benchmark (.obj vs cooked)"))
+			Mesh::LoadBenchmark(MeshAssetFiles());
+		if (ImGui::Button("Run Tangent Test"))
+			Mesh::TangentTest();
+		if (ImGui::Button("Run OBJ Loader Test"))
+			ObjLoader::Test();
+		if (ImGui::Button("Run OBJ Loader Benchmark (models + 10M triangles)"))
+			ObjLoader::Benchmark(MeshAssetFiles(), 10000000);
 		// close node tree
 		ImGui::TreePop();
 	}
+	if (ImGui::TreeNode("Asset Cache"))
+	{
+		AssetCacheStats stats = assets.GetCacheStats();
+		ImGui::Text("Cached: %d", stats.Entries);
+		ImGui::Text("Hits: %d", stats.Hits);
+		ImGui::Text("Misses: %d", stats.Misses);
+		ImGui::Text("Evicted: %d", stats.Evictions);
+		if (ImGui::Button("Evict Unused"))
+			assets.EvictUnused();
+		if (ImGui::Button("Run Cache Test"))
+			AssetLoader::CacheTest();
+		if (ImGui::Button("Run Async Asset Test"))
+			AsyncAssetTest();
+		ImGui::TreePop();
+	}
 	if (ImGui::TreeNode("Materials"))
 	{
 		for (int i = 0; i < materials.size(); i++) {
@@ -892,27 +1614,50 @@ void Game::BuildUI() {
 	}
 	if (ImGui::TreeNode("Entities"))
 	{
-		for (int i = 0; i < entities.size(); i++) {
-			ImGui::PushID(entities[i].get());
-			if (ImGui::TreeNode("Entity Node", "Entity %d", i+1)) {
-				std::shared_ptr<GameEntity> entity = entities[i];
-				std::shared_ptr<Mesh> mesh = entity->GetMesh();
-
+		for (int i = 0; i < entities.GetCount(); i++) {
+			EntityId id = entities.GetId(i);
+			ImGui::PushID(id.Slot);
+			if (ImGui::TreeNode("Entity Node", "Entity %d", id.Slot+1)) {
 				//Transform
-				Transform& transform = entity->GetTransform();
-				XMFLOAT3 position = transform.GetPosition();
-				XMFLOAT3 rotation = transform.GetPitchYawRoll();
-				XMFLOAT3 scale = transform.GetScale();
-
-				if (ImGui::DragFloat3("Position", &position.x, 0.01f)) transform.SetPosition(position);
-				if (ImGui::DragFloat3("Rotation", &rotation.x, 0.01f)) transform.SetRotation(rotation);
-				if (ImGui::DragFloat3("Scale", &scale.x, 0.01f)) transform.SetScale(scale);
-				//ImGui::Text("\tIndex Count: %d", entity->GetMesh()->GetIndexCount());
+				XMFLOAT3 position = entities.GetPosition(i);
+				XMFLOAT3 rotation = entities.GetPitchYawRoll(i);
+				XMFLOAT3 scale = entities.GetScale(i);
+
+				if (ImGui::DragFloat3("Position", &position.x, 0.01f)) entities.SetPosition(i, position);
+				if (ImGui::DragFloat3("Rotation", &rotation.x, 0.01f)) entities.SetRotation(i, rotation);
+				if (ImGui::DragFloat3("Scale", &scale.x, 0.01f)) entities.SetScale(i, scale);
+
+				// Hierarchy - position, rotation and scale above are
+				// relative to the parent
+				EntityId parent = entities.GetParent(i);
+				std::string parentName = parent.Slot == EntityStore::NoParent ? "None" : "Entity " + std::to_string(parent.Slot + 1);
+				if (ImGui::BeginCombo("Parent", parentName.c_str())) {
+					if (ImGui::Selectable("None", parent.Slot == EntityStore::NoParent))
+						entities.ClearParent(id);
+					for (int j = 0; j < entities.GetCount(); j++) {
+						EntityId other = entities.GetId(j);
+						std::string otherName = "Entity " + std::to_string(other.Slot + 1);
+						if (j != i && ImGui::Selectable(otherName.c_str(), other.Slot == parent.Slot))
+							entities.SetParent(id, other);
+					}
+					ImGui::EndCombo();
+				}
 				ImGui::TreePop();
 			}
 			ImGui::PopID();
 		}
 
+		if (ImGui::Button("Run Transform Benchmark (100k, 5% moving)"))
+			Transform::Benchmark(100000, 0.05f);
+		if (ImGui::Button("Run Rotation Benchmark (100k)"))
+			Transform::RotationBenchmark(100000);
+		if (ImGui::Button("Run Entity Storage Benchmark (10k / 100k / 1M)"))
+			EntityStore::Benchmark(0.05f);
+		if (ImGui::Button("Run Hierarchy Test"))
+			EntityStore::HierarchyTest();
+		if (ImGui::Button("Run Hierarchy Benchmark (deep / wide)"))
+			EntityStore::HierarchyBenchmark();
+
 		// close node tree
 		ImGui::TreePop();
 	}
@@ -927,6 +1672,8 @@ void Game::BuildUI() {
 			if (ImGui::TreeNode("Light Node", "Light %d", i + 1)) {
 				if (ImGui::ColorEdit3("Color", &lights[i].Color.x)) {}
 				if (ImGui::DragFloat("Intensity", &lights[i].Intensity)) {}
+				if (lights[i].Type != 1 && ImGui::DragFloat3("Direction", &lights[i].Direction.x, 0.01f) && i == 0)
+					shadowLightVersion++; // The first light casts the shadows
 
 				ImGui::TreePop();
 			}
@@ -935,6 +1682,20 @@ void Game::BuildUI() {
 
 		ImGui::TreePop();
 	}
+
+	if (ImGui::TreeNode("Light Clusters")) {
+		if (ImGui::SliderInt("Scattered Point Lights", &scatteredLightCount, 0, 4096))
+			ScatterLights();
+		ImGui::Text("Grid: %d x %d tiles, %d slices", LightClusters::TilesX, LightClusters::TilesY, LightClusters::Slices);
+		ImGui::Text("Clustered lights: %d (%d directional shaded everywhere)", lightClusters.GetClusteredLightCount(), frameDirectionalLights);
+		ImGui::Text("Index list: %d entries, at most %d lights in a cluster", lightClusters.GetLightIndexCount(), lightClusters.GetMaxLightsPerCluster());
+		if (ImGui::Button("Run Cluster Test"))
+			LightClusters::Test();
+		if (ImGui::Button("Run Cluster Benchmark (1k - 10k lights)"))
+			LightClusters::Benchmark();
+
+		ImGui::TreePop();
+	}
 	
 	// Cameras
 	if (ImGui::TreeNode("Camera Info")) {
@@ -961,14 +1722,132 @@ void Game::BuildUI() {
 		ImGui::TreePop();
 	}
 
+	if (ImGui::TreeNode("Constant Buffer Ring")) {
+		ImGui::Text("Uploaded last frame: %.1f KB", Graphics::ConstantBytesPerFrame() / 1024.0f);
+		ImGui::Text("In flight: %.1f KB", Graphics::ConstantBytesInFlight() / 1024.0f);
+		ImGui::Text("Discards: %d", Graphics::ConstantBufferDiscards());
+		ImGui::Text("Ring size: %u KB (grown %d times)", Graphics::ConstantBufferSize() / 1024, Graphics::ConstantBufferGrows());
+		if (ImGui::Button("Run Layout Test"))
+			BufferStructsTest();
+		if (ImGui::Button("Run Ring Test"))
+			ConstantRing::Test();
+		ImGui::TreePop();
+	}
+
+	if (ImGui::TreeNode("Render Queue")) {
+		RenderQueueStats mainStats = mainPassStats;
+		RenderQueueStats shadowStats = shadowPassStats;
+		ImGui::Checkbox("Hardware Instancing", &hardwareInstancing);
+		ImGui::Checkbox("Deferred Recording", &deferredRecording);
+		ImGui::Text("Deferred contexts: %d (used from %d draws)", (int)deferredContexts.size(), MinDeferredDrawsPerChunk * 2);
+		ImGui::Text("Main pass: %d draws, %d entities", mainStats.Draws, mainStats.Instances);
+		ImGui::Text("  Shader changes: %d", mainStats.ShaderChanges);
+		ImGui::Text("  Material changes: %d", mainStats.MaterialChanges);
+		ImGui::Text("  Mesh changes: %d", mainStats.MeshChanges);
+		ImGui::Text("Shadow pass: %d draws, %d entities", shadowStats.Draws, shadowStats.Instances);
+		ImGui::Text("  Mesh changes: %d", shadowStats.MeshChanges);
+		if (ImGui::Button("Run Render Queue Test"))
+			RenderQueue::Test();
+		if (ImGui::Button("Run Command Recording Test"))
+			CommandRecording::Test();
+		if (ImGui::Button("Run Instancing Benchmark (100k entities)"))
+			Instancing::Benchmark(100000);
+
+		ImGui::TreePop();
+	}
+
+	if (ImGui::TreeNode("Job System")) {
+		ImGui::Checkbox("Multithreaded Update", &multithreadedUpdate);
+		ImGui::Text("Threads: %d", jobs.GetThreadCount());
+		ImGui::Text("Jobs run: %d (%d stolen)", jobs.GetJobsRun(), jobs.GetJobsStolen());
+		if (ImGui::Button("Run Stress Test"))
+			JobSystem::StressTest();
+		if (ImGui::Button("Run Scaling Benchmark (100k entities)"))
+			JobSystem::Benchmark(100000);
+
+		ImGui::TreePop();
+	}
+
+	if (ImGui::TreeNode("Culling")) {
+		int count = entities.GetCount();
+		ImGui::Checkbox("Frustum Culling", &frustumCulling);
+		ImGui::Text("Main pass: %d visible, %d culled", cameraVisibleCount, count - cameraVisibleCount);
+		for (int c = 0; c < cascadeCount; c++)
+			ImGui::Text("Shadow cascade %d: %d visible, %d culled", c, shadowVisibleCount[c], count - shadowVisibleCount[c]);
+		if (ImGui::Button("Run Benchmark (100k entities)"))
+			Culling::Benchmark(100000);
+
+		ImGui::TreePop();
+	}
+
 	if (ImGui::TreeNode("Shadow Info")) {
-		ImGui::Image(shadowSRV.Get(), ImVec2(512, 512));
+		ImGui::SliderInt("Cascades", &cascadeCount, 1, ShadowCascades::MaxCascades);
+		ImGui::SliderFloat("Split Lambda", &cascadeSplitLambda, 0.0f, 1.0f);
+		ImGui::SliderFloat("Shadow Distance", &shadowDistance, 10.0f, 500.0f);
+		ImGui::Checkbox("Stable Cascades", &stableCascades);
+		ImGui::Checkbox("Cache Static Casters", &shadowCaching);
+		ImGui::Text("Static casters redrawn: %d of %d cascades this frame, %d in total",
+			staticShadowRedraws, cascadeCount, staticShadowRedrawTotal);
+		for (int c = 0; c < cascadeCount; c++) {
+			ImGui::Text("Cascade %d: %.2f to %.2f, %.2f units wide (%.4f per texel)",
+				c, cascades[c].SplitNear, cascades[c].SplitFar,
+				2.0f / cascades[c].Projection._11, 2.0f / cascades[c].Projection._11 / ShadowMapResolution);
+		}
+		if (ImGui::Button("Run Cascade Test"))
+			ShadowCascades::Test();
+		if (ImGui::Button("Run Cache Test"))
+			ShadowCache::Test();
 
 		ImGui::TreePop();
 	}
 
 	if (ImGui::TreeNode("Post Processing")) {
-		if (ImGui::DragInt("\tBlur Distance", &blurDistance, 1, 0, 50)) {}
+		if (ImGui::DragInt("\tBlur Distance", &blurDistance, 1, 0, Blur::MaxRadius)) {}
+		ImGui::Combo("\tBlur Kernel", &blurKernel, "Box\0Gaussian\0");
+		ImGui::Combo("\tBlur Resolution", &blurLevel, "Full\0Half\0Quarter\0");
+
+		// What the blur costs, against the old single pass box
+		if (blurDistance > 0) {
+			int scale = 1 << blurLevel;
+			BlurKernel kernel = Blur::MakeKernel((Blur::KernelType)blurKernel, (blurDistance + scale - 1) / scale);
+			ImGui::Text("\tSamples per screen pixel: %.2f (single pass box: %d)",
+				(float)Blur::SeparableSamples(kernel) / (scale * scale), Blur::BoxSamples(blurDistance));
+		}
+		if (ImGui::Button("Run Blur Test")) Blur::Test();
+
+		// HDR to the screen
+		if (ImGui::TreeNode("Exposure")) {
+			ImGui::Combo("Tonemapper", &tonemapper, "ACES\0Reinhard\0");
+			ImGui::Checkbox("Auto-Exposure", &autoExposure);
+			ImGui::DragFloat("Compensation", &exposureSettings.Compensation, 0.05f, -8.0f, 8.0f, "%.2f stops");
+			ImGui::DragFloat("Key Value", &exposureSettings.KeyValue, 0.005f, 0.01f, 1.0f);
+			ImGui::DragFloat("Adaptation Rate", &exposureSettings.AdaptationRate, 0.05f, 0.0f, 10.0f);
+			ImGui::DragFloat("Min Log Luminance", &exposureSettings.MinLogLuminance, 0.1f, -16.0f, 0.0f);
+			ImGui::DragFloat("Log Luminance Range", &exposureSettings.LogLuminanceRange, 0.1f, 1.0f, 24.0f);
+			if (ImGui::Button("Run Exposure Test")) Exposure::Test();
+			ImGui::TreePop();
+		}
+
+		// What the passes are drawn into
+		if (ImGui::TreeNode("Post Process Graph")) {
+			const std::vector<PostProcessGraph::Target>& targets = postGraph.GetTargets();
+			for (const PostProcessGraph::Pass& pass : postGraph.GetPasses()) {
+				if (pass.Output == PostProcessGraph::BackBuffer)
+					ImGui::Text("%s: back buffer", pass.Name.c_str());
+				else if (pass.Output == PostProcessGraph::NoOutput)
+					ImGui::Text("%s: buffers only", pass.Name.c_str());
+				else
+					ImGui::Text("%s: %s, %dx%d in texture %d", pass.Name.c_str(), targets[pass.Output].Name.c_str(),
+						targets[pass.Output].Width, targets[pass.Output].Height, targets[pass.Output].Slot);
+			}
+			ImGui::Text("%d targets in %d textures", (int)targets.size(), postTargets.GetTextureCount());
+			ImGui::Text("Target memory: %.2f MB (%.2f MB unshared, at least %.2f MB)",
+				postGraph.GetAllocatedBytes() / (1024.0f * 1024.0f),
+				postGraph.GetUnaliasedBytes() / (1024.0f * 1024.0f),
+				postGraph.GetPeakLiveBytes() / (1024.0f * 1024.0f));
+			if (ImGui::Button("Run Graph Test")) PostProcessGraph::Test();
+			ImGui::TreePop();
+		}
 
 		// Fog
 		if (ImGui::TreeNode("Fog")) {
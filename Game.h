@@ -1,14 +1,25 @@
 #pragma once
 
 #include <d3d11.h>
+#include <functional>
 #include <wrl/client.h>
 #include <memory>
+#include "AssetLoader.h"
 #include "Mesh.h"
 #include "Vertex.h"
 #include "BufferStructs.h"
-#include "GameEntity.h"
+#include "EntityStore.h"
+#include "Exposure.h"
 #include "Camera.h"
+#include "Culling.h"
+#include "JobSystem.h"
+#include "LightClusters.h"
 #include "Lights.h"
+#include "PostProcessGraph.h"
+#include "RenderQueue.h"
+#include "RenderTargetPool.h"
+#include "ShadowCache.h"
+#include "ShadowCascades.h"
 #include <vector>
 #include "Sky.h"
 
@@ -36,6 +47,11 @@ private:
 	float shaderTint[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	int radioIndex = 0;
 	int blurDistance = 0;
+	int blurKernel = Blur::KernelBox;
+	int blurLevel = 0; // Resolution blurred at - 0 full, 1 half, 2 quarter
+	int tonemapper = Exposure::TonemapACES;
+	bool autoExposure = true;
+	Exposure::Settings exposureSettings;
 
 	float clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 
@@ -45,36 +61,129 @@ private:
 	// directional lighting
 	std::vector<Light> lights;
 
+	// A dynamic structured buffer and its view, grown as needed
+	struct DynamicStructuredBuffer
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> Buffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+		int Capacity = 0;
+	};
+
+	// Clustered lighting - point and spot lights are sorted into the
+	// active camera's clusters every frame, so each pixel only shades
+	// the lights that reach it (see LightClusters.h)
+	LightClusters lightClusters;
+	std::vector<Light> frameLights;		// Directional first, then the rest - the shader's Lights
+	int frameDirectionalLights = 0;
+	int frameShadowedLight = -1;		// lights[0], if it's directional
+	std::vector<Light> scatteredLights;	// Extra point lights from the UI
+	int scatteredLightCount = 0;
+	DynamicStructuredBuffer lightBuffer;
+	DynamicStructuredBuffer clusterRangeBuffer;
+	DynamicStructuredBuffer clusterIndexBuffer;
+
+	// Loads (and keeps streaming) textures and meshes
+	AssetLoader assets;
+
 	// New Geometry
-	std::vector<std::shared_ptr<Mesh>> meshes;
+	std::vector<std::shared_ptr<AsyncMesh>> meshes;
 
 	// Sky
 	std::shared_ptr<Sky> sky;
 
-	// Game Entities
-	std::vector<std::shared_ptr<GameEntity>> entities;
+	// Game Entities - mesh and material handles index meshes and
+	// materials
+	EntityStore entities;
+	EntityId bobbingHelix;
+	std::vector<std::shared_ptr<Mesh>> frameMeshes; // meshes[i]->Get(), once per frame
 
 	// Camera
 	std::vector<std::shared_ptr<Camera>> cameras;
 	std::shared_ptr<Camera> activeCamera;
 
-	// Shadows
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
+	// Shadows - the first light's, in cascades refitted to the
+	// active camera every frame (see ShadowCascades.h).  Each
+	// cascade is one slice of the shadow map array.
+	static constexpr int ShadowMapResolution = 1024;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowMap;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSVs[ShadowCascades::MaxCascades];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV; // Every slice
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> shadowVS;
-	XMFLOAT4X4 lightViewMatrix;
-	XMFLOAT4X4 lightProjectionMatrix;
+	int cascadeCount = ShadowCascades::MaxCascades;
+	float cascadeSplitLambda = 0.75f;	// 0 = uniform splits, 1 = logarithmic
+	float shadowDistance = 80.0f;		// Nothing further away is shadowed
+	bool stableCascades = true;
+	ShadowCascade cascades[ShadowCascades::MaxCascades];
+
+	// Static casters are drawn into their own array, only when a
+	// cascade's ShadowCache says so, then copied into the shadow map
+	// each frame for the dynamic casters to go on top
+	bool shadowCaching = true;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staticShadowMap;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> staticShadowDSVs[ShadowCascades::MaxCascades];
+	ShadowCache shadowCaches[ShadowCascades::MaxCascades];
+	bool staticShadowStale[ShadowCascades::MaxCascades] = {};	// This frame, from PrepareFrame()
+	uint32_t shadowLightVersion = 0;	// Bumped whenever the first light's direction changes
+	int staticShadowRedraws = 0;		// Cascades, this frame
+	int staticShadowRedrawTotal = 0;
+
+	// Spreads PrepareFrame() over every core
+	JobSystem jobs;
+	bool multithreadedUpdate = true;
+
+	// Frustum culling, refreshed every frame by PrepareFrame()
+	bool frustumCulling = true;
+	CullingBounds entityBounds;			// World space, one per entity
+	std::vector<uint8_t> cameraVisible;	// Per entity, main pass
+	std::vector<uint8_t> shadowVisible[ShadowCascades::MaxCascades];	// Per entity, per cascade
+	int cameraVisibleCount = 0;
+	int shadowVisibleCount[ShadowCascades::MaxCascades] = {};
+
+	// Sorted draws for each pass, rebuilt every frame
+	RenderQueue mainQueue;
+	RenderQueue staticShadowQueues[ShadowCascades::MaxCascades];	// Only built when stale
+	RenderQueue dynamicShadowQueues[ShadowCascades::MaxCascades];
+
+	// Hardware instancing - entities sharing a mesh and material are
+	// drawn together, their matrices streamed from instanceBuffer
+	bool hardwareInstancing = true;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+	int instanceCapacity = 0;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> instancedInputLayout;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> instancedVS;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> instancedShadowVS;
+
+	// Big passes are recorded in chunks on deferred contexts, one per
+	// job system thread (see SubmitPass())
+	bool deferredRecording = true;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DeviceContext1>> deferredContexts;
+	RenderQueueStats mainPassStats = {};
+	RenderQueueStats shadowPassStats = {}; // Every cascade
 
 	// Post Process Resources
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> ppPS;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> copyPS;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> fullscreenVS;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> ppSampler;
 
-	// Resources that are tied to a particular post process
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ppRTV; // Rendering
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ppSRV; // Sampling
+	// Auto-exposure and tonemapping (see Exposure.h) - the adapted
+	// luminance carries over from frame to frame
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> tonemapPS;
+	Microsoft::WRL::ComPtr<ID3D11ComputeShader> histogramCS;
+	Microsoft::WRL::ComPtr<ID3D11ComputeShader> averageLuminanceCS;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> histogramUAV;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> adaptedLuminanceUAV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> adaptedLuminanceSRV;
+	ExposureData frameExposure = {};
+
+	// The post process passes for the current settings, and the
+	// textures they draw into - the main pass draws into sceneTarget
+	PostProcessGraph postGraph;
+	RenderTargetPool postTargets;
+	int sceneTarget = -1;
+	int postGraphLevel = -2; // Blur level the graph was built for, -1 for no blur
 
 	struct FogOptions
 	{
@@ -106,9 +215,37 @@ private:
 
 	// Helpers
 	void CreateShadowMapResources();
+	void PrepareFrame();
+	void UpdateCascades();
+	void UpdateBounds(int firstSubtree, int lastSubtree);
+	void CullCamera();
+	void CullShadow(int cascade);
+	void BuildMainQueue();
+	void BuildShadowQueue(int cascade);
 	void RenderShadowMap();
+	RenderQueueStats DrawShadowQueue(
+		RenderQueue& queue,
+		ID3D11DepthStencilView* target,
+		const Graphics::ConstantAllocation& cascadeConstants,
+		const std::vector<Graphics::ConstantAllocation>& objectConstants);
+	void BuildLightClusters();
+	void ScatterLights();
+	void UploadStructured(DynamicStructuredBuffer& target, const void* data, int count, int stride);
+	void UploadInstances(RenderQueue& queue);
+	void BindInstances(ID3D11DeviceContext* context);
+	RenderQueueStats SubmitPass(
+		RenderQueue& queue,
+		const std::vector<Graphics::ConstantAllocation>* materialConstants,
+		const std::vector<Graphics::ConstantAllocation>* objectConstants,
+		ID3D11VertexShader* instancedVertexShader,
+		const std::function<void(ID3D11DeviceContext1*)>& passState);
 	void CreatePostProcessResource();
 	void ResizedPostProcessResources();
+	void BuildPostProcessGraph();
+	void DrawFullscreenPass(ID3D11PixelShader* pixelShader, int source, int target);
+	void DrawBlurPass(int source, int target, bool horizontal);
+	void MeasureLuminance(int source);
+	void DrawTonemapPass(int source);
 	void UpdateImGui(float deltaTime);
 	void BuildUI();
 };
\ No newline at end of file
@@ -1,4 +1,8 @@
 #include "Graphics.h"
+#include "ConstantRing.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
 #include <dxgi1_6.h>
 
 #include <d3dcompiler.h>
@@ -23,9 +27,22 @@ namespace Graphics
 
 		D3D_FEATURE_LEVEL featureLevel{};
 
-		unsigned int cbSize = 0;
-		unsigned int cbOffset = 0;
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+
+		// Constant buffer ring, and the mapping of the open batch
+		ConstantRing cbRing;
+		D3D11_MAPPED_SUBRESOURCE cbMapped = {};
+
+		// Buffers the ring has grown out of this frame, which earlier
+		// allocations may still be bound from
+		std::vector<Microsoft::WRL::ComPtr<ID3D11Buffer>> outgrownBuffers;
+
+		// One event query per frame the GPU may be behind by, to learn
+		// when a frame's constant data is no longer being read
+		const int FencedFrames = 4;
+		Microsoft::WRL::ComPtr<ID3D11Query> frameFences[FencedFrames];
+		uint64_t fencedFrame[FencedFrames] = {};
+		bool fencePending[FencedFrames] = {};
 	}
 }
 
@@ -301,60 +318,214 @@ Microsoft::WRL::ComPtr<ID3D11PixelShader> Graphics::LoadPixelShader(const wchar_
 	return shader;
 }
 
-void Graphics::ResizeConstantBufferHeap(unsigned int sizeInBytes)
-{
-	// Ensure graphics API is initialized
-	if (!apiInitialized)
-		return;
+Microsoft::WRL::ComPtr<ID3D11ComputeShader> Graphics::LoadComputeShader(const wchar_t* filePath) {
+	ID3DBlob* computeShaderBlob;
+	Microsoft::WRL::ComPtr<ID3D11ComputeShader> shader;
 
-	// Resets the ComPtr, releasing any existing references
-	constBuffer.Reset();
+	D3DReadFileToBlob(filePath, &computeShaderBlob);
+	Graphics::Device->CreateComputeShader(
+		computeShaderBlob->GetBufferPointer(),	// Pointer to start of binary data
+		computeShaderBlob->GetBufferSize(),		// How big is the data
+		0,										// No classes in the shader
+		shader.GetAddressOf()					// ID3D11ComputeShader**
+	);
 
-	// Set up basic size tracking details
-	cbOffset = 0;
-	cbSize = (sizeInBytes + 255) / 256 * 256;
+	return shader;
+}
+
+// Makes the ring's buffer at whatever size the ring is now
+static void CreateConstantBuffer()
+{
+	// Resets the ComPtr, releasing any existing references
+	Graphics::constBuffer.Reset();
 
-	// Create the actual buffer
 	D3D11_BUFFER_DESC cbDesc{};
 	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbDesc.ByteWidth = cbSize;
+	cbDesc.ByteWidth = Graphics::cbRing.GetSize();
 	cbDesc.Usage = D3D11_USAGE_DYNAMIC;
 	cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	cbDesc.MiscFlags = 0;
 	cbDesc.StructureByteStride = 0;
-	Device->CreateBuffer(&cbDesc, 0, constBuffer.GetAddressOf());
+	Graphics::Device->CreateBuffer(&cbDesc, 0, Graphics::constBuffer.GetAddressOf());
 }
 
-//Load constant buffer
-void Graphics::FillAndBindNextConstantBuffer(void* buffData, unsigned int size, D3D11_SHADER_TYPE shaderType, unsigned int slot) {
-	unsigned int totalSize = (size + 255) / 256 * 256;
-	if (cbOffset + totalSize >= cbSize) {
-		cbOffset = 0;
+void Graphics::ResizeConstantBufferHeap(unsigned int sizeInBytes)
+{
+	// Ensure graphics API is initialized
+	if (!apiInitialized)
+		return;
+
+	// Set up basic size tracking details
+	cbRing = ConstantRing((sizeInBytes + 255) / 256 * 256);
+	outgrownBuffers.clear();
+
+	// Create the actual buffer
+	CreateConstantBuffer();
+
+	// Fences for tracking what the GPU is still reading
+	D3D11_QUERY_DESC fenceDesc = {};
+	fenceDesc.Query = D3D11_QUERY_EVENT;
+	for (int i = 0; i < FencedFrames; i++)
+	{
+		frameFences[i].Reset();
+		Device->CreateQuery(&fenceDesc, frameFences[i].GetAddressOf());
+		fencePending[i] = false;
+	}
+}
+
+unsigned int Graphics::ConstantSize(unsigned int size)
+{
+	return ConstantRing::AlignedSize(size);
+}
+
+// --------------------------------------------------------
+// NO_OVERWRITE when the batch goes somewhere the GPU is done
+// with, DISCARD when it wraps onto data that may still be in
+// flight (see ConstantRing::BeginBatch()).
+//
+// A batch bigger than the whole ring (lots of entities in view)
+// moves the ring to a new buffer of at least double the size.
+// The old buffer is kept until the end of the frame, since
+// allocations already made in it can still be bound.
+// --------------------------------------------------------
+void Graphics::BeginConstantUploads(unsigned int reserveBytes)
+{
+	unsigned int grownSize = cbRing.GrowSizeFor(reserveBytes);
+	if (grownSize)
+	{
+		outgrownBuffers.push_back(constBuffer);
+		cbRing.Grow(grownSize);
+		CreateConstantBuffer();
+		printf("Constant buffer ring grown to %u KB\n", grownSize / 1024);
 	}
 
-	D3D11_MAPPED_SUBRESOURCE mappedBuffer = {};
+	D3D11_MAP mapType = cbRing.BeginBatch(reserveBytes) == ConstantRing::MapMode::Discard ?
+		D3D11_MAP_WRITE_DISCARD :
+		D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	cbMapped = {};
+	Context->Map(constBuffer.Get(), 0, mapType, 0, &cbMapped);
+}
+
+Graphics::ConstantAllocation Graphics::AllocateConstants(unsigned int size)
+{
+	unsigned int offset = cbRing.Allocate(size);
+
+	ConstantAllocation allocation = {};
+	allocation.Data = (unsigned char*)cbMapped.pData + offset;
+	allocation.Buffer = constBuffer.Get();
+	allocation.FirstConstant = offset / 16;
+	allocation.NumConstants = ConstantSize(size) / 16;
+	return allocation;
+}
 
-	Graphics::Context->Map(constBuffer.Get(), 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedBuffer);
-	void* uploadAddress = reinterpret_cast<void*>((UINT64)mappedBuffer.pData + cbOffset); // from demo
-	memcpy(uploadAddress, buffData, size);
-	Graphics::Context->Unmap(constBuffer.Get(), 0);
+void Graphics::EndConstantUploads()
+{
+	Context->Unmap(constBuffer.Get(), 0);
+	cbMapped = {};
+	cbRing.EndBatch();
+}
 
-	unsigned int firstConstant = cbOffset / 16;
-	unsigned int numConstants = totalSize / 16;
+void Graphics::BindConstants(const ConstantAllocation& allocation, D3D11_SHADER_TYPE shaderType, unsigned int slot, ID3D11DeviceContext1* context)
+{
+	if (!context)
+		context = Graphics::context1.Get();
 
 	switch (shaderType) {
 	case D3D11_VERTEX_SHADER:
-		Graphics::context1->VSSetConstantBuffers1(slot, 1, constBuffer.GetAddressOf(), &firstConstant, &numConstants);
+		context->VSSetConstantBuffers1(slot, 1, &allocation.Buffer, &allocation.FirstConstant, &allocation.NumConstants);
 		break;
 	case D3D11_PIXEL_SHADER:
-		Graphics::context1->PSSetConstantBuffers1(slot, 1, constBuffer.GetAddressOf(), &firstConstant, &numConstants);
+		context->PSSetConstantBuffers1(slot, 1, &allocation.Buffer, &allocation.FirstConstant, &allocation.NumConstants);
 		break;
+	case D3D11_COMPUTE_SHADER:
+		context->CSSetConstantBuffers1(slot, 1, &allocation.Buffer, &allocation.FirstConstant, &allocation.NumConstants);
+		break;
+	}
+}
+
+Microsoft::WRL::ComPtr<ID3D11DeviceContext1> Graphics::CreateDeferredContext()
+{
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferred;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> deferred1;
+	Device->CreateDeferredContext(0, deferred.GetAddressOf());
+	if (deferred)
+		deferred.As(&deferred1);
+	return deferred1;
+}
+
+ID3D11DeviceContext1* Graphics::ImmediateContext1()
+{
+	return context1.Get();
+}
+
+//Load constant buffer
+void Graphics::FillAndBindNextConstantBuffer(void* buffData, unsigned int size, D3D11_SHADER_TYPE shaderType, unsigned int slot) {
+	BeginConstantUploads(size);
+	ConstantAllocation allocation = AllocateConstants(size);
+	memcpy(allocation.Data, buffData, size);
+	EndConstantUploads();
+
+	BindConstants(allocation, shaderType, slot);
+}
+
+// --------------------------------------------------------
+// Fences the frame that was just submitted, and retires any
+// earlier frames the GPU has finished since.  Polling never
+// stalls - if every fence is still pending the oldest is
+// reused, and its frame just stays in flight a little longer
+// (worst case, the ring discards where it didn't need to).
+// --------------------------------------------------------
+void Graphics::EndFrame()
+{
+	uint64_t frame = cbRing.EndFrame();
+	outgrownBuffers.clear(); // D3D keeps them alive for as long as the GPU needs them
+
+	// Event queries complete in order, so the newest one that's
+	// done means every frame before it is done too
+	uint64_t newestCompleted = 0;
+	bool anyCompleted = false;
+	for (int i = 0; i < FencedFrames; i++)
+	{
+		if (fencePending[i] && Context->GetData(frameFences[i].Get(), 0, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		{
+			fencePending[i] = false;
+			newestCompleted = anyCompleted ? std::max(newestCompleted, fencedFrame[i]) : fencedFrame[i];
+			anyCompleted = true;
+		}
+	}
+
+	if (anyCompleted)
+		cbRing.FrameCompleted(newestCompleted);
+
+	// A free fence, or failing that the oldest
+	int fence = -1;
+	for (int i = 0; i < FencedFrames && fence < 0; i++)
+	{
+		if (!fencePending[i])
+			fence = i;
+	}
+	if (fence < 0)
+	{
+		fence = 0;
+		for (int i = 1; i < FencedFrames; i++)
+		{
+			if (fencedFrame[i] < fencedFrame[fence])
+				fence = i;
+		}
 	}
 
-	// update offset
-	cbOffset += totalSize;
+	Context->End(frameFences[fence].Get());
+	fencedFrame[fence] = frame;
+	fencePending[fence] = true;
 }
 
+unsigned int Graphics::ConstantBytesPerFrame() { return cbRing.GetFrameBytes(); }
+unsigned int Graphics::ConstantBytesInFlight() { return cbRing.GetBytesInFlight(); }
+int Graphics::ConstantBufferDiscards() { return cbRing.GetDiscards(); }
+unsigned int Graphics::ConstantBufferSize() { return cbRing.GetSize(); }
+int Graphics::ConstantBufferGrows() { return cbRing.GetGrows(); }
+
 // --------------------------------------------------------
 // Prints graphics debug messages waiting in the queue
 // --------------------------------------------------------
@@ -41,10 +41,49 @@ namespace Graphics
 	// Shader loading helpers
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> LoadPixelShader(const wchar_t* compiledShaderPath);
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> LoadVertexShader(const wchar_t* compiledShaderPath);
+	Microsoft::WRL::ComPtr<ID3D11ComputeShader> LoadComputeShader(const wchar_t* compiledShaderPath);
+
+	// Constant data lives in one big ring buffer (see ConstantRing.h)
+	// - Data points straight into the mapped buffer: write to it, but
+	//   never read from it
+	struct ConstantAllocation
+	{
+		void* Data;
+		ID3D11Buffer* Buffer; // The ring's buffer at the time - it's replaced if the ring grows
+		unsigned int FirstConstant;
+		unsigned int NumConstants;
+	};
 
 	void ResizeConstantBufferHeap(unsigned int sizeInBytes);
+	unsigned int ConstantSize(unsigned int size); // Bytes a batch needs to reserve for one allocation
+
+	// Maps the ring once for a whole batch of uploads, which must total
+	// no more than reserveBytes (sum of ConstantSize()s).  Nothing may
+	// be bound and drawn until EndConstantUploads().  The ring grows
+	// if the batch is bigger than all of it.
+	void BeginConstantUploads(unsigned int reserveBytes);
+	ConstantAllocation AllocateConstants(unsigned int size);
+	void EndConstantUploads();
+	// context defaults to the immediate context
+	void BindConstants(const ConstantAllocation& allocation, D3D11_SHADER_TYPE shaderType, unsigned int slot, ID3D11DeviceContext1* context = 0);
+
+	// A batch of one - maps, copies, unmaps and binds
 	void FillAndBindNextConstantBuffer(void* buffData, unsigned int size, D3D11_SHADER_TYPE shaderType, unsigned int slot);
 
+	// Call once a frame, after Present() - fences the frame's constant
+	// data so the ring knows when it can be written over
+	void EndFrame();
+	unsigned int ConstantBytesPerFrame();
+	unsigned int ConstantBytesInFlight();
+	int ConstantBufferDiscards();
+	unsigned int ConstantBufferSize();
+	int ConstantBufferGrows();
+
+	// For recording commands on other threads - see CommandRecorder.h.
+	// Constant buffer offsets need the 11.1 interface there too.
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> CreateDeferredContext();
+	ID3D11DeviceContext1* ImmediateContext1(); // Context, as 11.1
+
 	// Debug Layer
 	void PrintDebugMessages();
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+#include "BufferStructs.h"
+#include "RenderQueue.h"
+#include "EntityStore.h"
+
+// --------------------------------------------------------
+// CPU side of instanced drawing.  Submitted instanced, a sorted
+// RenderQueue draws each run of same-state entries as one batch,
+// with the batch's instances being those entries in sorted order -
+// so the per-instance data is every queued item's matrices,
+// written out in that order.
+// --------------------------------------------------------
+namespace Instancing
+{
+	// world[item] and worldInverseTranspose[item] belong to the item
+	// passed to RenderQueue::Add().  Writes queue.GetCount() instances.
+	void WriteInstances(RenderQueue& queue, const DirectX::XMFLOAT4X4* world, const DirectX::XMFLOAT4X4* worldInverseTranspose, PerObjectVSData* instances);
+
+	// Times queueing, sorting and grouping entities spread over a few
+	// meshes and materials, and writing their instance data
+	void Benchmark(int entityCount = 100000);
+}
@@ -0,0 +1,342 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Which system (if any) this thread is a worker of, and its index
+	thread_local JobSystem* currentSystem = nullptr;
+	thread_local int currentIndex = -1;
+
+	// Idle workers spin (yielding) this many times before sleeping
+	const int IdleSpins = 64;
+
+	// Roughly what a frame does per entity: build a world matrix from
+	// position/rotation/scale, then a world space box from a unit cube
+	float SimulateEntity(int index)
+	{
+		float angle = index * 0.001f;
+		float s = sinf(angle), c = cosf(angle);
+		float scale = 1.0f + (index % 7) * 0.1f;
+		float m[3][3] = {
+			{ c * scale, 0, -s * scale },
+			{ 0, scale, 0 },
+			{ s * scale, 0, c * scale } };
+
+		float extents[3] = {};
+		for (int axis = 0; axis < 3; axis++)
+			for (int row = 0; row < 3; row++)
+				extents[axis] += fabsf(m[row][axis]) * 0.5f;
+
+		return extents[0] + extents[1] + extents[2] + sqrtf(m[0][0] * m[0][0] + m[1][1] * m[1][1]);
+	}
+}
+
+JobSystem::JobSystem(int workerCount)
+{
+	if (workerCount < 0)
+		workerCount = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+
+	owner = std::this_thread::get_id();
+	for (int i = 0; i <= workerCount; i++)
+		deques.push_back(new WorkStealingDeque<Job>());
+	blocked.resize(workerCount + 1);
+	for (int i = 1; i <= workerCount; i++)
+		workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping.store(true);
+	}
+	wake.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+	for (WorkStealingDeque<Job>* deque : deques)
+		delete deque;
+}
+
+// --------------------------------------------------------
+// This thread's deque, or -1 if it isn't one of ours
+// --------------------------------------------------------
+int JobSystem::ThreadIndex()
+{
+	if (currentSystem == this)
+		return currentIndex;
+	if (std::this_thread::get_id() == owner)
+		return 0;
+	return -1;
+}
+
+// --------------------------------------------------------
+// Anything set aside earlier that's now ready, then our own deque
+// (newest work), then steal from the others (oldest work), starting
+// with the next thread along.  Jobs found before their dependency
+// is done are set aside on this thread.
+// --------------------------------------------------------
+JobSystem::Job* JobSystem::FindJob(int threadIndex)
+{
+	std::vector<Job*>& waiting = blocked[threadIndex];
+	for (size_t i = 0; i < waiting.size(); i++)
+	{
+		if (waiting[i]->dependency->IsDone())
+		{
+			Job* job = waiting[i];
+			waiting.erase(waiting.begin() + i);
+			return job;
+		}
+	}
+
+	while (true)
+	{
+		Job* job = deques[threadIndex]->Pop();
+		if (!job)
+		{
+			int count = (int)deques.size();
+			for (int i = 1; i < count && !job; i++)
+			{
+				job = deques[(threadIndex + i) % count]->Steal();
+				if (job)
+					jobsStolen.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		if (!job)
+			return nullptr;
+
+		queuedJobs.fetch_sub(1);
+		if (!job->dependency || job->dependency->IsDone())
+			return job;
+		waiting.push_back(job);
+	}
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->work();
+	jobsRun.fetch_add(1, std::memory_order_relaxed);
+
+	if (job->counter)
+		job->counter->pending.fetch_sub(1, std::memory_order_release);
+	delete job;
+}
+
+void JobSystem::WorkerLoop(int threadIndex)
+{
+	currentSystem = this;
+	currentIndex = threadIndex;
+
+	int idle = 0;
+	while (!stopping.load(std::memory_order_acquire))
+	{
+		if (Job* job = FindJob(threadIndex))
+		{
+			Execute(job);
+			idle = 0;
+			continue;
+		}
+
+		// Never sleep on jobs that were set aside - nobody else can run them
+		if (++idle < IdleSpins || !blocked[threadIndex].empty())
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Nothing to do for a while - sleep until Run() queues something.
+		// Run() bumps queuedJobs before checking sleepingWorkers, and
+		// this bumps sleepingWorkers before checking queuedJobs, so one
+		// of them always sees the other.
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers.fetch_add(1);
+		wake.wait(lock, [&] { return queuedJobs.load() > 0 || stopping.load(); });
+		sleepingWorkers.fetch_sub(1);
+		idle = 0;
+	}
+}
+
+void JobSystem::Run(std::function<void()> work, JobCounter* counter, const JobCounter* dependency)
+{
+	int threadIndex = ThreadIndex();
+	if (threadIndex < 0)
+		throw std::logic_error("Jobs can only be started by the thread that created the JobSystem, or its workers");
+
+	if (counter)
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+	Job* job = new Job{ std::move(work), counter, dependency };
+	if (!deques[threadIndex]->Push(job))
+	{
+		// Deque's full - no room to share it, so do it now (or as soon
+		// as it can run)
+		if (dependency && !dependency->IsDone())
+			blocked[threadIndex].push_back(job);
+		else
+			Execute(job);
+		return;
+	}
+
+	queuedJobs.fetch_add(1);
+	if (sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+}
+
+void JobSystem::ParallelFor(int count, int batchSize, std::function<void(int, int)> work, JobCounter& counter)
+{
+	batchSize = std::max(batchSize, 1);
+	for (int begin = 0; begin < count; begin += batchSize)
+	{
+		int end = std::min(begin + batchSize, count);
+		Run([work, begin, end] { work(begin, end); }, &counter);
+	}
+}
+
+void JobSystem::Wait(const JobCounter& counter)
+{
+	int threadIndex = ThreadIndex();
+	while (!counter.IsDone())
+	{
+		Job* job = threadIndex >= 0 ? FindJob(threadIndex) : nullptr;
+		if (job)
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+int JobSystem::GetThreadCount()
+{
+	return (int)deques.size();
+}
+
+int JobSystem::GetJobsRun()
+{
+	return jobsRun.load(std::memory_order_relaxed);
+}
+
+int JobSystem::GetJobsStolen()
+{
+	return jobsStolen.load(std::memory_order_relaxed);
+}
+
+// --------------------------------------------------------
+// Three kinds of load, at every thread count:
+//  - Flat: lots of tiny independent jobs, each writing its own slot
+//  - Nested: jobs that start more jobs and wait on them
+//  - Chained: each job depends on the one before, so they must
+//    run strictly in order whichever threads pick them up
+// --------------------------------------------------------
+bool JobSystem::StressTest()
+{
+	const int flatJobs = 100000;
+	const int parents = 100;
+	const int children = 100;
+	const int chainLength = 200;
+	const int rounds = 5;
+
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	bool allPassed = true;
+	printf("Job system stress test: 1 to %d threads, %d rounds each\n", maxThreads, rounds);
+
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobSystem system(threads - 1);
+		int failures = 0;
+
+		for (int round = 0; round < rounds; round++)
+		{
+			// Flat
+			std::vector<int> hits(flatJobs, 0);
+			JobCounter flat;
+			system.ParallelFor(flatJobs, 1, [&](int begin, int end) {
+				for (int i = begin; i < end; i++)
+					hits[i]++;
+			}, flat);
+			system.Wait(flat);
+			for (int hit : hits)
+				failures += hit != 1;
+
+			// Nested
+			std::atomic<int> total{ 0 };
+			JobCounter nested;
+			for (int p = 0; p < parents; p++)
+			{
+				system.Run([&] {
+					JobCounter mine;
+					for (int c = 0; c < children; c++)
+						system.Run([&] { total.fetch_add(1, std::memory_order_relaxed); }, &mine);
+					system.Wait(mine);
+				}, &nested);
+			}
+			system.Wait(nested);
+			failures += total.load() != parents * children;
+
+			// Chained
+			std::vector<JobCounter> links(chainLength);
+			std::vector<int> order;
+			order.reserve(chainLength);
+			for (int i = 0; i < chainLength; i++)
+				system.Run([&order, i] { order.push_back(i); }, &links[i], i > 0 ? &links[i - 1] : nullptr);
+			system.Wait(links[chainLength - 1]);
+			failures += (int)order.size() != chainLength;
+			for (int i = 0; i < (int)order.size(); i++)
+				failures += order[i] != i;
+		}
+
+		printf("  %2d threads: %s (%d jobs run, %d stolen)\n",
+			threads, failures ? "FAILED" : "passed", system.GetJobsRun(), system.GetJobsStolen());
+		allPassed = allPassed && failures == 0;
+	}
+
+	printf("%s\n\n", allPassed ? "All passed" : "FAILURES - see above");
+	return allPassed;
+}
+
+// --------------------------------------------------------
+// A frame's worth of per-entity work, batched, on a fresh system
+// for each thread count.  Best of several frames.
+// --------------------------------------------------------
+void JobSystem::Benchmark(int itemCount)
+{
+	const int frames = 20;
+	const int batchSize = 1024;
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	std::vector<float> results(itemCount);
+	printf("Job system benchmark: %d entities, batches of %d, best of %d frames\n", itemCount, batchSize, frames);
+
+	double singleThreaded = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		JobSystem system(threads - 1);
+		double best = 1e9;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			JobCounter counter;
+			system.ParallelFor(itemCount, batchSize, [&](int begin, int end) {
+				for (int i = begin; i < end; i++)
+					results[i] = SimulateEntity(i + frame);
+			}, counter);
+			system.Wait(counter);
+			auto end = std::chrono::high_resolution_clock::now();
+			best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+
+		if (threads == 1)
+			singleThreaded = best;
+		printf("  %2d threads: %.3f ms (%.2fx)\n", threads, best, singleThreaded / best);
+	}
+	printf("\n");
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// --------------------------------------------------------
+// Counts jobs that haven't finished yet.  Every job started with a
+// counter adds one to it and takes one away when it's done, so a
+// counter reaching zero is a fence for everything started with it.
+// --------------------------------------------------------
+class JobCounter
+{
+private:
+	friend class JobSystem;
+	std::atomic<int> pending{ 0 };
+
+public:
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// --------------------------------------------------------
+// Chase-Lev work-stealing deque, fixed size (Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models", 2013).
+//
+// The owning thread pushes and pops at the bottom, like a stack, so
+// it keeps working on what it started most recently.  Any other
+// thread may steal from the top - the oldest, and usually biggest,
+// piece of work.  Only the last item is ever contended.
+// --------------------------------------------------------
+template<typename T>
+class WorkStealingDeque
+{
+private:
+	std::atomic<int64_t> top{ 0 };
+	std::atomic<int64_t> bottom{ 0 };
+	std::vector<std::atomic<T*>> items;
+	int64_t mask;
+
+public:
+	// capacity must be a power of two
+	explicit WorkStealingDeque(int capacity = 4096) : items(capacity), mask(capacity - 1) {}
+
+	// Owner only.  Returns false when full.
+	bool Push(T* item)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t > mask)
+			return false;
+
+		items[b & mask].store(item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only
+	T* Pop()
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			// Empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		T* item = items[b & mask].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// Last item - race any thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				item = nullptr;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	// Any thread
+	T* Steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return nullptr;
+
+		T* item = items[t & mask].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr; // Lost the race - the caller can try again
+		return item;
+	}
+};
+
+// --------------------------------------------------------
+// Work-stealing job scheduler.
+//
+// Each thread - the workers, plus the thread that created the
+// system, which counts as thread 0 - has its own deque.  New jobs go
+// on the deque of the thread that starts them.  Threads take work
+// from their own deque first, then steal from the others.
+//
+// The creating thread has no loop of its own.  It helps while it
+// waits: Wait() runs jobs until the counter it's waiting on is done.
+// Jobs may start more jobs and wait on them (fork/join).
+//
+// A job can also be started with a dependency - another counter that
+// has to be done first.  If a thread picks it up too early, the job
+// is set aside on that thread and retried later, rather than waited
+// on.  Waiting could deadlock: the waiting thread might be the one
+// that has the dependency further down its own stack.
+//
+// Only the creating thread and the workers may start jobs.
+// Plain C++ threads and atomics, no platform code.
+// --------------------------------------------------------
+class JobSystem
+{
+private:
+	struct Job
+	{
+		std::function<void()> work;
+		JobCounter* counter;
+		const JobCounter* dependency;
+	};
+
+	std::thread::id owner; // The creating thread
+	std::vector<std::thread> workers;
+	std::vector<WorkStealingDeque<Job>*> deques; // One per thread, 0 is the creating thread
+	std::vector<std::vector<Job*>> blocked;		// Per thread, owner only - dependency not done yet
+	std::atomic<int> queuedJobs{ 0 };			// Pushed but not yet taken
+
+	// Idle workers sleep here
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> sleepingWorkers{ 0 };
+	std::atomic<bool> stopping{ false };
+
+	// Stats
+	std::atomic<int> jobsRun{ 0 };
+	std::atomic<int> jobsStolen{ 0 };
+
+	int ThreadIndex();
+	Job* FindJob(int threadIndex);
+	void Execute(Job* job);
+	void WorkerLoop(int threadIndex);
+
+public:
+	// -1 workers means one per core, less the creating thread
+	explicit JobSystem(int workerCount = -1);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Starts work() on any thread.  counter (optional) tracks it;
+	// dependency (optional) must be done before work() begins.
+	void Run(std::function<void()> work, JobCounter* counter = nullptr, const JobCounter* dependency = nullptr);
+
+	// Splits [0, count) into batches of at most batchSize and runs
+	// work(begin, end) on each, all tracked by counter
+	void ParallelFor(int count, int batchSize, std::function<void(int, int)> work, JobCounter& counter);
+
+	// Runs jobs until counter is done
+	void Wait(const JobCounter& counter);
+
+	int GetThreadCount(); // Workers, plus the creating thread
+	int GetJobsRun();
+	int GetJobsStolen();
+
+	// Hammers a system with each thread count from 1 to the number of
+	// cores - lots of tiny jobs, jobs starting jobs, dependency chains -
+	// and checks every job ran exactly once, in order where it had to.
+	// Prints the results and returns whether everything passed.
+	static bool StressTest();
+
+	// Times the same CPU-bound work (transforms and bounds, as in a
+	// frame) spread over 1 to N threads and prints the speedups
+	static void Benchmark(int itemCount = 100000);
+};
@@ -0,0 +1,514 @@
+#include "LightClusters.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <set>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Padding spheres sit so far away that their distance to any box
+	// squares to infinity
+	const float FarAway = 1e30f;
+
+	// Whether a light reaches a world space point at all - what the
+	// shader's attenuation and spot falloff would say, less a little
+	// margin at the edges
+	bool Reaches(const Light& light, XMFLOAT3 point)
+	{
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+			return false;
+
+		XMVECTOR toPoint = XMVectorSubtract(XMLoadFloat3(&point), XMLoadFloat3(&light.Position));
+		float distance = sqrtf(XMVectorGetX(XMVector3LengthSq(toPoint)));
+		if (!(distance < light.Range * 0.999f))
+			return false;
+
+		XMVECTOR direction = XMLoadFloat3(&light.Direction);
+		bool cone = light.SpotInnerAngle < light.SpotOuterAngle && light.SpotOuterAngle < XM_PIDIV2 && XMVectorGetX(XMVector3LengthSq(direction)) > 0.0f;
+		if (light.Type != LIGHT_TYPE_SPOT || !cone || distance == 0.0f)
+			return true;
+		float cosine = XMVectorGetX(XMVector3Dot(XMVector3Normalize(toPoint), XMVector3Normalize(direction)));
+		return cosine > cosf(light.SpotOuterAngle) + 0.001f;
+	}
+
+	// Lights scattered around a point - mostly point and spot,
+	// some directional, and some spots set up wrong
+	std::vector<Light> RandomLights(std::mt19937& random, int count, XMFLOAT3 center, XMFLOAT3 spread, float minRange, float maxRange)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+
+		std::vector<Light> lights(count);
+		for (Light& light : lights)
+		{
+			light = {};
+			float type = unit(random);
+			light.Type = type < 0.05f ? LIGHT_TYPE_DIRECTIONAL : type < 0.7f ? LIGHT_TYPE_POINT : LIGHT_TYPE_SPOT;
+			light.Position = XMFLOAT3(
+				center.x + signedUnit(random) * spread.x,
+				center.y + signedUnit(random) * spread.y,
+				center.z + signedUnit(random) * spread.z);
+			light.Range = minRange + unit(random) * (maxRange - minRange);
+			light.Direction = XMFLOAT3(signedUnit(random), signedUnit(random), signedUnit(random)); // Not normalized, like the UI's
+			light.SpotOuterAngle = XMConvertToRadians(5.0f + unit(random) * 100.0f);
+			light.SpotInnerAngle = unit(random) < 0.1f ? light.SpotOuterAngle : light.SpotOuterAngle * 0.75f;
+			light.Color = XMFLOAT3(1, 1, 1);
+			light.Intensity = 1.0f;
+		}
+		return lights;
+	}
+}
+
+void LightClusters::SphereList::Clear()
+{
+	Count = 0;
+	X.clear();
+	Y.clear();
+	Z.clear();
+	Radius.clear();
+	Light.clear();
+}
+
+void LightClusters::SphereList::Push(float x, float y, float z, float radius, uint32_t light)
+{
+	X.push_back(x);
+	Y.push_back(y);
+	Z.push_back(z);
+	Radius.push_back(radius);
+	Light.push_back(light);
+	Count++;
+}
+
+void LightClusters::SphereList::Push(const SphereList& other, int index)
+{
+	Push(other.X[index], other.Y[index], other.Z[index], other.Radius[index], other.Light[index]);
+}
+
+void LightClusters::SphereList::Pad()
+{
+	size_t padded = (size_t)(Count + 3) & ~(size_t)3;
+	X.resize(padded, FarAway);
+	Y.resize(padded, FarAway);
+	Z.resize(padded, FarAway);
+	Radius.resize(padded, 0.0f);
+	Light.resize(padded, 0);
+}
+
+// --------------------------------------------------------
+// Distance from each sphere's center to the box, four spheres at
+// a time - zero on any axis the center is within the box's range
+// on.  A sphere reaches the box if that's no more than its radius.
+//
+// Math is done with XMVECTORs, like Culling::Cull().
+// --------------------------------------------------------
+template<typename Visit>
+void LightClusters::ForEachTouching(const SphereList& spheres, const Box& box, Visit visit)
+{
+	XMVECTOR minX = XMVectorReplicate(box.Min.x);
+	XMVECTOR minY = XMVectorReplicate(box.Min.y);
+	XMVECTOR minZ = XMVectorReplicate(box.Min.z);
+	XMVECTOR maxX = XMVectorReplicate(box.Max.x);
+	XMVECTOR maxY = XMVectorReplicate(box.Max.y);
+	XMVECTOR maxZ = XMVectorReplicate(box.Max.z);
+	XMVECTOR zero = XMVectorZero();
+
+	for (int i = 0; i < spheres.Count; i += 4)
+	{
+		XMVECTOR x = XMLoadFloat4((const XMFLOAT4*)&spheres.X[i]);
+		XMVECTOR y = XMLoadFloat4((const XMFLOAT4*)&spheres.Y[i]);
+		XMVECTOR z = XMLoadFloat4((const XMFLOAT4*)&spheres.Z[i]);
+		XMVECTOR radius = XMLoadFloat4((const XMFLOAT4*)&spheres.Radius[i]);
+
+		XMVECTOR dx = XMVectorMax(XMVectorMax(XMVectorSubtract(minX, x), XMVectorSubtract(x, maxX)), zero);
+		XMVECTOR dy = XMVectorMax(XMVectorMax(XMVectorSubtract(minY, y), XMVectorSubtract(y, maxY)), zero);
+		XMVECTOR dz = XMVectorMax(XMVectorMax(XMVectorSubtract(minZ, z), XMVectorSubtract(z, maxZ)), zero);
+		XMVECTOR distanceSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), XMVectorMultiply(dz, dz));
+		XMVECTOR touching = XMVectorLessOrEqual(distanceSq, XMVectorMultiply(radius, radius));
+		if (XMVector4EqualInt(touching, XMVectorFalseInt()))
+			continue;
+
+		uint32_t masks[4];
+		XMStoreInt4(masks, touching);
+		for (int j = 0; j < 4; j++)
+		{
+			if (masks[j])
+				visit(i + j);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Each cluster's box is the box around its eight corners, which
+// come straight from the projection's terms (perspective or
+// orthographic), like ShadowCascades::GetSliceCorners()
+// --------------------------------------------------------
+void LightClusters::BuildGrid(const XMFLOAT4X4& projection, float nearClip, float farClip)
+{
+	gridProjection = projection;
+	gridNear = nearClip;
+	gridFar = farClip;
+
+	float sliceNear = NearSliceDepth > nearClip && NearSliceDepth < farClip ? NearSliceDepth : nearClip;
+	sliceScale = Slices / logf(farClip / sliceNear);
+	sliceBias = -logf(sliceNear) * sliceScale;
+
+	auto emptyBox = []() {
+		Box box = {};
+		box.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		box.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		return box;
+	};
+	auto grow = [](Box& box, XMFLOAT3 min, XMFLOAT3 max) {
+		box.Min = XMFLOAT3(std::min(box.Min.x, min.x), std::min(box.Min.y, min.y), std::min(box.Min.z, min.z));
+		box.Max = XMFLOAT3(std::max(box.Max.x, max.x), std::max(box.Max.y, max.y), std::max(box.Max.z, max.z));
+	};
+
+	clusterBoxes.resize(ClusterCount);
+	rowBoxes.resize(Slices * TilesY);
+	sliceBoxes.resize(Slices);
+
+	const XMFLOAT4X4& p = projection;
+	for (int s = 0; s < Slices; s++)
+	{
+		// The first slice reaches in to the near plane
+		float depths[2] = {
+			s == 0 ? nearClip : sliceNear * powf(farClip / sliceNear, (float)s / Slices),
+			s == Slices - 1 ? farClip : sliceNear * powf(farClip / sliceNear, (float)(s + 1) / Slices) };
+
+		Box& sliceBox = sliceBoxes[s] = emptyBox();
+		for (int row = 0; row < TilesY; row++)
+		{
+			Box& rowBox = rowBoxes[s * TilesY + row] = emptyBox();
+			for (int tile = 0; tile < TilesX; tile++)
+			{
+				Box& box = clusterBoxes[(s * TilesY + row) * TilesX + tile] = emptyBox();
+				for (int corner = 0; corner < 8; corner++)
+				{
+					float clipX = -1.0f + 2.0f * (tile + (corner & 1)) / TilesX;
+					float clipY = 1.0f - 2.0f * (row + ((corner >> 1) & 1)) / TilesY;
+					float z = depths[corner >> 2];
+					float w = z * p._34 + p._44;
+					XMFLOAT3 point(
+						(clipX * w - z * p._31 - p._41) / p._11,
+						(clipY * w - z * p._32 - p._42) / p._22,
+						z);
+					grow(box, point, point);
+				}
+				grow(rowBox, box.Min, box.Max);
+			}
+			grow(sliceBox, rowBox.Min, rowBox.Max);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// A spot only reaches a cone, range long.  The smallest sphere
+// around it is centred on the cone's base for wide cones, or goes
+// through its tip and base circle for narrow ones.  Spots with a
+// hemisphere or more, or whose angles don't make a proper cone,
+// keep the point light's sphere.
+// --------------------------------------------------------
+bool LightClusters::BoundLight(const Light& light, const XMFLOAT4X4& view, XMFLOAT4& sphere)
+{
+	if (light.Type == LIGHT_TYPE_DIRECTIONAL || !(light.Range > 0.0f))
+		return false;
+
+	XMVECTOR center = XMLoadFloat3(&light.Position);
+	float radius = light.Range;
+
+	XMVECTOR direction = XMLoadFloat3(&light.Direction);
+	float angle = light.SpotOuterAngle;
+	if (light.Type == LIGHT_TYPE_SPOT &&
+		light.SpotInnerAngle < angle && angle < XM_PIDIV2 &&
+		XMVectorGetX(XMVector3LengthSq(direction)) > 0.0f)
+	{
+		direction = XMVector3Normalize(direction);
+		if (angle > XM_PIDIV4)
+		{
+			center = XMVectorMultiplyAdd(direction, XMVectorReplicate(light.Range * cosf(angle)), center);
+			radius = light.Range * sinf(angle);
+		}
+		else
+		{
+			radius = light.Range / (2.0f * cosf(angle));
+			center = XMVectorMultiplyAdd(direction, XMVectorReplicate(radius), center);
+		}
+	}
+
+	XMFLOAT3 viewCenter;
+	XMStoreFloat3(&viewCenter, XMVector3TransformCoord(center, XMLoadFloat4x4(&view)));
+	sphere = XMFLOAT4(viewCenter.x, viewCenter.y, viewCenter.z, radius);
+	return true;
+}
+
+void LightClusters::Build(
+	const XMFLOAT4X4& view, const XMFLOAT4X4& projection,
+	float nearClip, float farClip,
+	const Light* lights, int lightCount, JobSystem* jobs)
+{
+	if (nearClip != gridNear || farClip != gridFar || memcmp(&projection, &gridProjection, sizeof(XMFLOAT4X4)) != 0)
+		BuildGrid(projection, nearClip, farClip);
+
+	spheres.Clear();
+	for (int i = 0; i < lightCount; i++)
+	{
+		XMFLOAT4 sphere;
+		if (BoundLight(lights[i], view, sphere))
+			spheres.Push(sphere.x, sphere.y, sphere.z, sphere.w, (uint32_t)i);
+	}
+	spheres.Pad();
+
+	slices.resize(Slices);
+	if (jobs)
+	{
+		JobCounter counter;
+		jobs->ParallelFor(Slices, 1, [this](int begin, int end) {
+			for (int s = begin; s < end; s++)
+				AssignSlice(s);
+		}, counter);
+		jobs->Wait(counter);
+	}
+	else
+	{
+		for (int s = 0; s < Slices; s++)
+			AssignSlice(s);
+	}
+
+	// Stitch the slices' lists together, in cluster order
+	size_t indexCount = 0;
+	for (const SliceWork& work : slices)
+		indexCount += work.Indices.size();
+	lightIndices.resize(indexCount);
+	ranges.resize(ClusterCount);
+	maxLightsPerCluster = 0;
+
+	uint32_t offset = 0;
+	for (int s = 0; s < Slices; s++)
+	{
+		const SliceWork& work = slices[s];
+		for (int c = 0; c < TilesX * TilesY; c++)
+		{
+			ClusterRange range = work.Ranges[c];
+			range.Offset += offset;
+			ranges[s * TilesX * TilesY + c] = range;
+			maxLightsPerCluster = std::max(maxLightsPerCluster, (int)range.Count);
+		}
+		std::copy(work.Indices.begin(), work.Indices.end(), lightIndices.begin() + offset);
+		offset += (uint32_t)work.Indices.size();
+	}
+}
+
+// Narrows the lights down slice, then row, then tile
+void LightClusters::AssignSlice(int slice)
+{
+	SliceWork& work = slices[slice];
+	work.Indices.clear();
+
+	work.SliceSpheres.Clear();
+	ForEachTouching(spheres, sliceBoxes[slice], [&](int i) { work.SliceSpheres.Push(spheres, i); });
+	work.SliceSpheres.Pad();
+
+	for (int row = 0; row < TilesY; row++)
+	{
+		work.RowSpheres.Clear();
+		ForEachTouching(work.SliceSpheres, rowBoxes[slice * TilesY + row], [&](int i) { work.RowSpheres.Push(work.SliceSpheres, i); });
+		work.RowSpheres.Pad();
+
+		for (int tile = 0; tile < TilesX; tile++)
+		{
+			ClusterRange& range = work.Ranges[row * TilesX + tile];
+			range.Offset = (uint32_t)work.Indices.size();
+			ForEachTouching(work.RowSpheres, clusterBoxes[(slice * TilesY + row) * TilesX + tile],
+				[&](int i) { work.Indices.push_back(work.RowSpheres.Light[i]); });
+			range.Count = (uint32_t)work.Indices.size() - range.Offset;
+		}
+	}
+}
+
+const ClusterRange* LightClusters::GetRanges() const { return ranges.data(); }
+const uint32_t* LightClusters::GetLightIndices() const { return lightIndices.data(); }
+int LightClusters::GetLightIndexCount() const { return (int)lightIndices.size(); }
+int LightClusters::GetClusteredLightCount() const { return spheres.Count; }
+int LightClusters::GetMaxLightsPerCluster() const { return maxLightsPerCluster; }
+float LightClusters::GetSliceScale() const { return sliceScale; }
+float LightClusters::GetSliceBias() const { return sliceBias; }
+
+int LightClusters::GetCluster(XMFLOAT3 viewPosition) const
+{
+	XMFLOAT4 clip;
+	XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(viewPosition.x, viewPosition.y, viewPosition.z, 1.0f), XMLoadFloat4x4(&gridProjection)));
+
+	int tile = (int)floorf((clip.x / clip.w * 0.5f + 0.5f) * TilesX);
+	int row = (int)floorf((0.5f - clip.y / clip.w * 0.5f) * TilesY);
+	int slice = (int)floorf(logf(viewPosition.z) * sliceScale + sliceBias);
+	tile = std::clamp(tile, 0, TilesX - 1);
+	row = std::clamp(row, 0, TilesY - 1);
+	slice = std::clamp(slice, 0, Slices - 1);
+	return (slice * TilesY + row) * TilesX + tile;
+}
+
+// --------------------------------------------------------
+// For each camera:
+//  - Every cluster's list holds exactly the lights whose sphere
+//    reaches its box, tested one by one (but for lights right on
+//    the edge, where rounding can go either way)
+//  - Random points in view find every light that reaches them in
+//    their own cluster's list
+//  - Building on a JobSystem gives the very same lists
+// --------------------------------------------------------
+bool LightClusters::Test()
+{
+	const int cameraCount = 8;
+	const int lightCount = 400;
+	const int pointCount = 2000;
+	std::mt19937 random(4321);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+	JobSystem jobs;
+
+	int listMismatches = 0;
+	int missedLights = 0;
+	int threadMismatches = 0;
+	long long listed = 0;
+	for (int c = 0; c < cameraCount; c++)
+	{
+		bool orthographic = c % 4 == 3;
+		float nearClip = 0.01f;
+		float farClip = c % 2 ? 1000.0f : 100.0f;
+
+		XMFLOAT3 eye(signedUnit(random) * 20.0f, signedUnit(random) * 5.0f, signedUnit(random) * 20.0f);
+		XMMATRIX cameraWorld =
+			XMMatrixRotationRollPitchYaw(signedUnit(random) * 1.2f, signedUnit(random) * XM_PI, 0.0f) *
+			XMMatrixTranslation(eye.x, eye.y, eye.z);
+		XMFLOAT4X4 view, projection;
+		XMStoreFloat4x4(&view, XMMatrixInverse(0, cameraWorld));
+		XMStoreFloat4x4(&projection, orthographic ?
+			XMMatrixOrthographicLH(20.0f + unit(random) * 40.0f, 10.0f + unit(random) * 30.0f, nearClip, farClip) :
+			XMMatrixPerspectiveFovLH(XMConvertToRadians(45.0f + unit(random) * 45.0f), 1.0f + unit(random) * 1.4f, nearClip, farClip));
+
+		std::vector<Light> lights = RandomLights(random, lightCount, eye, XMFLOAT3(40.0f, 15.0f, 40.0f), 1.0f, 15.0f);
+
+		LightClusters single, threaded;
+		single.Build(view, projection, nearClip, farClip, lights.data(), lightCount);
+		threaded.Build(view, projection, nearClip, farClip, lights.data(), lightCount, &jobs);
+		listed += single.GetLightIndexCount();
+
+		if (threaded.lightIndices != single.lightIndices ||
+			memcmp(threaded.ranges.data(), single.ranges.data(), ClusterCount * sizeof(ClusterRange)) != 0)
+			threadMismatches++;
+
+		// Every light against every cluster
+		for (int cluster = 0; cluster < ClusterCount; cluster++)
+		{
+			const ClusterRange& range = single.ranges[cluster];
+			std::set<uint32_t> inList(single.lightIndices.begin() + range.Offset, single.lightIndices.begin() + range.Offset + range.Count);
+			const Box& box = single.clusterBoxes[cluster];
+			for (int i = 0; i < lightCount; i++)
+			{
+				XMFLOAT4 sphere;
+				bool expected = false;
+				float distanceSq = 0.0f, radiusSq = 0.0f;
+				if (BoundLight(lights[i], view, sphere))
+				{
+					float dx = std::max(std::max(box.Min.x - sphere.x, sphere.x - box.Max.x), 0.0f);
+					float dy = std::max(std::max(box.Min.y - sphere.y, sphere.y - box.Max.y), 0.0f);
+					float dz = std::max(std::max(box.Min.z - sphere.z, sphere.z - box.Max.z), 0.0f);
+					distanceSq = dx * dx + dy * dy + dz * dz;
+					radiusSq = sphere.w * sphere.w;
+					expected = distanceSq <= radiusSq;
+				}
+				if (expected != (inList.count(i) > 0) && fabsf(distanceSq - radiusSq) > 1e-4f * (radiusSq + 1.0f))
+					listMismatches++;
+			}
+		}
+
+		// Points, out to where the lights are
+		XMMATRIX toWorld = cameraWorld;
+		const XMFLOAT4X4& p = projection;
+		float pointFar = std::min(farClip, 60.0f);
+		for (int n = 0; n < pointCount; n++)
+		{
+			float ndcX = signedUnit(random) * 0.999f;
+			float ndcY = signedUnit(random) * 0.999f;
+			float z = nearClip * powf(pointFar / nearClip, unit(random));
+			float w = z * p._34 + p._44;
+			XMFLOAT3 viewPoint(
+				(ndcX * w - z * p._31 - p._41) / p._11,
+				(ndcY * w - z * p._32 - p._42) / p._22,
+				z);
+			XMFLOAT3 worldPoint;
+			XMStoreFloat3(&worldPoint, XMVector3TransformCoord(XMLoadFloat3(&viewPoint), toWorld));
+
+			const ClusterRange& range = single.ranges[single.GetCluster(viewPoint)];
+			const uint32_t* first = single.lightIndices.data() + range.Offset;
+			const uint32_t* last = first + range.Count;
+			for (int i = 0; i < lightCount; i++)
+			{
+				if (Reaches(lights[i], worldPoint) && std::find(first, last, (uint32_t)i) == last)
+					missedLights++;
+			}
+		}
+	}
+
+	bool passed = listMismatches == 0 && missedLights == 0 && threadMismatches == 0;
+	printf("Light cluster test: %d cameras, %d lights, %d points each - %s\n", cameraCount, lightCount, pointCount, passed ? "passed" : "FAILED");
+	printf("  Clusters listing the wrong lights: %d\n", listMismatches);
+	printf("  Lit points missing a light: %d\n", missedLights);
+	printf("  Multithreaded builds that differ: %d\n", threadMismatches);
+	printf("  Average lights per cluster: %.2f\n\n", (double)listed / (cameraCount * ClusterCount));
+	return passed;
+}
+
+// --------------------------------------------------------
+// Lights spread over a field in front of a camera, best of
+// several runs so one hiccup doesn't skew the result
+// --------------------------------------------------------
+void LightClusters::Benchmark()
+{
+	const int runs = 20;
+	const int lightCounts[] = { 1000, 2500, 5000, 10000 };
+	std::mt19937 random(1234);
+	JobSystem jobs;
+
+	XMFLOAT4X4 view, projection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 2, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 1000.0f));
+
+	printf("Light cluster benchmark: %dx%dx%d clusters, best of %d runs\n", TilesX, TilesY, Slices, runs);
+	for (int lightCount : lightCounts)
+	{
+		std::vector<Light> lights = RandomLights(random, lightCount, XMFLOAT3(0, 5, 80), XMFLOAT3(100, 10, 100), 2.0f, 12.0f);
+
+		LightClusters serial, parallel;
+		double bestSerial = 1e9;
+		double bestParallel = 1e9;
+		for (int run = 0; run < runs; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			serial.Build(view, projection, 0.01f, 1000.0f, lights.data(), lightCount);
+			auto middle = std::chrono::high_resolution_clock::now();
+			parallel.Build(view, projection, 0.01f, 1000.0f, lights.data(), lightCount, &jobs);
+			auto end = std::chrono::high_resolution_clock::now();
+
+			bestSerial = std::min(bestSerial, std::chrono::duration<double, std::milli>(middle - start).count());
+			bestParallel = std::min(bestParallel, std::chrono::duration<double, std::milli>(end - middle).count());
+		}
+
+		int litClusters = 0;
+		for (const ClusterRange& range : serial.ranges)
+			litClusters += range.Count > 0;
+		printf("  %5d lights: %.3f ms on 1 thread, %.3f ms on %d (%.2fx)\n", lightCount, bestSerial, bestParallel, jobs.GetThreadCount(), bestSerial / bestParallel);
+		printf("    %d listed, %.1f per lit cluster, at most %d\n",
+			serial.GetLightIndexCount(), litClusters ? (double)serial.GetLightIndexCount() / litClusters : 0.0, serial.GetMaxLightsPerCluster());
+	}
+	printf("\n");
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+#include "Lights.h"
+
+class JobSystem;
+
+// Where one cluster's lights sit in the light index list - matches
+// the uint2s PixelShader.hlsl reads
+struct ClusterRange
+{
+	uint32_t Offset;
+	uint32_t Count;
+};
+
+// --------------------------------------------------------
+// Clustered forward lighting.  The camera's view is cut into a
+// grid of clusters (froxels) - TilesX x TilesY screen tiles, each
+// cut into Slices by view depth - and every point and spot light
+// is listed in each cluster its range reaches.  A pixel then only
+// shades the lights listed in its own cluster.  Directional
+// lights reach everywhere, so they're never listed.
+//
+// Slices are logarithmic, so clusters stay roughly as deep as
+// they are wide, except that everything closer than
+// NearSliceDepth shares the first one - the first metre would
+// otherwise take up a third of the grid.
+//
+// Each light is bounded by a view space sphere and tested against
+// the clusters' view space boxes four lights at a time.  Slices
+// are independent, so they can be spread over a JobSystem, and a
+// light is only tested against a slice's rows once it touches the
+// slice, and a row's tiles once it touches the row.
+//
+// No D3D here - the game uploads the ranges and index list as
+// structured buffers.
+// --------------------------------------------------------
+class LightClusters
+{
+public:
+	static constexpr int TilesX = 16;
+	static constexpr int TilesY = 9;
+	static constexpr int Slices = 24;
+	static constexpr int ClusterCount = TilesX * TilesY * Slices;
+	static constexpr float NearSliceDepth = 1.0f;
+
+private:
+	struct Box
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+	};
+
+	// Bounding spheres, one array per component (padded to a
+	// multiple of 4 with spheres that never touch anything), and
+	// the light each one bounds
+	struct SphereList
+	{
+		int Count = 0;
+		std::vector<float> X, Y, Z, Radius;
+		std::vector<uint32_t> Light;
+
+		void Clear();
+		void Push(float x, float y, float z, float radius, uint32_t light);
+		void Push(const SphereList& other, int index);
+		void Pad();
+	};
+
+	// One slice's scratch lists and results, kept between frames
+	// so building doesn't allocate once it's warmed up
+	struct SliceWork
+	{
+		SphereList SliceSpheres;
+		SphereList RowSpheres;
+		std::vector<uint32_t> Indices;
+		ClusterRange Ranges[TilesX * TilesY]; // Offsets into Indices
+	};
+
+	// The grid - only rebuilt when the projection changes
+	DirectX::XMFLOAT4X4 gridProjection = {};
+	float gridNear = -1.0f;
+	float gridFar = -1.0f;
+	float sliceScale = 0.0f;
+	float sliceBias = 0.0f;
+	std::vector<Box> clusterBoxes;	// View space
+	std::vector<Box> rowBoxes;		// Every tile in a row of a slice
+	std::vector<Box> sliceBoxes;
+
+	SphereList spheres; // Every point and spot light, view space
+	std::vector<SliceWork> slices;
+
+	// Results
+	std::vector<ClusterRange> ranges;
+	std::vector<uint32_t> lightIndices;
+	int maxLightsPerCluster = 0;
+
+	void BuildGrid(const DirectX::XMFLOAT4X4& projection, float nearClip, float farClip);
+	void AssignSlice(int slice);
+
+	// Calls visit(i) for every sphere i reaching into box
+	template<typename Visit>
+	static void ForEachTouching(const SphereList& spheres, const Box& box, Visit visit);
+
+	// View space sphere around everything a light can reach - false
+	// for lights that don't go in clusters
+	static bool BoundLight(const Light& light, const DirectX::XMFLOAT4X4& view, DirectX::XMFLOAT4& sphere);
+
+public:
+	// Rebuilds every cluster's light list for a camera.  Indices in
+	// the list are indices into lights.  With jobs, slices are
+	// assigned in parallel (and this waits for them).
+	void Build(
+		const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+		float nearClip, float farClip,
+		const Light* lights, int lightCount, JobSystem* jobs = nullptr);
+
+	// Indexed by (slice * TilesY + row) * TilesX + tile, row 0 at
+	// the top of the screen
+	const ClusterRange* GetRanges() const;
+	const uint32_t* GetLightIndices() const;
+	int GetLightIndexCount() const;
+	int GetClusteredLightCount() const;
+	int GetMaxLightsPerCluster() const;
+
+	// Slice of a view depth is floor(log(depth) * scale + bias),
+	// clamped to the grid
+	float GetSliceScale() const;
+	float GetSliceBias() const;
+
+	// The cluster a view space point falls in - what the pixel
+	// shader works out from the pixel's position and depth
+	int GetCluster(DirectX::XMFLOAT3 viewPosition) const;
+
+	// Random cameras (perspective and orthographic) and lights,
+	// checking every cluster's list against testing every light
+	// against every cluster, that points lit by a light always
+	// find it in their cluster, and that building on a JobSystem
+	// gives the same lists.  Prints the results and returns
+	// whether everything passed.
+	static bool Test();
+
+	// Times building for 1k to 10k lights around a camera, on one
+	// thread and on every core, and prints the results
+	static void Benchmark();
+};
@@ -0,0 +1,28 @@
+#include "Exposure.hlsli"
+
+Texture2D HDRScene : register(t0);
+RWStructuredBuffer<uint> Histogram : register(u0); // Cleared by AverageLuminanceCS
+
+groupshared uint groupHistogram[HISTOGRAM_BINS];
+
+// --------------------------------------------------------
+// Bins one 16x16 tile of the scene by luminance.  The group
+// counts into shared memory first, so the histogram in memory
+// only takes one add per bin per group.
+// --------------------------------------------------------
+[numthreads(16, 16, 1)]
+void main(uint groupIndex : SV_GroupIndex, uint3 id : SV_DispatchThreadID)
+{
+    groupHistogram[groupIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+    
+    // Groups hanging off the edge of the screen
+    if (id.x < (uint)inputWidth && id.y < (uint)inputHeight)
+    {
+        float3 color = HDRScene.Load(int3(id.xy, 0)).rgb;
+        InterlockedAdd(groupHistogram[HistogramBin(Luminance(color))], 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
+    
+    InterlockedAdd(Histogram[groupIndex], groupHistogram[groupIndex]);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// --------------------------------------------------------
+// Read-only memory mapping of an entire file
+//
+// - Uses CreateFileMapping on Windows and mmap elsewhere
+// - The mapping lives as long as this object does, so any
+//   pointers into Data() must not outlive it
+// --------------------------------------------------------
+class MappedFile
+{
+	const char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+
+public:
+	MappedFile(const std::wstring& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete; // Owns OS handles
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool IsOpen();
+	const char* Data();
+	size_t Size();
+};
@@ -72,7 +72,11 @@ const char* Material::GetName() {
 
 std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> Material::GetTextureSRVs()
 {
-	return textureSRVs;
+	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> resolved;
+	for (auto& t : textureSRVs) {
+		resolved.insert({ t.first, t.second->Get() });
+	}
+	return resolved;
 }
 
 std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11SamplerState>> Material::GetSamplerMap()
@@ -82,7 +86,12 @@ std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11SamplerState>> Mat
 
 void Material::AddTextureSRV(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
-	textureSRVs.insert({ slot, srv });
+	textureSRVs.insert({ slot, AsyncTexture::Loaded(srv) });
+}
+
+void Material::AddTextureSRV(unsigned int slot, std::shared_ptr<AsyncTexture> texture)
+{
+	textureSRVs.insert({ slot, texture });
 }
 
 void Material::AddSampler(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
@@ -90,13 +99,17 @@ void Material::AddSampler(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11Sample
 	samplers.insert({ slot, sampler });
 }
 
-void Material::BindTexturesAndSamplers()
+void Material::BindTexturesAndSamplers(ID3D11DeviceContext* context)
 {
+	if (!context)
+		context = Graphics::Context.Get();
+
 	for (auto& t : textureSRVs) {
-		Graphics::Context->PSSetShaderResources(t.first, 1, t.second.GetAddressOf());
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv = t.second->Get();
+		context->PSSetShaderResources(t.first, 1, srv.GetAddressOf());
 	}
 
 	for (auto& s : samplers) {
-		Graphics::Context->PSSetSamplers(s.first, 1, s.second.GetAddressOf());
+		context->PSSetSamplers(s.first, 1, s.second.GetAddressOf());
 	}
 }
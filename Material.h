@@ -2,9 +2,14 @@
 #include <DirectXMath.h>
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <memory>
 #include <unordered_map>
+#include "AsyncAsset.h"
 #include "Graphics.h"
 
+// A texture that may still be streaming in
+typedef AsyncAsset<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> AsyncTexture;
+
 class Material
 {
 	const char* name;
@@ -18,7 +23,9 @@ class Material
 	// Example of arrays holding SRVs and Sampler States for a single material
 	// - The array sizes below correspond to the maximum number of SRVs and samplers that can
 	// be used simultaneously (during a single draw). This is NOT the maximum number in memory.
-	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
+	// - Textures are held as AsyncTexture handles, so they can be
+	//   swapped in as they finish loading
+	std::unordered_map<unsigned int, std::shared_ptr<AsyncTexture>> textureSRVs;
 	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
 
 public:
@@ -33,6 +40,7 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetPixelShader();
 	const char* GetName();
 
+	// Whatever each slot currently resolves to (placeholder or loaded)
 	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> GetTextureSRVs();
 	std::unordered_map<unsigned int, Microsoft::WRL::ComPtr<ID3D11SamplerState>> GetSamplerMap();
 
@@ -44,7 +52,8 @@ public:
 	void SetPixelShader(Microsoft::WRL::ComPtr<ID3D11PixelShader> ps);
 
 	void AddTextureSRV(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	void AddTextureSRV(unsigned int slot, std::shared_ptr<AsyncTexture> texture);
 	void AddSampler(unsigned int slot, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
-	void BindTexturesAndSamplers();
+	void BindTexturesAndSamplers(ID3D11DeviceContext* context = 0); // Immediate context by default
 };
 
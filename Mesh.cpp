@@ -1,10 +1,153 @@
 #include "Mesh.h"
-#include <fstream>
+#include "CookedMesh.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <random>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 using namespace DirectX;
 
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Tangent generation work is split into blocks of at least
+	// this many triangles (or vertices), and never more than this
+	// many blocks
+	const int TangentTrianglesPerBlock = 8192;
+	const int TangentMaxBlocks = 16;
+
+	// --------------------------------------------------------
+	// One set of helper threads shared by every CalculateTangents()
+	// call, whichever thread makes it - the asset loader's load and
+	// stream threads included, which the JobSystem doesn't allow.
+	// The calling thread works through its own blocks too, so a
+	// call never stalls behind another call that has the helpers.
+	// --------------------------------------------------------
+	class TangentPool
+	{
+	private:
+		struct Task
+		{
+			std::function<void(int)> work;
+			int count;
+			std::atomic<int> next{ 0 };
+			std::atomic<int> done{ 0 };
+		};
+
+		std::mutex mutex;
+		std::condition_variable wake;		// Helpers wait for tasks here
+		std::condition_variable finished;	// Callers wait for the last block here
+		std::deque<std::shared_ptr<Task>> tasks;
+		std::vector<std::thread> threads;
+		bool stopping = false;
+
+		// Claims and runs blocks until there are none left
+		void Work(Task& task)
+		{
+			for (int i = task.next++; i < task.count; i = task.next++)
+			{
+				task.work(i);
+				if (task.done.fetch_add(1) + 1 == task.count)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.notify_all();
+				}
+			}
+		}
+
+		void HelperLoop()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true)
+			{
+				wake.wait(lock, [&]() { return stopping || !tasks.empty(); });
+				if (stopping)
+					return;
+
+				std::shared_ptr<Task> task = tasks.front();
+				lock.unlock();
+				Work(*task);
+				lock.lock();
+				Retire(task);
+			}
+		}
+
+		// Every block has been claimed, so no one else needs to see
+		// the task.  Caller holds the lock.
+		void Retire(const std::shared_ptr<Task>& task)
+		{
+			auto found = std::find(tasks.begin(), tasks.end(), task);
+			if (found != tasks.end())
+				tasks.erase(found);
+		}
+
+		TangentPool()
+		{
+			int helperCount = (int)std::max(1u, std::thread::hardware_concurrency()) - 1;
+			for (int i = 0; i < helperCount; i++)
+				threads.emplace_back([this]() { HelperLoop(); });
+		}
+
+	public:
+		~TangentPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (std::thread& thread : threads)
+				thread.join();
+		}
+
+		static TangentPool& Get()
+		{
+			static TangentPool pool;
+			return pool;
+		}
+
+		// Runs work(0) ... work(count - 1) across the helpers and
+		// the calling thread, returning once every one has finished
+		void ParallelFor(int count, std::function<void(int)> work)
+		{
+			if (count <= 1 || threads.empty())
+			{
+				for (int i = 0; i < count; i++)
+					work(i);
+				return;
+			}
+
+			std::shared_ptr<Task> task = std::make_shared<Task>();
+			task->work = std::move(work);
+			task->count = count;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push_back(task);
+			}
+			wake.notify_all();
+
+			Work(*task);
+
+			std::unique_lock<std::mutex> lock(mutex);
+			Retire(task);
+			finished.wait(lock, [&]() { return task->done.load() == count; });
+		}
+	};
+}
+
 //Construct a new mesh using vertices and indices
 Mesh::Mesh(const char* name, Vertex vertices[], int numVertices, unsigned int indices[], int numIndices) {
 	this->numIndices = numIndices;
@@ -17,265 +160,186 @@ Mesh::Mesh(const char* name, Vertex vertices[], int numVertices, unsigned int in
 
 Mesh::Mesh(const char* name, const std::wstring& objFile) {
 	this->name = name;
-// Author: Chris Cascioli
-// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-
-// *************************************
-//      IMPLEMENTATION NOTES (1/2)
-//
-//  - You'll need to #include both
-//      <fstream> and <stdexcept>
-//
-//  - You will need to integrate
-//      this code into a function or
-//      constructor of your own making
-//
-//  - There is MORE TO DO after pasting 
-//      this code in - see the bottom for
-//      what to do *after* including 
-//      this code in your mesh class
-//
-// *************************************
 
-// File input object
-	std::ifstream obj(objFile);
-
-	// Check for successful open
-	if (!obj.is_open())
-		throw std::invalid_argument("Error opening file: Invalid file path or file is inaccessible");
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	LoadOBJ(name, objFile, verts, indices);
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size());
+}
 
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;	// Positions from the file
-	std::vector<XMFLOAT3> normals;		// Normals from the file
-	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
-	char chars[100];			// String for line reading
+// --------------------------------------------------------
+// Loads a cooked binary mesh if it's up to date, uploading
+// straight out of the file mapping.  Otherwise falls back to
+// the .obj and re-cooks it for next time.
+// --------------------------------------------------------
+Mesh::Mesh(const char* name, const std::wstring& objFile, const std::wstring& cookedFile) {
+	this->name = name;
 
-	// Still have data left?
-	while (obj.good())
+	auto loadStart = std::chrono::high_resolution_clock::now();
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
-
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
+		MappedFile cooked(cookedFile);
+		const CookedMeshHeader* header = CookedMesh::Validate(cooked, objFile);
+		if (header)
 		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
+			CreateBuffers(
+				CookedMesh::GetVertices(header), (int)header->VertexCount,
+				CookedMesh::GetIndices(header), (int)header->IndexCount,
+				&header->Bounds);
+
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - loadStart).count();
+			printf("Name: %s \nVertices: %i\nLoaded cooked mesh in %.2f ms\n\n", name, numVertices, seconds * 1000.0);
+			return;
 		}
-		else if (chars[0] == 'v' && chars[1] == 't')
+	}
+
+	// Missing or stale - do it the slow way and cook the result
+	std::vector<Vertex> verts;
+	std::vector<unsigned int> indices;
+	CookOBJ(name, objFile, cookedFile, verts, indices);
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size());
+}
+
+// Construct a mesh from geometry that's already final (see LoadGeometry)
+Mesh::Mesh(const char* name, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const MeshBounds& bounds) {
+	this->name = name;
+	CreateBuffers(vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size(), &bounds);
+}
+
+void Mesh::LoadGeometry(const char* name, const std::wstring& objFile, const std::wstring& cookedFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, MeshBounds& bounds) {
+	{
+		MappedFile cooked(cookedFile);
+		const CookedMeshHeader* header = CookedMesh::Validate(cooked, objFile);
+		if (header)
 		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
+			const Vertex* cookedVerts = CookedMesh::GetVertices(header);
+			const unsigned int* cookedIndices = CookedMesh::GetIndices(header);
+			verts.assign(cookedVerts, cookedVerts + header->VertexCount);
+			indices.assign(cookedIndices, cookedIndices + header->IndexCount);
+			bounds = header->Bounds;
+			return;
 		}
-		else if (chars[0] == 'v')
+	}
+
+	CookOBJ(name, objFile, cookedFile, verts, indices);
+	bounds = Culling::ComputeBounds(verts.data(), (int)verts.size());
+}
+
+void Mesh::CookOBJ(const char* name, const std::wstring& objFile, const std::wstring& cookedFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices) {
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	LoadOBJ(name, objFile, verts, indices);
+
+	if (!CookedMesh::Write(cookedFile, objFile, &verts[0], (uint32_t)verts.size(), &indices[0], (uint32_t)indices.size()))
+		printf("Failed to write cooked mesh for %s\n\n", name);
+
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	printf("Loaded %s from .obj (and cooked) in %.2f ms\n\n", name, seconds * 1000.0);
+}
+
+// --------------------------------------------------------
+// Everything needed to turn an .obj into final, GPU-ready
+// vertex and index arrays
+// --------------------------------------------------------
+void Mesh::LoadOBJ(const char* name, const std::wstring& objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, bool report) {
+	// Map the whole file and parse it in place
+	// - Based on Chris Cascioli's basic .OBJ loader, but without
+	//   the getline/sscanf_s loop (see ObjLoader.cpp)
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	MappedFile obj(objFile);
+
+	// Check for successful open
+	if (!obj.IsOpen())
+		throw std::invalid_argument("Error opening file: Invalid file path or file is inaccessible");
+
+	ObjLoader::Parse(obj.Data(), obj.Size(), verts, indices);
+
+	// Report parse throughput and how much welding saved
+	// - Without welding there would be one vertex per index
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	size_t savedBytes = (indices.size() - verts.size()) * sizeof(Vertex);
+	int weldedFrom = (int)indices.size();
+
+	// Reorder for the post-transform cache, overdraw and vertex fetch
+	unsigned int vertexCount = (unsigned int)verts.size();
+	float acmrBefore = MeshOptimizer::ACMR(indices, vertexCount);
+	float atvrBefore = MeshOptimizer::ATVR(indices, vertexCount);
+	MeshOptimizer::Optimize(verts, indices);
+
+	// One printf, so reports from meshes loading on other threads
+	// don't interleave
+	if (report) printf("Name: %s \nVertices: %i (welded from %i, saved %.1f KB)\nParsed %.2f MB in %.2f ms (%.1f MB/s)\nACMR: %.3f -> %.3f\nATVR: %.3f -> %.3f\n\n",
+		name, (int)verts.size(), weldedFrom, savedBytes / 1024.0,
+		obj.Size() / (1024.0 * 1024.0), seconds * 1000.0, obj.Size() / (1024.0 * 1024.0) / seconds,
+		acmrBefore, MeshOptimizer::ACMR(indices, vertexCount),
+		atvrBefore, MeshOptimizer::ATVR(indices, vertexCount));
+
+	CalculateTangents(&verts[0], (int)verts.size(), &indices[0], (int)indices.size());
+}
+
+// --------------------------------------------------------
+// Best of a few runs per mesh.  The .obj side is the whole
+// parse/weld/optimize/tangents path plus bounds; the cooked
+// side is LoadGeometry() on an up to date .mesh, which maps,
+// validates and copies the streams and bounds out.  Neither
+// includes the GPU upload, which is the same for both.
+// --------------------------------------------------------
+void Mesh::LoadBenchmark(const std::vector<std::wstring>& objFiles) {
+	const int runs = 5;
+	double totalObj = 0.0;
+	double totalCooked = 0.0;
+	printf("Mesh load benchmark: best of %d runs, CPU side only\n", runs);
+	for (const std::wstring& objFile : objFiles)
+	{
+		std::wstring cookedFile = std::filesystem::path(objFile).replace_extension(L".mesh").wstring();
+		std::string name = std::filesystem::path(objFile).filename().string();
+
+		// Cooks the .mesh if it's missing or stale, so every timed
+		// run below takes the fast path
+		std::vector<Vertex> verts;
+		std::vector<unsigned int> indices;
+		MeshBounds cookedBounds = {};
+		LoadGeometry(name.c_str(), objFile, cookedFile, verts, indices, cookedBounds);
+
+		double bestObj = 1e9;
+		double bestCooked = 1e9;
+		MeshBounds objBounds = {};
+		for (int run = 0; run < runs; run++)
 		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
+			verts.clear();
+			indices.clear();
+			auto objStart = std::chrono::high_resolution_clock::now();
+			LoadOBJ(name.c_str(), objFile, verts, indices, false);
+			objBounds = Culling::ComputeBounds(verts.data(), (int)verts.size());
+			auto objEnd = std::chrono::high_resolution_clock::now();
+
+			auto cookedStart = std::chrono::high_resolution_clock::now();
+			LoadGeometry(name.c_str(), objFile, cookedFile, verts, indices, cookedBounds);
+			auto cookedEnd = std::chrono::high_resolution_clock::now();
+
+			bestObj = std::min(bestObj, std::chrono::duration<double, std::milli>(objEnd - objStart).count());
+			bestCooked = std::min(bestCooked, std::chrono::duration<double, std::milli>(cookedEnd - cookedStart).count());
 		}
-		else if (chars[0] == 'f')
-		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			unsigned int i[12];
-			int numbersRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// If we only got the first number, chances are the OBJ
-			// file has no UV coordinates.  This isn't great, but we
-			// still want to load the model without crashing, so we
-			// need to re-read a different pattern (in which we assume
-			// there are no UVs denoted for any of the vertices)
-			if (numbersRead == 1)
-			{
-				// Re-read with a different pattern
-				numbersRead = sscanf_s(
-					chars,
-					"f %d//%d %d//%d %d//%d %d//%d",
-					&i[0], &i[2],
-					&i[3], &i[5],
-					&i[6], &i[8],
-					&i[9], &i[11]);
-
-				// The following indices are where the UVs should 
-				// have been, so give them a valid value
-				i[1] = 1;
-				i[4] = 1;
-				i[7] = 1;
-				i[10] = 1;
-
-				// If we have no UVs, create a single UV coordinate
-				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(XMFLOAT2(0, 0));
-			}
 
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal's Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-			numVertices += 3;
-
-			// Add three more indices
-			indices.push_back(numIndices); numIndices += 1;
-			indices.push_back(numIndices); numIndices += 1;
-			indices.push_back(numIndices); numIndices += 1;
-
-			// Was there a 4th face?
-			// - 12 numbers read means 4 faces WITH uv's
-			// - 8 numbers read means 4 faces WITHOUT uv's
-			if (numbersRead == 12 || numbersRead == 8)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal's Z
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-				numVertices += 3;
-
-				// Add three more indices
-				indices.push_back(numIndices); numIndices += 1;
-				indices.push_back(numIndices); numIndices += 1;
-				indices.push_back(numIndices); numIndices += 1;
-			}
-		}
+		bool boundsMatch =
+			objBounds.Center.x == cookedBounds.Center.x && objBounds.Center.y == cookedBounds.Center.y && objBounds.Center.z == cookedBounds.Center.z &&
+			objBounds.Extents.x == cookedBounds.Extents.x && objBounds.Extents.y == cookedBounds.Extents.y && objBounds.Extents.z == cookedBounds.Extents.z &&
+			objBounds.Radius == cookedBounds.Radius;
+		printf("%-24s %6d vertices  .obj: %8.3f ms  cooked: %7.3f ms  (%.1fx)%s\n",
+			name.c_str(), (int)verts.size(), bestObj, bestCooked, bestObj / bestCooked, boundsMatch ? "" : "  BOUNDS DIFFER");
+		totalObj += bestObj;
+		totalCooked += bestCooked;
 	}
-
-	// Close the file and create the actual buffers
-	obj.close();
-	printf("Name: %s \nVertices: %i\n\n", name, numVertices);
-	CalculateTangents(&verts[0], numVertices, &indices[0], numIndices);
-	CreateBuffers(&verts[0], numVertices, &indices[0], numIndices);
-	// *************************************
-	//      IMPLEMENTATION NOTES (2/2)
-	//
-	// - At this point, "verts" is a std::vector 
-	//     of Vertex structs, and can be used
-	//     to create your mesh's vertex buffer
-	//
-	// - NOTE: Use &verts[0] for the address of 
-	//     the first vertx, NOT JUST &verts
-	//
-	// - The vector "indices" is similar. It's 
-	//     a std::vector of unsigned ints and
-	//     can be used to create the index 
-	//     buffer (again, &indices[0] is the 
-	//     address of the first integer)
-	//
-	// - Make sure your mesh class actually SAVES
-	//     the number of vertices and indices, or
-	//     drawing may have unintended problems.
-	//     - "vertCounter" is the number of vertices
-	//     - "indexCounter" is the number of indices
-	//
-	// - If you dig into the code, you may notice 
-	//     that  "vertCounter" and "indexCounter" 
-	//     end up being the same.  Recall that OBJs 
-	//     do not index entire vertices, making
-	//     it complex to detect duplicate vertices.
-	//     This also means an index buffer isn't
-	//     doing much for us.  We could try to 
-	//     detect duplicate vertices ourselves, 
-	//     but at that point it would be better 
-	//     to use a more sophisticated mesh loading
-	//     library like TinyOBJLoader or 
-	//     The Open Asset Importer Library, both
-	//     of which are unnecessary for now.
-	//
-	// *************************************
+	printf("All %d meshes  .obj: %.3f ms  cooked: %.3f ms  (%.1fx)\n\n",
+		(int)objFiles.size(), totalObj, totalCooked, totalObj / totalCooked);
 }
 
 //Deconstruct
 Mesh::~Mesh() {}
 
-void Mesh::CreateBuffers(Vertex* vertices, int numVertices, unsigned int* indices, int numIndices) {
+void Mesh::CreateBuffers(const Vertex* vertices, int numVertices, const unsigned int* indices, int numIndices, const MeshBounds* knownBounds) {
+	// Bounds come from the same final vertices that get uploaded,
+	// unless they were worked out when the mesh was cooked
+	bounds = knownBounds ? *knownBounds : Culling::ComputeBounds(vertices, numVertices);
+
 	// Create a VERTEX BUFFER
 	// - This holds the vertex data of triangles for a single object
 	// - This buffer is created on the GPU, which is where the data needs to
@@ -355,6 +419,24 @@ const char* Mesh::GetName() {
 	return name;
 }
 
+MeshBounds Mesh::GetBounds() {
+	return bounds;
+}
+
+// --------------------------------------------------------
+// Binds this mesh's vertex and index buffers - split out of Draw()
+// so draws that share a mesh only need to do it once
+// --------------------------------------------------------
+void Mesh::SetBuffers(ID3D11DeviceContext* context) {
+	if (!context)
+		context = Graphics::Context.Get();
+
+	UINT stride = sizeof(Vertex);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
 // Draw
 void Mesh::Draw() {
 	// DRAW geometry
@@ -366,10 +448,7 @@ void Mesh::Draw() {
 		//  - For this demo, this step *could* simply be done once during Init()
 		//  - However, this needs to be done between EACH DrawIndexed() call
 		//     when drawing different geometry, so it's here as an example
-		UINT stride = sizeof(Vertex);
-		UINT offset = 0;
-		Graphics::Context->IASetVertexBuffers(0, 1, GetVertexBuffer().GetAddressOf(), &stride, &offset);
-		Graphics::Context->IASetIndexBuffer(GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
+		SetBuffers();
 
 		// Tell Direct3D to draw
 		//  - Begins the rendering pipeline on the GPU
@@ -397,79 +476,230 @@ void Mesh::Draw() {
 //   - See listing 7.4 in section 7.5 (page 9 of the PDF)
 //
 // - Note: For this code to work, your Vertex format must
-//         contain an XMFLOAT3 called Tangent
+//         contain an XMFLOAT4 called Tangent
 //
 // - Be sure to call this BEFORE creating your D3D vertex/index buffers
+//
+// Since modified to run in parallel:
+// - Each triangle's tangent and bitangent are worked out once, in
+//   blocks of triangles
+// - Each vertex then sums the triangles that use it, found through
+//   a vertex -> triangle list, in blocks of vertices.  No two blocks
+//   write the same vertex, and every vertex adds its triangles in
+//   triangle order, so the result is bit for bit what a single
+//   thread would get, for any number of threads
+// - Extra memory is per triangle and per vertex (about 36 bytes a
+//   triangle and 4 a vertex), not a copy of every vertex per block
+// - Blocks run on a pool of helper threads shared by every call
+// - All math is done with XMVECTORs, which DirectXMath maps to SSE
+//   (or plain floats when built with _XM_NO_INTRINSICS_)
+// - Tangent.w holds the handedness of the UV mapping (+1 or -1) so
+//   mirrored UVs get a correctly flipped bitangent in the shader
 // --------------------------------------------------------
 void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
 {
-	// Reset tangents
-	for (int i = 0; i < numVerts; i++)
+	int numTriangles = numIndices / 3;
+	TangentPool& pool = TangentPool::Get();
+
+	// Tangent and bitangent of every triangle
+	std::vector<XMFLOAT3> triangleTangents(numTriangles);
+	std::vector<XMFLOAT3> triangleBitangents(numTriangles);
+	int triangleBlocks = std::clamp(numTriangles / TangentTrianglesPerBlock, 1, TangentMaxBlocks);
+	int trianglesPerBlock = (numTriangles + triangleBlocks - 1) / triangleBlocks;
+	pool.ParallelFor(triangleBlocks, [&](int block)
+		{
+			int lastTriangle = std::min(numTriangles, (block + 1) * trianglesPerBlock);
+			for (int t = block * trianglesPerBlock; t < lastTriangle; t++)
+			{
+				// Grab indices and vertices of this triangle
+				unsigned int i1 = indices[t * 3];
+				unsigned int i2 = indices[t * 3 + 1];
+				unsigned int i3 = indices[t * 3 + 2];
+
+				// Calculate vectors relative to triangle positions
+				XMVECTOR p1 = XMLoadFloat3(&verts[i1].Position);
+				XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&verts[i2].Position), p1);
+				XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&verts[i3].Position), p1);
+
+				// Do the same for vectors relative to triangle uv's
+				float s1 = verts[i2].UV.x - verts[i1].UV.x;
+				float t1 = verts[i2].UV.y - verts[i1].UV.y;
+				float s2 = verts[i3].UV.x - verts[i1].UV.x;
+				float t2 = verts[i3].UV.y - verts[i1].UV.y;
+
+				// Create vectors for tangent calculation
+				float r = 1.0f / (s1 * t2 - s2 * t1);
+				XMStoreFloat3(&triangleTangents[t], XMVectorScale(XMVectorSubtract(XMVectorScale(e1, t2), XMVectorScale(e2, t1)), r));
+				XMStoreFloat3(&triangleBitangents[t], XMVectorScale(XMVectorSubtract(XMVectorScale(e2, s1), XMVectorScale(e1, s2)), r));
+			}
+		});
+
+	// Triangles using each vertex, in triangle order: vertex v's are
+	// vertexTriangles[firstTriangle[v]] up to firstTriangle[v + 1]
+	std::vector<int> firstTriangle(numVerts + 1, 0);
+	std::vector<int> vertexTriangles(numTriangles * 3);
+	for (int i = 0; i < numTriangles * 3; i++)
+		firstTriangle[indices[i] + 1]++;
+	for (int v = 0; v < numVerts; v++)
+		firstTriangle[v + 1] += firstTriangle[v];
 	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
+		std::vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (int i = 0; i < numTriangles * 3; i++)
+			vertexTriangles[filled[indices[i]]++] = i / 3;
 	}
 
-	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numIndices;)
+	// Sum each vertex's triangles and ensure all of the tangents
+	// are orthogonal to the normals
+	int vertexBlocks = std::clamp(numVerts / TangentTrianglesPerBlock, 1, TangentMaxBlocks);
+	int vertsPerBlock = (numVerts + vertexBlocks - 1) / vertexBlocks;
+	pool.ParallelFor(vertexBlocks, [&](int block)
+		{
+			int lastVert = std::min(numVerts, (block + 1) * vertsPerBlock);
+			for (int i = block * vertsPerBlock; i < lastVert; i++)
+			{
+				XMVECTOR tangent = XMVectorZero();
+				XMVECTOR bitangent = XMVectorZero();
+				for (int j = firstTriangle[i]; j < firstTriangle[i + 1]; j++)
+				{
+					tangent = XMVectorAdd(tangent, XMLoadFloat3(&triangleTangents[vertexTriangles[j]]));
+					bitangent = XMVectorAdd(bitangent, XMLoadFloat3(&triangleBitangents[vertexTriangles[j]]));
+				}
+
+				// Use Gram-Schmidt orthonormalize to ensure
+				// the normal and tangent are exactly 90 degrees apart
+				XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+				tangent = XMVector3Normalize(
+					XMVectorSubtract(tangent, XMVectorMultiply(normal, XMVector3Dot(normal, tangent))));
+
+				// Handedness: -1 where the UVs are mirrored, +1 otherwise
+				float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), bitangent)) < 0.0f ? -1.0f : 1.0f;
+
+				// Store the tangent
+				XMStoreFloat4(&verts[i].Tangent, XMVectorSetW(tangent, handedness));
+			}
+		});
+}
+
+// --------------------------------------------------------
+// Checks CalculateTangents() against the plain single threaded
+// loop, bit for bit, on a grid whose triangles are shuffled so
+// shared vertices are used from many different blocks.  Runs it
+// from several threads at once too, as the asset loader does.
+// Prints the results and returns whether they passed.
+// --------------------------------------------------------
+bool Mesh::TangentTest()
+{
+	const int quadsPerSide = 160; // 51200 triangles - several blocks
+	const int side = quadsPerSide + 1;
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	// A bumpy grid, with some of its UVs mirrored
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> bump(-0.1f, 0.1f);
+	std::vector<Vertex> grid(side * side);
+	for (int y = 0; y < side; y++)
 	{
-		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
-		Vertex* v1 = &verts[i1];
-		Vertex* v2 = &verts[i2];
-		Vertex* v3 = &verts[i3];
-
-		// Calculate vectors relative to triangle positions
-		float x1 = v2->Position.x - v1->Position.x;
-		float y1 = v2->Position.y - v1->Position.y;
-		float z1 = v2->Position.z - v1->Position.z;
-
-		float x2 = v3->Position.x - v1->Position.x;
-		float y2 = v3->Position.y - v1->Position.y;
-		float z2 = v3->Position.z - v1->Position.z;
-
-		// Do the same for vectors relative to triangle uv's
-		float s1 = v2->UV.x - v1->UV.x;
-		float t1 = v2->UV.y - v1->UV.y;
-
-		float s2 = v3->UV.x - v1->UV.x;
-		float t2 = v3->UV.y - v1->UV.y;
-
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
-
-		float tx = (t2 * x1 - t1 * x2) * r;
-		float ty = (t2 * y1 - t1 * y2) * r;
-		float tz = (t2 * z1 - t1 * z2) * r;
-
-		// Adjust tangents of each vert of the triangle
-		v1->Tangent.x += tx;
-		v1->Tangent.y += ty;
-		v1->Tangent.z += tz;
-
-		v2->Tangent.x += tx;
-		v2->Tangent.y += ty;
-		v2->Tangent.z += tz;
-
-		v3->Tangent.x += tx;
-		v3->Tangent.y += ty;
-		v3->Tangent.z += tz;
+		for (int x = 0; x < side; x++)
+		{
+			Vertex& v = grid[y * side + x];
+			v.Position = XMFLOAT3((float)x, bump(random), (float)y);
+			v.Normal = XMFLOAT3(0, 1, 0);
+			v.UV = XMFLOAT2((x < side / 2 ? x : side - x) / (float)quadsPerSide, y / (float)quadsPerSide);
+			v.Tangent = XMFLOAT4(0, 0, 0, 0);
+		}
 	}
 
-	// Ensure all of the tangents are orthogonal to the normals
-	for (int i = 0; i < numVerts; i++)
+	std::vector<unsigned int> quads(quadsPerSide * quadsPerSide);
+	for (int q = 0; q < (int)quads.size(); q++)
+		quads[q] = q;
+	std::shuffle(quads.begin(), quads.end(), random);
+	std::vector<unsigned int> indices;
+	for (unsigned int q : quads)
 	{
-		// Grab the two vectors
-		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
-
-		// Use Gram-Schmidt orthonormalize to ensure
-		// the normal and tangent are exactly 90 degrees apart
-		tangent = XMVector3Normalize(
-			tangent - normal * XMVector3Dot(normal, tangent));
+		unsigned int a = (q / quadsPerSide) * side + q % quadsPerSide;
+		unsigned int triangles[] = { a, a + side, a + 1, a + 1, a + side, a + side + 1 };
+		indices.insert(indices.end(), triangles, triangles + 6);
+	}
+	int numTriangles = (int)indices.size() / 3;
 
-		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
+	// The single threaded loop
+	std::vector<Vertex> expected = grid;
+	{
+		std::vector<XMFLOAT3> tangents(expected.size(), XMFLOAT3(0, 0, 0));
+		std::vector<XMFLOAT3> bitangents(expected.size(), XMFLOAT3(0, 0, 0));
+		for (int t = 0; t < numTriangles; t++)
+		{
+			unsigned int i1 = indices[t * 3];
+			unsigned int i2 = indices[t * 3 + 1];
+			unsigned int i3 = indices[t * 3 + 2];
+			XMVECTOR p1 = XMLoadFloat3(&expected[i1].Position);
+			XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&expected[i2].Position), p1);
+			XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&expected[i3].Position), p1);
+			float s1 = expected[i2].UV.x - expected[i1].UV.x;
+			float t1 = expected[i2].UV.y - expected[i1].UV.y;
+			float s2 = expected[i3].UV.x - expected[i1].UV.x;
+			float t2 = expected[i3].UV.y - expected[i1].UV.y;
+			float r = 1.0f / (s1 * t2 - s2 * t1);
+			XMFLOAT3 tangent;
+			XMFLOAT3 bitangent;
+			XMStoreFloat3(&tangent, XMVectorScale(XMVectorSubtract(XMVectorScale(e1, t2), XMVectorScale(e2, t1)), r));
+			XMStoreFloat3(&bitangent, XMVectorScale(XMVectorSubtract(XMVectorScale(e2, s1), XMVectorScale(e1, s2)), r));
+			for (unsigned int v : { i1, i2, i3 })
+			{
+				XMStoreFloat3(&tangents[v], XMVectorAdd(XMLoadFloat3(&tangents[v]), XMLoadFloat3(&tangent)));
+				XMStoreFloat3(&bitangents[v], XMVectorAdd(XMLoadFloat3(&bitangents[v]), XMLoadFloat3(&bitangent)));
+			}
+		}
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			XMVECTOR normal = XMLoadFloat3(&expected[i].Normal);
+			XMVECTOR tangent = XMLoadFloat3(&tangents[i]);
+			tangent = XMVector3Normalize(XMVectorSubtract(tangent, XMVectorMultiply(normal, XMVector3Dot(normal, tangent))));
+			float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), XMLoadFloat3(&bitangents[i]))) < 0.0f ? -1.0f : 1.0f;
+			XMStoreFloat4(&expected[i].Tangent, XMVectorSetW(tangent, handedness));
+		}
 	}
-}
\ No newline at end of file
+
+	auto sameTangents = [&](const std::vector<Vertex>& verts) {
+		for (size_t i = 0; i < verts.size(); i++)
+		{
+			if (memcmp(&verts[i].Tangent, &expected[i].Tangent, sizeof(XMFLOAT4)) != 0)
+				return false;
+		}
+		return true;
+	};
+
+	std::vector<Vertex> verts = grid;
+	auto start = std::chrono::high_resolution_clock::now();
+	CalculateTangents(verts.data(), (int)verts.size(), indices.data(), (int)indices.size());
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	check(sameTangents(verts), "tangents match the single threaded loop bit for bit");
+
+	bool mirrored = false;
+	for (const Vertex& v : verts)
+		mirrored = mirrored || v.Tangent.w < 0.0f;
+	check(mirrored, "mirrored UVs get a negative handedness");
+
+	// Four plain threads sharing the pool at once
+	std::vector<std::vector<Vertex>> copies(4, grid);
+	std::vector<std::thread> threads;
+	for (std::vector<Vertex>& copy : copies)
+		threads.emplace_back([&]() { CalculateTangents(copy.data(), (int)copy.size(), indices.data(), (int)indices.size()); });
+	for (std::thread& thread : threads)
+		thread.join();
+	bool allMatch = true;
+	for (const std::vector<Vertex>& copy : copies)
+		allMatch = allMatch && sameTangents(copy);
+	check(allMatch, "calls from several threads at once match too");
+
+	bool passed = failures == 0;
+	printf("Tangent test: %s\n  %d triangles, %d vertices in %.3f ms\n\n", passed ? "passed" : "FAILED", numTriangles, (int)verts.size(), ms);
+	return passed;
+}
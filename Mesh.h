@@ -1,6 +1,9 @@
 #pragma once
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <string>
+#include <vector>
+#include "Culling.h"
 #include "Graphics.h"
 #include "Vertex.h"
 
@@ -14,20 +17,47 @@ private:
 	int numIndices = 0; // num of indices - drawing
 	int numVertices = 0; // num of vertices - UI
 	const char* name; // name displayed in UI
+	MeshBounds bounds; // local space, for culling
 
 	//future - add variables to store textures and shader data
 
+	// Parses, welds and optimizes an .obj, and calculates tangents
+	static void LoadOBJ(const char* name, const std::wstring& objFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, bool report = true);
+
+	// LoadOBJ, then writes the result out as a cooked mesh
+	static void CookOBJ(const char* name, const std::wstring& objFile, const std::wstring& cookedFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
 public:
 	Mesh(const char* name, Vertex vertices[], int numVertices, unsigned int indices[], int numIndices);
 	Mesh(const char* name, const std::wstring& objFile);
+	Mesh(const char* name, const std::wstring& objFile, const std::wstring& cookedFile);
+	Mesh(const char* name, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const MeshBounds& bounds);
 	~Mesh();
 	void Draw();
-	void CreateBuffers(Vertex* vertices, int numVertices, unsigned int* indices, int numIndices);
+	void SetBuffers(ID3D11DeviceContext* context = 0); // Immediate context by default
+	void CreateBuffers(const Vertex* vertices, int numVertices, const unsigned int* indices, int numIndices, const MeshBounds* knownBounds = nullptr);
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	int GetVertexCount();
 	int GetIndexCount();
 	const char* GetName();
-	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	MeshBounds GetBounds();
+	static void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+
+	// Checks CalculateTangents() bit for bit against a single
+	// threaded loop, and from several threads at once.  Prints the
+	// results and returns whether they passed.
+	static bool TangentTest();
+
+	// CPU-only half of the cooked constructor, safe to call from any
+	// thread - fills verts/indices/bounds from the cooked file, or
+	// from the .obj (re-cooking it) when the cooked file is missing
+	// or stale
+	static void LoadGeometry(const char* name, const std::wstring& objFile, const std::wstring& cookedFile, std::vector<Vertex>& verts, std::vector<unsigned int>& indices, MeshBounds& bounds);
+
+	// Times loading each .obj the slow way against loading its
+	// cooked .mesh (cooking it first if needed), CPU side only,
+	// and prints the results
+	static void LoadBenchmark(const std::vector<std::wstring>& objFiles);
 };
 
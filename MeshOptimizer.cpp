@@ -0,0 +1,309 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Simulates a FIFO cache and counts vertex transforms
+	unsigned int CountTransforms(const std::vector<unsigned int>& indices, unsigned int vertexCount, int cacheSize)
+	{
+		// A vertex is cached if it was inserted within the last
+		// cacheSize insertions
+		std::vector<unsigned int> insertedAt(vertexCount, 0);
+		unsigned int time = cacheSize + 1;
+		unsigned int misses = 0;
+
+		for (unsigned int v : indices)
+		{
+			if (time - insertedAt[v] > (unsigned int)cacheSize)
+			{
+				insertedAt[v] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	// Tipsify's choice of the next vertex to fan around: the
+	// candidate that will still be in the cache after its remaining
+	// triangles are emitted, preferring the oldest such vertex
+	int GetNextVertex(
+		const std::vector<unsigned int>& candidates,
+		const std::vector<unsigned int>& cacheTime,
+		const std::vector<unsigned int>& liveTriangles,
+		std::vector<unsigned int>& deadEnd,
+		unsigned int& cursor,
+		unsigned int time,
+		int cacheSize)
+	{
+		int best = -1;
+		int bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= (unsigned int)cacheSize)
+				priority = time - cacheTime[v];
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		if (best != -1)
+			return best;
+
+		// Dead end - try recently used vertices first
+		while (!deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				return v;
+		}
+
+		// Then fall back to the next vertex in input order
+		for (; cursor < liveTriangles.size(); cursor++)
+		{
+			if (liveTriangles[cursor] > 0)
+				return cursor;
+		}
+		return -1;
+	}
+
+	XMFLOAT3 Sub(XMFLOAT3 a, XMFLOAT3 b) { return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z); }
+	XMFLOAT3 Cross(XMFLOAT3 a, XMFLOAT3 b) { return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	float Dot(XMFLOAT3 a, XMFLOAT3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+}
+
+// --------------------------------------------------------
+// Runs every optimization pass on a welded, indexed mesh
+// --------------------------------------------------------
+void MeshOptimizer::Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	if (verts.empty() || indices.size() < 3)
+		return;
+
+	std::vector<unsigned int> clusters = OptimizeVertexCache(indices, (unsigned int)verts.size());
+	OptimizeOverdraw(indices, verts, clusters);
+	OptimizeVertexFetch(verts, indices);
+}
+
+// --------------------------------------------------------
+// Tipsify: emits triangles by "fanning" around one vertex at a
+// time, picking the next fanning vertex from the ones just
+// emitted.  Every time it has to jump somewhere unrelated (a dead
+// end), a new cluster starts - those boundaries are returned so
+// the overdraw pass can shuffle clusters without hurting the cache.
+// --------------------------------------------------------
+std::vector<unsigned int> MeshOptimizer::OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+
+	// Vertex -> triangle adjacency, stored compactly
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (unsigned int v : indices)
+		liveTriangles[v]++;
+
+	std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+
+	std::vector<unsigned int> adjacency(adjacencyStart[vertexCount]);
+	std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+			adjacency[fill[indices[t * 3 + c]]++] = t;
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	std::vector<unsigned int> clusters;
+	output.reserve(indices.size());
+	deadEnd.reserve(indices.size());
+
+	unsigned int time = CacheSize + 1;
+	unsigned int cursor = 1;
+	int fanning = 0;
+	bool newCluster = true;
+
+	while (fanning >= 0)
+	{
+		if (newCluster)
+			clusters.push_back((unsigned int)output.size());
+
+		candidates.clear();
+		for (unsigned int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[t * 3 + c];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+
+				if (time - cacheTime[v] > (unsigned int)CacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Anything not among the candidates means we jumped
+		fanning = GetNextVertex(candidates, cacheTime, liveTriangles, deadEnd, cursor, time, CacheSize);
+		newCluster = fanning >= 0 && std::find(candidates.begin(), candidates.end(), (unsigned int)fanning) == candidates.end();
+	}
+
+	indices.swap(output);
+	return clusters;
+}
+
+// --------------------------------------------------------
+// Linear-speed overdraw reduction: clusters that face away from
+// the mesh's center are likely to occlude the others, so they
+// are drawn first.  Sorted by dot(clusterCenter - meshCenter,
+// clusterNormal), highest first.
+// --------------------------------------------------------
+void MeshOptimizer::OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& verts, const std::vector<unsigned int>& clusters)
+{
+	if (clusters.size() < 2)
+		return;
+
+	struct Cluster
+	{
+		unsigned int start;
+		unsigned int end;
+		XMFLOAT3 center;
+		XMFLOAT3 normal;
+		float area;
+		float sortKey;
+	};
+
+	std::vector<Cluster> sorted(clusters.size());
+	XMFLOAT3 meshCenter(0, 0, 0);
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		Cluster& cluster = sorted[c];
+		cluster.start = clusters[c];
+		cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : (unsigned int)indices.size();
+		cluster.center = XMFLOAT3(0, 0, 0);
+		cluster.normal = XMFLOAT3(0, 0, 0);
+		cluster.area = 0.0f;
+
+		// Area weighted center and normal of the cluster
+		for (unsigned int i = cluster.start; i < cluster.end; i += 3)
+		{
+			XMFLOAT3 p0 = verts[indices[i]].Position;
+			XMFLOAT3 p1 = verts[indices[i + 1]].Position;
+			XMFLOAT3 p2 = verts[indices[i + 2]].Position;
+
+			XMFLOAT3 normal = Cross(Sub(p1, p0), Sub(p2, p0));
+			float area = sqrtf(Dot(normal, normal));
+
+			cluster.center.x += (p0.x + p1.x + p2.x) / 3.0f * area;
+			cluster.center.y += (p0.y + p1.y + p2.y) / 3.0f * area;
+			cluster.center.z += (p0.z + p1.z + p2.z) / 3.0f * area;
+			cluster.normal.x += normal.x;
+			cluster.normal.y += normal.y;
+			cluster.normal.z += normal.z;
+			cluster.area += area;
+		}
+
+		meshCenter.x += cluster.center.x;
+		meshCenter.y += cluster.center.y;
+		meshCenter.z += cluster.center.z;
+		meshArea += cluster.area;
+
+		if (cluster.area > 0.0f)
+		{
+			cluster.center.x /= cluster.area;
+			cluster.center.y /= cluster.area;
+			cluster.center.z /= cluster.area;
+		}
+	}
+
+	if (meshArea > 0.0f)
+	{
+		meshCenter.x /= meshArea;
+		meshCenter.y /= meshArea;
+		meshCenter.z /= meshArea;
+	}
+
+	for (Cluster& cluster : sorted)
+	{
+		float length = sqrtf(Dot(cluster.normal, cluster.normal));
+		cluster.sortKey = length > 0.0f ? Dot(Sub(cluster.center, meshCenter), cluster.normal) / length : 0.0f;
+	}
+
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (const Cluster& cluster : sorted)
+		output.insert(output.end(), indices.begin() + cluster.start, indices.begin() + cluster.end);
+
+	indices.swap(output);
+}
+
+// --------------------------------------------------------
+// Renumbers vertices in the order the index buffer first
+// references them.  Unreferenced vertices are kept, at the end.
+// --------------------------------------------------------
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	const unsigned int unassigned = 0xFFFFFFFF;
+	std::vector<unsigned int> remap(verts.size(), unassigned);
+	std::vector<Vertex> output;
+	output.reserve(verts.size());
+
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == unassigned)
+		{
+			remap[index] = (unsigned int)output.size();
+			output.push_back(verts[index]);
+		}
+		index = remap[index];
+	}
+
+	for (size_t v = 0; v < verts.size(); v++)
+	{
+		if (remap[v] == unassigned)
+			output.push_back(verts[v]);
+	}
+
+	verts.swap(output);
+}
+
+float MeshOptimizer::ACMR(const std::vector<unsigned int>& indices, unsigned int vertexCount, int cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+	return CountTransforms(indices, vertexCount, cacheSize) / (indices.size() / 3.0f);
+}
+
+float MeshOptimizer::ATVR(const std::vector<unsigned int>& indices, unsigned int vertexCount, int cacheSize)
+{
+	if (vertexCount == 0)
+		return 0.0f;
+	return CountTransforms(indices, vertexCount, cacheSize) / (float)vertexCount;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// CPU-side index/vertex reordering, run on an indexed mesh
+// before its buffers are created:
+//
+//  1. Vertex cache - Tipsify (Sander, Nehab & Barczak 2007)
+//     reorders triangles so recently transformed vertices
+//     are reused while still in the post-transform cache
+//  2. Overdraw - the clusters Tipsify produces are sorted so
+//     outward-facing ones draw first and occlude the rest
+//  3. Vertex fetch - vertices are renumbered in first-use
+//     order so the vertex buffer is read front to back
+//
+// ACMR (average cache misses per triangle) and ATVR (average
+// transforms per vertex) measure the result; lower is better
+// and 0.5 / 1.0 are the ideals.
+// --------------------------------------------------------
+namespace MeshOptimizer
+{
+	// Size of the simulated FIFO post-transform cache
+	const int CacheSize = 16;
+
+	// Runs all three passes, in order
+	void Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+	// Reorders triangles, returning the index (into indices) where
+	// each cluster of triangles begins
+	std::vector<unsigned int> OptimizeVertexCache(std::vector<unsigned int>& indices, unsigned int vertexCount);
+	void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& verts, const std::vector<unsigned int>& clusters);
+	void OptimizeVertexFetch(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+	// Cache statistics for a FIFO cache of the given size
+	float ACMR(const std::vector<unsigned int>& indices, unsigned int vertexCount, int cacheSize = CacheSize);
+	float ATVR(const std::vector<unsigned int>& indices, unsigned int vertexCount, int cacheSize = CacheSize);
+}
@@ -0,0 +1,662 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// Exact powers of ten representable as doubles
+	const double powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline void SkipSpaces(const char*& p, const char* end)
+	{
+		while (p < end && IsSpace(*p)) p++;
+	}
+
+	// Returns the start of the following line (or end)
+	inline const char* NextLine(const char* p, const char* end)
+	{
+		const char* newline = (const char*)memchr(p, '\n', end - p);
+		return newline ? newline + 1 : end;
+	}
+
+	// One "v/vt/vn" corner of a face, already converted to
+	// 0-based indices (-1 means the value was not given)
+	struct Corner
+	{
+		int position;
+		int uv;
+		int normal;
+
+		bool operator==(const Corner& other) const
+		{
+			return position == other.position && uv == other.uv && normal == other.normal;
+		}
+	};
+
+	// Hash for welding identical corners into one vertex
+	struct CornerHash
+	{
+		size_t operator()(const Corner& c) const
+		{
+			uint64_t h = (uint64_t)(uint32_t)c.position * 0x9E3779B97F4A7C15ull;
+			h ^= (uint64_t)(uint32_t)c.uv * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+			h ^= (uint64_t)(uint32_t)c.normal * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+			return (size_t)h;
+		}
+	};
+
+	// OBJ indices are 1-based, and negative values count
+	// backwards from the most recently declared element
+	inline int ResolveIndex(int index, size_t count)
+	{
+		if (index > 0) return index - 1;
+		if (index < 0) return (int)count + index;
+		return -1;
+	}
+
+	// The original getline/sscanf_s loader, minus the buffer
+	// creation - kept as the baseline to measure Parse() against.
+	// Every triangle gets three vertices of its own.
+	void ParseWithStreams(std::istream& obj, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+	{
+		std::vector<XMFLOAT3> positions;	// Positions from the file
+		std::vector<XMFLOAT3> normals;		// Normals from the file
+		std::vector<XMFLOAT2> uvs;			// UVs from the file
+		char chars[100];					// String for line reading
+
+		while (obj.good())
+		{
+			obj.getline(chars, 100);
+
+			if (chars[0] == 'v' && chars[1] == 'n')
+			{
+				XMFLOAT3 norm;
+				sscanf_s(chars, "vn %f %f %f", &norm.x, &norm.y, &norm.z);
+				normals.push_back(norm);
+			}
+			else if (chars[0] == 'v' && chars[1] == 't')
+			{
+				XMFLOAT2 uv;
+				sscanf_s(chars, "vt %f %f", &uv.x, &uv.y);
+				uvs.push_back(uv);
+			}
+			else if (chars[0] == 'v')
+			{
+				XMFLOAT3 pos;
+				sscanf_s(chars, "v %f %f %f", &pos.x, &pos.y, &pos.z);
+				positions.push_back(pos);
+			}
+			else if (chars[0] == 'f')
+			{
+				unsigned int i[12];
+				int numbersRead = sscanf_s(
+					chars,
+					"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
+					&i[0], &i[1], &i[2],
+					&i[3], &i[4], &i[5],
+					&i[6], &i[7], &i[8],
+					&i[9], &i[10], &i[11]);
+
+				// No UVs - re-read as "v//vn" and point every corner
+				// at a single (0,0) uv
+				if (numbersRead == 1)
+				{
+					numbersRead = sscanf_s(
+						chars,
+						"f %d//%d %d//%d %d//%d %d//%d",
+						&i[0], &i[2],
+						&i[3], &i[5],
+						&i[6], &i[8],
+						&i[9], &i[11]);
+					i[1] = 1;
+					i[4] = 1;
+					i[7] = 1;
+					i[10] = 1;
+					if (uvs.size() == 0)
+						uvs.push_back(XMFLOAT2(0, 0));
+				}
+
+				// Same left-handed conversion as Parse()
+				Vertex corners[4] = {};
+				int cornerCount = (numbersRead == 12 || numbersRead == 8) ? 4 : 3;
+				for (int c = 0; c < cornerCount; c++)
+				{
+					corners[c].Position = positions[i[c * 3] - 1];
+					corners[c].UV = uvs[i[c * 3 + 1] - 1];
+					corners[c].Normal = normals[i[c * 3 + 2] - 1];
+					corners[c].UV.y = 1.0f - corners[c].UV.y;
+					corners[c].Position.z *= -1.0f;
+					corners[c].Normal.z *= -1.0f;
+				}
+
+				// Flipped winding order, and the 4th corner makes a
+				// second triangle
+				const int order[] = { 0, 2, 1, 0, 3, 2 };
+				for (int k = 0; k < (cornerCount == 4 ? 6 : 3); k++)
+				{
+					indices.push_back((unsigned int)verts.size());
+					verts.push_back(corners[order[k]]);
+				}
+			}
+		}
+	}
+
+	// Best times and output sizes of both loaders on one file
+	struct ParserTimes
+	{
+		double Megabytes;
+		double StreamsMs;
+		double ParseMs;
+		size_t StreamTriangles;
+		size_t StreamVertices;
+		size_t ParseTriangles;
+		size_t ParseVertices;
+	};
+
+	// Loads file runs times with each loader, keeping the best time
+	// - reading the file is part of each load
+	ParserTimes TimeParsers(const std::filesystem::path& file, int runs)
+	{
+		ParserTimes times = {};
+		std::error_code error;
+		times.Megabytes = std::filesystem::file_size(file, error) / (1024.0 * 1024.0);
+		times.StreamsMs = 1e9;
+		times.ParseMs = 1e9;
+		for (int run = 0; run < runs; run++)
+		{
+			{
+				std::vector<Vertex> verts;
+				std::vector<unsigned int> indices;
+				auto start = std::chrono::high_resolution_clock::now();
+				std::ifstream obj(file);
+				ParseWithStreams(obj, verts, indices);
+				auto end = std::chrono::high_resolution_clock::now();
+				times.StreamsMs = std::min(times.StreamsMs, std::chrono::duration<double, std::milli>(end - start).count());
+				times.StreamVertices = verts.size();
+				times.StreamTriangles = indices.size() / 3;
+			}
+			{
+				std::vector<Vertex> verts;
+				std::vector<unsigned int> indices;
+				auto start = std::chrono::high_resolution_clock::now();
+				MappedFile mapped(file.wstring());
+				if (mapped.IsOpen())
+					ObjLoader::Parse(mapped.Data(), mapped.Size(), verts, indices);
+				auto end = std::chrono::high_resolution_clock::now();
+				times.ParseMs = std::min(times.ParseMs, std::chrono::duration<double, std::milli>(end - start).count());
+				times.ParseVertices = verts.size();
+				times.ParseTriangles = indices.size() / 3;
+			}
+		}
+		return times;
+	}
+
+	// Both loaders should make the same triangles.  The original
+	// gives every corner its own vertex, so Parse() can only make
+	// as many or fewer.
+	bool CountsMatch(const ParserTimes& times)
+	{
+		return times.StreamTriangles == times.ParseTriangles && times.ParseVertices <= times.StreamVertices;
+	}
+
+	// Writes a grid of quads, two triangles each, with every
+	// corner referencing its own position and uv the way exported
+	// models do.  Lines stay under the old loader's 100 characters.
+	void WriteGridObj(std::ostream& obj, int quadsPerSide)
+	{
+		std::string buffer;
+		char line[100];
+		auto flush = [&]() { obj.write(buffer.data(), buffer.size()); buffer.clear(); };
+
+		int side = quadsPerSide + 1;
+		for (int y = 0; y < side; y++)
+		{
+			for (int x = 0; x < side; x++)
+			{
+				float height = ((x * 7 + y * 13) % 100) * 0.001f;
+				buffer.append(line, snprintf(line, sizeof(line), "v %.4f %.4f %.4f\n", x * 0.01f, height, y * 0.01f));
+				buffer.append(line, snprintf(line, sizeof(line), "vt %.5f %.5f\n", x / (float)quadsPerSide, y / (float)quadsPerSide));
+			}
+			if (buffer.size() > (1 << 20)) flush();
+		}
+		buffer.append("vn 0 1 0\n");
+
+		for (int y = 0; y < quadsPerSide; y++)
+		{
+			for (int x = 0; x < quadsPerSide; x++)
+			{
+				int a = y * side + x + 1;
+				int b = a + 1;
+				int c = a + side;
+				int d = c + 1;
+				buffer.append(line, snprintf(line, sizeof(line), "f %d/%d/1 %d/%d/1 %d/%d/1\n", a, a, c, c, b, b));
+				buffer.append(line, snprintf(line, sizeof(line), "f %d/%d/1 %d/%d/1 %d/%d/1\n", b, b, c, c, d, d));
+			}
+			if (buffer.size() > (1 << 20)) flush();
+		}
+		flush();
+	}
+
+	// A cube of quads with a triangle and comments mixed in, and a
+	// tetrahedron with no uvs ("v//vn" faces)
+	const char* cubeObj =
+		"# cube\n"
+		"v -0.5 -0.5 0.5\nv 0.5 -0.5 0.5\nv -0.5 0.5 0.5\nv 0.5 0.5 0.5\n"
+		"v -0.5 0.5 -0.5\nv 0.5 0.5 -0.5\nv -0.5 -0.5 -0.5\nv 0.5 -0.5 -0.5\n"
+		"vt 0 0\nvt 1 0\nvt 0 1\nvt 1 1\n"
+		"vn 0 0 1\nvn 0 1 0\nvn 0 0 -1\nvn 0 -1 0\nvn 1 0 0\nvn -1 0 0\n"
+		"f 1/1/1 2/2/1 4/4/1 3/3/1\n"
+		"f 3/1/2 4/2/2 6/4/2 5/3/2\n"
+		"f 5/4/3 6/3/3 8/1/3 7/2/3\n"
+		"f 7/1/4 8/2/4 2/4/4 1/3/4\n"
+		"f 2/1/5 8/2/5 6/4/5 4/3/5\n"
+		"# a face split in two\n"
+		"f 7/1/6 1/2/6 3/4/6\r\n"
+		"f 7/1/6 3/4/6 5/3/6\r\n";
+
+	const char* tetrahedronObj =
+		"v 0 1 0\nv -1 -1 1\nv 1 -1 1\nv 0 -1 -1.5e0\n"
+		"vn 0 0.447 0.894\nvn -0.832 0.277 -0.48\nvn 0.832 0.277 -0.48\nvn 0 -1 0\n"
+		"f 1//1 2//1 3//1\nf 1//2 4//2 2//2\nf 1//3 3//3 4//3\nf 2//4 4//4 3//4\n";
+}
+
+// --------------------------------------------------------
+// Parses a float without sscanf/strtof (and therefore without
+// the locale lookups they do on every call).  Digits past the
+// 19th are dropped, which is well beyond float precision.
+// --------------------------------------------------------
+float ObjLoader::ParseFloat(const char*& p, const char* end)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+
+	// Integer part
+	for (; p < end && IsDigit(*p); p++)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa != 0) digits++;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+
+	// Fractional part
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && IsDigit(*p); p++)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0) digits++;
+				exponent--;
+			}
+		}
+	}
+
+	// Scientific notation
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		exponent += ParseInt(p, end);
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0 && exponent >= -22) value /= powersOfTen[-exponent];
+	else if (exponent > 0 && exponent <= 22) value *= powersOfTen[exponent];
+	else if (exponent != 0) value *= pow(10.0, exponent);
+
+	return (float)(negative ? -value : value);
+}
+
+int ObjLoader::ParseInt(const char*& p, const char* end)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	int value = 0;
+	for (; p < end && IsDigit(*p); p++)
+		value = value * 10 + (*p - '0');
+
+	return negative ? -value : value;
+}
+
+// --------------------------------------------------------
+// Parses an entire .OBJ file that's already in memory.
+//
+// Like the original sscanf_s loader, the model is converted
+// from right-handed to left-handed space:
+//  - Invert the Z position and the normal's Z
+//  - Flip the winding order
+//  - Flip the V coordinate, since DirectX puts (0,0) at the
+//    top left of a texture
+// --------------------------------------------------------
+void ObjLoader::Parse(const char* data, size_t size, std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	const char* end = data + size;
+
+	// Counting pass so the vectors below can be reserved up front
+	size_t positionCount = 0;
+	size_t uvCount = 0;
+	size_t normalCount = 0;
+	size_t triangleCount = 0;
+	for (const char* line = data; line < end; line = NextLine(line, end))
+	{
+		if (line[0] == 'v')
+		{
+			if (line + 1 >= end) break;
+			if (line[1] == 'n') normalCount++;
+			else if (line[1] == 't') uvCount++;
+			else if (IsSpace(line[1])) positionCount++;
+		}
+		else if (line[0] == 'f')
+		{
+			// Count the corners (whitespace separated groups)
+			int corners = 0;
+			bool inToken = false;
+			for (const char* c = line + 1; c < end && *c != '\n'; c++)
+			{
+				bool space = IsSpace(*c);
+				if (!space && !inToken) corners++;
+				inToken = !space;
+			}
+			if (corners >= 3) triangleCount += corners - 2;
+		}
+	}
+
+	std::vector<XMFLOAT3> positions;	// Positions from the file
+	std::vector<XMFLOAT3> normals;		// Normals from the file
+	std::vector<XMFLOAT2> uvs;			// UVs from the file
+	std::vector<Corner> corners;		// Corners of the current face
+	positions.reserve(positionCount);
+	normals.reserve(normalCount);
+	uvs.reserve(uvCount);
+	corners.reserve(4);
+	indices.reserve(indices.size() + triangleCount * 3);
+
+	// Each unique (position, uv, normal) triple becomes exactly one
+	// vertex.  The final count isn't known yet, so reserve for half
+	// the corners, which covers typical closed meshes
+	std::unordered_map<Corner, unsigned int, CornerHash> welded;
+	welded.reserve(triangleCount * 3 / 2 + 1);
+	verts.reserve(verts.size() + triangleCount * 3 / 2 + 1);
+
+	// Returns the index of the vertex for a face corner, creating
+	// (and flipping into left-handed space) only the first time
+	// that exact corner is seen
+	auto weldVertex = [&](const Corner& c)
+		{
+			auto found = welded.find(c);
+			if (found != welded.end())
+				return found->second;
+
+			Vertex v = {};
+			if (c.position >= 0 && c.position < (int)positions.size()) v.Position = positions[c.position];
+			if (c.uv >= 0 && c.uv < (int)uvs.size()) v.UV = uvs[c.uv];
+			if (c.normal >= 0 && c.normal < (int)normals.size()) v.Normal = normals[c.normal];
+
+			v.UV.y = 1.0f - v.UV.y;
+			v.Position.z *= -1.0f;
+			v.Normal.z *= -1.0f;
+
+			unsigned int index = (unsigned int)verts.size();
+			verts.push_back(v);
+			welded.insert({ c, index });
+			return index;
+		};
+
+	for (const char* p = data; p < end; p = NextLine(p, end))
+	{
+		if (p[0] == 'v' && p + 1 < end)
+		{
+			if (p[1] == 'n')
+			{
+				const char* c = p + 2;
+				XMFLOAT3 norm;
+				SkipSpaces(c, end); norm.x = ParseFloat(c, end);
+				SkipSpaces(c, end); norm.y = ParseFloat(c, end);
+				SkipSpaces(c, end); norm.z = ParseFloat(c, end);
+				normals.push_back(norm);
+			}
+			else if (p[1] == 't')
+			{
+				const char* c = p + 2;
+				XMFLOAT2 uv;
+				SkipSpaces(c, end); uv.x = ParseFloat(c, end);
+				SkipSpaces(c, end); uv.y = ParseFloat(c, end);
+				uvs.push_back(uv);
+			}
+			else if (IsSpace(p[1]))
+			{
+				const char* c = p + 1;
+				XMFLOAT3 pos;
+				SkipSpaces(c, end); pos.x = ParseFloat(c, end);
+				SkipSpaces(c, end); pos.y = ParseFloat(c, end);
+				SkipSpaces(c, end); pos.z = ParseFloat(c, end);
+				positions.push_back(pos);
+			}
+		}
+		else if (p[0] == 'f' && p + 1 < end && IsSpace(p[1]))
+		{
+			// Read every "v", "v/vt", "v//vn" or "v/vt/vn" corner
+			corners.clear();
+			const char* c = p + 1;
+			while (true)
+			{
+				SkipSpaces(c, end);
+				if (c >= end || !(IsDigit(*c) || *c == '-'))
+					break;
+
+				Corner corner = { ResolveIndex(ParseInt(c, end), positions.size()), -1, -1 };
+				if (c < end && *c == '/')
+				{
+					c++;
+					if (c < end && *c != '/')
+						corner.uv = ResolveIndex(ParseInt(c, end), uvs.size());
+					if (c < end && *c == '/')
+					{
+						c++;
+						corner.normal = ResolveIndex(ParseInt(c, end), normals.size());
+					}
+				}
+				corners.push_back(corner);
+			}
+
+			// Triangulate as a fan, flipping the winding order
+			if (corners.size() < 3)
+				continue;
+
+			unsigned int first = weldVertex(corners[0]);
+			unsigned int previous = weldVertex(corners[1]);
+			for (size_t i = 2; i < corners.size(); i++)
+			{
+				unsigned int current = weldVertex(corners[i]);
+				indices.push_back(first);
+				indices.push_back(current);
+				indices.push_back(previous);
+				previous = current;
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Times the original getline/sscanf_s loader against mapping
+// the file and running Parse(), first on each of the real
+// models, then on a generated grid .OBJ of about triangleCount
+// triangles in the temp folder (deleted afterwards).  Prints
+// the results, flagging any file the loaders disagree on.
+// --------------------------------------------------------
+void ObjLoader::Benchmark(const std::vector<std::wstring>& objFiles, int triangleCount)
+{
+	const int assetRuns = 5;
+	const int generatedRuns = 3;
+	printf("OBJ loader benchmark: getline/sscanf_s vs. mapped Parse()\n");
+
+	// The real models - small, so the totals say more than any one
+	double totalMegabytes = 0.0;
+	double totalStreams = 0.0;
+	double totalParse = 0.0;
+	for (const std::wstring& objFile : objFiles)
+	{
+		std::string name = std::filesystem::path(objFile).filename().string();
+		std::error_code error;
+		if (!std::filesystem::exists(objFile, error))
+		{
+			printf("  %s: not found\n", name.c_str());
+			continue;
+		}
+
+		ParserTimes times = TimeParsers(objFile, assetRuns);
+		totalMegabytes += times.Megabytes;
+		totalStreams += times.StreamsMs;
+		totalParse += times.ParseMs;
+		printf("  %s, best of %d:\n    getline/sscanf_s: %.3f ms (%.1f MB/s), %zu triangles, %zu vertices\n    Mapped Parse(): %.3f ms (%.1f MB/s), %zu triangles, %zu vertices\n    Speedup: %.2fx%s\n",
+			name.c_str(), assetRuns,
+			times.StreamsMs, times.Megabytes * 1000.0 / times.StreamsMs, times.StreamTriangles, times.StreamVertices,
+			times.ParseMs, times.Megabytes * 1000.0 / times.ParseMs, times.ParseTriangles, times.ParseVertices,
+			times.StreamsMs / times.ParseMs, CountsMatch(times) ? "" : " - COUNTS DIFFER");
+	}
+	if (totalParse > 0.0)
+	{
+		printf("  All models (%.2f MB): getline/sscanf_s %.3f ms (%.1f MB/s), Parse() %.3f ms (%.1f MB/s), speedup %.2fx\n",
+			totalMegabytes,
+			totalStreams, totalMegabytes * 1000.0 / totalStreams,
+			totalParse, totalMegabytes * 1000.0 / totalParse,
+			totalStreams / totalParse);
+	}
+
+	// A generated file big enough to time properly
+	int quadsPerSide = std::max(1, (int)ceil(sqrt(triangleCount / 2.0)));
+	std::filesystem::path file = std::filesystem::temp_directory_path() / "ObjLoaderBenchmark.obj";
+	{
+		std::ofstream obj(file, std::ios::binary);
+		WriteGridObj(obj, quadsPerSide);
+	}
+
+	ParserTimes times = TimeParsers(file, generatedRuns);
+	std::error_code error;
+	std::filesystem::remove(file, error);
+
+	printf("  Generated %.1f MB file, best of %d:\n    getline/sscanf_s: %.1f ms (%.1f MB/s), %zu triangles, %zu vertices\n    Mapped Parse(): %.1f ms (%.1f MB/s), %zu triangles, %zu vertices\n    Speedup: %.2fx%s\n\n",
+		times.Megabytes, generatedRuns,
+		times.StreamsMs, times.Megabytes * 1000.0 / times.StreamsMs, times.StreamTriangles, times.StreamVertices,
+		times.ParseMs, times.Megabytes * 1000.0 / times.ParseMs, times.ParseTriangles, times.ParseVertices,
+		times.StreamsMs / times.ParseMs, CountsMatch(times) ? "" : " - COUNTS DIFFER");
+}
+
+// --------------------------------------------------------
+// Parses a few small models both welded, with Parse(), and
+// unwelded, with the original loader, and checks they come out
+// as the same triangles, corner by corner.  Also checks
+// ParseFloat() against strtof().  Prints the results and
+// returns whether they passed.
+// --------------------------------------------------------
+bool ObjLoader::Test()
+{
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	auto close = [](float a, float b) { return fabsf(a - b) <= 1e-6f * std::max(1.0f, fabsf(b)); };
+	auto sameVertex = [&](const Vertex& a, const Vertex& b) {
+		return close(a.Position.x, b.Position.x) && close(a.Position.y, b.Position.y) && close(a.Position.z, b.Position.z) &&
+			close(a.UV.x, b.UV.x) && close(a.UV.y, b.UV.y) &&
+			close(a.Normal.x, b.Normal.x) && close(a.Normal.y, b.Normal.y) && close(a.Normal.z, b.Normal.z);
+	};
+
+	std::ostringstream grid;
+	WriteGridObj(grid, 9);
+	std::string gridObj = grid.str();
+
+	// Vertex counts are every unique corner - the cube's faces and
+	// the tetrahedron's normals keep their corners apart
+	struct Model { const char* Name; std::string Text; size_t Vertices; };
+	Model models[] = { { "cube", cubeObj, 24 }, { "tetrahedron", tetrahedronObj, 12 }, { "grid", gridObj, 100 } };
+	for (const Model& model : models)
+	{
+		std::vector<Vertex> welded;
+		std::vector<unsigned int> weldedIndices;
+		Parse(model.Text.data(), model.Text.size(), welded, weldedIndices);
+
+		std::vector<Vertex> unwelded;
+		std::vector<unsigned int> unweldedIndices;
+		std::istringstream stream(model.Text);
+		ParseWithStreams(stream, unwelded, unweldedIndices);
+
+		bool sameCount = weldedIndices.size() == unweldedIndices.size();
+		bool inRange = true;
+		bool sameTriangles = sameCount;
+		for (size_t i = 0; sameCount && i < weldedIndices.size(); i++)
+		{
+			inRange = inRange && weldedIndices[i] < welded.size();
+			sameTriangles = sameTriangles && inRange && sameVertex(welded[weldedIndices[i]], unwelded[unweldedIndices[i]]);
+		}
+
+		printf("  %s: %zu triangles, %zu vertices welded, %zu unwelded\n",
+			model.Name, weldedIndices.size() / 3, welded.size(), unwelded.size());
+		check(sameCount, "both loaders make the same number of triangles");
+		check(inRange, "welded indices are in range");
+		check(sameTriangles, "welded triangles match the unwelded ones corner by corner");
+		check(welded.size() == model.Vertices, "welding keeps one vertex per unique corner");
+	}
+
+	// Hand parsed floats vs. strtof
+	const char* numbers[] = { "0", "-0", "1", "-1.5", "+2.25", "0.1", "3.14159265", "-0.000001",
+		"123456.789", "1e10", "-2.5E-3", "7.0e+2", "0.30000001192", "16777217", "1.17549435e-38" };
+	bool floatsMatch = true;
+	bool consumedAll = true;
+	for (const char* number : numbers)
+	{
+		const char* end = number + strlen(number);
+		const char* p = number;
+		float parsed = ParseFloat(p, end);
+		floatsMatch = floatsMatch && close(parsed, strtof(number, nullptr));
+		consumedAll = consumedAll && p == end;
+	}
+	check(floatsMatch, "ParseFloat matches strtof");
+	check(consumedAll, "ParseFloat consumes the whole number");
+
+	bool passed = failures == 0;
+	printf("OBJ loader test: %s\n\n", passed ? "passed" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <string>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Fast .OBJ parsing straight out of an in-memory buffer
+// (usually a MappedFile).  Supports positions, uvs and
+// normals, and triangulates polygons as fans.
+//
+// Numbers are parsed by hand - no sscanf, no locale - and
+// the output vectors are reserved up front from a quick
+// counting pass.
+//
+// Corners that share the same position/uv/normal indices are
+// welded into a single vertex, so the index buffer actually
+// shares vertices between neighboring triangles.
+// --------------------------------------------------------
+namespace ObjLoader
+{
+	// Parses the buffer and appends unique left-handed, UV-flipped
+	// vertices and three indices per triangle
+	void Parse(const char* data, size_t size, std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+
+	// Exposed so they can be checked against strtof/atoi
+	float ParseFloat(const char*& p, const char* end);
+	int ParseInt(const char*& p, const char* end);
+
+	// Parses small models welded and unwelded (with the original
+	// loader) and checks they make the same triangles.  Prints the
+	// results and returns whether they passed.
+	bool Test();
+
+	// Times the original getline/sscanf_s loader against Parse()
+	// on each of objFiles, then on a generated file of about
+	// triangleCount triangles, and prints the results.  The default
+	// writes a file of several hundred MB to the temp folder.
+	void Benchmark(const std::vector<std::wstring>& objFiles, int triangleCount = 10000000);
+}
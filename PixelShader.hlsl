@@ -1,20 +1,14 @@
 #include "ShaderIncludes.hlsli"
 
-// Constant Buffer
-cbuffer ExternalData : register(b0)
+// Constant Buffers - must match BufferStructs.h
+// Set once per frame
+cbuffer PerFrame : register(b0)
 {
-    Light lights[5]; // 5 lights
-    
-    int lightCount;
+    int directionalLightCount; // first in Lights, shaded everywhere
     float3 ambientLight;
     
-    float4 colorTint;
-    
-    float roughness;
     float3 cameraPos;
-    
-    float2 uvScale;
-    float2 uvOffset;
+    float farClipDistance;
     
     // Fog
     int fogType;
@@ -26,7 +20,31 @@ cbuffer ExternalData : register(b0)
     float fogVerticalDensity;
     float fogHeight;
     
-    float farClipDistance;
+    // Shadow cascades (see ShadowCascades.h)
+    matrix shadowViewProjections[4];
+    float4 cascadeSplits; // far depth of each cascade
+    float3 cameraForward;
+    int cascadeCount;
+    
+    // Light clusters (see LightClusters.h)
+    int clusterTilesX;
+    int clusterTilesY;
+    int clusterSlices;
+    float clusterSliceScale;
+    float2 clusterTileScale; // tiles per pixel
+    float clusterSliceBias;
+    int shadowedLight; // -1 if none
+}
+
+// Set only when the material changes
+cbuffer PerMaterial : register(b1)
+{
+    float4 colorTint;
+    
+    float2 uvScale;
+    float2 uvOffset;
+    
+    float roughness;
 }
 
 // Example Texture2D and SamplerState definitions in an HLSL pixel shader
@@ -36,11 +54,52 @@ Texture2D RoughnessMap : register(t2); // Roughness texture slot 2
 Texture2D MetalnessMap : register(t3); // Metallness texture slot 3
 
 TextureCube EnvironmentMap : register(t4);
-Texture2D ShadowMap : register(t5);
+Texture2DArray ShadowMap : register(t5); // one slice per cascade
+
+// Every light - directional first, then the ones in clusters - and
+// each cluster's range of the index list
+StructuredBuffer<Light> Lights : register(t6);
+StructuredBuffer<uint2> ClusterRanges : register(t7); // offset, count
+StructuredBuffer<uint> ClusterLightIndices : register(t8);
 
 SamplerState BasicSampler : register(s0); // A sampler assigned to sampler slot 0
 SamplerComparisonState ShadowSampler : register(s1); // shadow sampler slot 1
 
+// --------------------------------------------------------
+// How lit a point is by the first (shadowed) light - 1 if no
+// cascade reaches it.  Cascades go from near to far, so the first
+// one whose far split is past the point has the most detail.
+// --------------------------------------------------------
+float ShadowAmount(float3 worldPos, float viewDepth)
+{
+    for (int c = 0; c < cascadeCount; c++)
+    {
+        if (viewDepth < cascadeSplits[c])
+        {
+            float4 shadowMapPos = mul(shadowViewProjections[c], float4(worldPos, 1.0f));
+            
+            // convert normalized device coordinates to UVs for sampling
+            float2 shadowUV = shadowMapPos.xy * 0.5f + 0.5f;
+            shadowUV.y = 1 - shadowUV.y; // flip y
+            
+            // ratio of comparison results using SampleCmpLevelZero()
+            return ShadowMap.SampleCmpLevelZero(ShadowSampler, float3(shadowUV, c), shadowMapPos.z).r;
+        }
+    }
+    return 1.0f;
+}
+
+// --------------------------------------------------------
+// Which cluster a pixel is in - its screen tile, and the slice
+// its view depth falls in (slices are logarithmic)
+// --------------------------------------------------------
+uint ClusterIndex(float2 pixel, float viewDepth)
+{
+    uint2 tile = min(uint2(pixel * clusterTileScale), uint2(clusterTilesX - 1, clusterTilesY - 1));
+    int slice = clamp((int)floor(log(viewDepth) * clusterSliceScale + clusterSliceBias), 0, clusterSlices - 1);
+    return (slice * clusterTilesY + tile.y) * clusterTilesX + tile.x;
+}
+
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
@@ -52,26 +111,11 @@ SamplerComparisonState ShadowSampler : register(s1); // shadow sampler slot 1
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    // perspective divide
-    //input.shadowMapPos /= input.shadowMapPos.w;
-    
-    // convert normalized device coordinates to UVs for sampling
-    float2 shadowUV = input.shadowMapPos.xy * 0.5f + 0.5f;
-    shadowUV.y = 1 - shadowUV.y; // flip y
-    
-    //grab distances needed: light to pixel and closest surface
-    float distToLight = input.shadowMapPos.z;
-    float distShadowMap = ShadowMap.Sample(BasicSampler, shadowUV).r;
-    
-    // ratio of comparison results using SampleCmpLevelZero()
-    float shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, shadowUV, distToLight).r;
-    
-    // for testing, return black
-//    if (distShadowMap < distToLight)
-//        return float4(0, 0, 0, 1);
+    float viewDepth = dot(input.worldPos - cameraPos, cameraForward);
+    float shadowAmount = ShadowAmount(input.worldPos, viewDepth);
     
     input.normal = normalize(input.normal);
-    input.tangent = normalize(input.tangent);
+    input.tangent.xyz = normalize(input.tangent.xyz);
     input.uv = input.uv * uvScale + uvOffset;
     float3 surfaceColor = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2);
     surfaceColor *= colorTint.rgb;
@@ -79,8 +123,8 @@ float4 main(VertexToPixel input) : SV_TARGET
     // unpack normal map
     float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
     float3 N = normalize(input.normal);
-    float3 T = normalize(input.tangent - dot(input.tangent, N) * N);
-    float3 B = cross(T, N);
+    float3 T = normalize(input.tangent.xyz - dot(input.tangent.xyz, N) * N);
+    float3 B = cross(T, N) * input.tangent.w; // flipped for mirrored uvs
     
     float3x3 TBN = float3x3(T, B, N); // convert to world space
     input.normal = normalize(mul(unpackedNormal, TBN));
@@ -98,40 +142,43 @@ float4 main(VertexToPixel input) : SV_TARGET
     float3 totalLight = ambientLight * surfaceColor;
     //float3 totalLight = surfaceColor;
    
-    // diffuse calculation
-    for (int i = 0; i < lightCount; i++)
+    // directional lights reach every pixel
+    for (int i = 0; i < directionalLightCount; i++)
     {
-        Light light = lights[i];
+        Light light = Lights[i];
         light.Direction = normalize(light.Direction);
 
-        // directional light
-        if (light.Type == 0)
+        float3 lightResult = DirectionalLight(light, input.normal, input.worldPos, cameraPos, roughness, metalness, surfaceColor, specColor);
+        
+        if (i == shadowedLight)
         {
-            float3 lightResult = DirectionalLight(light, input.normal, input.worldPos, cameraPos, roughness, metalness, surfaceColor, specColor);
-            
-            if (i == 0)
-            {
-                lightResult *= shadowAmount;
-            }
-            
-            totalLight += lightResult;
+            lightResult *= shadowAmount;
         }
-        // point light
-        else if (light.Type == 1)
+        
+        totalLight += lightResult;
+    }
+    
+    // point and spot lights - only the ones that reach this pixel's cluster
+    uint2 cluster = ClusterRanges[ClusterIndex(input.screenPosition.xy, viewDepth)];
+    for (uint j = 0; j < cluster.y; j++)
+    {
+        Light light = Lights[ClusterLightIndices[cluster.x + j]];
+        light.Direction = normalize(light.Direction);
+
+        if (light.Type == LIGHT_TYPE_POINT)
         {
             totalLight += PointLight(light, input.normal, input.worldPos, cameraPos, roughness, metalness, surfaceColor, specColor);
         }
-        else if (light.Type == 2)
+        else
         {
             totalLight += SpotLight(light, input.normal, input.worldPos, cameraPos, roughness, metalness, surfaceColor, specColor);
         }
-
     }
     
     // Sample environment map using reflected view vector
     float3 viewVector = normalize(cameraPos - input.worldPos);
     float3 reflectionVector = reflect(-viewVector, input.normal); // Cam to pixel vector (negate)
-    float3 reflectionColor = EnvironmentMap.Sample(BasicSampler, reflectionVector).rgb;
+    float3 reflectionColor = pow(EnvironmentMap.Sample(BasicSampler, reflectionVector).rgb, 2.2); // Gamma encoded, like the sky
     
     // Fog type
     float fog = 0.0f;
@@ -168,6 +215,6 @@ float4 main(VertexToPixel input) : SV_TARGET
     //totalLight += (surfaceColor * (diffuse + spec)) * dirLight.Intensity * dirLight.Color; // tint specular
     //totalLight += (surfaceColor * diffuse + spec) * dirLight.Intensity * dirLight.Color; // dont tint specular
     
-    return float4(pow(finalColor, 1 / 2.2), 1); // gamma correction
+    return float4(finalColor, 1); // Linear HDR - TonemapPS gamma corrects
     //return float4(input.normal, 1);
 }
\ No newline at end of file
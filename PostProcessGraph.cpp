@@ -0,0 +1,357 @@
+#include "PostProcessGraph.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	size_t Bytes(const PostTargetDesc& desc, int width, int height)
+	{
+		return (size_t)desc.BytesPerPixel * width * height;
+	}
+
+	// Whether a target can go in a slot, ignoring lifetimes
+	bool Fits(const PostProcessGraph::Target& target, const PostProcessGraph::Slot& slot)
+	{
+		return target.Desc.Format == slot.Desc.Format &&
+			target.Desc.BytesPerPixel == slot.Desc.BytesPerPixel &&
+			target.Width == slot.Width &&
+			target.Height == slot.Height;
+	}
+
+	bool Overlap(const PostProcessGraph::Target& a, const PostProcessGraph::Target& b)
+	{
+		return a.FirstPass <= b.LastPass && b.FirstPass <= a.LastPass;
+	}
+}
+
+void PostProcessGraph::Clear()
+{
+	targets.clear();
+	passes.clear();
+	slots.clear();
+	error.clear();
+}
+
+int PostProcessGraph::AddTarget(const std::string& name, PostTargetDesc desc)
+{
+	Target target;
+	target.Name = name;
+	target.Desc = desc;
+	targets.push_back(target);
+	return (int)targets.size() - 1;
+}
+
+void PostProcessGraph::AddPass(const std::string& name, const std::vector<int>& inputs, int output, std::function<void()> execute)
+{
+	passes.push_back({ name, inputs, output, execute });
+}
+
+bool PostProcessGraph::Compile(int width, int height)
+{
+	slots.clear();
+	error.clear();
+	for (Target& target : targets)
+	{
+		target.Width = std::max(width >> target.Desc.ScaleShift, 1);
+		target.Height = std::max(height >> target.Desc.ScaleShift, 1);
+		target.FirstPass = -1;
+		target.LastPass = -1;
+		target.Slot = -1;
+	}
+
+	// Lifetimes, checking each target is written once and only read
+	// after that
+	for (int p = 0; p < (int)passes.size(); p++)
+	{
+		const Pass& pass = passes[p];
+		for (int input : pass.Inputs)
+		{
+			if (input < 0 || input >= (int)targets.size())
+				error = pass.Name + " reads a target that doesn't exist";
+			else if (input == pass.Output)
+				error = pass.Name + " reads " + targets[input].Name + ", which it also writes";
+			else if (targets[input].FirstPass < 0)
+				error = pass.Name + " reads " + targets[input].Name + " before anything writes it";
+			else
+				targets[input].LastPass = p;
+
+			if (!error.empty()) return false;
+		}
+
+		if (pass.Output == BackBuffer || pass.Output == NoOutput)
+			continue;
+		if (pass.Output < 0 || pass.Output >= (int)targets.size())
+			error = pass.Name + " writes a target that doesn't exist";
+		else if (targets[pass.Output].FirstPass >= 0)
+			error = pass.Name + " writes " + targets[pass.Output].Name + ", which " + passes[targets[pass.Output].FirstPass].Name + " already wrote";
+		if (!error.empty()) return false;
+
+		targets[pass.Output].FirstPass = p;
+		targets[pass.Output].LastPass = p; // Until something reads it
+	}
+
+	// Targets no pass writes get nothing
+	std::vector<int> order;
+	for (int t = 0; t < (int)targets.size(); t++)
+		if (targets[t].FirstPass >= 0) order.push_back(t);
+
+	// Taking targets in the order they're written and reusing any
+	// slot whose last target is finished with never uses more slots
+	// of a format and size than it has targets live at once
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return targets[a].FirstPass < targets[b].FirstPass; });
+	std::vector<int> slotLastPass;
+	for (int t : order)
+	{
+		Target& target = targets[t];
+		for (int s = 0; s < (int)slots.size() && target.Slot < 0; s++)
+		{
+			// Strictly before - a pass can't read the slot it's drawing into
+			if (slotLastPass[s] < target.FirstPass && Fits(target, slots[s]))
+				target.Slot = s;
+		}
+
+		if (target.Slot < 0)
+		{
+			target.Slot = (int)slots.size();
+			slots.push_back({ target.Desc, target.Width, target.Height });
+			slotLastPass.push_back(-1);
+		}
+		slotLastPass[target.Slot] = target.LastPass;
+	}
+	return true;
+}
+
+void PostProcessGraph::Execute() const
+{
+	for (const Pass& pass : passes)
+		if (pass.Execute) pass.Execute();
+}
+
+const std::vector<PostProcessGraph::Target>& PostProcessGraph::GetTargets() const { return targets; }
+const std::vector<PostProcessGraph::Pass>& PostProcessGraph::GetPasses() const { return passes; }
+const std::vector<PostProcessGraph::Slot>& PostProcessGraph::GetSlots() const { return slots; }
+const std::string& PostProcessGraph::GetError() const { return error; }
+
+size_t PostProcessGraph::GetAllocatedBytes() const
+{
+	size_t bytes = 0;
+	for (const Slot& slot : slots)
+		bytes += Bytes(slot.Desc, slot.Width, slot.Height);
+	return bytes;
+}
+
+size_t PostProcessGraph::GetUnaliasedBytes() const
+{
+	size_t bytes = 0;
+	for (const Target& target : targets)
+		if (target.Slot >= 0) bytes += Bytes(target.Desc, target.Width, target.Height);
+	return bytes;
+}
+
+size_t PostProcessGraph::GetPeakLiveBytes() const
+{
+	size_t peak = 0;
+	for (int p = 0; p < (int)passes.size(); p++)
+	{
+		size_t live = 0;
+		for (const Target& target : targets)
+		{
+			if (target.Slot >= 0 && target.FirstPass <= p && p <= target.LastPass)
+				live += Bytes(target.Desc, target.Width, target.Height);
+		}
+		peak = std::max(peak, live);
+	}
+	return peak;
+}
+
+bool PostProcessGraph::Test()
+{
+	const PostTargetDesc color = { 28, 4, 0 };	// DXGI_FORMAT_R8G8B8A8_UNORM
+	const PostTargetDesc hdr = { 10, 8, 0 };	// DXGI_FORMAT_R16G16B16A16_FLOAT
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	// The blur chain at quarter resolution - the quarter sized
+	// targets ping-pong between two slots, everything else needs
+	// its own
+	{
+		PostProcessGraph graph;
+		int scene = graph.AddTarget("Scene", color);
+		int half = graph.AddTarget("Half", { color.Format, color.BytesPerPixel, 1 });
+		int quarter = graph.AddTarget("Quarter", { color.Format, color.BytesPerPixel, 2 });
+		int across = graph.AddTarget("Across", { color.Format, color.BytesPerPixel, 2 });
+		int down = graph.AddTarget("Down", { color.Format, color.BytesPerPixel, 2 });
+		graph.AddPass("Scene", {}, scene);
+		graph.AddPass("Half", { scene }, half);
+		graph.AddPass("Quarter", { half }, quarter);
+		graph.AddPass("Across", { quarter }, across);
+		graph.AddPass("Down", { across }, down);
+		graph.AddPass("Copy", { down }, BackBuffer);
+
+		check(graph.Compile(1280, 720), "blur chain compiles");
+		const std::vector<Target>& t = graph.GetTargets();
+		check(graph.GetSlots().size() == 4, "blur chain uses 4 slots");
+		check(t[quarter].Slot == t[down].Slot, "quarter and down share a slot");
+		check(t[across].Slot != t[quarter].Slot && t[across].Slot != t[down].Slot, "across gets its own slot");
+		check(t[half].Width == 640 && t[half].Height == 360 && t[down].Width == 320, "targets are scaled");
+		check(t[scene].FirstPass == 0 && t[scene].LastPass == 1 && t[down].LastPass == 5, "lifetimes run from write to last read");
+		check(graph.GetAllocatedBytes() == (size_t)4 * (1280 * 720 + 640 * 360 + 2 * 320 * 180), "allocated bytes");
+		check(graph.GetUnaliasedBytes() == (size_t)4 * (1280 * 720 + 640 * 360 + 3 * 320 * 180), "unaliased bytes");
+		check(graph.GetPeakLiveBytes() == (size_t)4 * (1280 * 720 + 640 * 360), "peak live bytes");
+
+		// Tiny windows still get 1x1 targets
+		check(graph.Compile(3, 1) && graph.GetTargets()[down].Width == 1 && graph.GetTargets()[down].Height == 1, "targets are at least 1x1");
+	}
+
+	// Finished targets are only reused by the same format and size
+	{
+		PostProcessGraph graph;
+		int a = graph.AddTarget("A", color);
+		int b = graph.AddTarget("B", hdr);
+		int c = graph.AddTarget("C", { color.Format, color.BytesPerPixel, 1 });
+		int d = graph.AddTarget("D", color);
+		graph.AddPass("A", {}, a);
+		graph.AddPass("B", { a }, b);
+		graph.AddPass("C", { b }, c);
+		graph.AddPass("D", { c }, d);
+		check(graph.Compile(64, 64), "mixed formats compile");
+		const std::vector<Target>& t = graph.GetTargets();
+		check(t[a].Slot == t[d].Slot && t[b].Slot != t[a].Slot && t[c].Slot != t[a].Slot, "only the matching target reuses a slot");
+		check(graph.GetSlots().size() == 3, "mixed formats use 3 slots");
+	}
+
+	// Execute runs passes in order, skipping ones drawn elsewhere,
+	// and passes with no output still keep their inputs alive
+	{
+		PostProcessGraph graph;
+		std::vector<int> ran;
+		int a = graph.AddTarget("A", color);
+		int b = graph.AddTarget("B", color);
+		graph.AddPass("A", {}, a);
+		graph.AddPass("B", { a }, b, [&]() { ran.push_back(1); });
+		graph.AddPass("Measure", { a }, NoOutput, [&]() { ran.push_back(2); });
+		graph.AddPass("Out", { b }, BackBuffer, [&]() { ran.push_back(3); });
+		check(graph.Compile(8, 8), "passes with no output compile");
+		graph.Execute();
+		check(ran == std::vector<int>({ 1, 2, 3 }), "passes execute in order");
+		check(graph.GetTargets()[a].LastPass == 2 && graph.GetTargets()[a].Slot != graph.GetTargets()[b].Slot, "reads by passes with no output count");
+	}
+
+	// Graphs that make no sense fail to compile
+	{
+		PostProcessGraph graph;
+		int a = graph.AddTarget("A", color);
+		graph.AddPass("Early", { a }, BackBuffer);
+		graph.AddPass("A", {}, a);
+		check(!graph.Compile(8, 8) && graph.GetSlots().empty(), "reading before writing fails");
+	}
+	{
+		PostProcessGraph graph;
+		int a = graph.AddTarget("A", color);
+		graph.AddPass("A", {}, a);
+		graph.AddPass("A again", {}, a);
+		check(!graph.Compile(8, 8), "writing twice fails");
+	}
+	{
+		PostProcessGraph graph;
+		int a = graph.AddTarget("A", color);
+		graph.AddPass("A", {}, a);
+		graph.AddPass("Self", { a }, a);
+		check(!graph.Compile(8, 8), "reading the output fails");
+	}
+	{
+		PostProcessGraph graph;
+		graph.AddPass("Nowhere", { 3 }, BackBuffer);
+		check(!graph.Compile(8, 8), "reading a missing target fails");
+	}
+
+	// Random graphs - every pass writes a new target of one of four
+	// kinds, reading up to three targets written before it.  Windows
+	// are big enough that no two kinds come out the same size.
+	std::mt19937 random(1234);
+	const PostTargetDesc kinds[] = { color, hdr, { color.Format, color.BytesPerPixel, 1 }, { hdr.Format, hdr.BytesPerPixel, 2 } };
+	const int graphCount = 2000;
+	int sharedLive = 0;
+	int extraSlots = 0;
+	int badSlots = 0;
+	size_t allocated = 0;
+	size_t unaliased = 0;
+	for (int g = 0; g < graphCount; g++)
+	{
+		PostProcessGraph graph;
+		int passCount = 1 + random() % 16;
+		for (int p = 0; p < passCount; p++)
+		{
+			int output = graph.AddTarget("T" + std::to_string(p), kinds[random() % 4]);
+			std::vector<int> inputs;
+			int inputCount = p == 0 ? 0 : random() % 4;
+			for (int i = 0; i < inputCount; i++)
+			{
+				// Mostly recent targets, like a real chain
+				int back = std::min((int)(random() % 3 == 0 ? random() % p : random() % 3), p - 1);
+				inputs.push_back(p - 1 - back);
+			}
+			graph.AddPass("P" + std::to_string(p), inputs, output);
+		}
+		graph.AddPass("Out", { passCount - 1 }, BackBuffer);
+
+		if (!graph.Compile(64 + random() % 2000, 64 + random() % 2000))
+		{
+			check(false, "random graph compiles");
+			continue;
+		}
+
+		const std::vector<Target>& t = graph.GetTargets();
+		const std::vector<Slot>& s = graph.GetSlots();
+		for (int a = 0; a < (int)t.size(); a++)
+		{
+			if (!Fits(t[a], s[t[a].Slot])) badSlots++;
+			for (int b = a + 1; b < (int)t.size(); b++)
+				if (t[a].Slot == t[b].Slot && Overlap(t[a], t[b])) sharedLive++;
+		}
+
+		// Each kind's slots vs. the most of that kind live at once
+		for (int k = 0; k < 4; k++)
+		{
+			int kindSlots = 0;
+			for (const Slot& slot : s)
+				if (slot.Desc.Format == kinds[k].Format && slot.Desc.ScaleShift == kinds[k].ScaleShift) kindSlots++;
+
+			int mostLive = 0;
+			for (int p = 0; p < (int)graph.GetPasses().size(); p++)
+			{
+				int live = 0;
+				for (const Target& target : t)
+					if (target.Desc.Format == kinds[k].Format && target.Desc.ScaleShift == kinds[k].ScaleShift &&
+						target.FirstPass <= p && p <= target.LastPass) live++;
+				mostLive = std::max(mostLive, live);
+			}
+			extraSlots += kindSlots - mostLive;
+		}
+
+		if (graph.GetAllocatedBytes() < graph.GetPeakLiveBytes() || graph.GetAllocatedBytes() > graph.GetUnaliasedBytes())
+			check(false, "allocated bytes lie between peak live and unaliased");
+		allocated += graph.GetAllocatedBytes();
+		unaliased += graph.GetUnaliasedBytes();
+	}
+	check(sharedLive == 0, "no slot holds two live targets");
+	check(badSlots == 0, "every target fits its slot");
+	check(extraSlots == 0, "no more slots than targets live at once");
+
+	bool passed = failures == 0;
+	printf("Post process graph test: %s\n", passed ? "passed" : "FAILED");
+	printf("  %d random graphs - slots holding two live targets: %d, mismatched slots: %d, slots over the minimum: %d\n",
+		graphCount, sharedLive, badSlots, extraSlots);
+	printf("  Random graph memory: %.1f MB allocated, %.1f MB without aliasing (%.0f%%)\n\n",
+		allocated / (1024.0 * 1024.0), unaliased / (1024.0 * 1024.0), 100.0 * allocated / unaliased);
+	return passed;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// What a post process target holds and how big it is
+struct PostTargetDesc
+{
+	int Format;			// A DXGI_FORMAT, kept as an int so the graph doesn't need D3D
+	int BytesPerPixel;
+	int ScaleShift;		// 0 is window sized, 1 half, 2 quarter...
+};
+
+// --------------------------------------------------------
+// The post process pipeline, as an ordered list of passes that
+// each read some targets and write one.  Targets are only
+// declared here - Compile() works out when each one is live
+// (from the pass that writes it to the last pass that reads it)
+// and packs them into as few slots as it can.  Two targets
+// share a slot when they match in format and size and one is
+// finished with before the other is written, so a chain of
+// passes ends up ping-ponging between two slots on its own.
+//
+// No D3D here - RenderTargetPool makes a texture for each slot.
+// --------------------------------------------------------
+class PostProcessGraph
+{
+public:
+	// The output of a pass that draws to the screen - owned by the
+	// swap chain, so never given a slot
+	static constexpr int BackBuffer = -1;
+
+	// The output of a pass that only writes buffers the graph
+	// doesn't manage (compute passes)
+	static constexpr int NoOutput = -2;
+
+	struct Target
+	{
+		std::string Name;
+		PostTargetDesc Desc;
+
+		// Filled in by Compile()
+		int Width = 0;
+		int Height = 0;
+		int FirstPass = -1;	// Writes it
+		int LastPass = -1;	// Last to read it
+		int Slot = -1;
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		std::vector<int> Inputs;
+		int Output;
+		std::function<void()> Execute; // Empty for passes drawn elsewhere
+	};
+
+	// A physical texture the pool creates
+	struct Slot
+	{
+		PostTargetDesc Desc;
+		int Width;
+		int Height;
+	};
+
+private:
+	std::vector<Target> targets;
+	std::vector<Pass> passes;
+	std::vector<Slot> slots;
+	std::string error;
+
+public:
+	void Clear();
+
+	// Returns the target's handle
+	int AddTarget(const std::string& name, PostTargetDesc desc);
+
+	// Passes run in the order they're added.  Each target must be
+	// written by exactly one pass, before any pass reads it.
+	void AddPass(const std::string& name, const std::vector<int>& inputs, int output, std::function<void()> execute = nullptr);
+
+	// Sizes every target for a window, works out lifetimes and
+	// assigns slots.  Returns false (see GetError()) if the passes
+	// don't make sense, leaving no slots.
+	bool Compile(int width, int height);
+
+	// Runs every pass's Execute, in order
+	void Execute() const;
+
+	const std::vector<Target>& GetTargets() const;
+	const std::vector<Pass>& GetPasses() const;
+	const std::vector<Slot>& GetSlots() const;
+	const std::string& GetError() const;
+
+	// Memory for every slot (what the pool allocates), for every
+	// target if none shared, and for the most targets live during
+	// any one pass - the least any packing could get away with
+	size_t GetAllocatedBytes() const;
+	size_t GetUnaliasedBytes() const;
+	size_t GetPeakLiveBytes() const;
+
+	// Fixed graphs checking lifetimes, aliasing and that bad graphs
+	// fail to compile, then random graphs checking no two targets
+	// sharing a slot are ever live together and that each format
+	// and size uses no more slots than it has targets live at
+	// once.  Prints the results and returns whether they passed.
+	static bool Test();
+};
@@ -0,0 +1,386 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	uint32_t Field(uint64_t key, int shift, int bits)
+	{
+		return (uint32_t)((key >> shift) & ((1ull << bits) - 1));
+	}
+
+	// Hands out the next ID, refusing any that wouldn't fit in the
+	// key - two things sharing an ID would skip a needed bind
+	template<typename Map, typename Key>
+	uint32_t Intern(Map& ids, const Key& key, int bits, const char* what)
+	{
+		auto found = ids.find(key);
+		if (found != ids.end())
+			return found->second;
+
+		if (ids.size() >= (1ull << bits))
+			throw std::length_error(std::string("Too many unique ") + what + " for a render key");
+
+		uint32_t id = (uint32_t)ids.size();
+		ids[key] = id;
+		return id;
+	}
+
+	// State an item in the test was added with
+	struct TestItem
+	{
+		uint32_t Pass;
+		uint32_t Shader;
+		uint32_t Material;
+		uint32_t Mesh;
+	};
+
+	// Tracks what's bound as the queue submits, counting binds that
+	// change nothing and draws that would use the wrong state
+	class CheckingSink : public RenderCommandSink
+	{
+	public:
+		const std::vector<TestItem>& items;
+		int shader = -1;
+		int material = -1;
+		int mesh = -1;
+		int redundantBinds = 0;
+		int wrongDraws = 0;
+		int binds = 0;
+		std::vector<int> drawn;					// Items in draw order
+		std::vector<std::pair<int, int>> batches;	// First instance and count
+
+		CheckingSink(const std::vector<TestItem>& items) : items(items) {}
+
+		void Bind(int& bound, uint32_t id)
+		{
+			if (bound == (int)id)
+				redundantBinds++;
+			bound = (int)id;
+			binds++;
+		}
+
+		void BindShaders(int item) override { Bind(shader, items[item].Shader); }
+		void BindMaterial(int item) override { Bind(material, items[item].Material); }
+		void BindMesh(int item) override { Bind(mesh, items[item].Mesh); }
+
+		void Draw(int item) override
+		{
+			Check(item);
+			drawn.push_back(item);
+		}
+
+		void DrawInstanced(int item, int firstInstance, int instanceCount) override
+		{
+			Check(item);
+			drawn.push_back(item);
+			batches.push_back({ firstInstance, instanceCount });
+		}
+
+		void Check(int item)
+		{
+			const TestItem& expected = items[item];
+			if (shader != (int)expected.Shader || material != (int)expected.Material || mesh != (int)expected.Mesh)
+				wrongDraws++;
+		}
+	};
+}
+
+uint64_t RenderKey::Make(uint32_t pass, uint32_t shader, uint32_t material, uint32_t mesh, float depth)
+{
+	uint64_t quantizedDepth = (uint64_t)(std::clamp(depth, 0.0f, 1.0f) * ((1 << DepthBits) - 1));
+	return
+		((uint64_t)pass << PassShift) |
+		((uint64_t)shader << ShaderShift) |
+		((uint64_t)material << MaterialShift) |
+		((uint64_t)mesh << MeshShift) |
+		(quantizedDepth << DepthShift);
+}
+
+uint32_t RenderKey::Pass(uint64_t key) { return Field(key, PassShift, PassBits); }
+uint32_t RenderKey::Shader(uint64_t key) { return Field(key, ShaderShift, ShaderBits); }
+uint32_t RenderKey::Material(uint64_t key) { return Field(key, MaterialShift, MaterialBits); }
+uint32_t RenderKey::Mesh(uint64_t key) { return Field(key, MeshShift, MeshBits); }
+uint64_t RenderKey::State(uint64_t key) { return key >> MeshShift; }
+
+uint32_t RenderQueue::ShaderId(const void* vertexShader, const void* pixelShader)
+{
+	return Intern(shaderIds, std::make_pair(vertexShader, pixelShader), RenderKey::ShaderBits, "shader pairs");
+}
+
+uint32_t RenderQueue::MaterialId(const void* material)
+{
+	return Intern(materialIds, material, RenderKey::MaterialBits, "materials");
+}
+
+uint32_t RenderQueue::MeshId(const void* mesh)
+{
+	return Intern(meshIds, mesh, RenderKey::MeshBits, "meshes");
+}
+
+void RenderQueue::Clear()
+{
+	entries.clear();
+}
+
+void RenderQueue::Add(uint32_t pass, uint32_t shader, uint32_t material, uint32_t mesh, float depth, int item)
+{
+	entries.push_back({ RenderKey::Make(pass, shader, material, mesh, depth), item });
+}
+
+// --------------------------------------------------------
+// LSD radix sort, 8 bits at a time.  All eight histograms are
+// built in one pass over the keys, and any byte that's the same
+// for every key (the pass, usually, and high ID bits) is skipped.
+// Stable, so equal keys keep the order they were added in.
+// --------------------------------------------------------
+void RenderQueue::Sort()
+{
+	if (entries.size() < 2)
+		return;
+
+	size_t counts[8][256] = {};
+	for (const Entry& entry : entries)
+	{
+		for (int digit = 0; digit < 8; digit++)
+			counts[digit][(entry.key >> (digit * 8)) & 0xFF]++;
+	}
+
+	scratch.resize(entries.size());
+	for (int digit = 0; digit < 8; digit++)
+	{
+		int shift = digit * 8;
+		if (counts[digit][(entries[0].key >> shift) & 0xFF] == entries.size())
+			continue;
+
+		size_t offsets[256];
+		size_t total = 0;
+		for (int value = 0; value < 256; value++)
+		{
+			offsets[value] = total;
+			total += counts[digit][value];
+		}
+
+		for (const Entry& entry : entries)
+			scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+		entries.swap(scratch);
+	}
+}
+
+// --------------------------------------------------------
+// Walks the (sorted) entries, binding each part of the state
+// only when its ID differs from the previous draw's
+// --------------------------------------------------------
+RenderQueueStats RenderQueue::Submit(RenderCommandSink& sink, bool instanced)
+{
+	return SubmitRange(sink, instanced, 0, (int)entries.size());
+}
+
+RenderQueueStats RenderQueue::SubmitRange(RenderCommandSink& sink, bool instanced, int first, int last)
+{
+	RenderQueueStats stats = {};
+	size_t end = (size_t)last;
+	size_t next = 0;
+	for (size_t i = (size_t)first; i < end; i = next)
+	{
+		uint64_t key = entries[i].key;
+		int item = entries[i].item;
+		bool start = i == (size_t)first;
+		uint64_t previous = start ? 0 : entries[i - 1].key;
+
+		if (start || RenderKey::Shader(key) != RenderKey::Shader(previous))
+		{
+			sink.BindShaders(item);
+			stats.ShaderChanges++;
+		}
+		if (start || RenderKey::Material(key) != RenderKey::Material(previous))
+		{
+			sink.BindMaterial(item);
+			stats.MaterialChanges++;
+		}
+		if (start || RenderKey::Mesh(key) != RenderKey::Mesh(previous))
+		{
+			sink.BindMesh(item);
+			stats.MeshChanges++;
+		}
+
+		// Instanced, this draw covers every following entry with the
+		// same state.  Otherwise just this one.
+		next = i + 1;
+		if (instanced)
+		{
+			while (next < end && RenderKey::State(entries[next].key) == RenderKey::State(key))
+				next++;
+			sink.DrawInstanced(item, (int)i, (int)(next - i));
+		}
+		else
+		{
+			sink.Draw(item);
+		}
+		stats.Draws++;
+		stats.Instances += (int)(next - i);
+	}
+	return stats;
+}
+
+int RenderQueue::GetCount()
+{
+	return (int)entries.size();
+}
+
+int RenderQueue::GetItem(int index)
+{
+	return entries[index].item;
+}
+
+uint64_t RenderQueue::GetKey(int index)
+{
+	return entries[index].key;
+}
+
+bool RenderQueue::Test()
+{
+	int failures = 0;
+	auto check = [&](bool condition, const char* what) {
+		if (!condition)
+		{
+			printf("  FAILED: %s\n", what);
+			failures++;
+		}
+	};
+
+	// Keys keep every field, and sort by pass, then shader,
+	// material, mesh and depth
+	uint64_t key = RenderKey::Make(RenderQueue::Opaque, 4095, 65535, 1234, 0.5f);
+	check(RenderKey::Pass(key) == RenderQueue::Opaque && RenderKey::Shader(key) == 4095 &&
+		RenderKey::Material(key) == 65535 && RenderKey::Mesh(key) == 1234, "keys round trip their fields");
+	check(RenderKey::Make(0, 1, 0, 0, 0.0f) > RenderKey::Make(0, 0, 65535, 65535, 1.0f) &&
+		RenderKey::Make(0, 0, 1, 0, 0.0f) > RenderKey::Make(0, 0, 0, 65535, 1.0f) &&
+		RenderKey::Make(0, 0, 0, 1, 0.0f) > RenderKey::Make(0, 0, 0, 0, 1.0f) &&
+		RenderKey::Make(1, 0, 0, 0, 0.0f) > RenderKey::Make(0, 4095, 65535, 65535, 1.0f), "fields sort in priority order");
+	check(RenderKey::State(RenderKey::Make(0, 3, 2, 1, 0.1f)) == RenderKey::State(RenderKey::Make(0, 3, 2, 1, 0.9f)), "state ignores depth");
+
+	// IDs are stable, and running out of them throws rather than
+	// letting two shaders share one
+	{
+		RenderQueue queue;
+		int things[2] = {};
+		check(queue.MaterialId(&things[0]) == 0 && queue.MaterialId(&things[1]) == 1 && queue.MaterialId(&things[0]) == 0, "IDs are stable");
+		bool threw = false;
+		try
+		{
+			for (uintptr_t i = 0; i <= (1u << RenderKey::ShaderBits); i++)
+				queue.ShaderId((const void*)(i + 1), nullptr);
+		}
+		catch (const std::length_error&)
+		{
+			threw = true;
+		}
+		check(threw, "too many shader pairs throws");
+	}
+
+	std::mt19937 random(1234);
+	int queuesChecked = 0;
+	int itemsChecked = 0;
+	for (int round = 0; round < 200; round++)
+	{
+		// Few shaders, more materials and meshes, random depths -
+		// sometimes tiny queues, sometimes with every item sharing state
+		int count = round < 10 ? round : (int)(random() % 2000);
+		int shaders = 1 + random() % 4;
+		int materials = 1 + random() % (round % 3 == 0 ? 1 : 12);
+		int meshes = 1 + random() % (round % 5 == 0 ? 1 : 20);
+
+		RenderQueue queue;
+		std::vector<TestItem> items(count);
+		std::vector<uint64_t> keys(count);
+		for (int i = 0; i < count; i++)
+		{
+			items[i] = { (uint32_t)(random() % 2), (uint32_t)(random() % shaders), (uint32_t)(random() % materials), (uint32_t)(random() % meshes) };
+			float depth = (random() % 8) / 7.0f; // Plenty of ties
+			keys[i] = RenderKey::Make(items[i].Pass, items[i].Shader, items[i].Material, items[i].Mesh, depth);
+			queue.Add(items[i].Pass, items[i].Shader, items[i].Material, items[i].Mesh, depth, i);
+		}
+		queue.Sort();
+
+		// Same order as a stable sort by key - equal keys stay in the
+		// order they were added
+		std::vector<int> expected(count);
+		for (int i = 0; i < count; i++)
+			expected[i] = i;
+		std::stable_sort(expected.begin(), expected.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+		bool sorted = queue.GetCount() == count;
+		for (int i = 0; sorted && i < count; i++)
+			sorted = queue.GetItem(i) == expected[i] && queue.GetKey(i) == keys[expected[i]];
+		check(sorted, "radix sort matches a stable sort");
+
+		// The fewest binds sorted order allows - one per run of each ID
+		int shaderRuns = 0;
+		int materialRuns = 0;
+		int meshRuns = 0;
+		int stateRuns = 0;
+		for (int i = 0; i < count; i++)
+		{
+			uint64_t previous = i == 0 ? 0 : queue.GetKey(i - 1);
+			shaderRuns += i == 0 || RenderKey::Shader(queue.GetKey(i)) != RenderKey::Shader(previous);
+			materialRuns += i == 0 || RenderKey::Material(queue.GetKey(i)) != RenderKey::Material(previous);
+			meshRuns += i == 0 || RenderKey::Mesh(queue.GetKey(i)) != RenderKey::Mesh(previous);
+			stateRuns += i == 0 || RenderKey::State(queue.GetKey(i)) != RenderKey::State(previous);
+		}
+
+		// One draw per item
+		CheckingSink sink(items);
+		RenderQueueStats stats = queue.Submit(sink);
+		check(sink.wrongDraws == 0, "every draw has its own state bound");
+		check(sink.redundantBinds == 0, "no bind repeats what's bound");
+		check(stats.ShaderChanges == shaderRuns && stats.MaterialChanges == materialRuns && stats.MeshChanges == meshRuns, "one bind per run of each ID");
+		check(stats.ShaderChanges + stats.MaterialChanges + stats.MeshChanges == sink.binds, "stats count the binds made");
+		check(stats.Draws == count && stats.Instances == count && sink.drawn == expected, "every item drawn once, in sorted order");
+
+		// Instanced - one draw per run of identical state, covering
+		// the sorted items in order
+		CheckingSink instancedSink(items);
+		RenderQueueStats instancedStats = queue.Submit(instancedSink, true);
+		check(instancedSink.wrongDraws == 0 && instancedSink.redundantBinds == 0, "instanced draws bind only what changes");
+		check(instancedStats.Draws == stateRuns && instancedStats.Instances == count, "one instanced draw per run of state");
+		bool batchesCover = true;
+		int nextInstance = 0;
+		for (const std::pair<int, int>& batch : instancedSink.batches)
+		{
+			batchesCover = batchesCover && batch.first == nextInstance && batch.second > 0;
+			for (int i = batch.first; batchesCover && i < batch.first + batch.second; i++)
+				batchesCover = RenderKey::State(queue.GetKey(i)) == RenderKey::State(queue.GetKey(batch.first));
+			nextInstance += batch.second;
+		}
+		check(batchesCover && nextInstance == count, "batches cover every item and share state");
+
+		// Ranges submitted on their own draw the same items, each
+		// binding everything up front
+		if (count > 0)
+		{
+			int split = (int)(random() % count);
+			CheckingSink first(items);
+			CheckingSink second(items);
+			RenderQueueStats firstStats = queue.SubmitRange(first, false, 0, split);
+			RenderQueueStats secondStats = queue.SubmitRange(second, false, split, count);
+			std::vector<int> both = first.drawn;
+			both.insert(both.end(), second.drawn.begin(), second.drawn.end());
+			check(both == expected && first.wrongDraws == 0 && second.wrongDraws == 0, "ranges draw their items with their own state");
+			check(secondStats.ShaderChanges >= 1 && secondStats.MaterialChanges >= 1 && secondStats.MeshChanges >= 1 &&
+				firstStats.Draws + secondStats.Draws == count, "a range binds everything at its start");
+		}
+
+		queuesChecked++;
+		itemsChecked += count;
+	}
+
+	bool passed = failures == 0;
+	printf("Render queue test: %s\n", passed ? "passed" : "FAILED");
+	printf("  %d queues, %d items sorted and submitted\n\n", queuesChecked, itemsChecked);
+	return passed;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Where each part of a sort key lives, highest bits sort first:
+//   pass (4) | shader (12) | material (16) | mesh (16) | depth (16)
+namespace RenderKey
+{
+	const int DepthBits = 16;
+	const int MeshBits = 16;
+	const int MaterialBits = 16;
+	const int ShaderBits = 12;
+	const int PassBits = 4;
+
+	const int DepthShift = 0;
+	const int MeshShift = DepthShift + DepthBits;
+	const int MaterialShift = MeshShift + MeshBits;
+	const int ShaderShift = MaterialShift + MaterialBits;
+	const int PassShift = ShaderShift + ShaderBits;
+
+	uint64_t Make(uint32_t pass, uint32_t shader, uint32_t material, uint32_t mesh, float depth);
+	uint32_t Pass(uint64_t key);
+	uint32_t Shader(uint64_t key);
+	uint32_t Material(uint64_t key);
+	uint32_t Mesh(uint64_t key);
+
+	// Everything but depth - draws with the same state can be instanced
+	uint64_t State(uint64_t key);
+}
+
+// Draws and state changes issued by one Submit()
+struct RenderQueueStats
+{
+	int Draws;			// Draw calls
+	int Instances;		// Items drawn - more than Draws when instanced
+	int ShaderChanges;
+	int MaterialChanges;
+	int MeshChanges;
+};
+
+// --------------------------------------------------------
+// Receives the commands a RenderQueue submits.  Each call gets the
+// item (whatever index was passed to RenderQueue::Add()) whose
+// state should be bound or drawn.  An instanced draw gets the first
+// item of the batch, plus where the batch starts in sorted order -
+// instance data is expected to be laid out in that order.
+//
+// The game implements this with D3D calls; anything else (a mock
+// that just records the calls, for instance) works the same.
+// --------------------------------------------------------
+class RenderCommandSink
+{
+public:
+	virtual ~RenderCommandSink() = default;
+	virtual void BindShaders(int item) = 0;
+	virtual void BindMaterial(int item) = 0;
+	virtual void BindMesh(int item) = 0;
+	virtual void Draw(int item) = 0;
+	virtual void DrawInstanced(int item, int firstInstance, int instanceCount) = 0;
+};
+
+// --------------------------------------------------------
+// Sorts draws by a 64 bit key so that draws sharing state end up
+// next to each other, then submits them, only binding the parts
+// of the state that differ from the previous draw.
+//
+// Shaders, materials and meshes are identified by small IDs, handed
+// out the first time each is seen and stable from then on.
+// --------------------------------------------------------
+class RenderQueue
+{
+private:
+	struct Entry
+	{
+		uint64_t key;
+		int item;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<Entry> scratch; // Radix sort ping-pong
+
+	std::map<std::pair<const void*, const void*>, uint32_t> shaderIds;
+	std::unordered_map<const void*, uint32_t> materialIds;
+	std::unordered_map<const void*, uint32_t> meshIds;
+
+public:
+	enum Pass : uint32_t
+	{
+		Shadow = 0,
+		Opaque = 1
+	};
+
+	uint32_t ShaderId(const void* vertexShader, const void* pixelShader);
+	uint32_t MaterialId(const void* material);
+	uint32_t MeshId(const void* mesh);
+
+	void Clear();
+
+	// depth is 0 (near) to 1 (far) - nearer draws go first within
+	// the same state, so they can occlude the ones behind
+	void Add(uint32_t pass, uint32_t shader, uint32_t material, uint32_t mesh, float depth, int item);
+
+	void Sort();
+
+	// Instanced submission draws each run of consecutive items that
+	// share all state (everything but depth) with one call
+	RenderQueueStats Submit(RenderCommandSink& sink, bool instanced = false);
+
+	// Just entries [first, last), as if they were the whole queue - the
+	// first binds everything.  Only reads the queue, so different
+	// ranges can be submitted from different threads at once.
+	RenderQueueStats SubmitRange(RenderCommandSink& sink, bool instanced, int first, int last);
+
+	int GetCount();
+	int GetItem(int index); // In sorted order, after Sort()
+	uint64_t GetKey(int index);
+
+	// Sorts random queues and checks the order against a plain
+	// stable sort, then submits them to a sink that tracks what's
+	// bound, checking every draw sees its own state and no bind
+	// repeats what's already bound.  Prints the results and returns
+	// whether they passed.
+	static bool Test();
+};
@@ -0,0 +1,45 @@
+#include "RenderTargetPool.h"
+#include "Graphics.h"
+
+void RenderTargetPool::Realize(const PostProcessGraph& graph)
+{
+	const std::vector<PostProcessGraph::Slot>& slots = graph.GetSlots();
+	targets.resize(slots.size());
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		const PostProcessGraph::Slot& slot = slots[i];
+		RenderTarget& target = targets[i];
+		if (target.Texture && target.Format == slot.Desc.Format && target.Width == slot.Width && target.Height == slot.Height)
+			continue;
+
+		target = {};
+		target.Format = (DXGI_FORMAT)slot.Desc.Format;
+		target.Width = slot.Width;
+		target.Height = slot.Height;
+
+		D3D11_TEXTURE2D_DESC textureDesc = {};
+		textureDesc.Width = target.Width;
+		textureDesc.Height = target.Height;
+		textureDesc.ArraySize = 1;
+		textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+		textureDesc.Format = target.Format;
+		textureDesc.MipLevels = 1;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_DEFAULT;
+		Graphics::Device->CreateTexture2D(&textureDesc, 0, target.Texture.GetAddressOf());
+
+		// Default views cover the whole texture
+		Graphics::Device->CreateRenderTargetView(target.Texture.Get(), 0, target.RTV.GetAddressOf());
+		Graphics::Device->CreateShaderResourceView(target.Texture.Get(), 0, target.SRV.GetAddressOf());
+	}
+}
+
+RenderTarget& RenderTargetPool::Get(const PostProcessGraph& graph, int target)
+{
+	return targets[graph.GetTargets()[target].Slot];
+}
+
+int RenderTargetPool::GetTextureCount() const
+{
+	return (int)targets.size();
+}
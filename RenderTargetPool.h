@@ -0,0 +1,34 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+#include "PostProcessGraph.h"
+
+// A texture with views for drawing into it and sampling it
+struct RenderTarget
+{
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> Texture;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> RTV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+	DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+	int Width = 0;
+	int Height = 0;
+};
+
+// --------------------------------------------------------
+// The textures behind a compiled PostProcessGraph, one for each
+// of its slots.  Realize() only recreates the slots whose format
+// or size changed, so recompiling after a setting changes
+// doesn't throw away textures the new graph can still use.
+// --------------------------------------------------------
+class RenderTargetPool
+{
+	std::vector<RenderTarget> targets;
+
+public:
+	void Realize(const PostProcessGraph& graph);
+
+	// The texture one of the graph's targets lives in
+	RenderTarget& Get(const PostProcessGraph& graph, int target);
+	int GetTextureCount() const;
+};
@@ -41,9 +41,8 @@ struct VertexToPixel
     float4 screenPosition : SV_POSITION;
     float2 uv : TEXCOORD;
     float3 normal : NORMAL;
-    float3 tangent : TANGENT;
+    float4 tangent : TANGENT; // w = handedness
     float3 worldPos : POSITION;
-    float4 shadowMapPos : SHADOW_POSITION;
 };
 
 // redefine V to P struct
@@ -68,7 +67,27 @@ struct VertexShaderInput
     float3 localPosition : POSITION; // XYZ position
     float2 uv : TEXCOORD;
     float3 normal : NORMAL;
-    float3 tangent : TANGENT;
+    float4 tangent : TANGENT; // w = handedness (+1 or -1)
+};
+
+// Same vertex, plus a second stream that advances once per instance
+// rather than per vertex (slot 1 in the instanced input layout)
+// - Each matrix arrives as its 4 rows, as laid out in PerObjectVSData
+struct VertexShaderInstancedInput
+{
+    float3 localPosition : POSITION;
+    float2 uv : TEXCOORD;
+    float3 normal : NORMAL;
+    float4 tangent : TANGENT;
+
+    float4 world0 : WORLD0;
+    float4 world1 : WORLD1;
+    float4 world2 : WORLD2;
+    float4 world3 : WORLD3;
+    float4 worldInvTranspose0 : WORLD_INV_TRANSPOSE0;
+    float4 worldInvTranspose1 : WORLD_INV_TRANSPOSE1;
+    float4 worldInvTranspose2 : WORLD_INV_TRANSPOSE2;
+    float4 worldInvTranspose3 : WORLD_INV_TRANSPOSE3;
 };
 
 
@@ -0,0 +1,94 @@
+#include "ShadowCache.h"
+#include "EntityStore.h"
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+using namespace DirectX;
+
+bool ShadowCache::IsCurrent(uint32_t staticVersion, uint32_t lightVersion, const XMFLOAT4X4& viewProjection)
+{
+	return valid &&
+		this->staticVersion == staticVersion &&
+		this->lightVersion == lightVersion &&
+		memcmp(&this->viewProjection, &viewProjection, sizeof(XMFLOAT4X4)) == 0;
+}
+
+void ShadowCache::Store(uint32_t staticVersion, uint32_t lightVersion, const XMFLOAT4X4& viewProjection)
+{
+	valid = true;
+	this->staticVersion = staticVersion;
+	this->lightVersion = lightVersion;
+	this->viewProjection = viewProjection;
+}
+
+void ShadowCache::Invalidate()
+{
+	valid = false;
+}
+
+// --------------------------------------------------------
+// A static root with a static child, and a dynamic root with a
+// (static flagged) child.  After each change, the matrices are
+// updated like a frame would, and the cache should be stale only
+// when a static caster, the light or the cascade changed.
+// --------------------------------------------------------
+bool ShadowCache::Test()
+{
+	EntityStore entities;
+	EntityId root = entities.Create(0, 0);
+	EntityId child = entities.Create(0, 0);
+	EntityId mover = entities.Create(0, 0);
+	EntityId rider = entities.Create(0, 0);
+	entities.SetParent(child, root);
+	entities.SetParent(rider, mover);
+	entities.SetDynamic(entities.GetIndex(mover), true);
+	entities.UpdateMatrices();
+
+	uint32_t lightVersion = 0;
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixOrthographicLH(20, 20, 0, 50));
+
+	ShadowCache cache;
+	cache.Store(entities.GetStaticVersion(), lightVersion, viewProjection);
+
+	int checks = 0;
+	int failures = 0;
+	auto check = [&](const char* change, bool expectRedraw, const std::function<void()>& apply) {
+		apply();
+		entities.UpdateMatrices();
+		bool redraw = !cache.IsCurrent(entities.GetStaticVersion(), lightVersion, viewProjection);
+		checks++;
+		if (redraw != expectRedraw)
+		{
+			failures++;
+			printf("  %s: %s, expected %s\n", change, redraw ? "redrew" : "kept", expectRedraw ? "a redraw" : "to keep");
+		}
+		cache.Store(entities.GetStaticVersion(), lightVersion, viewProjection);
+	};
+	auto move = [&](EntityId id) { entities.MoveAbsolute(entities.GetIndex(id), XMFLOAT3(0, 1, 0)); };
+
+	printf("Shadow cache test\n");
+	check("Nothing", false, [] {});
+	check("Dynamic entity moved", false, [&] { move(mover); });
+	check("Static entity under a dynamic one moved", false, [&] { move(rider); });
+	check("Static root moved", true, [&] { move(root); });
+	check("Static child moved", true, [&] { move(child); });
+	check("Static mesh changed", true, [&] { entities.SetMesh(entities.GetIndex(root), 1); });
+	check("Material changed", false, [&] { entities.SetMaterial(entities.GetIndex(root), 1); });
+	check("Light changed", true, [&] { lightVersion++; });
+	check("Cascade moved", true, [&] { viewProjection._41 += 0.01f; });
+	check("Static root made dynamic", true, [&] { entities.SetDynamic(entities.GetIndex(root), true); });
+	check("Its (static) child moved", false, [&] { move(child); });
+	check("Made static again", true, [&] { entities.SetDynamic(entities.GetIndex(root), false); });
+	check("Static entity re-parented under a dynamic one", true, [&] { entities.SetParent(child, mover); });
+	check("Dynamic parent moved", false, [&] { move(mover); });
+	check("Entity created", true, [&] { entities.Create(0, 0); });
+	check("Entity destroyed", true, [&] { entities.Destroy(rider); });
+	check("Dynamic entity moved after all that", false, [&] { move(mover); });
+	check("Invalidated", true, [&] { cache.Invalidate(); });
+
+	bool passed = failures == 0;
+	printf("  %d changes, %d wrong - %s\n\n", checks, failures, passed ? "passed" : "FAILED");
+	return passed;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <DirectXMath.h>
+#include <cstdint>
+
+// --------------------------------------------------------
+// Remembers what a cached shadow map was last drawn with - the
+// static casters' version (EntityStore::GetStaticVersion()), the
+// light's version and the light's view * projection - so the
+// static casters are only redrawn when one of those changes.
+// Dynamic casters go on top of a copy every frame.
+//
+// No D3D here - what triggers a redraw can be checked anywhere.
+// --------------------------------------------------------
+class ShadowCache
+{
+	bool valid = false;
+	uint32_t staticVersion = 0;
+	uint32_t lightVersion = 0;
+	DirectX::XMFLOAT4X4 viewProjection = {};
+
+public:
+	// Whether the cached map still holds what drawing now would
+	bool IsCurrent(uint32_t staticVersion, uint32_t lightVersion, const DirectX::XMFLOAT4X4& viewProjection);
+
+	// Call once the static casters have been drawn with these
+	void Store(uint32_t staticVersion, uint32_t lightVersion, const DirectX::XMFLOAT4X4& viewProjection);
+
+	// For changes nothing above tracks (streamed in meshes, say)
+	void Invalidate();
+
+	// Drives an EntityStore and a light through the changes that
+	// should and shouldn't redraw a cache, prints the results and
+	// returns whether every one matched
+	static bool Test();
+};
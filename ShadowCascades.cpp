@@ -0,0 +1,274 @@
+#include "ShadowCascades.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace DirectX;
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// A camera at position, turned by yaw and pitch, like the game's
+	XMFLOAT4X4 TestView(XMFLOAT3 position, float pitch, float yaw)
+	{
+		XMMATRIX rotation = XMMatrixRotationRollPitchYaw(pitch, yaw, 0);
+		XMVECTOR forward = XMVector3Transform(XMVectorSet(0, 0, 1, 0), rotation);
+		XMVECTOR up = XMVector3Transform(XMVectorSet(0, 1, 0, 0), rotation);
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMLoadFloat3(&position), forward, up));
+		return view;
+	}
+}
+
+void ShadowCascades::ComputeSplits(float nearClip, float farClip, int cascadeCount, float lambda, float* splits)
+{
+	splits[0] = nearClip;
+	for (int i = 1; i < cascadeCount; i++)
+	{
+		float fraction = (float)i / cascadeCount;
+		float logarithmic = nearClip * powf(farClip / nearClip, fraction);
+		float uniform = nearClip + (farClip - nearClip) * fraction;
+		splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+	}
+	splits[cascadeCount] = farClip;
+}
+
+// A clip space corner (x, y) at view depth z comes from view space
+// x * _11 + z * _31 + _41 = x * w, where w = z * _34 + _44 (z for a
+// perspective projection, 1 for orthographic) - the same for y
+void ShadowCascades::GetSliceCorners(
+	const XMFLOAT4X4& view, const XMFLOAT4X4& projection,
+	float sliceNear, float sliceFar, XMFLOAT3 corners[8])
+{
+	const XMFLOAT4X4& p = projection;
+	XMMATRIX inverseView = XMMatrixInverse(0, XMLoadFloat4x4(&view));
+	for (int i = 0; i < 8; i++)
+	{
+		float clipX = (i & 1) ? 1.0f : -1.0f;
+		float clipY = (i & 2) ? 1.0f : -1.0f;
+		float z = (i & 4) ? sliceFar : sliceNear;
+		float w = z * p._34 + p._44;
+		XMVECTOR corner = XMVectorSet(
+			(clipX * w - z * p._31 - p._41) / p._11,
+			(clipY * w - z * p._32 - p._42) / p._22,
+			z,
+			1.0f);
+		XMStoreFloat3(&corners[i], XMVector3TransformCoord(corner, inverseView));
+	}
+}
+
+XMFLOAT4X4 ShadowCascades::GetLightView(XMFLOAT3 direction)
+{
+	// Any up works, as long as it isn't along the light
+	XMVECTOR forward = XMVector3Normalize(XMLoadFloat3(&direction));
+	XMVECTOR up = fabsf(XMVectorGetY(forward)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+
+	XMFLOAT4X4 view;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorZero(), forward, up));
+	return view;
+}
+
+XMFLOAT4X4 ShadowCascades::FitProjection(const XMFLOAT4X4& lightView, const XMFLOAT3 corners[8], int resolution, bool stable)
+{
+	XMMATRIX view = XMLoadFloat4x4(&lightView);
+	XMFLOAT3 lightCorners[8];
+	for (int i = 0; i < 8; i++)
+		XMStoreFloat3(&lightCorners[i], XMVector3TransformCoord(XMLoadFloat3(&corners[i]), view));
+
+	float minX, maxX, minY, maxY, minZ, maxZ;
+	if (stable)
+	{
+		// Rotating the view doesn't change the distances between its
+		// corners, so neither center (relative to the camera) nor
+		// radius change.  Rounding the radius up keeps float noise
+		// from changing the size anyway.
+		XMFLOAT3 center(0, 0, 0);
+		for (const XMFLOAT3& corner : lightCorners)
+			center = XMFLOAT3(center.x + corner.x / 8, center.y + corner.y / 8, center.z + corner.z / 8);
+		float radius = 0.0f;
+		for (const XMFLOAT3& corner : lightCorners)
+		{
+			float dx = corner.x - center.x;
+			float dy = corner.y - center.y;
+			float dz = corner.z - center.z;
+			radius = fmaxf(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+		}
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		// Centered on a texel, the (resolution wide) edges are too.
+		// Snapping moves the center up to half a texel, so the box
+		// is a texel wider than the sphere.
+		float texel = radius * 2.0f / (resolution - 1);
+		float halfSize = texel * resolution / 2;
+		center.x = roundf(center.x / texel) * texel;
+		center.y = roundf(center.y / texel) * texel;
+		minX = center.x - halfSize;
+		maxX = center.x + halfSize;
+		minY = center.y - halfSize;
+		maxY = center.y + halfSize;
+		minZ = center.z - radius;
+		maxZ = center.z + radius;
+	}
+	else
+	{
+		minX = maxX = lightCorners[0].x;
+		minY = maxY = lightCorners[0].y;
+		minZ = maxZ = lightCorners[0].z;
+		for (const XMFLOAT3& corner : lightCorners)
+		{
+			minX = fminf(minX, corner.x);
+			maxX = fmaxf(maxX, corner.x);
+			minY = fminf(minY, corner.y);
+			maxY = fmaxf(maxY, corner.y);
+			minZ = fminf(minZ, corner.z);
+			maxZ = fmaxf(maxZ, corner.z);
+		}
+
+		// One texel spare, so the snapped box still holds the slice
+		// while staying exactly resolution texels wide.  Sizes are
+		// rounded up, like the stable radius, so float noise as the
+		// camera moves doesn't change the texel size.
+		float texelX = ceilf((maxX - minX) * 16.0f) / 16.0f / (resolution - 1);
+		float texelY = ceilf((maxY - minY) * 16.0f) / 16.0f / (resolution - 1);
+		minX = floorf(minX / texelX) * texelX;
+		minY = floorf(minY / texelY) * texelY;
+		maxX = minX + texelX * resolution;
+		maxY = minY + texelY * resolution;
+	}
+
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixOrthographicOffCenterLH(minX, maxX, minY, maxY, minZ, maxZ));
+	return projection;
+}
+
+void ShadowCascades::Build(
+	const XMFLOAT4X4& cameraView, const XMFLOAT4X4& cameraProjection,
+	float nearClip, float shadowDistance,
+	XMFLOAT3 lightDirection, int cascadeCount, float lambda,
+	int resolution, bool stable, ShadowCascade* cascades)
+{
+	float splits[MaxCascades + 1];
+	ComputeSplits(nearClip, shadowDistance, cascadeCount, lambda, splits);
+
+	XMFLOAT4X4 lightView = GetLightView(lightDirection);
+
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		XMFLOAT3 corners[8];
+		GetSliceCorners(cameraView, cameraProjection, splits[i], splits[i + 1], corners);
+
+		ShadowCascade& cascade = cascades[i];
+		cascade.SplitNear = splits[i];
+		cascade.SplitFar = splits[i + 1];
+		cascade.View = lightView;
+		cascade.Projection = FitProjection(lightView, corners, resolution, stable);
+		XMStoreFloat4x4(&cascade.ViewProjection, XMLoadFloat4x4(&cascade.View) * XMLoadFloat4x4(&cascade.Projection));
+	}
+}
+
+// --------------------------------------------------------
+// Random cameras and lights, both fitting modes:
+//  - Splits start and end at the right depths, only ever grow,
+//    and lambda 0 / 1 give uniform / logarithmic splits
+//  - Every corner of every slice projects inside its cascade
+//  - A small camera move shifts each cascade by whole texels
+//  - Stable cascades are the same size after the camera turns
+// --------------------------------------------------------
+bool ShadowCascades::Test()
+{
+	const int resolution = 1024;
+	const float nearClip = 0.01f;
+	const float farClip = 1000.0f;
+	const float shadowDistance = 80.0f;
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> angle(-1.5f, 1.5f);
+	std::uniform_real_distribution<float> nudge(-0.3f, 0.3f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> lambdas(0.0f, 1.0f);
+
+	int splitFails = 0;
+	int containFails = 0;
+	int snapFails = 0;
+	int sizeFails = 0;
+
+	float splits[MaxCascades + 1];
+	ComputeSplits(1.0f, 100.0f, 2, 0.0f, splits);
+	splitFails += fabsf(splits[1] - 50.5f) > 0.001f;
+	ComputeSplits(1.0f, 100.0f, 2, 1.0f, splits);
+	splitFails += fabsf(splits[1] - 10.0f) > 0.001f;
+
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, nearClip, farClip));
+
+	const int trials = 2000;
+	for (int trial = 0; trial < trials; trial++)
+	{
+		bool stable = trial % 2 == 0;
+		int cascadeCount = 1 + trial % MaxCascades;
+		float lambda = lambdas(random);
+		XMFLOAT3 light(unit(random), -1.0f + unit(random) * 0.5f, unit(random));
+		XMFLOAT3 eye(position(random), position(random) * 0.1f, position(random));
+		float pitch = angle(random);
+		float yaw = angle(random) * 2.0f;
+
+		ComputeSplits(nearClip, shadowDistance, cascadeCount, lambda, splits);
+		splitFails += splits[0] != nearClip || splits[cascadeCount] != shadowDistance;
+		for (int i = 0; i < cascadeCount; i++)
+			splitFails += !(splits[i] < splits[i + 1]);
+
+		XMFLOAT4X4 view = TestView(eye, pitch, yaw);
+		ShadowCascade cascades[MaxCascades];
+		Build(view, projection, nearClip, shadowDistance, light, cascadeCount, lambda, resolution, stable, cascades);
+
+		for (int i = 0; i < cascadeCount; i++)
+		{
+			XMFLOAT3 corners[8];
+			GetSliceCorners(view, projection, cascades[i].SplitNear, cascades[i].SplitFar, corners);
+			XMMATRIX viewProjection = XMLoadFloat4x4(&cascades[i].ViewProjection);
+			for (const XMFLOAT3& corner : corners)
+			{
+				XMFLOAT3 clip;
+				XMStoreFloat3(&clip, XMVector3TransformCoord(XMLoadFloat3(&corner), viewProjection));
+				const float e = 0.001f;
+				containFails += clip.x < -1 - e || clip.x > 1 + e || clip.y < -1 - e || clip.y > 1 + e || clip.z < -e || clip.z > 1 + e;
+			}
+		}
+
+		// Nudged, the same world point should move by a whole number
+		// of texels in every cascade
+		XMFLOAT3 moved(eye.x + nudge(random), eye.y + nudge(random), eye.z + nudge(random));
+		ShadowCascade movedCascades[MaxCascades];
+		Build(TestView(moved, pitch, yaw), projection, nearClip, shadowDistance, light, cascadeCount, lambda, resolution, stable, movedCascades);
+		for (int i = 0; i < cascadeCount; i++)
+		{
+			XMFLOAT3 before, after;
+			XMStoreFloat3(&before, XMVector3TransformCoord(XMLoadFloat3(&eye), XMLoadFloat4x4(&cascades[i].ViewProjection)));
+			XMStoreFloat3(&after, XMVector3TransformCoord(XMLoadFloat3(&eye), XMLoadFloat4x4(&movedCascades[i].ViewProjection)));
+			float texelsX = (after.x - before.x) * resolution / 2;
+			float texelsY = (after.y - before.y) * resolution / 2;
+
+			// Allowing for float rounding of the projection's offset -
+			// that's a lot of texels for a tiny cascade far from the
+			// origin
+			float tolerance = 0.01f + (fabsf(cascades[i].Projection._41) + fabsf(cascades[i].Projection._42)) * resolution * 1.2e-7f;
+			snapFails += fabsf(texelsX - roundf(texelsX)) > tolerance || fabsf(texelsY - roundf(texelsY)) > tolerance;
+			snapFails += fabsf(cascades[i].Projection._11 - movedCascades[i].Projection._11) > cascades[i].Projection._11 * 0.0001f;
+		}
+
+		// Turned, stable cascades keep their size
+		if (stable)
+		{
+			ShadowCascade turnedCascades[MaxCascades];
+			Build(TestView(eye, angle(random), angle(random) * 2.0f), projection, nearClip, shadowDistance, light, cascadeCount, lambda, resolution, stable, turnedCascades);
+			for (int i = 0; i < cascadeCount; i++)
+				sizeFails += fabsf(cascades[i].Projection._11 - turnedCascades[i].Projection._11) > cascades[i].Projection._11 * 0.0001f;
+		}
+	}
+
+	bool passed = splitFails == 0 && containFails == 0 && snapFails == 0 && sizeFails == 0;
+	printf("Shadow cascade test: %d cameras - %s\n  Split failures: %d\n  Corners outside their cascade: %d\n  Moves not in whole texels: %d\n  Stable cascades resized by turning: %d\n\n",
+		trials, passed ? "passed" : "FAILED", splitFails, containFails, snapFails, sizeFails);
+	return passed;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <DirectXMath.h>
+
+// One slice of the camera's view, and the light's matrices covering
+// it
+struct ShadowCascade
+{
+	float SplitNear;					// View depth the slice starts at
+	float SplitFar;						// and ends at
+	DirectX::XMFLOAT4X4 View;			// Light view, the same for every cascade
+	DirectX::XMFLOAT4X4 Projection;		// Orthographic, fitted to the slice
+	DirectX::XMFLOAT4X4 ViewProjection;	// View * Projection
+};
+
+// --------------------------------------------------------
+// Cascaded shadow maps for a directional light.  The camera's
+// view, out to some shadow distance, is cut into slices by depth
+// - short ones up close, longer ones further away - and each
+// slice gets its own shadow map, fitted around just that slice.
+//
+// Only math here, no D3D, so it can be checked anywhere
+// DirectXMath builds.
+// --------------------------------------------------------
+namespace ShadowCascades
+{
+	constexpr int MaxCascades = 4;
+
+	// The practical split scheme: each split is a blend of a
+	// logarithmic split (lambda = 1, even texel density per depth)
+	// and a uniform one (lambda = 0).  Writes cascadeCount + 1
+	// depths, nearClip first and farClip last.
+	void ComputeSplits(float nearClip, float farClip, int cascadeCount, float lambda, float* splits);
+
+	// World space corners of the part of a camera's view between two
+	// view depths - near first, then far, each in the order (-1,-1),
+	// (1,-1), (-1,1), (1,1) in clip space.  Built straight from the
+	// projection's terms (perspective or orthographic) rather than by
+	// inverting view * projection, which loses too much precision
+	// with a near plane as close as the game's.
+	void GetSliceCorners(
+		const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection,
+		float sliceNear, float sliceFar, DirectX::XMFLOAT3 corners[8]);
+
+	// Looks along the light, from the origin - where it sits doesn't
+	// matter to an orthographic projection, and a fixed origin keeps
+	// the texel grid still
+	DirectX::XMFLOAT4X4 GetLightView(DirectX::XMFLOAT3 direction);
+
+	// Orthographic projection around a slice, in light space.  Its
+	// edges are snapped to whole texels of a resolution sized map,
+	// so moving the camera slides the map in whole texels and edges
+	// don't crawl.
+	//  - stable: a box around the slice's bounding sphere.  Same size
+	//    whichever way the camera faces, so turning doesn't shimmer
+	//    either, at the cost of some texels outside the slice.
+	//  - otherwise: the slice's own light space box.  Tightest, but
+	//    its size changes as the camera turns.
+	// Depth covers the slice only - shadow rasterization is depth
+	// clamped, so casters between it and the light still land.
+	DirectX::XMFLOAT4X4 FitProjection(
+		const DirectX::XMFLOAT4X4& lightView, const DirectX::XMFLOAT3 corners[8],
+		int resolution, bool stable);
+
+	// All of the above - splits [nearClip, shadowDistance] and fits
+	// each cascade
+	void Build(
+		const DirectX::XMFLOAT4X4& cameraView, const DirectX::XMFLOAT4X4& cameraProjection,
+		float nearClip, float shadowDistance,
+		DirectX::XMFLOAT3 lightDirection, int cascadeCount, float lambda,
+		int resolution, bool stable, ShadowCascade* cascades);
+
+	// Checks the splits, that every slice lands inside its cascade,
+	// that camera moves shift cascades by whole texels and that
+	// stable cascades keep their size as the camera turns.  Prints
+	// the results and returns whether everything passed.
+	bool Test();
+}
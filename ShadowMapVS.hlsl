@@ -1,13 +1,19 @@
 #include "ShaderIncludes.hlsli"
 
-// Constant Buffer for external data
-cbuffer ExternalData : register(b0)
+// The light's view and projection, set once per shadow map
+cbuffer PerFrame : register(b0)
 {
-    matrix world;
     matrix view;
     matrix projection;
 };
 
+// Same per-object buffer as VertexShader.hlsl (see BufferStructs.h)
+cbuffer PerObject : register(b2)
+{
+    matrix world;
+    matrix worldInvTranspose;
+};
+
 // simplified vertex shader for rendering to a shadow map
 float4 main(VertexShaderInput input) : SV_POSITION
 {
@@ -0,0 +1,17 @@
+#include "ShaderIncludes.hlsli"
+
+// The light's view and projection, set once per shadow map
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+};
+
+// Instanced version of ShadowMapVS.hlsl - world matrix from the
+// per-instance stream (see VertexShaderInstanced.hlsl)
+float4 main(VertexShaderInstancedInput input) : SV_POSITION
+{
+    matrix world = transpose(matrix(input.world0, input.world1, input.world2, input.world3));
+    matrix wvp = mul(projection, mul(view, world));
+    return mul(wvp, float4(input.localPosition, 1.0f));
+}
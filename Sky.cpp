@@ -12,7 +12,18 @@ Sky::Sky(const wchar_t* right,
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> skyVS,
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS,
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) 
+	: Sky(CreateCubemap(right, left, up, down, front, back), skyMesh, skyVS, skyPS, samplerState)
 {
+}
+
+// Uses a cube map that was already created (such as by AssetLoader)
+Sky::Sky(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeMap,
+	std::shared_ptr<Mesh> skyMesh,
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> skyVS,
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS,
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState)
+{
+	this->cubeMapSRV = cubeMap;
 	this->skyMesh = skyMesh;
 	this->vertexShader = skyVS;
 	this->pixelShader = skyPS;
@@ -27,8 +38,6 @@ Sky::Sky(const wchar_t* right,
 	depthStencilDesc.DepthEnable = true;
 	depthStencilDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL; // include depths that are less than and equal to 1
 	Graphics::Device->CreateDepthStencilState(&depthStencilDesc, depthStencil.GetAddressOf());
-
-	cubeMapSRV = CreateCubemap(right, left, up, down, front, back);
 }
 
 Sky::~Sky() {}
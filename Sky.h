@@ -28,6 +28,12 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS,
 		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState
 	);
+	Sky(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeMap,
+		std::shared_ptr<Mesh> skyMesh,
+		Microsoft::WRL::ComPtr<ID3D11VertexShader> skyVS,
+		Microsoft::WRL::ComPtr<ID3D11PixelShader> skyPS,
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState
+	);
 	~Sky();
 	void Draw(std::shared_ptr<Camera> camera);
 
@@ -44,7 +50,7 @@ public:
 	// --- HEADER ---
 
 	// Helper for creating a cubemap from 6 individual textures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
+	static Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
 		const wchar_t* right,
 		const wchar_t* left,
 		const wchar_t* up,
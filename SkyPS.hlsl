@@ -7,5 +7,6 @@ SamplerState BasicSampler : register(s0);
 float4 main(VertexToPixel_Sky input) : SV_TARGET
 {
     // sample a direction - not a uv coord
-    return SkyCube.Sample(BasicSampler, input.sampleDir);
+    // The cube is gamma encoded and the scene target is linear
+    return float4(pow(SkyCube.Sample(BasicSampler, input.sampleDir).rgb, 2.2), 1);
 }
\ No newline at end of file
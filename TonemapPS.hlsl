@@ -0,0 +1,22 @@
+#include "Exposure.hlsli"
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+Texture2D Pixels : register(t0);
+StructuredBuffer<float> AdaptedLuminance : register(t1);
+SamplerState ClampSampler : register(s0);
+
+// --------------------------------------------------------
+// HDR to the back buffer - exposes, tonemaps, then gamma corrects
+// (which the scene's pixel shaders no longer do themselves)
+// --------------------------------------------------------
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    float3 color = Pixels.Sample(ClampSampler, input.uv).rgb;
+    color = Tonemap(color * ExposureScale(AdaptedLuminance[0]));
+    return float4(pow(color, 1 / 2.2), 1);
+}
@@ -1,9 +1,90 @@
 #include "Transform.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Annonymous namespace to hold helpers
+// only accessible in this file
+namespace
+{
+	// What GetWorldMatrix() used to do on every call, for comparison
+	void RebuildWithInverse(XMFLOAT3 position, XMFLOAT3 rotation, XMFLOAT3 scale, XMFLOAT4X4& world, XMFLOAT4X4& worldInverseTranspose)
+	{
+		XMMATRIX worldMatrix =
+			XMMatrixScaling(scale.x, scale.y, scale.z) *
+			XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z) *
+			XMMatrixTranslation(position.x, position.y, position.z);
+		XMStoreFloat4x4(&world, worldMatrix);
+		XMStoreFloat4x4(&worldInverseTranspose, XMMatrixInverse(0, XMMatrixTranspose(worldMatrix)));
+	}
+
+	// How the rotation used to be handled, for comparison - pitch /
+	// yaw / roll only, with the rotation rebuilt on every call
+	struct EulerTransform
+	{
+		XMFLOAT3 Position;
+		XMFLOAT3 Rotation;
+		XMFLOAT3 Scale;
+
+		XMFLOAT3 RotateVector(float x, float y, float z)
+		{
+			XMVECTOR rq = XMQuaternionRotationRollPitchYaw(Rotation.x, Rotation.y, Rotation.z);
+			XMFLOAT3 result;
+			XMStoreFloat3(&result, XMVector3Rotate(XMVectorSet(x, y, z, 0), rq));
+			return result;
+		}
+
+		void MoveRelative(float x, float y, float z)
+		{
+			XMFLOAT3 offset = RotateVector(x, y, z);
+			Position.x += offset.x;
+			Position.y += offset.y;
+			Position.z += offset.z;
+		}
+
+		XMFLOAT4X4 GetWorldMatrix()
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world,
+				XMMatrixScaling(Scale.x, Scale.y, Scale.z) *
+				XMMatrixRotationRollPitchYaw(Rotation.x, Rotation.y, Rotation.z) *
+				XMMatrixTranslation(Position.x, Position.y, Position.z));
+			return world;
+		}
+	};
+
+	// Undoes XMQuaternionRotationRollPitchYaw().  Its matrix is
+	// Rz(roll) * Rx(pitch) * Ry(yaw), so the third row is
+	// (cos p sin y, -sin p, cos p cos y) and the second column is
+	// (sin r cos p, cos r cos p, -sin p).  Looking straight up or
+	// down, yaw and roll turn about the same axis - roll is taken
+	// as zero then.
+	XMFLOAT3 PitchYawRollFromQuaternion(FXMVECTOR quaternion)
+	{
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, XMMatrixRotationQuaternion(quaternion));
+
+		float sinPitch = -m._32;
+		sinPitch = sinPitch > 1.0f ? 1.0f : (sinPitch < -1.0f ? -1.0f : sinPitch);
+		float pitch = asinf(sinPitch);
+		if (fabsf(sinPitch) > 0.99999f)
+			return XMFLOAT3(pitch, atan2f(-m._13, m._11), 0.0f);
+		return XMFLOAT3(pitch, atan2f(m._31, m._33), atan2f(m._12, m._22));
+	}
+}
 
 Transform::Transform() : 
 	position(0, 0, 0), 
 	rotation(0, 0, 0), 
-	scale(1, 1, 1)
+	orientation(0, 0, 0, 1),
+	scale(1, 1, 1),
+	right(1, 0, 0),
+	up(0, 1, 0),
+	forward(0, 0, 1),
+	dirty(false),
+	basisDirty(false)
 {
 	XMStoreFloat4x4(&world, XMMatrixIdentity());
 	XMStoreFloat4x4(&worldInverseTranspose, XMMatrixIdentity());
@@ -16,30 +97,56 @@ Transform::~Transform() {
 // Setter Definitions
 void Transform::SetPosition(float x, float y, float z) {
 	this->position = XMFLOAT3(x, y, z);
+	dirty = true;
 }
 
 void Transform::SetPosition(XMFLOAT3 position) {
 	this->position = position;
+	dirty = true;
 }
 
 void Transform::SetRotation(float pitch, float yaw, float roll)
 {
 	this->rotation = XMFLOAT3(pitch, yaw, roll);
+	RotationChanged();
 }
 
 void Transform::SetRotation(XMFLOAT3 rotation)
 {
 	this->rotation = rotation;
+	RotationChanged();
+}
+
+void Transform::SetRotation(XMFLOAT4 quaternion)
+{
+	XMVECTOR q = XMQuaternionNormalize(XMLoadFloat4(&quaternion));
+	XMStoreFloat4(&orientation, q);
+	rotation = PitchYawRollFromQuaternion(q);
+	dirty = true;
+	basisDirty = true;
+}
+
+// --------------------------------------------------------
+// The one place pitch / yaw / roll turn into a quaternion -
+// everything else (matrices, basis, relative moves) uses that
+// --------------------------------------------------------
+void Transform::RotationChanged()
+{
+	XMStoreFloat4(&orientation, XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z));
+	dirty = true;
+	basisDirty = true;
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
 	this->scale = XMFLOAT3(x, y, z);
+	dirty = true;
 }
 
 void Transform::SetScale(XMFLOAT3 scale)
 {
 	this->scale = scale;
+	dirty = true;
 }
 
 // Getters
@@ -53,58 +160,81 @@ XMFLOAT3 Transform::GetPitchYawRoll()
 	return rotation;
 }
 
+XMFLOAT4 Transform::GetRotation()
+{
+	return orientation;
+}
+
 XMFLOAT3 Transform::GetScale()
 {
 	return scale;
 }
 
 XMFLOAT4X4 Transform::GetWorldMatrix()
+{
+	if (dirty)
+		UpdateMatrices();
+	return world;
+}
+
+XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
+{
+	if (dirty)
+		UpdateMatrices();
+	return worldInverseTranspose;
+}
+
+// --------------------------------------------------------
+// Rebuilds both matrices - only called once something has
+// changed since they were last built.
+//
+// World = S * R * T, so the upper 3x3 of its inverse transpose
+// is (S * R)^-T = S^-1 * R (rotations are orthonormal), and the
+// translation doesn't matter since normals have no w.  No
+// general 4x4 inverse needed.
+// --------------------------------------------------------
+void Transform::UpdateMatrices()
 {
 	XMMATRIX transform = XMMatrixTranslation(position.x, position.y, position.z);
 	XMMATRIX scaling = XMMatrixScaling(scale.x, scale.y, scale.z);
-	XMMATRIX rotate = XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
+	XMMATRIX rotate = XMMatrixRotationQuaternion(XMLoadFloat4(&orientation));
 
 	// Scale * Rotation * Transformation
-	XMMATRIX worldMatrix = scaling * rotate * transform;
-	XMStoreFloat4x4(&world, worldMatrix);
+	XMStoreFloat4x4(&world, scaling * rotate * transform);
 	XMStoreFloat4x4(&worldInverseTranspose,
-		XMMatrixInverse(0, XMMatrixTranspose(worldMatrix)));
+		XMMatrixScaling(1.0f / scale.x, 1.0f / scale.y, 1.0f / scale.z) * rotate);
 
-	return world;
+	dirty = false;
 }
 
-XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
+// Rows of the rotation matrix are the rotated axes
+void Transform::UpdateBasis()
 {
-	return worldInverseTranspose;
+	XMMATRIX rotate = XMMatrixRotationQuaternion(XMLoadFloat4(&orientation));
+	XMStoreFloat3(&right, rotate.r[0]);
+	XMStoreFloat3(&up, rotate.r[1]);
+	XMStoreFloat3(&forward, rotate.r[2]);
+	basisDirty = false;
 }
 
 XMFLOAT3 Transform::GetRight()
 {
-	XMVECTOR rq = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-	XMVECTOR rightVector = XMVector3Rotate(XMVectorSet(1, 0, 0, 0), rq);
-	XMFLOAT3 right;
-
-	XMStoreFloat3(&right, rightVector);
+	if (basisDirty)
+		UpdateBasis();
 	return right;
 }
 
 XMFLOAT3 Transform::GetUp()
 {
-	XMVECTOR rq = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-	XMVECTOR upVector = XMVector3Rotate(XMVectorSet(0, 1, 0, 0), rq);
-	XMFLOAT3 up;
-
-	XMStoreFloat3(&up, upVector);
+	if (basisDirty)
+		UpdateBasis();
 	return up;
 }
 
 XMFLOAT3 Transform::GetForward()
 {
-	XMVECTOR rq = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
-	XMVECTOR forwardVector = XMVector3Rotate(XMVectorSet(0, 0, 1, 0), rq);
-	XMFLOAT3 forward;
-
-	XMStoreFloat3(&forward, forwardVector);
+	if (basisDirty)
+		UpdateBasis();
 	return forward;
 }
 
@@ -114,6 +244,7 @@ void Transform::MoveAbsolute(float x, float y, float z)
 	position.x += x;
 	position.y += y;
 	position.z += z;
+	dirty = true;
 }
 
 void Transform::MoveAbsolute(XMFLOAT3 offset)
@@ -121,15 +252,17 @@ void Transform::MoveAbsolute(XMFLOAT3 offset)
 	position.x += offset.x;
 	position.y += offset.y;
 	position.z += offset.z;
+	dirty = true;
 }
 
 void Transform::MoveRelative(float x, float y, float z)
 {
 	XMVECTOR dir = XMVectorSet(x, y, z, 0); //direction
-	XMVECTOR rot = XMQuaternionRotationRollPitchYaw(rotation.x, rotation.y, rotation.z); //rotation quaternion
+	XMVECTOR rot = XMLoadFloat4(&orientation); //rotation quaternion
 
 	XMStoreFloat3(&position, 
 		XMLoadFloat3(&position) + XMVector3Rotate(dir, rot));
+	dirty = true;
 }
 
 void Transform::MoveRelative(XMFLOAT3 offset)
@@ -142,6 +275,7 @@ void Transform::Rotate(float pitch, float yaw, float roll)
 	rotation.x += pitch;
 	rotation.y += yaw;
 	rotation.z += roll;
+	RotationChanged();
 }
 
 void Transform::Rotate(XMFLOAT3 rotation)
@@ -149,6 +283,7 @@ void Transform::Rotate(XMFLOAT3 rotation)
 	this->rotation.x += rotation.x;
 	this->rotation.y += rotation.y;
 	this->rotation.z += rotation.z;
+	RotationChanged();
 }
 
 void Transform::Scale(float x, float y, float z)
@@ -156,6 +291,7 @@ void Transform::Scale(float x, float y, float z)
 	scale.x += x;
 	scale.y += y;
 	scale.z += z;
+	dirty = true;
 }
 
 void Transform::Scale(XMFLOAT3 scale)
@@ -163,4 +299,202 @@ void Transform::Scale(XMFLOAT3 scale)
 	this->scale.x += scale.x;
 	this->scale.y += scale.y;
 	this->scale.z += scale.z;
+	dirty = true;
+}
+
+void Transform::PitchYawRollToQuaternions(const XMFLOAT3* pitchYawRoll, XMFLOAT4* quaternions, int count)
+{
+	for (int i = 0; i < count; i++)
+		XMStoreFloat4(&quaternions[i], XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll[i])));
+}
+
+void Transform::QuaternionsToBases(const XMFLOAT4* quaternions, XMFLOAT3* right, XMFLOAT3* up, XMFLOAT3* forward, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		XMMATRIX rotate = XMMatrixRotationQuaternion(XMLoadFloat4(&quaternions[i]));
+		XMStoreFloat3(&right[i], rotate.r[0]);
+		XMStoreFloat3(&up[i], rotate.r[1]);
+		XMStoreFloat3(&forward[i], rotate.r[2]);
+	}
+}
+
+// Same matrices as UpdateMatrices()
+void Transform::BuildWorldMatrices(const XMFLOAT3* positions, const XMFLOAT4* quaternions, const XMFLOAT3* scales,
+	XMFLOAT4X4* world, XMFLOAT4X4* worldInverseTranspose, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		XMMATRIX rotate = XMMatrixRotationQuaternion(XMLoadFloat4(&quaternions[i]));
+		const XMFLOAT3& p = positions[i];
+		const XMFLOAT3& s = scales[i];
+		XMStoreFloat4x4(&world[i], XMMatrixScaling(s.x, s.y, s.z) * rotate * XMMatrixTranslation(p.x, p.y, p.z));
+		XMStoreFloat4x4(&worldInverseTranspose[i], XMMatrixScaling(1.0f / s.x, 1.0f / s.y, 1.0f / s.z) * rotate);
+	}
+}
+
+// --------------------------------------------------------
+// Simulates frames where only movingFraction of the transforms
+// change, each frame asking every transform for what the shadow
+// and main passes need
+// --------------------------------------------------------
+void Transform::Benchmark(int transformCount, float movingFraction)
+{
+	const int frames = 60;
+	int movingCount = (int)(transformCount * movingFraction);
+
+	std::vector<Transform> transforms(transformCount);
+	for (int i = 0; i < transformCount; i++)
+	{
+		transforms[i].SetPosition((float)(i % 100), 0, (float)(i / 100));
+		transforms[i].SetRotation(i * 0.1f, i * 0.2f, i * 0.3f);
+		transforms[i].SetScale(1.0f + (i % 7) * 0.1f, 1.0f, 1.0f + (i % 3) * 0.2f);
+	}
+
+	// Keeps the results alive so nothing is optimized out
+	float checksum = 0.0f;
+	XMFLOAT4X4 world;
+	XMFLOAT4X4 worldInverseTranspose;
+
+	auto rebuildStart = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (int i = 0; i < movingCount; i++)
+			transforms[i].MoveAbsolute(0, 0.01f, 0);
+
+		for (Transform& transform : transforms)
+		{
+			for (int pass = 0; pass < 2; pass++)
+			{
+				RebuildWithInverse(transform.position, transform.rotation, transform.scale, world, worldInverseTranspose);
+				checksum += world._41 + worldInverseTranspose._11;
+			}
+		}
+	}
+
+	auto cachedStart = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (int i = 0; i < movingCount; i++)
+			transforms[i].MoveAbsolute(0, 0.01f, 0);
+
+		for (Transform& transform : transforms)
+		{
+			checksum += transform.GetWorldMatrix()._41;
+			checksum += transform.GetWorldMatrix()._41;
+			checksum += transform.GetWorldInverseTransposeMatrix()._11;
+		}
+	}
+	auto cachedEnd = std::chrono::high_resolution_clock::now();
+
+	double rebuildMs = std::chrono::duration<double, std::milli>(cachedStart - rebuildStart).count() / frames;
+	double cachedMs = std::chrono::duration<double, std::milli>(cachedEnd - cachedStart).count() / frames;
+	printf("Transform benchmark: %d transforms, %d moving, %d frames (checksum %.1f)\nRebuild every call: %.3f ms per frame\nDirty flags: %.3f ms per frame (%.1fx faster)\n\n",
+		transformCount, movingCount, frames, checksum,
+		rebuildMs,
+		cachedMs, rebuildMs / std::max(cachedMs, 0.000001));
+}
+
+// --------------------------------------------------------
+// Each frame, every transform does what Camera::Update() asks of
+// one: turn a little, move forward and sideways, then hand over
+// its forward and up (for the view) and right, plus a world
+// matrix.  Then the same without the turn, where cached rotation
+// work drops out entirely.
+//
+// Rebuilding: the rotation is made from pitch / yaw / roll six
+// times (two moves, three axes, the matrix).  Cached: once per
+// turn.  Batch: the same work as cached, but as whole-array
+// passes - quaternions, then bases, then matrices.
+// --------------------------------------------------------
+void Transform::RotationBenchmark(int transformCount)
+{
+	const int frames = 30;
+	const float turn = 0.001f;
+	const float step = 0.01f;
+
+	std::vector<EulerTransform> euler(transformCount);
+	std::vector<Transform> transforms(transformCount);
+	std::vector<XMFLOAT3> positions(transformCount), pitchYawRoll(transformCount), scales(transformCount);
+	std::vector<XMFLOAT4> quaternions(transformCount);
+	std::vector<XMFLOAT3> rights(transformCount), ups(transformCount), forwards(transformCount);
+	std::vector<XMFLOAT4X4> worlds(transformCount), worldInverseTransposes(transformCount);
+	for (int i = 0; i < transformCount; i++)
+	{
+		XMFLOAT3 p((float)(i % 100), 0, (float)(i / 100));
+		XMFLOAT3 r(i * 0.001f, i * 0.002f, 0);
+		euler[i] = { p, r, XMFLOAT3(1, 1, 1) };
+		transforms[i].SetPosition(p);
+		transforms[i].SetRotation(r);
+		positions[i] = p;
+		pitchYawRoll[i] = r;
+		scales[i] = XMFLOAT3(1, 1, 1);
+	}
+
+	// Keeps the results alive so nothing is optimized out
+	float checksum = 0.0f;
+
+	printf("Rotation benchmark: %d transforms, camera-style update, average of %d frames\n", transformCount, frames);
+	for (int turning = 1; turning >= 0; turning--)
+	{
+		float yaw = turning ? turn : 0.0f;
+
+		auto rebuildStart = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (EulerTransform& t : euler)
+			{
+				t.Rotation.y += yaw;
+				t.MoveRelative(0, 0, step);
+				t.MoveRelative(step, 0, 0);
+				checksum += t.RotateVector(0, 0, 1).x + t.RotateVector(0, 1, 0).y + t.RotateVector(1, 0, 0).z;
+				checksum += t.GetWorldMatrix()._41;
+			}
+		}
+
+		auto cachedStart = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (Transform& t : transforms)
+			{
+				if (turning)
+					t.Rotate(0, yaw, 0);
+				t.MoveRelative(0, 0, step);
+				t.MoveRelative(step, 0, 0);
+				checksum += t.GetForward().x + t.GetUp().y + t.GetRight().z;
+				checksum += t.GetWorldMatrix()._41;
+			}
+		}
+
+		auto batchStart = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frames; frame++)
+		{
+			if (turning)
+			{
+				for (XMFLOAT3& r : pitchYawRoll)
+					r.y += yaw;
+				PitchYawRollToQuaternions(pitchYawRoll.data(), quaternions.data(), transformCount);
+				QuaternionsToBases(quaternions.data(), rights.data(), ups.data(), forwards.data(), transformCount);
+			}
+			for (int i = 0; i < transformCount; i++)
+			{
+				positions[i].x += (forwards[i].x + rights[i].x) * step;
+				positions[i].y += (forwards[i].y + rights[i].y) * step;
+				positions[i].z += (forwards[i].z + rights[i].z) * step;
+			}
+			BuildWorldMatrices(positions.data(), quaternions.data(), scales.data(), worlds.data(), worldInverseTransposes.data(), transformCount);
+			checksum += forwards[0].x + ups[0].y + rights[0].z + worlds[0]._41;
+		}
+		auto batchEnd = std::chrono::high_resolution_clock::now();
+
+		double rebuildMs = std::chrono::duration<double, std::milli>(cachedStart - rebuildStart).count() / frames;
+		double cachedMs = std::chrono::duration<double, std::milli>(batchStart - cachedStart).count() / frames;
+		double batchMs = std::chrono::duration<double, std::milli>(batchEnd - batchStart).count() / frames;
+		printf("  %s: rebuild every call %.3f ms, cached %.3f ms (%.1fx), batch %.3f ms (%.1fx)\n",
+			turning ? "Turning" : "Not turning",
+			rebuildMs,
+			cachedMs, rebuildMs / std::max(cachedMs, 0.000001),
+			batchMs, rebuildMs / std::max(batchMs, 0.000001));
+	}
+	printf("  (checksum %.1f)\n\n", checksum);
 }
@@ -6,10 +6,20 @@ using namespace DirectX;
 class Transform
 {
 	XMFLOAT3 position;
-	XMFLOAT3 rotation; // pitch / yaw / angles
+	XMFLOAT3 rotation; // pitch / yaw / roll, as set - for the UI
+	XMFLOAT4 orientation; // the same rotation as a quaternion, used for everything else
 	XMFLOAT3 scale;
 	XMFLOAT4X4 world;
 	XMFLOAT4X4 worldInverseTranspose; // used in a future assignment
+	XMFLOAT3 right;
+	XMFLOAT3 up;
+	XMFLOAT3 forward;
+	bool dirty; // position/rotation/scale changed since the matrices were built
+	bool basisDirty; // rotation changed since right/up/forward were built
+
+	void UpdateMatrices();
+	void UpdateBasis();
+	void RotationChanged();
 
 public:
 	Transform(); // Constructor
@@ -20,12 +30,14 @@ public:
 	void SetPosition(XMFLOAT3 position);
 	void SetRotation(float pitch, float yaw, float roll);
 	void SetRotation(XMFLOAT3 rotation);
+	void SetRotation(XMFLOAT4 quaternion);
 	void SetScale(float x, float y, float z);
 	void SetScale(XMFLOAT3 scale);
 
 	// Getters
 	XMFLOAT3 GetPosition();
 	XMFLOAT3 GetPitchYawRoll();
+	XMFLOAT4 GetRotation(); // quaternion
 	XMFLOAT3 GetScale();
 	XMFLOAT4X4 GetWorldMatrix();
 	XMFLOAT4X4 GetWorldInverseTransposeMatrix();
@@ -42,5 +54,24 @@ public:
 	void Rotate(XMFLOAT3 rotation);
 	void Scale(float x, float y, float z);
 	void Scale(XMFLOAT3 scale);
+
+	// Batch versions, over whole arrays of count - one straight loop
+	// each, no per-transform caching or branching
+	static void PitchYawRollToQuaternions(const XMFLOAT3* pitchYawRoll, XMFLOAT4* quaternions, int count);
+	static void QuaternionsToBases(const XMFLOAT4* quaternions, XMFLOAT3* right, XMFLOAT3* up, XMFLOAT3* forward, int count);
+	static void BuildWorldMatrices(const XMFLOAT3* positions, const XMFLOAT4* quaternions, const XMFLOAT3* scales,
+		XMFLOAT4X4* world, XMFLOAT4X4* worldInverseTranspose, int count);
+
+	// Times a frame's worth of matrix requests (two world matrices and
+	// one inverse transpose each) for a mostly static set of transforms,
+	// cached vs. rebuilding every call, and prints the results
+	static void Benchmark(int transformCount = 100000, float movingFraction = 0.05f);
+
+	// Times what a Camera::Update() asks of its transform (turn a
+	// little, move forward and sideways, then the basis and world
+	// matrix) for lots of transforms: rebuilding the rotation on
+	// every call, as before, vs. the cached quaternion and basis vs.
+	// the batch functions.  Also a frame with no turning.
+	static void RotationBenchmark(int transformCount = 100000);
 };
 
@@ -1,15 +1,18 @@
 #include "ShaderIncludes.hlsli"
 
-// Constant Buffer
-cbuffer ExternalData : register(b0)
+// Constant Buffers - must match BufferStructs.h
+// Set once per frame
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+}
+
+// Set for every object
+cbuffer PerObject : register(b2)
 {
     matrix world;
     matrix worldInvTranspose;
-    matrix projection;
-    matrix view;
-	
-    matrix lightView;
-    matrix lightProj;
 }
 
 // --------------------------------------------------------
@@ -39,11 +42,8 @@ VertexToPixel main( VertexShaderInput input )
 	
     output.uv = input.uv;
     output.normal = mul((float3x3)worldInvTranspose, input.normal);
-    output.tangent = mul((float3x3) world, input.tangent); // rotated with normals
+    output.tangent = float4(mul((float3x3) world, input.tangent.xyz), input.tangent.w); // rotated with normals
     output.worldPos = mul(world, float4(input.localPosition, 1)).xyz;
-	
-    matrix shadowWVP = mul(lightProj, mul(lightView, world));
-    output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
 
 	// Pass the color through 
 	// - The values will be interpolated per-pixel by the rasterizer
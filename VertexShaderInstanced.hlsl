@@ -0,0 +1,35 @@
+#include "ShaderIncludes.hlsli"
+
+// Constant Buffers - must match BufferStructs.h
+// Set once per frame
+cbuffer PerFrame : register(b0)
+{
+    matrix view;
+    matrix projection;
+}
+
+// --------------------------------------------------------
+// Instanced version of VertexShader.hlsl - the same, except each
+// object's matrices come from the per-instance stream instead of
+// the per-object constant buffer
+// --------------------------------------------------------
+VertexToPixel main( VertexShaderInstancedInput input )
+{
+	VertexToPixel output;
+
+	// The stream holds the rows of the C++ (row major) matrices, while
+	// constant buffer matrices are read column major - transpose to
+	// match what VertexShader.hlsl gets
+    matrix world = transpose(matrix(input.world0, input.world1, input.world2, input.world3));
+    matrix worldInvTranspose = transpose(matrix(input.worldInvTranspose0, input.worldInvTranspose1, input.worldInvTranspose2, input.worldInvTranspose3));
+
+    matrix wvp = mul(projection, mul(view, world));
+    output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+	
+    output.uv = input.uv;
+    output.normal = mul((float3x3)worldInvTranspose, input.normal);
+    output.tangent = float4(mul((float3x3) world, input.tangent.xyz), input.tangent.w); // rotated with normals
+    output.worldPos = mul(world, float4(input.localPosition, 1)).xyz;
+
+	return output;
+}